@@ -98,6 +98,38 @@ math_op_prec(gerbv_opcodes_t math_op) {
 #define MATH_OP_TOP        (math_op_idx > 0) ? math_op[math_op_idx - 1] : GERBV_OPCODE_NOP
 #define MATH_OP_EMPTY      (math_op_idx == 0)
 
+/*
+ * Flattens the parsed program into an array that the aperture macro VM in
+ * gerber.c can run without chasing pointers, once for all apertures using
+ * the macro.
+ */
+static void
+compile_program(gerbv_amacro_t* amacro) {
+    gerbv_instruction_t* ip;
+    unsigned int         n = 0;
+
+    for (ip = amacro->program; ip != NULL; ip = ip->next)
+        if (ip->opcode != GERBV_OPCODE_NOP)
+            n++;
+
+    amacro->code       = g_new(gerbv_instruction_t, MAX(n, 1));
+    amacro->nuf_code   = 0;
+    amacro->nuf_locals = 0;
+
+    for (ip = amacro->program; ip != NULL; ip = ip->next) {
+        if (ip->opcode == GERBV_OPCODE_NOP)
+            continue;
+
+        /* the VM checks the index itself, this only sizes its copy of the parameters */
+        if ((ip->opcode == GERBV_OPCODE_PPUSH || ip->opcode == GERBV_OPCODE_PPOP) && ip->data.ival > 0)
+            amacro->nuf_locals = MAX(amacro->nuf_locals, (unsigned int)MIN(ip->data.ival, APERTURE_PARAMETERS_MAX));
+
+        amacro->code[amacro->nuf_code]      = *ip;
+        amacro->code[amacro->nuf_code].next = NULL;
+        amacro->nuf_code++;
+    }
+} /* compile_program */
+
 /*
  * Parses the definition of an aperture macro
  */
@@ -275,6 +307,7 @@ parse_aperture_macro(gerb_file_t* fd) {
             case '%':
                 gerb_ungetc(fd); /* Must return with % first in string
                         since the main parser needs it */
+                compile_program(amacro);
                 return amacro;
             default:
                 /* Whitespace */
@@ -305,6 +338,9 @@ free_amacro(gerbv_amacro_t* amacro) {
             free(instr2);
             instr2 = NULL;
         }
+        g_free(am1->code);
+        if (am1->simplified != NULL)
+            g_hash_table_destroy(am1->simplified);
 
         am2 = am1;
         am1 = am1->next;
@@ -0,0 +1,743 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** \file batch.c
+    \brief Command line export, and batch export of many files in one run
+    \ingroup gerbv
+
+    A job file lists one export per line: the format, the output file, and
+    options overriding the command line, e.g.
+
+        png  top.png     layers=1 dpi=600 antialias
+        pdf  board.pdf
+        drill drills.cnc layers=3 sort-drills=hilbert
+        rs274x panel.gbr compact
+
+    The input files are parsed once, then the jobs run on a thread pool. A
+    job only sees its own copy of the project file list, with the layers it
+    exports made visible. Rendering fills caches in the images, so jobs
+    rendering the same layer take turns with it; RS-274X and drill export
+    only read the images and never wait.
+
+    Exporting layers to files of their own works the same way, with one job
+    per layer, except that PNG files are left to libgerbv and all layers go
+    to a single PDF file, a page each.
+*/
+
+#include "gerbv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "batch.h"
+
+/* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
+#define dprintf \
+    if (DEBUG)  \
+    printf
+
+static const char* batch_export_type_names[] = { "png",    "pdf",       "svg",       "ps", "rs274x", "drill",
+                                                  "idrill", "svg-native", "pdf-native", NULL };
+
+static const gchar* batch_export_default_filenames[] = { "output.png", "output.pdf", "output.svg", "output.ps",
+                                                         "output.gbx", "output.cnc", "output.ncp", "output.svg",
+                                                         "output.pdf", NULL };
+
+static const char* batch_drill_order_names[] = { "file", "hilbert", NULL };
+
+typedef struct {
+    gint                line;     /* Line of the job file */
+    batch_export_type_t type;     /* Export format */
+    gchar*              filename; /* Output file */
+    gboolean*           layers;   /* The project files to export, or NULL for the default ones */
+    batch_settings_t    settings;
+
+    /* results */
+    gboolean ok;
+    gdouble  seconds;
+    gdouble  drillTravel;
+} batch_job_t;
+
+typedef struct {
+    gerbv_project_t*    project;
+    gerbv_render_size_t boundingBox; /* Of the visible layers, shared by all rendered jobs */
+#if GLIB_CHECK_VERSION(2, 36, 0)
+    GMutex* layerLocks; /* One per project file, held while rendering it */
+#endif
+} batch_t;
+
+/* ------------------------------------------------------------------ */
+batch_export_type_t
+batch_export_type_from_name(const gchar* name) {
+    gint i;
+
+    for (i = 0; batch_export_type_names[i] != NULL; i++) {
+        if (strcmp(name, batch_export_type_names[i]) == 0)
+            return (batch_export_type_t)i;
+    }
+
+    return BATCH_EXPORT_NONE;
+}
+
+/* ------------------------------------------------------------------ */
+const gchar*
+batch_default_filename(batch_export_type_t type) {
+    return batch_export_default_filenames[type];
+}
+
+/* ------------------------------------------------------------------ */
+/* Fill in renderInfo for the image size, origin and resolution in settings,
+   fitting boundingBox when they aren't given */
+static void
+batch_render_info(
+    const gerbv_render_size_t* boundingBox, const batch_settings_t* settings, gerbv_render_info_t* renderInfo
+) {
+    gfloat originX = settings->originX, originY = settings->originY;
+    gfloat dpiX = settings->dpiX, dpiY = settings->dpiY;
+    gfloat userWidth = settings->width, userHeight = settings->height;
+
+    // Set origin to the left-bottom corner if it is not specified
+    if (!settings->userOrigin) {
+        originX = boundingBox->left;
+        originY = boundingBox->top;
+    }
+
+    float width  = boundingBox->right - originX + 0.001;   // Plus a little extra to prevent from
+    float height = boundingBox->bottom - originY + 0.001;  // missing items due to round-off errors
+    // If the user did not specify a height and width, autoscale w&h till full size from origin.
+    if (!settings->userWindow) {
+        userWidth  = width;
+        userHeight = height;
+    } else {
+        // If size was specified in pixels, and no resolution was specified, autoscale resolution till fit
+        if ((!settings->userDpi) && settings->windowInPixels) {
+            dpiX = MIN((userWidth - 0.5) / width, (userHeight - 0.5) / height);
+            dpiY = dpiX;
+            originX -= 0.5 / dpiX;
+            originY -= 0.5 / dpiY;
+        }
+    }
+
+    // Add the border size (if there is one)
+    if (settings->border != 0) {
+        // If supplied in inches, add a border around the image
+        if (!settings->windowInPixels) {
+            originX -= (userWidth * settings->border) / 2.0;
+            originY -= (userHeight * settings->border) / 2.0;
+            userWidth += userWidth * settings->border;
+            userHeight += userHeight * settings->border;
+        }
+        // If supplied in pixels, shrink image content for border_size
+        else {
+            originX -= ((userWidth / dpiX) * settings->border) / 2.0;
+            originY -= ((userHeight / dpiX) * settings->border) / 2.0;
+            dpiX -= (dpiX * settings->border);
+            dpiY -= (dpiY * settings->border);
+        }
+    }
+
+    if (!settings->windowInPixels) {
+        userWidth *= dpiX;
+        userHeight *= dpiY;
+    }
+
+    // Make sure there is something valid in it. It could become negative if
+    // the userSuppliedOrigin is further than the bb.right or bb.top.
+    if (userWidth <= 0)
+        userWidth = 1;
+    if (userHeight <= 0)
+        userHeight = 1;
+
+    renderInfo->scaleFactorX  = dpiX;
+    renderInfo->scaleFactorY  = dpiY;
+    renderInfo->lowerLeftX    = originX;
+    renderInfo->lowerLeftY    = originY;
+    renderInfo->displayWidth  = userWidth;
+    renderInfo->displayHeight = userHeight;
+    renderInfo->renderType =
+        settings->antiAlias ? GERBV_RENDER_TYPE_CAIRO_HIGH_QUALITY : GERBV_RENDER_TYPE_CAIRO_NORMAL;
+}
+
+/* ------------------------------------------------------------------ */
+/* Merge all files of project into the first one, and write the result */
+static gboolean
+batch_export_merged(
+    gerbv_project_t* project, const batch_settings_t* settings, batch_export_type_t type, const gchar* filename,
+    gdouble* drillTravel
+) {
+    static gerbv_user_transformation_t identity = { 0, 0, 1, 1, 0, FALSE, FALSE, FALSE };
+    gerbv_image_t*                     exportImage;
+    gboolean                           ok = FALSE;
+    gint                               first, i;
+
+    for (first = 0; first <= project->last_loaded; first++) {
+        if (project->file[first] && project->file[first]->image)
+            break;
+    }
+    if (first > project->last_loaded) {
+        fprintf(stderr, _("A valid file was not loaded.\n"));
+        return FALSE;
+    }
+
+    exportImage = gerbv_image_duplicate_image(
+        project->file[first]->image, (first < settings->nTransforms) ? &settings->transforms[first] : &identity
+    );
+
+    /* If more than one file, merge them before exporting */
+    for (i = project->last_loaded; i > first; i--) {
+        if (project->file[i])
+            gerbv_image_copy_image(
+                project->file[i]->image, (i < settings->nTransforms) ? &settings->transforms[i] : &identity,
+                exportImage
+            );
+    }
+
+    switch (type) {
+        case BATCH_EXPORT_RS274X:
+            if (settings->compactRS274X)
+                ok = gerbv_export_rs274x_file_from_image_compact(
+                    filename, exportImage, &project->file[first]->transform
+                );
+            else
+                ok = gerbv_export_rs274x_file_from_image(filename, exportImage, &project->file[first]->transform);
+            break;
+        case BATCH_EXPORT_DRILL:
+            ok = gerbv_export_drill_file_from_image_ordered(
+                filename, exportImage, &project->file[first]->transform, settings->drillOrder, drillTravel
+            );
+            break;
+        case BATCH_EXPORT_IDRILL:
+            ok = gerbv_export_isel_drill_file_from_image(filename, exportImage, &project->file[first]->transform);
+            break;
+        default: break;
+    }
+
+    gerbv_destroy_image(exportImage);
+
+    return ok;
+}
+
+/* ------------------------------------------------------------------ */
+/* Export project, rendering within boundingBox unless settings give the
+   window */
+static gboolean
+batch_export_project(
+    gerbv_project_t* project, const gerbv_render_size_t* boundingBox, const batch_settings_t* settings,
+    batch_export_type_t type, const gchar* filename, gdouble* drillTravel
+) {
+    gerbv_render_info_t renderInfo;
+
+    batch_render_info(boundingBox, settings, &renderInfo);
+
+    switch (type) {
+        case BATCH_EXPORT_PNG: return gerbv_export_png_file_from_project(project, &renderInfo, filename);
+        case BATCH_EXPORT_PDF: return gerbv_export_pdf_file_from_project(project, &renderInfo, filename);
+        case BATCH_EXPORT_SVG: return gerbv_export_svg_file_from_project(project, &renderInfo, filename);
+        case BATCH_EXPORT_SVG_NATIVE: return gerbv_export_svg_native_file_from_project(project, &renderInfo, filename);
+        case BATCH_EXPORT_PDF_NATIVE: return gerbv_export_pdf_native_file_from_project(project, &renderInfo, filename);
+        case BATCH_EXPORT_PS: return gerbv_export_postscript_file_from_project(project, &renderInfo, filename);
+        case BATCH_EXPORT_RS274X:
+        case BATCH_EXPORT_DRILL:
+        case BATCH_EXPORT_IDRILL: return batch_export_merged(project, settings, type, filename, drillTravel);
+        default: fprintf(stderr, _("A valid file was not loaded.\n")); return FALSE;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+batch_export(
+    gerbv_project_t* project, const batch_settings_t* settings, batch_export_type_t type, const gchar* filename
+) {
+    gerbv_render_size_t boundingBox;
+    gdouble             drillTravel = 0;
+    gboolean            ok;
+
+    gerbv_render_get_boundingbox(project, &boundingBox);
+
+    /* the merge includes the hidden layers */
+    if (type == BATCH_EXPORT_RS274X || type == BATCH_EXPORT_DRILL || type == BATCH_EXPORT_IDRILL) {
+        while (gerbv_load_next_deferred_layer(project))
+            ;
+    }
+
+    ok = batch_export_project(project, &boundingBox, settings, type, filename, &drillTravel);
+
+    if (ok && type == BATCH_EXPORT_DRILL && settings->reportDrillTravel)
+        printf(_("Drill travel: %.4f inch\n"), drillTravel);
+
+    return ok;
+}
+
+/* ------------------------------------------------------------------ */
+/* Parse "AxB", "A;B" or, if b is NULL or single is TRUE, "A" */
+static gboolean
+batch_parse_pair(const gchar* value, gfloat* a, gfloat* b, gboolean single) {
+    gchar* end;
+
+    *a = g_ascii_strtod(value, &end);
+    if (end == value)
+        return FALSE;
+
+    if (*end == '\0' && single) {
+        if (b)
+            *b = *a;
+        return TRUE;
+    }
+    if (b == NULL || (*end != 'x' && *end != 'X' && *end != ';'))
+        return FALSE;
+
+    value = end + 1;
+    *b    = g_ascii_strtod(value, &end);
+
+    return end != value && *end == '\0';
+}
+
+/* ------------------------------------------------------------------ */
+/* Parse "all" or a list of layer numbers from 1 separated by commas. Returns
+   which project files are listed, or NULL if one of them isn't loaded. */
+static gboolean*
+batch_parse_layers(gerbv_project_t* project, const gchar* value) {
+    gboolean* layers = g_new0(gboolean, project->last_loaded + 1);
+    gchar**   numbers;
+    gint      i;
+
+    if (strcmp(value, "all") == 0) {
+        for (i = 0; i <= project->last_loaded; i++)
+            layers[i] = (project->file[i] != NULL);
+        return layers;
+    }
+
+    numbers = g_strsplit(value, ",", -1);
+    for (i = 0; numbers[i] != NULL; i++) {
+        gchar* end;
+        gint64 n = g_ascii_strtoll(numbers[i], &end, 10);
+
+        if (end == numbers[i] || *end != '\0' || n < 1 || n > project->last_loaded + 1
+            || project->file[n - 1] == NULL) {
+            g_strfreev(numbers);
+            g_free(layers);
+            return NULL;
+        }
+        layers[n - 1] = TRUE;
+    }
+    g_strfreev(numbers);
+
+    return layers;
+}
+
+/* Apply one "name=value" option of a job line to job */
+static gboolean
+batch_parse_option(batch_job_t* job, gerbv_project_t* project, const gchar* option) {
+    batch_settings_t* s     = &job->settings;
+    const gchar*      value = strchr(option, '=');
+    gsize             len   = value ? (gsize)(value - option) : strlen(option);
+    gint              i;
+
+    value = value ? value + 1 : NULL;
+
+#define BATCH_OPTION_IS(name) (len == strlen(name) && strncmp(option, name, len) == 0)
+
+    if (BATCH_OPTION_IS("antialias") && value == NULL) {
+        s->antiAlias = TRUE;
+        return TRUE;
+    }
+    if (BATCH_OPTION_IS("compact") && value == NULL) {
+        s->compactRS274X = TRUE;
+        return TRUE;
+    }
+    if (value == NULL)
+        return FALSE;
+
+    if (BATCH_OPTION_IS("layers")) {
+        g_free(job->layers);
+        job->layers = batch_parse_layers(project, value);
+        return job->layers != NULL;
+    }
+    if (BATCH_OPTION_IS("dpi")) {
+        s->userDpi = TRUE;
+        return batch_parse_pair(value, &s->dpiX, &s->dpiY, TRUE) && s->dpiX > 0 && s->dpiY > 0;
+    }
+    if (BATCH_OPTION_IS("origin")) {
+        s->userOrigin = TRUE;
+        return batch_parse_pair(value, &s->originX, &s->originY, FALSE);
+    }
+    if (BATCH_OPTION_IS("window") || BATCH_OPTION_IS("window_inch")) {
+        s->userWindow     = TRUE;
+        s->windowInPixels = BATCH_OPTION_IS("window");
+        return batch_parse_pair(value, &s->width, &s->height, FALSE) && s->width > 0 && s->height > 0;
+    }
+    if (BATCH_OPTION_IS("border")) {
+        if (!batch_parse_pair(value, &s->border, NULL, TRUE) || s->border < 0 || s->border > 1000)
+            return FALSE;
+        s->border /= 100.0;
+        return TRUE;
+    }
+    if (BATCH_OPTION_IS("sort-drills")) {
+        for (i = 0; batch_drill_order_names[i] != NULL; i++) {
+            if (strcmp(value, batch_drill_order_names[i]) == 0) {
+                s->drillOrder        = (gerbv_drill_order_t)i;
+                s->reportDrillTravel = TRUE;
+                return TRUE;
+            }
+        }
+        return FALSE;
+    }
+
+#undef BATCH_OPTION_IS
+
+    return FALSE;
+}
+
+/* ------------------------------------------------------------------ */
+static void
+batch_free_job(gpointer data) {
+    batch_job_t* job = (batch_job_t*)data;
+
+    g_free(job->filename);
+    g_free(job->layers);
+    g_free(job);
+}
+
+/* ------------------------------------------------------------------ */
+/* Read the jobs of jobFile. Returns NULL, after telling why, if the file
+   can't be read or any line of it is wrong. */
+static GPtrArray*
+batch_read_jobs(gerbv_project_t* project, const batch_settings_t* defaults, const gchar* jobFile) {
+    GPtrArray* jobs;
+    gchar*     contents;
+    gchar**    lines;
+    GError*    error = NULL;
+    gint       i, j;
+
+    if (!g_file_get_contents(jobFile, &contents, NULL, &error)) {
+        fprintf(stderr, _("Can't read job file \"%s\": %s\n"), jobFile, error->message);
+        g_error_free(error);
+        return NULL;
+    }
+
+    jobs  = g_ptr_array_new_with_free_func(batch_free_job);
+    lines = g_strsplit(contents, "\n", -1);
+    g_free(contents);
+
+    for (i = 0; lines[i] != NULL; i++) {
+        batch_job_t* job;
+        gchar**      argv;
+        gint         argc;
+        gchar*       line = g_strstrip(lines[i]);
+
+        if (*line == '\0' || *line == '#')
+            continue;
+
+        if (!g_shell_parse_argv(line, &argc, &argv, &error)) {
+            fprintf(stderr, _("%s:%d: %s\n"), jobFile, i + 1, error->message);
+            g_error_free(error);
+            goto error;
+        }
+
+        job           = g_new0(batch_job_t, 1);
+        job->line     = i + 1;
+        job->settings = *defaults;
+        job->type     = batch_export_type_from_name(argv[0]);
+        g_ptr_array_add(jobs, job);
+
+        if (job->type == BATCH_EXPORT_NONE) {
+            fprintf(stderr, _("%s:%d: Unrecognized \"%s\" export type.\n"), jobFile, i + 1, argv[0]);
+            g_strfreev(argv);
+            goto error;
+        }
+        if (argc < 2) {
+            fprintf(stderr, _("%s:%d: No output file given.\n"), jobFile, i + 1);
+            g_strfreev(argv);
+            goto error;
+        }
+        job->filename = g_strdup(argv[1]);
+
+        for (j = 2; j < argc; j++) {
+            if (!batch_parse_option(job, project, argv[j])) {
+                fprintf(stderr, _("%s:%d: Invalid option \"%s\".\n"), jobFile, i + 1, argv[j]);
+                g_strfreev(argv);
+                goto error;
+            }
+        }
+        g_strfreev(argv);
+    }
+
+    g_strfreev(lines);
+
+    return jobs;
+
+error:
+    g_strfreev(lines);
+    g_ptr_array_free(jobs, TRUE);
+
+    return NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/* Return a copy of project with its own file list, holding the files job
+   uses. Free it with batch_free_view(). */
+static gerbv_project_t*
+batch_new_view(gerbv_project_t* project, const batch_job_t* job) {
+    gerbv_project_t* view = g_new(gerbv_project_t, 1);
+    gint             i;
+
+    *view      = *project;
+    view->file = g_new0(gerbv_fileinfo_t*, project->max_files);
+
+    for (i = 0; i <= project->last_loaded; i++) {
+        if (project->file[i] == NULL || (job->layers && !job->layers[i]))
+            continue;
+
+        view->file[i]                    = g_new(gerbv_fileinfo_t, 1);
+        *view->file[i]                   = *project->file[i];
+        view->file[i]->privateRenderData = NULL;
+        if (job->layers)
+            view->file[i]->isVisible = TRUE;
+    }
+
+    return view;
+}
+
+/* ------------------------------------------------------------------ */
+static void
+batch_free_view(gerbv_project_t* view) {
+    gint i;
+
+    for (i = 0; i <= view->last_loaded; i++)
+        g_free(view->file[i]);
+    g_free(view->file);
+    g_free(view);
+}
+
+/* ------------------------------------------------------------------ */
+static void
+batch_run_job(gpointer data, gpointer user_data) {
+    batch_job_t*     job   = (batch_job_t*)data;
+    batch_t*         batch = (batch_t*)user_data;
+    gerbv_project_t* view  = batch_new_view(batch->project, job);
+    gint64           start = g_get_monotonic_time();
+    gboolean         renders;
+    gint             i;
+
+    renders = (job->type == BATCH_EXPORT_PNG || job->type == BATCH_EXPORT_PDF || job->type == BATCH_EXPORT_SVG
+               || job->type == BATCH_EXPORT_PS || job->type == BATCH_EXPORT_SVG_NATIVE
+               || job->type == BATCH_EXPORT_PDF_NATIVE);
+
+    dprintf("Starting job on line %d: %s\n", job->line, job->filename);
+
+#if GLIB_CHECK_VERSION(2, 36, 0)
+    /* always in the same order, so two jobs can't wait for each other */
+    for (i = 0; renders && i <= view->last_loaded; i++) {
+        if (view->file[i] && view->file[i]->isVisible)
+            g_mutex_lock(&batch->layerLocks[i]);
+    }
+#endif
+
+    job->ok = batch_export_project(
+        view, &batch->boundingBox, &job->settings, job->type, job->filename, &job->drillTravel
+    );
+
+#if GLIB_CHECK_VERSION(2, 36, 0)
+    for (i = 0; renders && i <= view->last_loaded; i++) {
+        if (view->file[i] && view->file[i]->isVisible)
+            g_mutex_unlock(&batch->layerLocks[i]);
+    }
+#endif
+
+    job->seconds = (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC;
+    batch_free_view(view);
+}
+
+/* ------------------------------------------------------------------ */
+/* Run jobs on a thread pool, all rendered within boundingBox unless their
+   settings give the window, then print the time each one took. The images
+   of project must all be loaded. Returns FALSE if any job failed. */
+static gboolean
+batch_run_jobs(gerbv_project_t* project, const gerbv_render_size_t* boundingBox, GPtrArray* jobs) {
+    batch_t  batch;
+    gint64   start;
+    gboolean ok       = TRUE;
+    gint     nThreads = 1;
+    guint    i;
+
+    batch.project     = project;
+    batch.boundingBox = *boundingBox;
+
+    start = g_get_monotonic_time();
+
+#if GLIB_CHECK_VERSION(2, 36, 0)
+    {
+        GThreadPool* pool;
+
+        nThreads         = CLAMP((gint)g_get_num_processors(), 1, (gint)MAX(jobs->len, 1));
+        batch.layerLocks = g_new(GMutex, project->last_loaded + 1);
+        for (i = 0; i <= (guint)project->last_loaded; i++)
+            g_mutex_init(&batch.layerLocks[i]);
+
+        pool = g_thread_pool_new(batch_run_job, &batch, nThreads, TRUE, NULL);
+        for (i = 0; i < jobs->len; i++)
+            g_thread_pool_push(pool, g_ptr_array_index(jobs, i), NULL);
+
+        /* wait for all jobs to finish */
+        g_thread_pool_free(pool, FALSE, TRUE);
+
+        for (i = 0; i <= (guint)project->last_loaded; i++)
+            g_mutex_clear(&batch.layerLocks[i]);
+        g_free(batch.layerLocks);
+    }
+#else
+    for (i = 0; i < jobs->len; i++)
+        batch_run_job(g_ptr_array_index(jobs, i), &batch);
+#endif
+
+    printf(
+        _("Exported %u files on %d threads in %.3f s:\n"), jobs->len, nThreads,
+        (g_get_monotonic_time() - start) / (gdouble)G_USEC_PER_SEC
+    );
+
+    for (i = 0; i < jobs->len; i++) {
+        batch_job_t* job = g_ptr_array_index(jobs, i);
+
+        printf("%9.3f s  %-6s  %s", job->seconds, batch_export_type_names[job->type], job->filename);
+        if (job->ok && job->type == BATCH_EXPORT_DRILL && job->settings.reportDrillTravel)
+            printf(_("  (drill travel: %.4f inch)"), job->drillTravel);
+        if (!job->ok)
+            printf(_("  (failed)"));
+        printf("\n");
+
+        ok &= job->ok;
+    }
+
+    return ok;
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+batch_run(gerbv_project_t* project, const batch_settings_t* defaults, const gchar* jobFile) {
+    GPtrArray*          jobs;
+    gerbv_render_size_t boundingBox;
+    gboolean            ok;
+
+    if ((jobs = batch_read_jobs(project, defaults, jobFile)) == NULL)
+        return FALSE;
+
+    /* the jobs only read the images, which must be complete beforehand */
+    while (gerbv_load_next_deferred_layer(project))
+        ;
+
+    gerbv_render_get_boundingbox(project, &boundingBox);
+
+    ok = batch_run_jobs(project, &boundingBox, jobs);
+
+    g_ptr_array_free(jobs, TRUE);
+
+    return ok;
+}
+
+/* ------------------------------------------------------------------ */
+/* Return filename with "-n" inserted before its extension */
+static gchar*
+batch_layer_filename(const gchar* filename, gint n) {
+    const gchar* dot = strrchr(filename, '.');
+
+    if (dot == NULL || dot == filename || strchr(dot, '/') != NULL || strchr(dot, G_DIR_SEPARATOR) != NULL
+        || dot[-1] == '/' || dot[-1] == G_DIR_SEPARATOR)
+        return g_strdup_printf("%s-%d", filename, n);
+
+    return g_strdup_printf("%.*s-%d%s", (gint)(dot - filename), filename, n, dot);
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+batch_export_layers(
+    gerbv_project_t* project, const batch_settings_t* settings, batch_export_type_t type, const gchar* filename,
+    const gchar* layers
+) {
+    gerbv_render_size_t boundingBox;
+    gerbv_render_info_t renderInfo;
+    batch_job_t         job;
+    gerbv_project_t*    view;
+    gboolean*           selected;
+    gboolean            ok = TRUE;
+    gint                i;
+
+    if ((selected = batch_parse_layers(project, layers)) == NULL) {
+        fprintf(stderr, _("Invalid layer list \"%s\".\n"), layers);
+        return FALSE;
+    }
+
+    /* all layers are read at once, hidden ones too */
+    while (gerbv_load_next_deferred_layer(project))
+        ;
+
+    /* the view shows just the exported layers, and the window fits all of
+       them, so each layer keeps its place on the page when they are
+       compared */
+    memset(&job, 0, sizeof(job));
+    job.layers = selected;
+    view       = batch_new_view(project, &job);
+    gerbv_render_get_boundingbox(view, &boundingBox);
+    batch_render_info(&boundingBox, settings, &renderInfo);
+
+    if (type == BATCH_EXPORT_PDF) {
+        ok = gerbv_export_pdf_pages_from_project(view, &renderInfo, filename);
+    } else if (type == BATCH_EXPORT_PDF_NATIVE) {
+        ok = gerbv_export_pdf_native_pages_from_project(view, &renderInfo, filename);
+    } else if (type == BATCH_EXPORT_PNG) {
+        gchar** filenames = g_new0(gchar*, project->last_loaded + 1);
+
+        for (i = 0; i <= project->last_loaded; i++) {
+            if (selected[i])
+                filenames[i] = batch_layer_filename(filename, i + 1);
+        }
+        ok = gerbv_export_png_files_from_project(project, &renderInfo, filenames);
+
+        for (i = 0; i <= project->last_loaded; i++)
+            g_free(filenames[i]);
+        g_free(filenames);
+    } else {
+        /* one job per layer, which never wait for each other */
+        GPtrArray* jobs = g_ptr_array_new_with_free_func(batch_free_job);
+
+        for (i = 0; i <= project->last_loaded; i++) {
+            batch_job_t* job;
+
+            if (!selected[i])
+                continue;
+
+            job            = g_new0(batch_job_t, 1);
+            job->type      = type;
+            job->filename  = batch_layer_filename(filename, i + 1);
+            job->layers    = g_new0(gboolean, project->last_loaded + 1);
+            job->layers[i] = TRUE;
+            job->settings  = *settings;
+            g_ptr_array_add(jobs, job);
+        }
+
+        ok = batch_run_jobs(project, &boundingBox, jobs);
+        g_ptr_array_free(jobs, TRUE);
+    }
+
+    batch_free_view(view);
+    g_free(selected);
+
+    return ok;
+}
@@ -0,0 +1,98 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** \file batch.h
+    \brief Header info for the command line export and batch export
+    \ingroup gerbv
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    BATCH_EXPORT_NONE = -1,
+    BATCH_EXPORT_PNG,
+    BATCH_EXPORT_PDF,
+    BATCH_EXPORT_SVG,
+    BATCH_EXPORT_PS,
+    BATCH_EXPORT_RS274X,
+    BATCH_EXPORT_DRILL,
+    BATCH_EXPORT_IDRILL,
+    BATCH_EXPORT_SVG_NATIVE,
+    BATCH_EXPORT_PDF_NATIVE,
+} batch_export_type_t;
+
+/*! How an export is rendered, from the command line options or a line of
+    the job file */
+typedef struct {
+    gfloat              originX, originY; /*!< lower left corner, in inches */
+    gfloat              dpiX, dpiY;
+    gfloat              width, height; /*!< window size, in inches or pixels */
+    gfloat              border;        /*!< border around the image, as a fraction of its size */
+    gboolean            userOrigin;    /*!< TRUE if originX and originY were given */
+    gboolean            userWindow;    /*!< TRUE if width and height were given */
+    gboolean            windowInPixels;
+    gboolean            userDpi;
+    gboolean            antiAlias;
+    gerbv_drill_order_t drillOrder;
+    gboolean            reportDrillTravel;
+    gboolean            compactRS274X; /*!< write RS274X with gerbv_export_rs274x_file_from_image_compact() */
+
+    /*! transformations to merge the layers with for RS274X and drill
+        export, indexed like the project files */
+    gerbv_user_transformation_t* transforms;
+    gint                         nTransforms;
+} batch_settings_t;
+
+/* Return the export type called name, or BATCH_EXPORT_NONE */
+batch_export_type_t batch_export_type_from_name(const gchar* name);
+
+/* Return the file name used when no output is given for type */
+const gchar* batch_default_filename(batch_export_type_t type);
+
+/* Export the visible layers of project, exactly like a single -x export.
+ * Returns FALSE if the export failed. */
+gboolean batch_export(
+    gerbv_project_t* project, const batch_settings_t* settings, batch_export_type_t type, const gchar* filename
+);
+
+/* Export each of the layers listed in layers, "all" or layer numbers from 1
+ * separated by commas, on its own: to a page of its own for PDF, or else to
+ * a file named after filename with "-<layer number>" before the extension.
+ * The layers share one window, fitting all of them. Returns FALSE if any
+ * export failed. */
+gboolean batch_export_layers(
+    gerbv_project_t* project, const batch_settings_t* settings, batch_export_type_t type, const gchar* filename,
+    const gchar* layers
+);
+
+/* Run all jobs of jobFile on project, concurrently, and print the time each
+ * one took. defaults holds the command line options, which each job can
+ * override. Returns FALSE if any job failed. */
+gboolean batch_run(gerbv_project_t* project, const batch_settings_t* defaults, const gchar* jobFile);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* BATCH_H */
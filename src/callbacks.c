@@ -230,6 +230,7 @@ open_files(GSList* filenames) {
         if (0 == project_is_gerbv_project(fn->data, &is_project) && is_project) {
             open_project(fn->data);
 
+            render_load_visible_deferred_layers();
             gerbv_render_zoom_to_fit_display(mainProject, &screenRenderInfo);
             render_refresh_rendered_image_on_screen();
             callbacks_update_layer_tree();
@@ -312,6 +313,7 @@ open_files(GSList* filenames) {
     g_slist_free(fns_lay_num);
     g_slist_free(cnt);
 
+    render_load_visible_deferred_layers();
     gerbv_render_zoom_to_fit_display(mainProject, &screenRenderInfo);
     render_refresh_rendered_image_on_screen();
     callbacks_update_layer_tree();
@@ -742,6 +744,7 @@ callbacks_generic_save_activate(GtkMenuItem* menuitem, gpointer user_data) {
                 );
             } else { /* Non zero DPI */
                 gerbv_render_size_t bb;
+                render_load_visible_deferred_layers();
                 gerbv_render_get_boundingbox(mainProject, &bb);
                 gfloat              w          = bb.right - bb.left;
                 gfloat              h          = bb.bottom - bb.top;
@@ -964,6 +967,12 @@ callbacks_toggle_layer_visibility_activate(GtkMenuItem* menuitem, gpointer user_
             break;
     }
 
+    /* layers that were only pre-scanned are loaded when first shown */
+    for (i = 0; i <= mainProject->last_loaded; i++) {
+        if (mainProject->file[i] && mainProject->file[i]->isVisible)
+            render_load_deferred_layer(i);
+    }
+
     callbacks_update_layer_tree();
 
     if (screenRenderInfo.renderType <= GERBV_RENDER_TYPE_GDK_XOR) {
@@ -989,6 +998,7 @@ callbacks_zoom_out_activate(GtkMenuItem* menuitem, gpointer user_data) {
 /* --------------------------------------------------------- */
 void
 callbacks_fit_to_window_activate(GtkMenuItem* menuitem, gpointer user_data) {
+    render_load_visible_deferred_layers();
     gerbv_render_zoom_to_fit_display(mainProject, &screenRenderInfo);
     render_refresh_rendered_image_on_screen();
 }
@@ -1871,6 +1881,7 @@ callbacks_update_scrollbar_limits(void) {
 
     GtkAdjustment* hAdjust = (GtkAdjustment*)screen.win.hAdjustment;
     GtkAdjustment* vAdjust = (GtkAdjustment*)screen.win.vAdjustment;
+    render_load_visible_deferred_layers();
     gerbv_render_zoom_to_fit_display(mainProject, &tempRenderInfo);
     hAdjust->lower          = tempRenderInfo.lowerLeftX;
     hAdjust->page_increment = hAdjust->page_size;
@@ -1953,6 +1964,8 @@ callbacks_vadjustment_value_changed(GtkAdjustment* adjustment, gpointer user_dat
 static void
 callbacks_layer_tree_visibility_toggled(gint index) {
     mainProject->file[index]->isVisible = !mainProject->file[index]->isVisible;
+    if (mainProject->file[index]->isVisible)
+        render_load_deferred_layer(index);
 
     callbacks_update_layer_tree();
     if (screenRenderInfo.renderType <= GERBV_RENDER_TYPE_GDK_XOR) {
@@ -2695,6 +2708,7 @@ callbacks_update_layer_tree(void) {
     for (unsigned int i = 0; i < G_N_ELEMENTS(screen.win.curFileMenuItem); i++) {
         gtk_widget_set_sensitive(screen.win.curFileMenuItem[i], showItems);
     }
+    callbacks_update_statusbar_memory();
     screen.win.treeIsUpdating = FALSE;
 }
 
@@ -2815,6 +2829,7 @@ callbacks_benchmark_clicked(GtkButton* button, gpointer user_data) {
 
     // autoscale the image for now...maybe we don't want to do this in order to
     //   allow benchmarking of different zoom levels?
+    render_load_visible_deferred_layers();
     gerbv_render_zoom_to_fit_display(mainProject, &renderInfo);
     callbacks_support_benchmark(&renderInfo);
 
@@ -2853,9 +2868,26 @@ callbacks_move_objects_clicked(GtkButton* button, gpointer user_data) {
 /* --------------------------------------------------------------------------- */
 void
 callbacks_reduce_object_area_clicked(GtkButton* button, gpointer user_data) {
+    GHashTable*    images = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GHashTableIter iter;
+    gpointer       image;
+    guint          i;
+
+    for (i = 0; i < selection_length(&screen.selectionInfo); i++) {
+        gerbv_selection_item_t sel_item = selection_get_item_by_index(&screen.selectionInfo, i);
+        g_hash_table_insert(images, sel_item.image, sel_item.image);
+    }
+
     /* for testing, just hard code in some parameters */
     gerbv_image_reduce_area_of_selected_objects(screen.selectionInfo.selectedNodeArray, 0.20, 3, 3, 0.01);
     selection_clear(&screen.selectionInfo);
+
+    /* the replaced nets are only marked deleted, free them now nothing points at them */
+    g_hash_table_iter_init(&iter, images);
+    while (g_hash_table_iter_next(&iter, &image, NULL))
+        gerbv_image_compact((gerbv_image_t*)image);
+    g_hash_table_destroy(images);
+
     update_selected_object_message(FALSE);
     render_refresh_rendered_image_on_screen();
 }
@@ -2891,7 +2923,10 @@ callbacks_delete_objects_clicked(GtkButton* button, gpointer user_data) {
         }
     }
 
-    guint i;
+    GHashTable*    images = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GHashTableIter iter;
+    gpointer       image;
+    guint          i;
     for (i = 0; i < selection_length(&screen.selectionInfo);) {
         gerbv_selection_item_t sel_item  = selection_get_item_by_index(&screen.selectionInfo, i);
         gerbv_fileinfo_t*      file_info = gerbv_get_fileinfo_for_image(sel_item.image, mainProject);
@@ -2905,7 +2940,14 @@ callbacks_delete_objects_clicked(GtkButton* button, gpointer user_data) {
         file_info->layer_dirty = TRUE;
         selection_clear_item_by_index(&screen.selectionInfo, i);
         gerbv_image_delete_net(sel_item.net);
+        g_hash_table_insert(images, sel_item.image, sel_item.image);
     }
+
+    /* what is left selected is on invisible layers, so no deleted net is still referenced */
+    g_hash_table_iter_init(&iter, images);
+    while (g_hash_table_iter_next(&iter, &image, NULL))
+        gerbv_image_compact((gerbv_image_t*)image);
+    g_hash_table_destroy(images);
     update_selected_object_message(FALSE);
 
     render_refresh_rendered_image_on_screen();
@@ -2949,6 +2991,7 @@ callbacks_drawingarea_configure_event(GtkWidget* widget, GdkEventConfigure* even
     /* if this is the first time, go ahead and call autoscale even if we don't
        have a model loaded */
     if ((screenRenderInfo.scaleFactorX < 0.001) || (screenRenderInfo.scaleFactorY < 0.001)) {
+        render_load_visible_deferred_layers();
         gerbv_render_zoom_to_fit_display(mainProject, &screenRenderInfo);
     }
     render_refresh_rendered_image_on_screen();
@@ -2959,17 +3002,32 @@ callbacks_drawingarea_configure_event(GtkWidget* widget, GdkEventConfigure* even
 gboolean
 callbacks_drawingarea_expose_event(GtkWidget* widget, GdkEventExpose* event) {
     if (screenRenderInfo.renderType <= GERBV_RENDER_TYPE_GDK_XOR) {
-        GdkPixmap* new_pixmap;
-        GdkGC*     gc = gdk_gc_new(widget->window);
+        GdkGC* gc    = gdk_gc_new(widget->window);
+        gint   width = 0, height = 0;
 
         /*
-         * Create a pixmap with default background
+         * Get a pixmap of the window size, only the exposed area is used
+         * so it is kept between exposes until the window is resized or
+         * moved to another screen
          */
-        new_pixmap = gdk_pixmap_new(widget->window, widget->allocation.width, widget->allocation.height, -1);
+        if (screen.exposePixmap
+            && gdk_drawable_get_screen(screen.exposePixmap) == gdk_drawable_get_screen(widget->window))
+            gdk_drawable_get_size(screen.exposePixmap, &width, &height);
+        if (width != widget->allocation.width || height != widget->allocation.height) {
+            if (screen.exposePixmap)
+                gdk_pixmap_unref(screen.exposePixmap);
+            screen.exposePixmap =
+                gdk_pixmap_new(widget->window, widget->allocation.width, widget->allocation.height, -1);
+        }
 
+        /*
+         * Fill the exposed area with default background
+         */
         gdk_gc_set_foreground(gc, &mainProject->background);
 
-        gdk_draw_rectangle(new_pixmap, gc, TRUE, event->area.x, event->area.y, event->area.width, event->area.height);
+        gdk_draw_rectangle(
+            screen.exposePixmap, gc, TRUE, event->area.x, event->area.y, event->area.width, event->area.height
+        );
 
         /*
          * Copy gerber pixmap onto background if we have one to copy.
@@ -2977,8 +3035,9 @@ callbacks_drawingarea_expose_event(GtkWidget* widget, GdkEventExpose* event) {
          */
         if (screen.pixmap != NULL) {
             gdk_draw_pixmap(
-                new_pixmap, widget->style->fg_gc[GTK_WIDGET_STATE(widget)], screen.pixmap, event->area.x - screen.off_x,
-                event->area.y - screen.off_y, event->area.x, event->area.y, event->area.width, event->area.height
+                screen.exposePixmap, widget->style->fg_gc[GTK_WIDGET_STATE(widget)], screen.pixmap,
+                event->area.x - screen.off_x, event->area.y - screen.off_y, event->area.x, event->area.y,
+                event->area.width, event->area.height
             );
         }
 
@@ -2986,11 +3045,10 @@ callbacks_drawingarea_expose_event(GtkWidget* widget, GdkEventExpose* event) {
          * Draw the whole thing onto screen
          */
         gdk_draw_pixmap(
-            widget->window, widget->style->fg_gc[GTK_WIDGET_STATE(widget)], new_pixmap, event->area.x, event->area.y,
-            event->area.x, event->area.y, event->area.width, event->area.height
+            widget->window, widget->style->fg_gc[GTK_WIDGET_STATE(widget)], screen.exposePixmap, event->area.x,
+            event->area.y, event->area.x, event->area.y, event->area.width, event->area.height
         );
 
-        gdk_pixmap_unref(new_pixmap);
         gdk_gc_unref(gc);
 
         /*
@@ -3537,6 +3595,23 @@ callbacks_update_statusbar(void) {
     }
 }
 
+/* --------------------------------------------------------- */
+/** Shows the memory held by all layers and the screen surfaces in the statusbar.
+    It walks every netlist, so it is only updated when the layers change. */
+void
+callbacks_update_statusbar_memory(void) {
+    gerbv_memory_usage_t usage;
+    gchar*               str;
+
+    if (!GTK_IS_LABEL(screen.win.statusMessageMemory))
+        return;
+
+    gerbv_project_get_memory_usage(mainProject, &usage);
+    str = g_strdup_printf(_("%.1f MiB"), (usage.total + render_get_memory_usage()) / (1024.0 * 1024.0));
+    gtk_label_set_text(GTK_LABEL(screen.win.statusMessageMemory), str);
+    g_free(str);
+}
+
 /* --------------------------------------------------------- */
 void
 callbacks_update_statusbar_measured_distance(gdouble dx, gdouble dy) {
@@ -142,6 +142,8 @@ void callbacks_update_statusbar(void);
 
 void callbacks_update_statusbar_measured_distance(gdouble dx, gdouble dy);
 
+void callbacks_update_statusbar_memory(void);
+
 void callbacks_update_layer_tree(void);
 
 gboolean callbacks_layer_tree_key_press(GtkWidget* widget, GdkEventKey* event, gpointer user_data);
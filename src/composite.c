@@ -0,0 +1,365 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ *
+ * composite.c -- this file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** \file composite.c
+    \brief Fused multi-layer compositor
+    \ingroup libgerbv
+
+    Blends every rendered layer onto the background in one pass over the
+    frame, instead of one cairo_paint_with_alpha() per layer. The arithmetic
+    follows pixman (x * a + 0x80, divided by 255 with a shift and add), so the
+    output is bit-identical to the cairo path.
+*/
+
+#include "gerbv.h"
+#include "composite.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define dprintf \
+    if (DEBUG)  \
+    printf
+
+/* don't bother starting a thread for less than this many rows */
+#define COMPOSITE_MIN_BAND_ROWS 64
+
+/* maximum number of row bands, and so threads, per frame */
+#define COMPOSITE_MAX_BANDS 16
+
+typedef struct {
+    guint8*                        dest;
+    gint                           destStride;
+    gint                           width;
+    gint                           firstRow;
+    gint                           lastRow;
+    guint32                        background;
+    gboolean                       overDest; /* blend onto the pixels already in dest, not the background */
+    const gerbv_composite_layer_t* layers;
+    guint                          nLayers;
+} composite_band_t;
+
+#if GLIB_CHECK_VERSION(2, 36, 0)
+/*! The bands of one frame, shared by the calling thread and the pool
+    threads helping it. The last of them to let go of it frees it. */
+typedef struct {
+    composite_band_t bands[COMPOSITE_MAX_BANDS];
+    gint             nBands;
+    gint             nextBand;  /* the next band nobody has taken, atomic */
+    gint             bandsDone; /* protected by mutex */
+    gint             refCount;  /* atomic */
+    GMutex           mutex;
+    GCond            done;
+} composite_frame_t;
+#endif
+
+/* x * a / 255, rounded like pixman's MUL_UN8 */
+static inline guint32
+composite_mul_un8(guint32 x, guint32 a) {
+    guint32 t = x * a + 0x80;
+
+    return (t + (t >> 8)) >> 8;
+}
+
+/* dst = src IN alpha OVER dst, for a single pixel */
+static inline guint32
+composite_over_pixel(guint32 src, guint32 dst, guint32 alpha) {
+    guint32 result = 0;
+    guint32 ia;
+    int     shift;
+
+    if (alpha != 255) {
+        src = (composite_mul_un8(src >> 24, alpha) << 24) | (composite_mul_un8((src >> 16) & 0xff, alpha) << 16)
+            | (composite_mul_un8((src >> 8) & 0xff, alpha) << 8) | composite_mul_un8(src & 0xff, alpha);
+    }
+    ia = 255 - (src >> 24);
+
+    for (shift = 0; shift < 32; shift += 8) {
+        guint32 c = ((src >> shift) & 0xff) + composite_mul_un8((dst >> shift) & 0xff, ia);
+
+        result |= MIN(c, 255) << shift;
+    }
+
+    return result;
+}
+
+#ifdef __SSE2__
+/* x * a / 255 on eight 16 bit channels, rounded like pixman's MUL_UN8 */
+static inline __m128i
+composite_mul_un8_sse2(__m128i x, __m128i a) {
+    __m128i t = _mm_adds_epu16(_mm_mullo_epi16(x, a), _mm_set1_epi16(0x0080));
+
+    return _mm_mulhi_epu16(t, _mm_set1_epi16(0x0101));
+}
+
+/* broadcast the alpha channel of two unpacked pixels */
+static inline __m128i
+composite_expand_alpha_sse2(__m128i x) {
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_shufflehi_epi16(x, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+/* dst = src IN alpha OVER dst, for four pixels */
+static inline __m128i
+composite_over_sse2(__m128i src, __m128i dst, __m128i alpha, gboolean opaque) {
+    __m128i zero   = _mm_setzero_si128();
+    __m128i ff     = _mm_set1_epi16(0x00ff);
+    __m128i src_lo = _mm_unpacklo_epi8(src, zero);
+    __m128i src_hi = _mm_unpackhi_epi8(src, zero);
+    __m128i dst_lo, dst_hi, ia_lo, ia_hi;
+
+    if (!opaque) {
+        src_lo = composite_mul_un8_sse2(src_lo, alpha);
+        src_hi = composite_mul_un8_sse2(src_hi, alpha);
+    }
+
+    ia_lo  = _mm_xor_si128(composite_expand_alpha_sse2(src_lo), ff);
+    ia_hi  = _mm_xor_si128(composite_expand_alpha_sse2(src_hi), ff);
+    dst_lo = composite_mul_un8_sse2(_mm_unpacklo_epi8(dst, zero), ia_lo);
+    dst_hi = composite_mul_un8_sse2(_mm_unpackhi_epi8(dst, zero), ia_hi);
+
+    return _mm_adds_epu8(_mm_packus_epi16(src_lo, src_hi), _mm_packus_epi16(dst_lo, dst_hi));
+}
+#endif
+
+static void
+composite_band(const composite_band_t* band) {
+    gint  row;
+    guint l;
+
+    for (row = band->firstRow; row < band->lastRow; row++) {
+        guint32* dst = (guint32*)(band->dest + (gsize)row * band->destStride);
+        gint     x   = 0;
+
+#ifdef __SSE2__
+        __m128i background = _mm_set1_epi32((gint)band->background);
+
+        for (; x + 4 <= band->width; x += 4) {
+            __m128i pixels = band->overDest ? _mm_loadu_si128((const __m128i*)(dst + x)) : background;
+
+            for (l = 0; l < band->nLayers; l++) {
+                const gerbv_composite_layer_t* layer = &band->layers[l];
+                __m128i                        src;
+
+                if (layer->alpha == 0)
+                    continue;
+
+                src = _mm_loadu_si128((const __m128i*)(layer->data + (gsize)row * layer->stride) + x / 4);
+
+                /* most of a layer is empty, and OVER with a clear source is a no-op */
+                if (_mm_movemask_epi8(_mm_cmpeq_epi32(src, _mm_setzero_si128())) == 0xffff)
+                    continue;
+
+                pixels = composite_over_sse2(src, pixels, _mm_set1_epi16(layer->alpha), layer->alpha == 255);
+            }
+            _mm_storeu_si128((__m128i*)(dst + x), pixels);
+        }
+#endif
+
+        for (; x < band->width; x++) {
+            guint32 pixel = band->overDest ? dst[x] : band->background;
+
+            for (l = 0; l < band->nLayers; l++) {
+                const gerbv_composite_layer_t* layer = &band->layers[l];
+                guint32                        src;
+
+                if (layer->alpha == 0)
+                    continue;
+
+                src = ((const guint32*)(layer->data + (gsize)row * layer->stride))[x];
+                if (src == 0)
+                    continue;
+
+                pixel = composite_over_pixel(src, pixel, layer->alpha);
+            }
+            dst[x] = pixel;
+        }
+    }
+}
+
+#if GLIB_CHECK_VERSION(2, 36, 0)
+static void
+composite_frame_unref(composite_frame_t* frame) {
+    if (g_atomic_int_dec_and_test(&frame->refCount)) {
+        g_mutex_clear(&frame->mutex);
+        g_cond_clear(&frame->done);
+        g_free(frame);
+    }
+}
+
+/* Blend bands of frame until none are left. A pool thread that gets to a
+   frame late finds them all taken and only lets go of it. */
+static void
+composite_frame_work(composite_frame_t* frame) {
+    gint band;
+
+    while ((band = g_atomic_int_add(&frame->nextBand, 1)) < frame->nBands) {
+        composite_band(&frame->bands[band]);
+
+        g_mutex_lock(&frame->mutex);
+        if (++frame->bandsDone == frame->nBands)
+            g_cond_signal(&frame->done);
+        g_mutex_unlock(&frame->mutex);
+    }
+}
+
+static void
+composite_pool_thread(gpointer data, gpointer user_data) {
+    composite_frame_work((composite_frame_t*)data);
+    composite_frame_unref((composite_frame_t*)data);
+}
+
+/* Start the threads that help blend frames, which are kept for the next ones */
+static gpointer
+composite_pool_new(gpointer data) {
+    return g_thread_pool_new(composite_pool_thread, NULL, COMPOSITE_MAX_BANDS - 1, FALSE, NULL);
+}
+#endif
+
+/* ------------------------------------------------------------------ */
+static void
+composite_layers(
+    guint8* dest, gint destStride, gint width, gint height, guint32 background, gboolean overDest,
+    const gerbv_composite_layer_t* layers, guint nLayers
+) {
+    composite_band_t  bands[COMPOSITE_MAX_BANDS];
+    composite_band_t* band   = bands;
+    gint              nBands = 1, rowsPerBand, i;
+#if GLIB_CHECK_VERSION(2, 36, 0)
+    static GOnce       poolOnce = G_ONCE_INIT;
+    composite_frame_t* frame    = NULL;
+#endif
+
+    if (width <= 0 || height <= 0)
+        return;
+
+#if GLIB_CHECK_VERSION(2, 36, 0)
+    nBands = CLAMP(MIN((gint)g_get_num_processors(), height / COMPOSITE_MIN_BAND_ROWS), 1, COMPOSITE_MAX_BANDS);
+    if (nBands > 1) {
+        frame           = g_new0(composite_frame_t, 1);
+        frame->nBands   = nBands;
+        frame->refCount = 1;
+        g_mutex_init(&frame->mutex);
+        g_cond_init(&frame->done);
+        band = frame->bands;
+    }
+#endif
+    rowsPerBand = (height + nBands - 1) / nBands;
+
+    for (i = 0; i < nBands; i++) {
+        band[i].dest       = dest;
+        band[i].destStride = destStride;
+        band[i].width      = width;
+        band[i].firstRow   = MIN(i * rowsPerBand, height);
+        band[i].lastRow    = MIN((i + 1) * rowsPerBand, height);
+        band[i].background = background | 0xff000000;
+        band[i].overDest   = overDest;
+        band[i].layers     = layers;
+        band[i].nLayers    = nLayers;
+    }
+
+    dprintf("Compositing %u layers into %dx%d in %d bands\n", nLayers, width, height, nBands);
+
+#if GLIB_CHECK_VERSION(2, 36, 0)
+    if (frame != NULL) {
+        GThreadPool* pool = g_once(&poolOnce, composite_pool_new, NULL);
+
+        /* the calling thread blends bands too, so the frame gets done even
+           when the pool threads are busy with other frames */
+        for (i = 1; i < nBands; i++) {
+            g_atomic_int_inc(&frame->refCount);
+            g_thread_pool_push(pool, frame, NULL);
+        }
+        composite_frame_work(frame);
+
+        g_mutex_lock(&frame->mutex);
+        while (frame->bandsDone < frame->nBands)
+            g_cond_wait(&frame->done, &frame->mutex);
+        g_mutex_unlock(&frame->mutex);
+
+        composite_frame_unref(frame);
+        return;
+    }
+#endif
+
+    composite_band(&bands[0]);
+}
+
+/* ------------------------------------------------------------------ */
+void
+gerbv_composite_layers(
+    guint8* dest, gint destStride, gint width, gint height, guint32 background, const gerbv_composite_layer_t* layers,
+    guint nLayers
+) {
+    composite_layers(dest, destStride, width, height, background, FALSE, layers, nLayers);
+}
+
+/* ------------------------------------------------------------------ */
+void
+gerbv_composite_layers_over(
+    guint8* dest, gint destStride, gint width, gint height, const gerbv_composite_layer_t* layers, guint nLayers
+) {
+    composite_layers(dest, destStride, width, height, 0, TRUE, layers, nLayers);
+}
+
+/* ------------------------------------------------------------------ */
+void
+gerbv_composite_layers_to_surface(
+    cairo_surface_t* surface, guint32 background, const gerbv_composite_layer_t* layers, guint nLayers
+) {
+    cairo_surface_flush(surface);
+    gerbv_composite_layers(
+        cairo_image_surface_get_data(surface), cairo_image_surface_get_stride(surface),
+        cairo_image_surface_get_width(surface), cairo_image_surface_get_height(surface), background, layers, nLayers
+    );
+    cairo_surface_mark_dirty(surface);
+}
+
+/* ------------------------------------------------------------------ */
+void
+gerbv_composite_layers_over_surface(cairo_surface_t* surface, const gerbv_composite_layer_t* layers, guint nLayers) {
+    cairo_surface_flush(surface);
+    gerbv_composite_layers_over(
+        cairo_image_surface_get_data(surface), cairo_image_surface_get_stride(surface),
+        cairo_image_surface_get_width(surface), cairo_image_surface_get_height(surface), layers, nLayers
+    );
+    cairo_surface_mark_dirty(surface);
+}
+
+/* ------------------------------------------------------------------ */
+void
+gerbv_composite_layer_from_surface(gerbv_composite_layer_t* layer, cairo_surface_t* surface, guint16 alpha) {
+    cairo_surface_flush(surface);
+    layer->data   = cairo_image_surface_get_data(surface);
+    layer->stride = cairo_image_surface_get_stride(surface);
+    /* cairo hands pixman the top 8 bits of its 16 bit alpha */
+    layer->alpha = alpha >> 8;
+
+    /* an unusable surface is blended as fully transparent */
+    if (layer->data == NULL || cairo_image_surface_get_format(surface) != CAIRO_FORMAT_ARGB32)
+        layer->alpha = 0;
+}
+
+/* ------------------------------------------------------------------ */
+guint32
+gerbv_composite_pixel_from_color(guint16 red, guint16 green, guint16 blue) {
+    return 0xff000000 | ((guint32)(red >> 8) << 16) | ((guint32)(green >> 8) << 8) | (blue >> 8);
+}
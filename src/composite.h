@@ -0,0 +1,79 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ *
+ * composite.h -- this file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** \file composite.h
+    \brief Header info for the multi-layer compositor
+    \ingroup libgerbv
+*/
+
+#ifndef COMPOSITE_H
+#define COMPOSITE_H
+
+#include <glib.h>
+#include <cairo.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! One rendered layer to blend into the frame */
+typedef struct {
+    const guint8* data;   /*!< premultiplied ARGB32 pixels, in cairo's native byte order */
+    gint          stride; /*!< bytes per row of data */
+    guint8        alpha;  /*!< constant opacity of the layer, 255 is opaque */
+} gerbv_composite_layer_t;
+
+/* Fill dest with the opaque background color, then blend all layers onto it
+ * from first to last with the OVER operator. The whole stack is blended in a
+ * single pass over the frame, split into row bands across the available CPUs.
+ * The result is identical to painting each layer with cairo_paint_with_alpha(). */
+void gerbv_composite_layers(
+    guint8* dest, gint destStride, gint width, gint height, guint32 background, const gerbv_composite_layer_t* layers,
+    guint nLayers
+);
+
+/* Like gerbv_composite_layers(), but blend onto the opaque pixels already in
+ * dest instead of a background. Blending a stack one layer at a time this
+ * way gives the same frame as blending it all at once. */
+void gerbv_composite_layers_over(
+    guint8* dest, gint destStride, gint width, gint height, const gerbv_composite_layer_t* layers, guint nLayers
+);
+
+/* Composite layers onto an ARGB32 or RGB24 cairo image surface */
+void gerbv_composite_layers_to_surface(
+    cairo_surface_t* surface, guint32 background, const gerbv_composite_layer_t* layers, guint nLayers
+);
+
+/* Blend layers onto what is already in an ARGB32 or RGB24 cairo image surface */
+void gerbv_composite_layers_over_surface(
+    cairo_surface_t* surface, const gerbv_composite_layer_t* layers, guint nLayers
+);
+
+/* Fill in a compositor layer from an ARGB32 cairo image surface the same size as the frame */
+void gerbv_composite_layer_from_surface(gerbv_composite_layer_t* layer, cairo_surface_t* surface, guint16 alpha);
+
+/* Return the opaque ARGB32 pixel for a 16 bit per channel color */
+guint32 gerbv_composite_pixel_from_color(guint16 red, guint16 green, guint16 blue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* COMPOSITE_H */
@@ -41,6 +41,7 @@
 #include <gtk/gtk.h>
 #include "gerbv.h"
 #include "draw-gdk.h"
+#include "gerb_image.h"
 #include "common.h"
 
 #undef round
@@ -645,12 +646,19 @@ draw_gdk_render_polygon_object(
     gerbv_net_t* oldNet, gerbv_image_t* image, double sr_x, double sr_y, cairo_matrix_t* fullMatrix,
     cairo_matrix_t* scaleMatrix, GdkGC* gc, GdkGC* pgc, GdkPixmap** pixmap
 ) {
-    gerbv_net_t* currentNet;
-    gint         x2, y2, cp_x = 0, cp_y = 0, cir_width = 0;
-    GdkPoint*    points = NULL;
-    unsigned int pointArraySize, curr_point_idx;
-    int          steps, i;
-    gdouble      angleDiff, tempX, tempY;
+    gerbv_net_t*                      currentNet;
+    const gerbv_image_arc_polyline_t* arc;
+    gint                              x2, y2;
+    GdkPoint*                         points = NULL;
+    unsigned int                      pointArraySize, curr_point_idx;
+    guint                             i;
+    gdouble                           tempX, tempY, tolerance;
+
+    /* flatten arcs to within half a pixel */
+    tempX = 1.0;
+    tempY = 0.0;
+    cairo_matrix_transform_distance(scaleMatrix, &tempX, &tempY);
+    tolerance = 0.5 / MAX(hypot(tempX, tempY), 1e-9);
 
     /* save the first net in the polygon as the "ID" net pointer
     in case we are saving this net to the selection array */
@@ -664,25 +672,6 @@ draw_gdk_render_polygon_object(
         x2 = (int)round(tempX);
         y2 = (int)round(tempY);
 
-        /*
-         * If circle segment, scale and translate that one too
-         */
-        if (currentNet->cirseg) {
-            tempX = currentNet->cirseg->width;
-            tempY = currentNet->cirseg->height;
-            cairo_matrix_transform_point(scaleMatrix, &tempX, &tempY);
-
-            /* Variables can be negative after transformation */
-            tempX     = fabs(tempX);
-            cir_width = (int)round(tempX);
-
-            tempX = currentNet->cirseg->cp_x + sr_x;
-            tempY = currentNet->cirseg->cp_y + sr_y;
-            cairo_matrix_transform_point(fullMatrix, &tempX, &tempY);
-            cp_x = (int)round(tempX);
-            cp_y = (int)round(tempY);
-        }
-
         switch (currentNet->interpolation) {
             case GERBV_INTERPOLATION_LINEARx1:
             case GERBV_INTERPOLATION_LINEARx10:
@@ -699,18 +688,21 @@ draw_gdk_render_polygon_object(
             case GERBV_INTERPOLATION_CW_CIRCULAR:
             case GERBV_INTERPOLATION_CCW_CIRCULAR:
                 /* we need to chop up the arc into small lines for rendering
-                with GDK */
-                angleDiff = currentNet->cirseg->angle2 - currentNet->cirseg->angle1;
-                steps     = (int)abs(angleDiff);
-                if (pointArraySize < (curr_point_idx + steps)) {
-                    pointArraySize = curr_point_idx + steps;
+                with GDK, the image keeps them for the current zoom */
+                arc = gerbv_image_return_arc_polyline(image, currentNet, tolerance);
+                if (arc == NULL)
+                    break;
+
+                if (pointArraySize < (curr_point_idx + arc->n_points)) {
+                    pointArraySize = curr_point_idx + arc->n_points;
                     points         = (GdkPoint*)g_realloc(points, pointArraySize * sizeof(GdkPoint));
                 }
-                for (i = 0; i < steps; i++) {
-                    points[curr_point_idx].x =
-                        cp_x + cir_width / 2.0 * cos(DEG2RAD(currentNet->cirseg->angle1 + (angleDiff * i) / steps));
-                    points[curr_point_idx].y =
-                        cp_y - cir_width / 2.0 * sin(DEG2RAD(currentNet->cirseg->angle1 + (angleDiff * i) / steps));
+                for (i = 0; i < arc->n_points; i++) {
+                    tempX = currentNet->cirseg->cp_x + arc->points[2 * i] + sr_x;
+                    tempY = currentNet->cirseg->cp_y + arc->points[2 * i + 1] + sr_y;
+                    cairo_matrix_transform_point(fullMatrix, &tempX, &tempY);
+                    points[curr_point_idx].x = (int)round(tempX);
+                    points[curr_point_idx].y = (int)round(tempY);
                     curr_point_idx++;
                 }
                 break;
@@ -874,10 +866,14 @@ draw_gdk_image_to_pixmap(
     }
     oldLayer = image->layers;
     oldState = image->states;
-    for (net = image->netlist->next; net != NULL; net = gerbv_image_return_next_renderable_object(net)) {
-        int    repeat_X = 1, repeat_Y = 1;
-        double repeat_dist_X = 0.0, repeat_dist_Y = 0.0;
-        int    repeat_i, repeat_j;
+    for (net = image->netlist->next; net != NULL; net = gerbv_image_return_next_renderable_object_cached(image, net)) {
+        int                  repeat_X = 1, repeat_Y = 1;
+        double               repeat_dist_X = 0.0, repeat_dist_Y = 0.0;
+        int                  repeat_i, repeat_j;
+        gerbv_render_size_t* boundingBox = &net->boundingBox;
+
+        if (net->interpolation == GERBV_INTERPOLATION_PAREA_START)
+            boundingBox = &gerbv_image_return_region(image, net)->boundingBox;
 
         /*
          * If step_and_repeat (%SR%) used, repeat the drawing;
@@ -922,8 +918,8 @@ draw_gdk_image_to_pixmap(
                 double sr_y = repeat_j * repeat_dist_Y;
 
                 if ((useOptimizations)
-                    && ((net->boundingBox.right + sr_x < minX) || (net->boundingBox.left + sr_x > maxX)
-                        || (net->boundingBox.top + sr_y < minY) || (net->boundingBox.bottom + sr_y > maxY))) {
+                    && ((boundingBox->right + sr_x < minX) || (boundingBox->left + sr_x > maxX)
+                        || (boundingBox->top + sr_y < minY) || (boundingBox->bottom + sr_y > maxY))) {
                     continue;
                 }
 
@@ -38,6 +38,7 @@
 #include "draw.h"
 #include "common.h"
 #include "selection.h"
+#include "gerb_image.h"
 
 #define dprintf \
     if (DEBUG)  \
@@ -637,67 +638,109 @@ draw_apply_netstate_transformation(cairo_t* cairoTarget, gerbv_netstate_t* state
     }
 }
 
+/** Draw a G36/G37 region from its cached outline.
+  @param region	Cached region outline.
+  @param polygonStartNet	The PAREA_START net, used as the selection "ID".
+  @param sr_x	Step and repeat x offset.
+  @param sr_y	Step and repeat y offset.
+*/
+static void
+draw_render_region(
+    gerbv_image_region_t* region, gerbv_net_t* polygonStartNet, cairo_t* cairoTarget, gdouble sr_x, gdouble sr_y,
+    gerbv_image_t* image, enum draw_mode drawMode, gerbv_selection_info_t* selectionInfo, gboolean pixelOutput
+) {
+    const gdouble* v = region->coords;
+
+    cairo_new_path(cairoTarget);
+
+    for (guint i = 0; i < region->n_ops; i++) {
+        switch (region->ops[i]) {
+            case GERBV_REGION_OP_MOVE_TO:
+                draw_cairo_move_to(cairoTarget, v[0] + sr_x, v[1] + sr_y, FALSE, pixelOutput);
+                v += 2;
+                break;
+            case GERBV_REGION_OP_LINE_TO:
+                draw_cairo_line_to(cairoTarget, v[0] + sr_x, v[1] + sr_y, FALSE, pixelOutput);
+                v += 2;
+                break;
+            case GERBV_REGION_OP_ARC:
+                cairo_arc(cairoTarget, v[0] + sr_x, v[1] + sr_y, v[2], v[3], v[4]);
+                v += 5;
+                break;
+            case GERBV_REGION_OP_ARC_NEGATIVE:
+                cairo_arc_negative(cairoTarget, v[0] + sr_x, v[1] + sr_y, v[2], v[3], v[4]);
+                v += 5;
+                break;
+            default: break;
+        }
+    }
+
+    if (!region->closed)
+        return;
+
+    cairo_close_path(cairoTarget);
+    /* turn off anti-aliasing for polygons, since it shows seams
+       with adjacent polygons (usually on PCB ground planes) */
+    cairo_antialias_t oldAlias = cairo_get_antialias(cairoTarget);
+    cairo_set_antialias(cairoTarget, CAIRO_ANTIALIAS_NONE);
+    draw_fill(cairoTarget, drawMode, selectionInfo, image, polygonStartNet);
+    cairo_set_antialias(cairoTarget, oldAlias);
+}
+
 void
 draw_render_polygon_object(
     gerbv_net_t* oldNet, cairo_t* cairoTarget, gdouble sr_x, gdouble sr_y, gerbv_image_t* image,
     enum draw_mode drawMode, gerbv_selection_info_t* selectionInfo, gboolean pixelOutput
 ) {
-    gerbv_net_t *currentNet, *polygonStartNet;
-    int          haveDrawnFirstFillPoint = 0;
-    gdouble      x2, y2, cp_x = 0, cp_y = 0;
-
-    haveDrawnFirstFillPoint = FALSE;
-    /* save the first net in the polygon as the "ID" net pointer
-       in case we are saving this net to the selection array */
-    polygonStartNet = oldNet;
-    cairo_new_path(cairoTarget);
-
-    for (currentNet = oldNet->next; currentNet != NULL; currentNet = currentNet->next) {
-        x2 = currentNet->stop_x + sr_x;
-        y2 = currentNet->stop_y + sr_y;
+    draw_render_region(
+        gerbv_image_return_region(image, oldNet), oldNet, cairoTarget, sr_x, sr_y, image, drawMode, selectionInfo,
+        pixelOutput
+    );
+}
 
-        /* translate circular x,y data as well */
-        if (currentNet->cirseg) {
-            cp_x = currentNet->cirseg->cp_x + sr_x;
-            cp_y = currentNet->cirseg->cp_y + sr_y;
-        }
-        if (!haveDrawnFirstFillPoint) {
-            draw_cairo_move_to(cairoTarget, x2, y2, FALSE, pixelOutput);
-            haveDrawnFirstFillPoint = TRUE;
-            continue;
-        }
+/** Add the path of an arc net.
+  Hit-testing and the selection highlight take the arc from the image's
+  flattened arc cache, within the cairo tolerance of the current zoom, so
+  every click doesn't flatten each arc again. Images are drawn with a true
+  arc, which keeps exported output the same.
+  @param cp_x	Arc center x coordinate, including step and repeat.
+  @param cp_y	Arc center y coordinate, including step and repeat.
+*/
+static void
+draw_cairo_arc_net(
+    cairo_t* cairoTarget, gerbv_image_t* image, gerbv_net_t* net, gdouble cp_x, gdouble cp_y, enum draw_mode drawMode
+) {
+    const gerbv_image_arc_polyline_t* arc;
+    gdouble                           x = 1.0, y = 0.0, scale;
+
+    if (drawMode != DRAW_IMAGE) {
+        cairo_user_to_device_distance(cairoTarget, &x, &y);
+        scale = hypot(x, y);
+        x     = 0.0;
+        y     = 1.0;
+        cairo_user_to_device_distance(cairoTarget, &x, &y);
+        scale = MAX(scale, hypot(x, y));
+
+        arc = gerbv_image_return_arc_polyline(image, net, cairo_get_tolerance(cairoTarget) / MAX(scale, 1e-9));
+        cairo_move_to(cairoTarget, cp_x + arc->points[0], cp_y + arc->points[1]);
+        for (guint i = 1; i < arc->n_points; i++)
+            cairo_line_to(cairoTarget, cp_x + arc->points[2 * i], cp_y + arc->points[2 * i + 1]);
+
+        return;
+    }
 
-        switch (currentNet->interpolation) {
-            case GERBV_INTERPOLATION_LINEARx1:
-            case GERBV_INTERPOLATION_LINEARx10:
-            case GERBV_INTERPOLATION_LINEARx01:
-            case GERBV_INTERPOLATION_LINEARx001: draw_cairo_line_to(cairoTarget, x2, y2, FALSE, pixelOutput); break;
-            case GERBV_INTERPOLATION_CW_CIRCULAR:
-            case GERBV_INTERPOLATION_CCW_CIRCULAR:
-                if (currentNet->cirseg->angle2 > currentNet->cirseg->angle1) {
-                    cairo_arc(
-                        cairoTarget, cp_x, cp_y, currentNet->cirseg->width / 2.0, DEG2RAD(currentNet->cirseg->angle1),
-                        DEG2RAD(currentNet->cirseg->angle2)
-                    );
-                } else {
-                    cairo_arc_negative(
-                        cairoTarget, cp_x, cp_y, currentNet->cirseg->width / 2.0, DEG2RAD(currentNet->cirseg->angle1),
-                        DEG2RAD(currentNet->cirseg->angle2)
-                    );
-                }
-                break;
-            case GERBV_INTERPOLATION_PAREA_END:
-                cairo_close_path(cairoTarget);
-                /* turn off anti-aliasing for polygons, since it shows seams
-                   with adjacent polygons (usually on PCB ground planes) */
-                cairo_antialias_t oldAlias = cairo_get_antialias(cairoTarget);
-                cairo_set_antialias(cairoTarget, CAIRO_ANTIALIAS_NONE);
-                draw_fill(cairoTarget, drawMode, selectionInfo, image, polygonStartNet);
-                cairo_set_antialias(cairoTarget, oldAlias);
-                return;
-            default: break;
-        }
+    /* cairo doesn't have a function to draw oval arcs, so we must
+     * draw an arc and stretch it by scaling different x and y values
+     */
+    cairo_save(cairoTarget);
+    cairo_translate(cairoTarget, cp_x, cp_y);
+    cairo_scale(cairoTarget, net->cirseg->width, net->cirseg->height);
+    if (net->cirseg->angle2 > net->cirseg->angle1) {
+        cairo_arc(cairoTarget, 0.0, 0.0, 0.5, DEG2RAD(net->cirseg->angle1), DEG2RAD(net->cirseg->angle2));
+    } else {
+        cairo_arc_negative(cairoTarget, 0.0, 0.0, 0.5, DEG2RAD(net->cirseg->angle1), DEG2RAD(net->cirseg->angle2));
     }
+    cairo_restore(cairoTarget);
 }
 
 /** Draw Cairo cross.
@@ -714,42 +757,6 @@ draw_cairo_cross(cairo_t* cairoTarget, gdouble xc, gdouble yc, gdouble r) {
     cairo_stroke(cairoTarget);
 }
 
-static int
-draw_calc_pnp_mark_coords(struct gerbv_net* start_net, double* label_x, double* label_y) {
-    double            x, y;
-    struct gerbv_net* net   = start_net;
-    const char*       label = NULL;
-
-    if (net && net->label)
-        label = net->label->str;
-
-    if (label == NULL)
-        return 0;
-
-    x = HUGE_VAL;
-    y = -HUGE_VAL;
-    do {
-        if (!net->label || 0 != g_strcmp0(net->label->str, label))
-            break;
-
-        /* Search top left corner */
-        if (net->boundingBox.top != HUGE_VAL) {
-            /* Bounding box not calculated */
-            x = MIN(x, net->boundingBox.left);
-            y = MAX(y, net->boundingBox.top);
-        } else {
-            x = MIN(x, net->stop_x);
-            y = MAX(y, net->stop_y + 0.01 / 2);
-            /* 0.01 default line width */
-        }
-    } while (NULL != (net = gerbv_image_return_next_renderable_object(net)));
-
-    *label_x = x;
-    *label_y = y;
-
-    return 1;
-}
-
 int
 draw_image_to_cairo_target(
     cairo_t* cairoTarget, gerbv_image_t* image, gdouble pixelWidth, enum draw_mode drawMode,
@@ -862,9 +869,17 @@ draw_image_to_cairo_target(
     oldLayer = image->layers;
     oldState = image->states;
 
-    const char* pnp_net_label_str_prev = NULL;
+    GString* pnp_net_label_prev = NULL;
+
+    for (net = image->netlist->next; net != NULL; net = gerbv_image_return_next_renderable_object_cached(image, net)) {
+        gerbv_image_region_t* region      = NULL;
+        gerbv_render_size_t*  boundingBox = &net->boundingBox;
 
-    for (net = image->netlist->next; net != NULL; net = gerbv_image_return_next_renderable_object(net)) {
+        /* regions are culled and drawn using their cached outline */
+        if (net->interpolation == GERBV_INTERPOLATION_PAREA_START) {
+            region      = gerbv_image_return_region(image, net);
+            boundingBox = &region->boundingBox;
+        }
 
         /* check if this is a new layer */
         if (net->layer != oldLayer) {
@@ -950,15 +965,15 @@ draw_image_to_cairo_target(
         if (drawMode != DRAW_SELECTIONS && net->label
             && (image->layertype == GERBV_LAYERTYPE_PICKANDPLACE_TOP
                 || image->layertype == GERBV_LAYERTYPE_PICKANDPLACE_BOT)
-            && g_strcmp0(net->label->str, pnp_net_label_str_prev)) {
+            && net->label != pnp_net_label_prev) {
 
             double mark_x, mark_y;
 
             /* Add PNP text label only one time per
              * net and if it is not selected. */
-            pnp_net_label_str_prev = net->label->str;
+            pnp_net_label_prev = net->label;
 
-            if (draw_calc_pnp_mark_coords(net, &mark_x, &mark_y)) {
+            if (gerbv_image_return_label_mark(image, net, &mark_x, &mark_y)) {
                 cairo_save(cairoTarget);
 
                 cairo_set_font_size(cairoTarget, 0.05);
@@ -979,8 +994,8 @@ draw_image_to_cairo_target(
                 double sr_y = iy * sr->dist_Y;
 
                 if (useOptimizations && pixelOutput
-                    && ((net->boundingBox.right + sr_x < minX) || (net->boundingBox.left + sr_x > maxX)
-                        || (net->boundingBox.top + sr_y < minY) || (net->boundingBox.bottom + sr_y > maxY))) {
+                    && ((boundingBox->right + sr_x < minX) || (boundingBox->left + sr_x > maxX)
+                        || (boundingBox->top + sr_y < minY) || (boundingBox->bottom + sr_y > maxY))) {
                     continue;
                 }
 
@@ -1006,14 +1021,14 @@ draw_image_to_cairo_target(
                             cairo_set_operator(cairoTarget, CAIRO_OPERATOR_OVER);
                             cairo_set_source_rgba(cairoTarget, bg_r, bg_g, bg_b, 1.0);
 
-                            draw_render_polygon_object(
-                                net, cairoTarget, sr_x, sr_y, image, drawMode, selectionInfo, pixelOutput
+                            draw_render_region(
+                                region, net, cairoTarget, sr_x, sr_y, image, drawMode, selectionInfo, pixelOutput
                             );
 
                             cairo_restore(cairoTarget);
                         } else {
-                            draw_render_polygon_object(
-                                net, cairoTarget, sr_x, sr_y, image, drawMode, selectionInfo, pixelOutput
+                            draw_render_region(
+                                region, net, cairoTarget, sr_x, sr_y, image, drawMode, selectionInfo, pixelOutput
                             );
                         }
 
@@ -1133,30 +1148,13 @@ draw_image_to_cairo_target(
                                 break;
                             case GERBV_INTERPOLATION_CW_CIRCULAR:
                             case GERBV_INTERPOLATION_CCW_CIRCULAR:
-                                /* cairo doesn't have a function to draw oval arcs, so we must
-                                 * draw an arc and stretch it by scaling different x and y values
-                                 */
                                 cairo_new_path(cairoTarget);
                                 if (image->aperture[net->aperture]->type == GERBV_APTYPE_RECTANGLE) {
                                     cairo_set_line_cap(cairoTarget, CAIRO_LINE_CAP_SQUARE);
                                 } else {
                                     cairo_set_line_cap(cairoTarget, CAIRO_LINE_CAP_ROUND);
                                 }
-                                cairo_save(cairoTarget);
-                                cairo_translate(cairoTarget, cp_x, cp_y);
-                                cairo_scale(cairoTarget, net->cirseg->width, net->cirseg->height);
-                                if (net->cirseg->angle2 > net->cirseg->angle1) {
-                                    cairo_arc(
-                                        cairoTarget, 0.0, 0.0, 0.5, DEG2RAD(net->cirseg->angle1),
-                                        DEG2RAD(net->cirseg->angle2)
-                                    );
-                                } else {
-                                    cairo_arc_negative(
-                                        cairoTarget, 0.0, 0.0, 0.5, DEG2RAD(net->cirseg->angle1),
-                                        DEG2RAD(net->cirseg->angle2)
-                                    );
-                                }
-                                cairo_restore(cairoTarget);
+                                draw_cairo_arc_net(cairoTarget, image, net, cp_x, cp_y, drawMode);
                                 draw_stroke(cairoTarget, drawMode, selectionInfo, image, net);
                                 break;
                             default:
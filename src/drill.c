@@ -113,6 +113,73 @@ typedef struct drill_state {
 
 } drill_state_t;
 
+/* Character classes used when scanning drill files */
+#define DRILL_CHAR_DIGIT  0x01 /* 0 to 9 */
+#define DRILL_CHAR_NUMBER 0x02 /* anything read_double() takes: digits, signs, '.' and ',' */
+#define DRILL_CHAR_BLANK  0x04 /* space and tab */
+#define DRILL_CHAR_EOL    0x08 /* CR and LF */
+#define DRILL_CHAR_MARK   0x10 /* characters drill_file_p() looks for */
+
+#define DRILL_CHAR_IS(c, class) (drill_char_class[(guchar)(c)] & (class))
+
+static const guint8 drill_char_class[256] = {
+    ['\t'] = DRILL_CHAR_BLANK,  ['\n'] = DRILL_CHAR_EOL,   ['\r'] = DRILL_CHAR_EOL,   [' '] = DRILL_CHAR_BLANK,
+    ['+'] = DRILL_CHAR_NUMBER, [','] = DRILL_CHAR_NUMBER, ['-'] = DRILL_CHAR_NUMBER, ['.'] = DRILL_CHAR_NUMBER,
+    ['0'] = DRILL_CHAR_DIGIT | DRILL_CHAR_NUMBER, ['1'] = DRILL_CHAR_DIGIT | DRILL_CHAR_NUMBER,
+    ['2'] = DRILL_CHAR_DIGIT | DRILL_CHAR_NUMBER, ['3'] = DRILL_CHAR_DIGIT | DRILL_CHAR_NUMBER,
+    ['4'] = DRILL_CHAR_DIGIT | DRILL_CHAR_NUMBER, ['5'] = DRILL_CHAR_DIGIT | DRILL_CHAR_NUMBER,
+    ['6'] = DRILL_CHAR_DIGIT | DRILL_CHAR_NUMBER, ['7'] = DRILL_CHAR_DIGIT | DRILL_CHAR_NUMBER,
+    ['8'] = DRILL_CHAR_DIGIT | DRILL_CHAR_NUMBER, ['9'] = DRILL_CHAR_DIGIT | DRILL_CHAR_NUMBER,
+    ['%'] = DRILL_CHAR_MARK,   [';'] = DRILL_CHAR_MARK,   ['M'] = DRILL_CHAR_MARK,   ['T'] = DRILL_CHAR_MARK,
+    ['X'] = DRILL_CHAR_MARK,   ['Y'] = DRILL_CHAR_MARK,
+};
+
+/* What drill_file_p() found in one line, see drill_scan_line() */
+typedef struct {
+    gboolean comment;  /* there is a ';' */
+    gboolean binary;   /* there are bytes outside of 7 bit ASCII */
+    gboolean M48;      /* start of header */
+    gboolean M30;      /* end of program */
+    gboolean percent;  /* the first '%' ends the line */
+    gboolean T;        /* the first 'T' is followed by a digit */
+    gboolean X;        /* the first 'X' is followed by a digit */
+    gboolean Y;        /* the first 'Y' is followed by a digit */
+} drill_line_marks_t;
+
+/* Header commands, told apart by drill_header_keyword() before the
+   matching drill_parse_header_is_*() function is tried */
+typedef enum {
+    DRILL_KEYWORD_NONE,    /* none of the ones below */
+    DRILL_KEYWORD_UNKNOWN, /* can't tell without reading, any of them could follow */
+    DRILL_KEYWORD_FILE_FORMAT,
+    DRILL_KEYWORD_ICI,
+    DRILL_KEYWORD_INCH,
+    DRILL_KEYWORD_METRIC
+} drill_keyword_t;
+
+static const struct {
+    const char*     name;
+    drill_keyword_t keyword;
+} drill_header_keywords[] = {
+    { "FILE_FORMAT", DRILL_KEYWORD_FILE_FORMAT },
+    { "ICI,O", DRILL_KEYWORD_ICI },
+    { "INCH", DRILL_KEYWORD_INCH },
+    { "METRIC", DRILL_KEYWORD_METRIC },
+};
+
+/* Longest name in drill_header_keywords */
+#define DRILL_KEYWORD_MAX_LEN 11
+
+/* Reads characters like gerb_fgetc(), but straight from memory when the
+   whole file is there. drill_reader_done() must be called before fd is
+   used directly again. */
+typedef struct {
+    gerb_file_t* fd;
+    const char*  buf; /* the unread part of the file, or NULL to use gerb_fgetc() */
+    goffset      len; /* length of buf */
+    goffset      pos; /* characters read from buf */
+} drill_reader_t;
+
 /* Local function prototypes */
 static drill_g_code_t drill_parse_G_code(gerb_file_t* fd, gerbv_image_t* image, ssize_t file_line);
 static drill_m_code_t
@@ -132,6 +199,10 @@ static void           eat_whitespace(gerb_file_t* fd);
 static char*          get_line(gerb_file_t* fd);
 static int            file_check_str(gerb_file_t* fd, const char* str);
 
+static const char*     drill_next_line(gerb_file_t* fd, char* buf, gsize* len);
+static void            drill_scan_line(const char* line, gsize len, drill_line_marks_t* marks);
+static drill_keyword_t drill_header_keyword(gerb_file_t* fd);
+
 /* -------------------------------------------------------------- */
 /* This is the list of specific attributes a drill file may have from
  * the point of view of parsing it.
@@ -223,7 +294,7 @@ drill_add_drill_hole(gerbv_image_t* image, drill_state_t* state, gerbv_drill_sta
     /* Add one to drill stats  for the current tool */
     drill_stats_increment_drill_counter(image->drill_stats->drill_list, state->current_tool);
 
-    curr_net->next = g_new0(gerbv_net_t, 1);
+    curr_net->next = gerbv_image_new_net(image);
     if (curr_net->next == NULL)
         GERB_FATAL_ERROR("malloc curr_net->next failed in %s()", __FUNCTION__);
 
@@ -276,6 +347,7 @@ parse_drillfile(gerb_file_t* fd, gerbv_HID_Attribute* attr_list, int n_attr, int
     int                  read;
     gerbv_drill_stats_t* stats;
     gchar*               tmps;
+    drill_keyword_t      keyword;
     ssize_t              file_line = 1;
 
     /*
@@ -358,7 +430,9 @@ parse_drillfile(gerb_file_t* fd, gerbv_HID_Attribute* attr_list, int n_attr, int
 
             case ';':
                 /* Comment found. Eat rest of line */
-                if (drill_parse_header_is_metric_comment(fd, state, image, file_line)) {
+                keyword = drill_header_keyword(fd);
+                if ((keyword == DRILL_KEYWORD_FILE_FORMAT || keyword == DRILL_KEYWORD_UNKNOWN)
+                    && drill_parse_header_is_metric_comment(fd, state, image, file_line)) {
                     break;
                 }
                 tmps = get_line(fd);
@@ -532,10 +606,13 @@ parse_drillfile(gerb_file_t* fd, gerbv_HID_Attribute* attr_list, int n_attr, int
             case 'I':
                 gerb_ungetc(fd); /* To compare full string in function or
                         report full string  */
-                if (drill_parse_header_is_inch(fd, state, image, file_line))
+                keyword = drill_header_keyword(fd);
+                if ((keyword == DRILL_KEYWORD_INCH || keyword == DRILL_KEYWORD_UNKNOWN)
+                    && drill_parse_header_is_inch(fd, state, image, file_line))
                     break;
 
-                if (drill_parse_header_is_ici(fd, state, image, file_line))
+                if ((keyword == DRILL_KEYWORD_ICI || keyword == DRILL_KEYWORD_UNKNOWN)
+                    && drill_parse_header_is_ici(fd, state, image, file_line))
                     break;
 
                 tmps = get_line(fd);
@@ -662,7 +739,9 @@ parse_drillfile(gerb_file_t* fd, gerbv_HID_Attribute* attr_list, int n_attr, int
                         case DRILL_M_UNKNOWN:
                             gerb_ungetc(fd); /* To compare full string in function or
                                         report full string  */
-                            if (drill_parse_header_is_metric(fd, state, image, file_line))
+                            keyword = drill_header_keyword(fd);
+                            if ((keyword == DRILL_KEYWORD_METRIC || keyword == DRILL_KEYWORD_UNKNOWN)
+                                && drill_parse_header_is_metric(fd, state, image, file_line))
                                 break;
 
                             stats->M_unknown++;
@@ -899,101 +978,62 @@ drill_parse_end:
  */
 gboolean
 drill_file_p(gerb_file_t* fd, gboolean* returnFoundBinary) {
-    char *   buf = NULL, *tbuf;
-    int      len = 0;
-    char*    letter;
-    int      ascii;
-    int      zero = 48; /* ascii 0 */
-    int      nine = 57; /* ascii 9 */
-    int      i;
-    gboolean found_binary  = FALSE;
-    gboolean found_M48     = FALSE;
-    gboolean found_M30     = FALSE;
-    gboolean found_percent = FALSE;
-    gboolean found_T       = FALSE;
-    gboolean found_X       = FALSE;
-    gboolean found_Y       = FALSE;
-    gboolean end_comments  = FALSE;
+    char*              tbuf;
+    const char*        line;
+    gsize              len;
+    drill_line_marks_t marks;
+    gboolean           found_binary  = FALSE;
+    gboolean           found_M48     = FALSE;
+    gboolean           found_M30     = FALSE;
+    gboolean           found_percent = FALSE;
+    gboolean           found_T       = FALSE;
+    gboolean           found_X       = FALSE;
+    gboolean           found_Y       = FALSE;
+    gboolean           end_comments  = FALSE;
 
     tbuf = g_malloc(MAXL);
     if (tbuf == NULL)
         GERB_FATAL_ERROR("malloc buf failed while checking for drill file in %s()", __FUNCTION__);
 
-    while (fgets(tbuf, MAXL, fd->fd) != NULL) {
-        len = strlen(tbuf);
-        buf = tbuf;
-        /* check for comments at top of file.  */
+    while ((line = drill_next_line(fd, tbuf, &len)) != NULL) {
+        drill_scan_line(line, len, &marks);
+
+        /* skip comments at top of file */
         if (!end_comments) {
-            if (g_strstr_len(buf, len, ";") != NULL) { /* comments at top of file  */
-                for (i = 0; i < len - 1; ++i) {
-                    if (buf[i] == '\n' && buf[i + 1] != ';' && buf[i + 1] != '\r' && buf[i + 1] != '\n') {
-                        end_comments = TRUE;
-                        /* Set rest of parser to end of
-                         * comments */
-                        buf = &tbuf[i + 1];
-                    }
-                }
-                if (!end_comments)
-                    continue;
-            } else
-                end_comments = TRUE;
+            if (marks.comment)
+                continue;
+
+            end_comments = TRUE;
         }
 
-        /* First look through the file for indications of its type */
-        len = strlen(buf);
         /* check that file is not binary (non-printing chars) */
-        for (i = 0; i < len; i++) {
-            ascii = (int)buf[i];
-            if ((ascii > 128) || (ascii < 0)) {
-                found_binary = TRUE;
-            }
-        }
+        if (marks.binary)
+            found_binary = TRUE;
 
         /* Check for M48 = start of drill header */
-        if (g_strstr_len(buf, len, "M48")) {
+        if (marks.M48)
             found_M48 = TRUE;
-        }
 
-        /* Check for M30 = end of drill program */
-        if (g_strstr_len(buf, len, "M30")) {
-            if (found_percent) {
-                found_M30 = TRUE; /* Found M30 after % = good */
-            }
-        }
+        /* Check for M30 = end of drill program, good if after % */
+        if (marks.M30 && found_percent)
+            found_M30 = TRUE;
 
         /* Check for % on its own line at end of header */
-        if ((letter = g_strstr_len(buf, len, "%")) != NULL) {
-            if ((letter[1] == '\r') || (letter[1] == '\n'))
-                found_percent = TRUE;
-        }
+        if (marks.percent)
+            found_percent = TRUE;
 
-        /* Check for T<number> */
-        if ((letter = g_strstr_len(buf, len, "T")) != NULL) {
-            if (!found_T && (found_X || found_Y)) {
-                found_T = FALSE; /* Found first T after X or Y */
-            } else {
-                if (isdigit((int)letter[1])) { /* verify next char is digit */
-                    found_T = TRUE;
-                }
-            }
-        }
+        /* Check for T<number>, unless it is the first one and comes after X or Y */
+        if (marks.T && !found_X && !found_Y)
+            found_T = TRUE;
 
         /* look for X<number> or Y<number> */
-        if ((letter = g_strstr_len(buf, len, "X")) != NULL) {
-            ascii = (int)letter[1]; /* grab char after X */
-            if ((ascii >= zero) && (ascii <= nine)) {
-                found_X = TRUE;
-            }
-        }
-        if ((letter = g_strstr_len(buf, len, "Y")) != NULL) {
-            ascii = (int)letter[1]; /* grab char after Y */
-            if ((ascii >= zero) && (ascii <= nine)) {
-                found_Y = TRUE;
-            }
-        }
-    } /* while (fgets(buf, MAXL, fd->fd) */
+        if (marks.X)
+            found_X = TRUE;
+        if (marks.Y)
+            found_Y = TRUE;
+    }
 
-    rewind(fd->fd);
+    gerb_frewind(fd);
     g_free(tbuf);
     *returnFoundBinary = found_binary;
 
@@ -1780,23 +1820,46 @@ new_state(drill_state_t* state) {
     return state;
 } /* new_state */
 
+/* -------------------------------------------------------------- */
+static inline void
+drill_reader_init(drill_reader_t* reader, gerb_file_t* fd) {
+    reader->fd  = fd;
+    reader->buf = gerb_fbuffer(fd, &reader->len);
+    reader->pos = 0;
+}
+
+static inline int
+drill_reader_getc(drill_reader_t* reader) {
+    if (reader->buf == NULL)
+        return gerb_fgetc(reader->fd);
+
+    return reader->pos < reader->len ? (int)reader->buf[reader->pos++] : EOF;
+}
+
+static inline void
+drill_reader_done(drill_reader_t* reader) {
+    if (reader->buf != NULL)
+        reader->fd->ptr += reader->pos;
+}
+
 /* -------------------------------------------------------------- */
 /* Reads one double from fd and returns it.
    If a decimal point is found, fmt is not used. */
 static double
 read_double(gerb_file_t* fd, number_fmt_t fmt, gerbv_omit_zeros_t omit_zeros, int decimals) {
-    int          read;
-    char         temp[DRILL_READ_DOUBLE_SIZE];
-    unsigned int i = 0, ndigits = 0;
-    double       result;
-    gboolean     decimal_point = FALSE;
-    gboolean     sign_prepend  = FALSE;
+    int            read;
+    char           temp[DRILL_READ_DOUBLE_SIZE];
+    unsigned int   i = 0, ndigits = 0;
+    double         result;
+    gboolean       decimal_point = FALSE;
+    gboolean       sign_prepend  = FALSE;
+    drill_reader_t reader;
 
     memset(temp, 0, sizeof(temp));
 
-    read = gerb_fgetc(fd);
-    while (read != EOF && i < (DRILL_READ_DOUBLE_SIZE - 1)
-           && (isdigit(read) || read == '.' || read == ',' || read == '+' || read == '-')) {
+    drill_reader_init(&reader, fd);
+    read = drill_reader_getc(&reader);
+    while (read != EOF && i < (DRILL_READ_DOUBLE_SIZE - 1) && DRILL_CHAR_IS(read, DRILL_CHAR_NUMBER)) {
         if (read == ',' || read == '.')
             decimal_point = TRUE;
 
@@ -1807,17 +1870,18 @@ read_double(gerb_file_t* fd, number_fmt_t fmt, gerbv_omit_zeros_t omit_zeros, in
         if (read == ',')
             read = '.'; /* adjust for strtod() */
 
-        if (isdigit(read))
+        if (DRILL_CHAR_IS(read, DRILL_CHAR_DIGIT))
             ndigits++;
 
         if (read == '-' || read == '+')
             sign_prepend = TRUE;
 
         temp[i++] = (char)read;
-        read      = gerb_fgetc(fd);
+        read      = drill_reader_getc(&reader);
     }
 
     temp[i] = 0;
+    drill_reader_done(&reader);
     gerb_ungetc(fd);
 
     if (decimal_point) {
@@ -1931,11 +1995,14 @@ read_double(gerb_file_t* fd, number_fmt_t fmt, gerbv_omit_zeros_t omit_zeros, in
    the first one of CR or LF */
 static void
 eat_line(gerb_file_t* fd) {
-    int read;
+    drill_reader_t reader;
+    int            read;
 
+    drill_reader_init(&reader, fd);
     do {
-        read = gerb_fgetc(fd);
-    } while (read != '\n' && read != '\r' && read != EOF);
+        read = drill_reader_getc(&reader);
+    } while (read != EOF && !DRILL_CHAR_IS(read, DRILL_CHAR_EOL));
+    drill_reader_done(&reader);
 
     /* Restore new line character for processing */
     if (read != EOF)
@@ -1946,11 +2013,14 @@ eat_line(gerb_file_t* fd) {
 /* Eats all tabs and spaces. */
 static void
 eat_whitespace(gerb_file_t* fd) {
-    int read;
+    drill_reader_t reader;
+    int            read;
 
+    drill_reader_init(&reader, fd);
     do {
-        read = gerb_fgetc(fd);
-    } while ((read == ' ' || read == '\t') && read != EOF);
+        read = drill_reader_getc(&reader);
+    } while (read != EOF && DRILL_CHAR_IS(read, DRILL_CHAR_BLANK));
+    drill_reader_done(&reader);
 
     /* Restore the non-whitespace character for processing */
     if (read != EOF)
@@ -1960,28 +2030,26 @@ eat_whitespace(gerb_file_t* fd) {
 /* -------------------------------------------------------------- */
 static char*
 get_line(gerb_file_t* fd) {
-    int    read;
-    gchar* retstring;
-    gchar* tmps = g_strdup("");
-
-    read = gerb_fgetc(fd);
-    while (read != '\n' && read != '\r' && read != EOF) {
-        retstring = g_strdup_printf("%s%c", tmps, read);
-
-        /* since g_strdup_printf allocates memory, we need to free it */
-        if (tmps) {
-            g_free(tmps);
-            tmps = NULL;
-        }
-        tmps = retstring;
-        read = gerb_fgetc(fd);
+    drill_reader_t reader;
+    int            read;
+    GString*       line = g_string_new(NULL);
+
+    drill_reader_init(&reader, fd);
+    read = drill_reader_getc(&reader);
+    while (read != EOF && !DRILL_CHAR_IS(read, DRILL_CHAR_EOL)) {
+        /* NUL characters can't be part of the returned string */
+        if (read != '\0')
+            g_string_append_c(line, (gchar)read);
+
+        read = drill_reader_getc(&reader);
     }
+    drill_reader_done(&reader);
 
     /* Restore new line character for processing */
     if (read != EOF)
         gerb_ungetc(fd);
 
-    return tmps;
+    return g_string_free(line, FALSE);
 } /* get_line */
 
 /* -------------------------------------------------------------- */
@@ -1992,7 +2060,31 @@ get_line(gerb_file_t* fd) {
  */
 static int
 file_check_str(gerb_file_t* fd, const char* str) {
-    char c;
+    const char* data;
+    goffset     left;
+    char        c;
+
+    /* compare in place when the file is in memory */
+    data = gerb_fbuffer(fd, &left);
+    if (data != NULL) {
+        goffset i;
+
+        for (i = 0; str[i] != '\0'; i++) {
+            if (i == left) {
+                fd->ptr += i;
+                return -1;
+            }
+            if (data[i] == (char)EOF) {
+                fd->ptr += i + 1;
+                return -1;
+            }
+            if (data[i] != str[i])
+                return 0;
+        }
+        fd->ptr += i;
+
+        return 1;
+    }
 
     for (int i = 0; str[i] != '\0'; i++) {
 
@@ -2014,6 +2106,123 @@ file_check_str(gerb_file_t* fd, const char* str) {
     return 1;
 }
 
+/* -------------------------------------------------------------- */
+/* Return the next line of fd like gerb_fgets() into buf of MAXL bytes
+ * would, up to MAXL - 1 characters and cut short at a NUL, with its
+ * length in len. Lines of files that are in memory aren't copied.
+ * Returns NULL at the end of the file. */
+static const char*
+drill_next_line(gerb_file_t* fd, char* buf, gsize* len) {
+    const char* data;
+    const char* end;
+    const char* nul;
+    goffset     left;
+    gsize       n;
+
+    data = gerb_fbuffer(fd, &left);
+    if (data == NULL) {
+        if (gerb_fgets(buf, MAXL, fd) == NULL)
+            return NULL;
+
+        *len = strlen(buf);
+        return buf;
+    }
+
+    if (left <= 0)
+        return NULL;
+
+    n   = (gsize)MIN(left, MAXL - 1);
+    end = memchr(data, '\n', n);
+    if (end != NULL)
+        n = end - data + 1;
+    fd->ptr += n;
+
+    nul  = memchr(data, '\0', n);
+    *len = nul != NULL ? (gsize)(nul - data) : n;
+
+    return data;
+} /* drill_next_line */
+
+/* -------------------------------------------------------------- */
+/* Look through line once for everything drill_file_p() checks */
+static void
+drill_scan_line(const char* line, gsize len, drill_line_marks_t* marks) {
+    gboolean seen_percent = FALSE, seen_T = FALSE, seen_X = FALSE, seen_Y = FALSE;
+    gsize    i;
+    char     next;
+
+    memset(marks, 0, sizeof(*marks));
+
+    for (i = 0; i < len; i++) {
+        guchar c = (guchar)line[i];
+
+        if (c >= 0x80) {
+            marks->binary = TRUE;
+            continue;
+        }
+        if (!DRILL_CHAR_IS(c, DRILL_CHAR_MARK))
+            continue;
+
+        /* line isn't NUL terminated if it points into the file */
+        next = i + 1 < len ? line[i + 1] : '\0';
+
+        switch (c) {
+            case ';': marks->comment = TRUE; break;
+            case 'M':
+                if (next == '4' && i + 2 < len && line[i + 2] == '8')
+                    marks->M48 = TRUE;
+                else if (next == '3' && i + 2 < len && line[i + 2] == '0')
+                    marks->M30 = TRUE;
+                break;
+            case '%':
+                if (!seen_percent)
+                    marks->percent = next == '\r' || next == '\n';
+                seen_percent = TRUE;
+                break;
+            case 'T':
+                if (!seen_T)
+                    marks->T = DRILL_CHAR_IS(next, DRILL_CHAR_DIGIT);
+                seen_T = TRUE;
+                break;
+            case 'X':
+                if (!seen_X)
+                    marks->X = DRILL_CHAR_IS(next, DRILL_CHAR_DIGIT);
+                seen_X = TRUE;
+                break;
+            case 'Y':
+                if (!seen_Y)
+                    marks->Y = DRILL_CHAR_IS(next, DRILL_CHAR_DIGIT);
+                seen_Y = TRUE;
+                break;
+        }
+    }
+} /* drill_scan_line */
+
+/* -------------------------------------------------------------- */
+/* Tell which header command, if any, starts at the current position of fd
+ * without reading it. Returns DRILL_KEYWORD_UNKNOWN when the
+ * drill_parse_header_is_*() functions have to look for themselves, as they
+ * report running into the end of the file. */
+static drill_keyword_t
+drill_header_keyword(gerb_file_t* fd) {
+    const char* data;
+    goffset     left;
+    gsize       i;
+
+    data = gerb_fbuffer(fd, &left);
+    if (data == NULL || left < DRILL_KEYWORD_MAX_LEN || memchr(data, (char)EOF, DRILL_KEYWORD_MAX_LEN) != NULL)
+        return DRILL_KEYWORD_UNKNOWN;
+
+    for (i = 0; i < G_N_ELEMENTS(drill_header_keywords); i++) {
+        const char* name = drill_header_keywords[i].name;
+
+        if (strncmp(data, name, strlen(name)) == 0)
+            return drill_header_keywords[i].keyword;
+    }
+
+    return DRILL_KEYWORD_NONE;
+} /* drill_header_keyword */
+
 /* -------------------------------------------------------------- */
 /** Return drill G-code name by code number. */
 const char*
@@ -29,9 +29,11 @@
 #include "gerbv.h"
 
 #include <math.h>
-#include <glib/gstdio.h>
 
 #include "common.h"
+#include "gerb_image.h"
+#include "export-drill.h"
+#include "export-writer.h"
 
 #define dprintf \
     if (DEBUG)  \
@@ -39,43 +41,209 @@
 
 #define round(x) floor(x + 0.5)
 
+/* the number of cells along each side of the grid the Hilbert curve is drawn on */
+#define HILBERT_GRID_SIZE 65536
+
+GArray**
+export_drill_bucket_hits(gerbv_export_iter_t* iter, GArray* apertureTable) {
+    GArray**     buckets  = g_new(GArray*, apertureTable->len);
+    gint*        bucketOf = g_new(gint, APERTURE_MAX);
+    gerbv_net_t* net;
+    guint        i, netIndex;
+
+    for (i = 0; i < APERTURE_MAX; i++)
+        bucketOf[i] = -1;
+
+    for (i = 0; i < apertureTable->len; i++) {
+        buckets[i]                                     = g_array_new(FALSE, FALSE, sizeof(export_drill_hit_t));
+        bucketOf[g_array_index(apertureTable, int, i)] = i;
+    }
+
+    gerbv_image_export_iter_rewind(iter);
+    for (netIndex = 0; (net = gerbv_image_export_iter_next(iter)) != NULL; netIndex++) {
+        export_drill_hit_t hit;
+
+        if (net->aperture < 0 || net->aperture >= APERTURE_MAX || bucketOf[net->aperture] < 0)
+            continue;
+
+        hit.start_x        = net->start_x;
+        hit.start_y        = net->start_y;
+        hit.stop_x         = net->stop_x;
+        hit.stop_y         = net->stop_y;
+        hit.aperture_state = net->aperture_state;
+        hit.interpolation  = net->interpolation;
+        hit.index          = netIndex;
+        hit.key            = 0;
+        g_array_append_val(buckets[bucketOf[net->aperture]], hit);
+    }
+
+    g_free(bucketOf);
+    return buckets;
+}
+
+void
+export_drill_free_buckets(GArray** buckets, guint nBuckets) {
+    for (guint i = 0; i < nBuckets; i++)
+        g_array_free(buckets[i], TRUE);
+    g_free(buckets);
+}
+
+/* Return where the drill enters the board for hit. Slots are cut from start to stop */
+static void
+export_drill_hit_entry(const export_drill_hit_t* hit, gdouble* x, gdouble* y) {
+    if (hit->aperture_state == GERBV_APERTURE_STATE_ON) {
+        *x = hit->start_x;
+        *y = hit->start_y;
+    } else {
+        *x = hit->stop_x;
+        *y = hit->stop_y;
+    }
+}
+
+/* Return the distance from the start of a Hilbert curve filling the grid to cell x,y */
+static guint32
+export_drill_hilbert_key(guint32 x, guint32 y) {
+    guint32 d = 0, s, rx, ry, t;
+
+    for (s = HILBERT_GRID_SIZE / 2; s > 0; s /= 2) {
+        rx = (x & s) > 0;
+        ry = (y & s) > 0;
+        d += s * s * ((3 * rx) ^ ry);
+
+        /* rotate the quadrant, so the curve continues where it left off */
+        if (ry == 0) {
+            if (rx == 1) {
+                x = HILBERT_GRID_SIZE - 1 - x;
+                y = HILBERT_GRID_SIZE - 1 - y;
+            }
+            t = x;
+            x = y;
+            y = t;
+        }
+    }
+
+    return d;
+}
+
+static gint
+export_drill_compare_hits(gconstpointer a, gconstpointer b) {
+    const export_drill_hit_t* hitA = a;
+    const export_drill_hit_t* hitB = b;
+
+    if (hitA->key != hitB->key)
+        return (hitA->key < hitB->key) ? -1 : 1;
+
+    /* keep the order of the image for hits in the same cell */
+    return (hitA->index > hitB->index) - (hitA->index < hitB->index);
+}
+
+/* Sort the hits of each tool in the requested order */
+static void
+export_drill_order_hits(GArray** buckets, guint nBuckets, gerbv_drill_order_t order) {
+    gdouble minX = HUGE_VAL, minY = HUGE_VAL, maxX = -HUGE_VAL, maxY = -HUGE_VAL, scale, x, y;
+    guint   i, j;
+
+    if (order != GERBV_DRILL_ORDER_HILBERT)
+        return;
+
+    /* draw the curve over all hits, so every tool is drilled in the same sweep */
+    for (i = 0; i < nBuckets; i++) {
+        for (j = 0; j < buckets[i]->len; j++) {
+            export_drill_hit_entry(&g_array_index(buckets[i], export_drill_hit_t, j), &x, &y);
+            minX = MIN(minX, x);
+            minY = MIN(minY, y);
+            maxX = MAX(maxX, x);
+            maxY = MAX(maxY, y);
+        }
+    }
+
+    /* keep the aspect ratio, so the curve doesn't favour one axis */
+    scale = MAX(maxX - minX, maxY - minY);
+    if (!isfinite(scale))
+        return;
+    scale = (scale > 0) ? (HILBERT_GRID_SIZE - 1) / scale : 0;
+
+    for (i = 0; i < nBuckets; i++) {
+        for (j = 0; j < buckets[i]->len; j++) {
+            export_drill_hit_t* hit = &g_array_index(buckets[i], export_drill_hit_t, j);
+
+            export_drill_hit_entry(hit, &x, &y);
+            hit->key = export_drill_hilbert_key((guint32)((x - minX) * scale), (guint32)((y - minY) * scale));
+        }
+        g_array_sort(buckets[i], export_drill_compare_hits);
+    }
+}
+
+/* Return the distance the drill moves between the hits that are written, in
+   the order they are written */
+static gdouble
+export_drill_travel(GArray** buckets, guint nBuckets) {
+    gdouble  travel = 0, lastX = 0, lastY = 0, x, y;
+    gboolean first  = TRUE;
+
+    for (guint i = 0; i < nBuckets; i++) {
+        for (guint j = 0; j < buckets[i]->len; j++) {
+            const export_drill_hit_t* hit = &g_array_index(buckets[i], export_drill_hit_t, j);
+
+            if (hit->aperture_state != GERBV_APERTURE_STATE_FLASH && hit->aperture_state != GERBV_APERTURE_STATE_ON)
+                continue;
+
+            export_drill_hit_entry(hit, &x, &y);
+            if (!first)
+                travel += hypot(x - lastX, y - lastY);
+
+            first = FALSE;
+            lastX = hit->stop_x;
+            lastY = hit->stop_y;
+        }
+    }
+
+    return travel;
+}
+
 gboolean
 gerbv_export_drill_file_from_image(
     const gchar* filename, gerbv_image_t* inputImage, gerbv_user_transformation_t* transform
 ) {
-    FILE*        fd;
-    GArray*      apertureTable = g_array_new(FALSE, FALSE, sizeof(int));
-    gerbv_net_t* net;
+    return gerbv_export_drill_file_from_image_ordered(filename, inputImage, transform, GERBV_DRILL_ORDER_FILE, NULL);
+}
 
-    /* force gerbv to output decimals as dots (not commas for other locales) */
-    setlocale(LC_NUMERIC, "C");
+gboolean
+gerbv_export_drill_file_from_image_ordered(
+    const gchar* filename, gerbv_image_t* inputImage, gerbv_user_transformation_t* transform,
+    gerbv_drill_order_t order, gdouble* travel
+) {
+    export_writer_t*    fd;
+    GArray*             apertureTable = g_array_new(FALSE, FALSE, sizeof(int));
+    GArray**            buckets;
+    gerbv_export_iter_t iter;
 
-    if ((fd = g_fopen(filename, "w")) == NULL) {
+    if ((fd = export_writer_open(filename)) == NULL) {
         GERB_COMPILE_ERROR(_("Can't open file for writing: %s"), filename);
         return FALSE;
     }
 
-    /* duplicate the image, cleaning it in the process */
-    gerbv_image_t* image = gerbv_image_duplicate_image(inputImage, transform);
+    /* stream the transformed image, without duplicating it */
+    gerbv_image_export_iter_init(&iter, inputImage, transform);
 
     /* write header info */
-    fprintf(fd, "M48\n");
-    fprintf(fd, "INCH,TZ\n");
+    export_writer_printf(fd, "M48\n");
+    export_writer_printf(fd, "INCH,TZ\n");
 
     /* define all apertures */
     gerbv_aperture_t* aperture;
 
-    /* the image should already have been cleaned by a duplicate_image call, so we can safely
+    /* the apertures have been renumbered by the export iterator, so we can safely
        assume the aperture range is correct */
     for (int i = APERTURE_MIN; i < APERTURE_MAX; i++) {
-        aperture = image->aperture[i];
+        aperture = iter.aperture[i];
 
         if (!aperture)
             continue;
 
         switch (aperture->type) {
             case GERBV_APTYPE_CIRCLE:
-                fprintf(fd, "T%dC%1.3f\n", i, aperture->parameter[0]);
+                export_writer_printf(fd, "T%dC%1.3f\n", i, aperture->parameter[0]);
                 /* add the "approved" aperture to our valid list */
                 g_array_append_val(apertureTable, i);
                 break;
@@ -83,45 +251,47 @@ gerbv_export_drill_file_from_image(
         }
     }
 
-    fprintf(fd, "%%\n");
-    /* write rest of image */
+    export_writer_printf(fd, "%%\n");
+    /* write rest of image, collecting the holes of all tools in one pass */
+    buckets = export_drill_bucket_hits(&iter, apertureTable);
+    export_drill_order_hits(buckets, apertureTable->len, order);
 
     for (guint i = 0; i < apertureTable->len; i++) {
         int aperture_idx = g_array_index(apertureTable, int, i);
 
         /* write tool change */
-        fprintf(fd, "T%d\n", aperture_idx);
+        export_writer_printf(fd, "T%d\n", aperture_idx);
 
-        /* run through all nets and look for drills using this aperture */
-        for (net = image->netlist; net; net = net->next) {
-            if (net->aperture != aperture_idx)
-                continue;
+        for (guint j = 0; j < buckets[i]->len; j++) {
+            const export_drill_hit_t* hit = &g_array_index(buckets[i], export_drill_hit_t, j);
 
-            switch (net->aperture_state) {
+            switch (hit->aperture_state) {
                 case GERBV_APERTURE_STATE_FLASH:
-                    fprintf(
-                        fd, "X%06ldY%06ld\n", (long)round(net->stop_x * 10000.0), (long)round(net->stop_y * 10000.0)
+                    export_writer_printf(
+                        fd, "X%06ldY%06ld\n", (long)round(hit->stop_x * 10000.0), (long)round(hit->stop_y * 10000.0)
                     );
                     break;
                 case GERBV_APERTURE_STATE_ON: /* Cut slot */
-                    fprintf(
-                        fd, "X%06ldY%06ldG85X%06ldY%06ld\n", (long)round(net->start_x * 10000.0),
-                        (long)round(net->start_y * 10000.0), (long)round(net->stop_x * 10000.0),
-                        (long)round(net->stop_y * 10000.0)
+                    export_writer_printf(
+                        fd, "X%06ldY%06ldG85X%06ldY%06ld\n", (long)round(hit->start_x * 10000.0),
+                        (long)round(hit->start_y * 10000.0), (long)round(hit->stop_x * 10000.0),
+                        (long)round(hit->stop_y * 10000.0)
                     );
                     break;
                 default: break;
             }
         }
     }
+
+    if (travel)
+        *travel = export_drill_travel(buckets, apertureTable->len);
+
+    export_drill_free_buckets(buckets, apertureTable->len);
     g_array_free(apertureTable, TRUE);
 
     /* write footer */
-    fprintf(fd, "M30\n\n");
-    gerbv_destroy_image(image);
-    fclose(fd);
+    export_writer_printf(fd, "M30\n\n");
+    gerbv_image_export_iter_clear(&iter);
 
-    /* return to the default locale */
-    setlocale(LC_NUMERIC, "");
-    return TRUE;
+    return export_writer_close(fd);
 }
@@ -0,0 +1,57 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file export-drill.h
+    \brief Header info shared by the drill file exporters
+    \ingroup libgerbv
+*/
+
+#ifndef EXPORT_DRILL_H
+#define EXPORT_DRILL_H
+
+#include "gerb_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! A flash or slot of one tool, as collected by export_drill_bucket_hits() */
+typedef struct {
+    gdouble                start_x;
+    gdouble                start_y;
+    gdouble                stop_x;
+    gdouble                stop_y;
+    gerbv_aperture_state_t aperture_state;
+    gerbv_interpolation_t  interpolation;
+    guint                  index; /*!< the position of the net in the image */
+    guint32                key;   /*!< the position of the hit along the drill order */
+} export_drill_hit_t;
+
+/* Return an array of export_drill_hit_t for each tool in apertureTable, in
+ * the same order, holding all nets using that tool. The nets are read in a
+ * single pass. Free the result with export_drill_free_buckets(). */
+GArray** export_drill_bucket_hits(gerbv_export_iter_t* iter, GArray* apertureTable);
+
+void export_drill_free_buckets(GArray** buckets, guint nBuckets);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EXPORT_DRILL_H */
@@ -34,6 +34,7 @@
 #include <dxflib/dl_dxf.h>
 
 #include "common.h"
+#include "gerb_image.h"
 
 /* dxflib version difference */
 #ifndef DL_STRGRP_END
@@ -72,18 +73,196 @@ enum insunits {
     /* ... and more ... */
 };
 
+typedef struct {
+    double x, y;
+    double bulge; /* of the segment from this vertex to the next */
+} dxf_vertex_t;
+
+/* Return the name of the block of aperture number */
+static std::string
+dxf_block_name(int number) {
+    char name[16];
+
+    snprintf(name, sizeof(name), "D%d", number);
+
+    return name;
+}
+
+/* Return TRUE if apert can be written as a block */
+static gboolean
+dxf_aperture_supported(const gerbv_aperture_t* apert) {
+    switch (apert->type) {
+        case GERBV_APTYPE_CIRCLE:
+        case GERBV_APTYPE_RECTANGLE:
+        case GERBV_APTYPE_OVAL: return TRUE;
+        case GERBV_APTYPE_POLYGON: return apert->parameter[1] >= 3;
+        default: return FALSE;
+    }
+}
+
+/* Write the outline of apert, centered at the block origin */
+static void
+dxf_write_aperture_block(DL_Dxf* dxf, DL_WriterA* dw, DL_Attributes* attr, int number, const gerbv_aperture_t* apert) {
+    double      x[4], y[4], r, dx, dy;
+    int         i, n;
+    std::string name = dxf_block_name(number);
+
+    dxf->writeBlock(*dw, DL_BlockData(name, 0, 0.0, 0.0, 0.0));
+
+    switch (apert->type) {
+        case GERBV_APTYPE_CIRCLE:
+            r = apert->parameter[0] / 2;
+            dxf->writeCircle(*dw, DL_CircleData(0.0, 0.0, 0.0, r), *attr);
+            break;
+        case GERBV_APTYPE_RECTANGLE:
+            x[0] = apert->parameter[0] / 2;
+            y[0] = apert->parameter[1] / 2;
+            x[1] = x[0];
+            y[1] = y[0] - apert->parameter[1];
+            x[2] = x[1] - apert->parameter[0];
+            y[2] = y[1];
+            x[3] = x[2];
+            y[3] = y[0];
+            dxf->writePolyline(*dw, DL_PolylineData(4, 0, 0, DL_CLOSED_PLINE), *attr);
+            for (i = 0; i < 4; i++)
+                dxf->writeVertex(*dw, DL_VertexData(x[i], y[i], 0, 0));
+            dxf->writePolylineEnd(*dw);
+            break;
+        case GERBV_APTYPE_OVAL:
+            if (apert->parameter[0] > apert->parameter[1]) {
+                /* Horizontal oval */
+                r  = apert->parameter[1] / 2;
+                dx = apert->parameter[0] / 2 - r;
+
+                x[0] = -dx;
+                y[0] = r;
+                x[1] = dx;
+                y[1] = y[0];
+                x[2] = x[1];
+                y[2] = -r;
+                x[3] = x[0];
+                y[3] = y[2];
+            } else {
+                /* Vertical oval */
+                r  = apert->parameter[0] / 2;
+                dy = apert->parameter[1] / 2 - r;
+
+                x[0] = -r;
+                y[0] = -dy;
+                x[1] = x[0];
+                y[1] = dy;
+                x[2] = r;
+                y[2] = y[1];
+                x[3] = x[2];
+                y[3] = y[0];
+            }
+
+            dxf->writePolyline(*dw, DL_PolylineData(4, 0, 0, DL_CLOSED_PLINE), *attr);
+            dxf->writeVertex(*dw, DL_VertexData(x[3], y[3], 0, -1));
+            dxf->writeVertex(*dw, DL_VertexData(x[0], y[0], 0, 0));
+            dxf->writeVertex(*dw, DL_VertexData(x[1], y[1], 0, -1));
+            dxf->writeVertex(*dw, DL_VertexData(x[2], y[2], 0, 0));
+            dxf->writePolylineEnd(*dw);
+            break;
+        case GERBV_APTYPE_POLYGON:
+            n = (int)apert->parameter[1];
+            r = apert->parameter[0] / 2;
+            dxf->writePolyline(*dw, DL_PolylineData(n, 0, 0, DL_CLOSED_PLINE), *attr);
+            for (i = 0; i < n; i++) {
+                double angle = DEG2RAD(apert->parameter[2]) + i * 2 * M_PI / n;
+
+                dxf->writeVertex(*dw, DL_VertexData(r * cos(angle), r * sin(angle), 0, 0));
+            }
+            dxf->writePolylineEnd(*dw);
+            break;
+        default: break;
+    }
+
+    dxf->writeEndBlock(*dw, name);
+}
+
+/* Add the segment of net to vertices, which already end at its start. Arcs
+   become bulges, split in two when they are more than a half circle. */
+static void
+dxf_append_segment(GArray* vertices, const gerbv_net_t* net) {
+    const gerbv_cirseg_t* cirseg = net->cirseg;
+    dxf_vertex_t          v;
+    double                sweep, angle, r;
+
+    if ((net->interpolation == GERBV_INTERPOLATION_CW_CIRCULAR
+         || net->interpolation == GERBV_INTERPOLATION_CCW_CIRCULAR)
+        && cirseg != NULL && cirseg->width == cirseg->height) {
+        sweep = DEG2RAD(cirseg->angle2 - cirseg->angle1);
+
+        if (fabs(sweep) > M_PI) {
+            angle = DEG2RAD(cirseg->angle1) + sweep / 2;
+            r     = cirseg->width / 2;
+
+            g_array_index(vertices, dxf_vertex_t, vertices->len - 1).bulge = tan(sweep / 8);
+            v.x     = cirseg->cp_x + r * cos(angle);
+            v.y     = cirseg->cp_y + r * sin(angle);
+            v.bulge = tan(sweep / 8);
+            g_array_append_val(vertices, v);
+        } else {
+            g_array_index(vertices, dxf_vertex_t, vertices->len - 1).bulge = tan(sweep / 4);
+        }
+    }
+
+    v.x     = net->stop_x;
+    v.y     = net->stop_y;
+    v.bulge = 0;
+    g_array_append_val(vertices, v);
+}
+
+/* Write vertices as one LWPOLYLINE, with a constant width unless it is 0,
+   and empty them */
+static void
+dxf_write_polyline(DL_Dxf* dxf, DL_WriterA* dw, DL_Attributes* attr, GArray* vertices, int flags, double width) {
+    dxf_vertex_t* first;
+    dxf_vertex_t* last;
+    unsigned int  i;
+
+    if (vertices->len < 2) {
+        g_array_set_size(vertices, 0);
+        return;
+    }
+
+    /* the closing vertex of a closed outline is implied */
+    first = &g_array_index(vertices, dxf_vertex_t, 0);
+    last  = &g_array_index(vertices, dxf_vertex_t, vertices->len - 1);
+    if ((flags & DL_CLOSED_PLINE) && vertices->len > 2 && fabs(first->x - last->x) < GERBV_PRECISION_LINEAR_INCH
+        && fabs(first->y - last->y) < GERBV_PRECISION_LINEAR_INCH)
+        g_array_set_size(vertices, vertices->len - 1);
+
+    dxf->writePolyline(*dw, DL_PolylineData(vertices->len, 0, 0, flags), *attr);
+    if (width > 0)
+        dw->dxfReal(43, width); /* Constant width */
+
+    for (i = 0; i < vertices->len; i++) {
+        dxf_vertex_t* v = &g_array_index(vertices, dxf_vertex_t, i);
+
+        dxf->writeVertex(*dw, DL_VertexData(COORD2INS(v->x), COORD2INS(v->y), 0, v->bulge));
+    }
+
+    dxf->writePolylineEnd(*dw);
+    g_array_set_size(vertices, 0);
+}
+
 extern "C" {
 gboolean
 gerbv_export_dxf_file_from_image(const gchar* file_name, gerbv_image_t* input_img, gerbv_user_transformation_t* trans) {
     DL_Codes::version exportVersion = DL_Codes::AC1015;
     DL_Dxf*           dxf           = new DL_Dxf();
     DL_WriterA*       dw;
-    gerbv_aperture_t* apert;
-    gerbv_image_t*    img;
-    gerbv_net_t*      net;
-    GArray*           apert_tab;
-    double            x[4], y[4], r, dx, dy, nom;
-    unsigned int      i;
+    gerbv_aperture_t*   apert;
+    gerbv_export_iter_t iter;
+    gerbv_net_t*        net;
+    GArray*             trace;
+    GArray*             outline;
+    gint*               block;
+    double              traceWidth = 0;
+    dxf_vertex_t        v;
+    int                 i, traceAperture = -1;
 
     dw = dxf->out(file_name, exportVersion);
 
@@ -92,11 +271,28 @@ gerbv_export_dxf_file_from_image(const gchar* file_name, gerbv_image_t* input_im
         return FALSE;
     }
 
-    /* Output decimals as dots for all locales */
-    setlocale(LC_NUMERIC, "C");
-
-    /* Duplicate the image, cleaning it in the process */
-    img = gerbv_image_duplicate_image(input_img, trans);
+    /* Stream the nets with trans applied, instead of duplicating the image */
+    gerbv_image_export_iter_init(&iter, input_img, trans);
+
+    /* Each flashed aperture becomes a block, the flashes insert it.
+       block is 1 for those, and -1 for the ones that can't be written. */
+    block = g_new0(gint, APERTURE_MAX);
+    while ((net = gerbv_image_export_iter_next(&iter)) != NULL) {
+        apert = iter.aperture[net->aperture];
+        if (net->aperture_state == GERBV_APERTURE_STATE_FLASH && apert && block[net->aperture] == 0) {
+            block[net->aperture] = 1;
+            if (!dxf_aperture_supported(apert)) {
+                /* TODO: other GERBV_APTYPE_ */
+                GERB_COMPILE_WARNING(
+                    "%s:%d: aperture type %d is "
+                    "not yet supported",
+                    __func__, __LINE__, apert->type
+                );
+                block[net->aperture] = -1;
+            }
+        }
+    }
+    gerbv_image_export_iter_rewind(&iter);
 
     dxf->writeHeader(*dw);
 
@@ -168,10 +364,16 @@ gerbv_export_dxf_file_from_image(const gchar* file_name, gerbv_image_t* input_im
     dw->dxfString(2, "ACAD");
     dw->dxfInt(DL_ATTFLAGS_CODE, 0);
     dw->tableEnd();
-    dw->sectionEnd();
 
-    /* All entities */
-    dw->sectionEntities();
+    /* Block records, the model and paper space ones first */
+    dxf->writeBlockRecord(*dw);
+    for (i = 0; i < APERTURE_MAX; i++) {
+        if (block[i] > 0)
+            dxf->writeBlockRecord(*dw, dxf_block_name(i));
+    }
+    dw->tableEnd();
+
+    dw->sectionEnd();
 
 #if (DL_VERSION_MAJOR == 3)
     DL_Attributes* attr = new DL_Attributes("0", 0, -1, "ByLayer", 1.0);
@@ -179,129 +381,100 @@ gerbv_export_dxf_file_from_image(const gchar* file_name, gerbv_image_t* input_im
     DL_Attributes* attr = new DL_Attributes("0", 0, -1, "ByLayer");
 #endif
 
-    for (net = img->netlist; net != NULL; net = net->next) {
-        apert = img->aperture[net->aperture];
-        if (!apert)
-            continue;
+    /* Blocks */
+    dw->sectionBlocks();
+    dxf->writeBlock(*dw, DL_BlockData("*Model_Space", 0, 0.0, 0.0, 0.0));
+    dxf->writeEndBlock(*dw, "*Model_Space");
+    dxf->writeBlock(*dw, DL_BlockData("*Paper_Space", 0, 0.0, 0.0, 0.0));
+    dxf->writeEndBlock(*dw, "*Paper_Space");
+    dxf->writeBlock(*dw, DL_BlockData("*Paper_Space0", 0, 0.0, 0.0, 0.0));
+    dxf->writeEndBlock(*dw, "*Paper_Space0");
+    for (i = 0; i < APERTURE_MAX; i++) {
+        if (block[i] > 0)
+            dxf_write_aperture_block(dxf, dw, attr, i, iter.aperture[i]);
+    }
+    dw->sectionEnd();
 
-        if (net->interpolation == GERBV_INTERPOLATION_PAREA_START) {
-            dxf->writePolyline(*dw, DL_PolylineData(1, 0, 0, DL_CLOSED_PLINE), *attr);
+    /* All entities */
+    dw->sectionEntities();
+
+    trace   = g_array_new(FALSE, FALSE, sizeof(dxf_vertex_t));
+    outline = g_array_new(FALSE, FALSE, sizeof(dxf_vertex_t));
 
-            net = net->next;
+    while ((net = gerbv_image_export_iter_next(&iter)) != NULL) {
+        apert = iter.aperture[net->aperture];
+        if (!apert && net->interpolation != GERBV_INTERPOLATION_PAREA_START)
+            continue;
 
-            while (net != NULL && net->interpolation != GERBV_INTERPOLATION_PAREA_END) {
+        if (net->interpolation == GERBV_INTERPOLATION_PAREA_START) {
+            while ((net = gerbv_image_export_iter_next(&iter)) != NULL
+                && net->interpolation != GERBV_INTERPOLATION_PAREA_END) {
                 if (net->aperture_state == GERBV_APERTURE_STATE_ON) {
-                    dxf->writeVertex(*dw, DL_VertexData(COORD2INS(net->stop_x), COORD2INS(net->stop_y), 0, 0));
+                    if (outline->len == 0) {
+                        v.x     = net->start_x;
+                        v.y     = net->start_y;
+                        v.bulge = 0;
+                        g_array_append_val(outline, v);
+                    }
+                    dxf_append_segment(outline, net);
                 }
-                net = net->next;
             }
 
-            dxf->writePolylineEnd(*dw);
+            dxf_write_polyline(dxf, dw, attr, outline, DL_CLOSED_PLINE, 0);
 
+            if (net == NULL)
+                break;
             continue;
         }
 
         switch (net->aperture_state) {
             case GERBV_APERTURE_STATE_FLASH:
-                switch (apert->type) {
-                    case GERBV_APTYPE_CIRCLE:
-                        x[0] = net->stop_x;
-                        y[0] = net->stop_y;
-                        r    = apert->parameter[0] / 2;
-                        dxf->writeCircle(*dw, DL_CircleData(x[0], y[0], 0.0, r), *attr);
-                        break;
-                    case GERBV_APTYPE_RECTANGLE:
-                        x[0] = net->stop_x + apert->parameter[0] / 2;
-                        y[0] = net->stop_y + apert->parameter[1] / 2;
-                        x[1] = x[0];
-                        y[1] = y[0] - apert->parameter[1];
-                        x[2] = x[1] - apert->parameter[0];
-                        y[2] = y[1];
-                        x[3] = x[2];
-                        y[3] = y[0];
-                        dxf->writePolyline(*dw, DL_PolylineData(4, 0, 0, DL_CLOSED_PLINE), *attr);
-                        for (i = 0; i < 4; i++)
-                            dxf->writeVertex(*dw, DL_VertexData(x[i], y[i], 0, 0));
-                        dxf->writePolylineEnd(*dw);
-                        break;
-                    case GERBV_APTYPE_OVAL:
-                        if (apert->parameter[0] > apert->parameter[1]) {
-                            /* Horizontal oval */
-                            r  = apert->parameter[1] / 2;
-                            dx = apert->parameter[0] / 2 - r;
-
-                            x[0] = net->stop_x - dx;
-                            y[0] = net->stop_y + r;
-                            x[1] = net->stop_x + dx;
-                            y[1] = y[0];
-                            x[2] = x[1];
-                            y[2] = net->stop_y - r;
-                            x[3] = x[0];
-                            y[3] = y[2];
-                        } else {
-                            /* Vertical oval */
-                            r  = apert->parameter[0] / 2;
-                            dy = apert->parameter[1] / 2 - r;
-
-                            x[0] = net->stop_x - r;
-                            y[0] = net->stop_y - dy;
-                            x[1] = x[0];
-                            y[1] = net->stop_y + dy;
-                            x[2] = net->stop_x + r;
-                            y[2] = y[1];
-                            x[3] = x[2];
-                            y[3] = y[0];
-                        }
-
-                        dxf->writePolyline(*dw, DL_PolylineData(4, 0, 0, DL_CLOSED_PLINE), *attr);
-                        dxf->writeVertex(*dw, DL_VertexData(x[3], y[3], 0, -1));
-                        dxf->writeVertex(*dw, DL_VertexData(x[0], y[0], 0, 0));
-                        dxf->writeVertex(*dw, DL_VertexData(x[1], y[1], 0, -1));
-                        dxf->writeVertex(*dw, DL_VertexData(x[2], y[2], 0, 0));
-
-                        dxf->writePolylineEnd(*dw);
-                        break;
-                    case GERBV_APTYPE_MACRO:
-                    default:
-                        /* TODO: other GERBV_APTYPE_ */
-                        GERB_COMPILE_WARNING(
-                            "%s:%d: aperture type %d is "
-                            "not yet supported",
-                            __func__, __LINE__, apert->type
-                        );
-                        break;
-                }
+                if (block[net->aperture] > 0)
+                    dxf->writeInsert(
+                        *dw,
+                        DL_InsertData(
+                            dxf_block_name(net->aperture), COORD2INS(net->stop_x), COORD2INS(net->stop_y), 0, 1, 1,
+                            1, 0, 1, 1, 0, 0
+                        ),
+                        *attr
+                    );
                 break;
             case GERBV_APERTURE_STATE_ON:
                 /* Line or cut slot in drill file */
                 switch (apert->type) {
                     case GERBV_APTYPE_CIRCLE:
-                        /* Calculate perpendicular vector */
-                        dx  = net->stop_x - net->start_x;
-                        dy  = net->stop_y - net->start_y;
-                        nom = apert->parameter[0] / (2 * sqrt(dx * dx + dy * dy));
-                        dx  = dx * nom;
-                        dy  = dy * nom;
-
-                        /* Line 1 of 2 */
-                        x[0] = net->stop_x + dy;
-                        y[0] = net->stop_y - dx;
-                        x[1] = net->start_x + dy;
-                        y[1] = net->start_y - dx;
-
-                        /* Line 2 of 2 */
-                        x[2] = net->start_x - dy;
-                        y[2] = net->start_y + dx;
-                        x[3] = net->stop_x - dy;
-                        y[3] = net->stop_y + dx;
-
-                        dxf->writePolyline(*dw, DL_PolylineData(4, 0, 0, DL_CLOSED_PLINE), *attr);
-                        dxf->writeVertex(*dw, DL_VertexData(x[3], y[3], 0, -1));
-                        dxf->writeVertex(*dw, DL_VertexData(x[0], y[0], 0, 0));
-                        dxf->writeVertex(*dw, DL_VertexData(x[1], y[1], 0, -1));
-                        dxf->writeVertex(*dw, DL_VertexData(x[2], y[2], 0, 0));
-
-                        dxf->writePolylineEnd(*dw);
+                        /* Connected segments of one aperture are a single polyline with its width */
+                        if (trace->len > 0
+                            && (traceAperture != net->aperture
+                                || fabs(g_array_index(trace, dxf_vertex_t, trace->len - 1).x - net->start_x)
+                                       >= GERBV_PRECISION_LINEAR_INCH
+                                || fabs(g_array_index(trace, dxf_vertex_t, trace->len - 1).y - net->start_y)
+                                       >= GERBV_PRECISION_LINEAR_INCH))
+                            dxf_write_polyline(dxf, dw, attr, trace, 0, traceWidth);
+
+                        if (net->cirseg == NULL && fabs(net->stop_x - net->start_x) < GERBV_PRECISION_LINEAR_INCH
+                            && fabs(net->stop_y - net->start_y) < GERBV_PRECISION_LINEAR_INCH) {
+                            /* A dot, unless it continues a polyline */
+                            if (trace->len == 0)
+                                dxf->writeCircle(
+                                    *dw,
+                                    DL_CircleData(
+                                        COORD2INS(net->stop_x), COORD2INS(net->stop_y), 0.0, apert->parameter[0] / 2
+                                    ),
+                                    *attr
+                                );
+                            break;
+                        }
+
+                        if (trace->len == 0) {
+                            v.x     = net->start_x;
+                            v.y     = net->start_y;
+                            v.bulge = 0;
+                            g_array_append_val(trace, v);
+                            traceAperture = net->aperture;
+                            traceWidth    = apert->parameter[0];
+                        }
+                        dxf_append_segment(trace, net);
                         break;
                     default:
                         GERB_COMPILE_WARNING(
@@ -316,7 +489,12 @@ gerbv_export_dxf_file_from_image(const gchar* file_name, gerbv_image_t* input_im
         }
     }
 
-    gerbv_destroy_image(img);
+    dxf_write_polyline(dxf, dw, attr, trace, 0, traceWidth);
+
+    g_array_free(trace, TRUE);
+    g_array_free(outline, TRUE);
+    g_free(block);
+    gerbv_image_export_iter_clear(&iter);
 
     dw->sectionEnd();
 
@@ -329,8 +507,6 @@ gerbv_export_dxf_file_from_image(const gchar* file_name, gerbv_image_t* input_im
     delete dw;
     delete dxf;
 
-    setlocale(LC_NUMERIC, ""); /* Return to the default locale */
-
     return TRUE;
 }
 } /* extern "C" */
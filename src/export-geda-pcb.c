@@ -26,15 +26,14 @@
 
 #include "gerbv.h"
 #include "common.h"
-
-#include <glib/gstdio.h>
+#include "export-writer.h"
 
 static void
-write_line(FILE* fd, gerbv_net_t* net, double thick, double dx_p, double dy_m, const char* sflags) {
+write_line(export_writer_t* fd, gerbv_net_t* net, double thick, double dx_p, double dy_m, const char* sflags) {
     dx_p = COORD2MILS(dx_p);
     dy_m = COORD2MILS(dy_m);
 
-    fprintf(
+    export_writer_printf(
         fd,
         "\tLine[%.2fmil %.2fmil %.2fmil %.2fmil "
         "%.2fmil %.2fmil \"%s\"]\n",
@@ -43,10 +42,14 @@ write_line(FILE* fd, gerbv_net_t* net, double thick, double dx_p, double dy_m, c
     );
 }
 
+/* element_num counts the pads of one file, so that several files can be
+ * exported at once */
 static void
-write_element_with_pad(FILE* fd, gerbv_net_t* net, double thick, double dx_p, double dy_m, const char* sflags) {
-    double              xc, yc;
-    static unsigned int element_num = 1;
+write_element_with_pad(
+    export_writer_t* fd, gerbv_net_t* net, double thick, double dx_p, double dy_m, const char* sflags,
+    unsigned int* element_num
+) {
+    double xc, yc;
 
     dx_p = COORD2MILS(dx_p);
     dy_m = COORD2MILS(dy_m);
@@ -54,13 +57,13 @@ write_element_with_pad(FILE* fd, gerbv_net_t* net, double thick, double dx_p, do
     xc = COORD2MILS(net->stop_x + net->start_x) / 2;
     yc = COORD2MILS(net->stop_y + net->start_y) / 2;
 
-    fprintf(
+    export_writer_printf(
         fd,
         "Element[\"\" \"\" \"pad%d\" \"\" "
         "%.2fmil %.2fmil 0mil 0mil 0 100 \"\"]\n(\n",
-        element_num++, dx_p + xc, dy_m - yc
+        (*element_num)++, dx_p + xc, dy_m - yc
     );
-    fprintf(
+    export_writer_printf(
         fd,
         "\tPad[%.2fmil %.2fmil %.2fmil %.2fmil "
         "%.2fmil 0mil %.2fmil "
@@ -75,17 +78,17 @@ write_element_with_pad(FILE* fd, gerbv_net_t* net, double thick, double dx_p, do
 }
 
 static void
-write_polygon(FILE* fd, gerbv_net_t* net, double dx_p, double dy_m, const char* sflags) {
+write_polygon(export_writer_t* fd, gerbv_net_t* net, double dx_p, double dy_m, const char* sflags) {
     dx_p = COORD2MILS(dx_p);
     dy_m = COORD2MILS(dy_m);
 
-    fprintf(fd, "\tPolygon(\"%s\")\n\t(", sflags);
+    export_writer_printf(fd, "\tPolygon(\"%s\")\n\t(", sflags);
     net = net->next;
 
     unsigned int i = 0;
     while (net != NULL && net->interpolation != GERBV_INTERPOLATION_PAREA_END) {
         if (net->aperture_state == GERBV_APERTURE_STATE_ON) {
-            fprintf(
+            export_writer_printf(
                 fd, "%s[%.2fmil %.2fmil] ", !(i % 5) ? "\n\t\t" : "", dx_p + COORD2MILS(net->stop_x),
                 dy_m - COORD2MILS(net->stop_y)
             );
@@ -94,7 +97,7 @@ write_polygon(FILE* fd, gerbv_net_t* net, double dx_p, double dy_m, const char*
         net = net->next;
     }
 
-    fprintf(fd, "\n\t)\n");
+    export_writer_printf(fd, "\n\t)\n");
 }
 
 gboolean
@@ -106,33 +109,31 @@ gerbv_export_geda_pcb_file_from_image(
     gerbv_net_t*      net;
     double            dx_p, dy_m;
     double            thick, len;
-    FILE*             fd;
+    unsigned int      element_num = 1;
+    export_writer_t*  fd;
 
-    if ((fd = g_fopen(file_name, "w")) == NULL) {
+    if ((fd = export_writer_open(file_name)) == NULL) {
         GERB_MESSAGE(_("Can't open file for writing: %s"), file_name);
         return FALSE;
     }
 
-    /* Output decimals as dots for all locales */
-    setlocale(LC_NUMERIC, "C");
-
     /* Duplicate the image, cleaning it in the process */
     img = gerbv_image_duplicate_image(input_img, trans);
 
     /* Header */
-    fputs("# Generated with gerbv\n\n", fd);
-    fputs("FileVersion[20091103]\n", fd);
+    export_writer_puts(fd, "# Generated with gerbv\n\n");
+    export_writer_puts(fd, "FileVersion[20091103]\n");
 
     dx_p = (img->info->max_x - img->info->min_x) - img->info->min_x;
     dy_m = 2 * (img->info->max_y - img->info->min_y) + img->info->min_y;
 
     /* Make board size is 3 times more than Gerber size */
-    fprintf(
+    export_writer_printf(
         fd, "PCB[\"%s\" %.2fmil %.2fmil]\n", img->info->name, 3 * COORD2MILS(img->info->max_x - img->info->min_x),
         3 * COORD2MILS(img->info->max_y - img->info->min_y)
     );
 
-    fputs("Grid[1000.000000 0.0000 0.0000 0]\n", fd);
+    export_writer_puts(fd, "Grid[1000.000000 0.0000 0.0000 0]\n");
 
     /* Write all apertures as elements with single pad, before layer
      * definition */
@@ -157,7 +158,7 @@ gerbv_export_geda_pcb_file_from_image(
                         /* Set start to stop coords for Circle flash */
                         net->start_x = net->stop_x;
                         net->start_y = net->stop_y;
-                        write_element_with_pad(fd, net, apert->parameter[0], dx_p, dy_m, "");
+                        write_element_with_pad(fd, net, apert->parameter[0], dx_p, dy_m, "", &element_num);
                         break;
                     case GERBV_APTYPE_OVAL:
                     case GERBV_APTYPE_RECTANGLE:
@@ -181,7 +182,8 @@ gerbv_export_geda_pcb_file_from_image(
                         }
 
                         write_element_with_pad(
-                            fd, net, thick, dx_p, dy_m, (apert->type == GERBV_APTYPE_RECTANGLE) ? "square" : ""
+                            fd, net, thick, dx_p, dy_m, (apert->type == GERBV_APTYPE_RECTANGLE) ? "square" : "",
+                            &element_num
                         );
                         break;
                     default:
@@ -209,7 +211,7 @@ gerbv_export_geda_pcb_file_from_image(
     }
 
     /* Write all lines in layer definition */
-    fputs("Layer(1 \"top\")\n(\n", fd);
+    export_writer_puts(fd, "Layer(1 \"top\")\n(\n");
 
     for (net = img->netlist; net != NULL; net = net->next) {
         apert = img->aperture[net->aperture];
@@ -254,15 +256,12 @@ gerbv_export_geda_pcb_file_from_image(
         }
     }
 
-    fputs(")\n", fd); /* End of Layer 1 */
+    export_writer_puts(fd, ")\n"); /* End of Layer 1 */
 
     /* Necessary layer */
-    fputs("Layer(7 \"outline\")\n(\n)\n", fd);
+    export_writer_puts(fd, "Layer(7 \"outline\")\n(\n)\n");
 
     gerbv_destroy_image(img);
-    fclose(fd);
-
-    setlocale(LC_NUMERIC, ""); /* Return to the default locale */
 
-    return TRUE;
+    return export_writer_close(fd);
 }
@@ -38,20 +38,79 @@
 #include "render.h"
 
 #include "draw.h"
+#include "composite.h"
 #include <cairo.h>
 #include <cairo-pdf.h>
 #include <cairo-ps.h>
 #include <cairo-svg.h>
 
-void
+/* Render the project to a vector surface writing filename, and return TRUE
+   if the surface wrote all of it */
+static gboolean
 exportimage_render_to_surface_and_destroy(
     gerbv_project_t* gerbvProject, cairo_surface_t* cSurface, gerbv_render_info_t* renderInfo, const gchar* filename
 ) {
     cairo_t* cairoTarget = cairo_create(cSurface);
+    gboolean ok;
 
     gerbv_render_all_layers_to_cairo_target_for_vector_output(gerbvProject, cairoTarget, renderInfo);
     cairo_destroy(cairoTarget);
+
+    /* the file is only completely written once the surface is finished */
+    cairo_surface_finish(cSurface);
+    ok = (cairo_surface_status(cSurface) == CAIRO_STATUS_SUCCESS);
+    if (!ok)
+        GERB_COMPILE_ERROR(_("Exporting error to file \"%s\""), filename);
+
     cairo_surface_destroy(cSurface);
+
+    return ok;
+}
+
+/* Render every visible layer and blend it onto cSurface with the fused
+   compositor, like gerbv_render_all_layers_to_cairo_target() does. The
+   layers are blended as soon as they are rendered, so a single scratch
+   surface is cleared and reused for all of them. */
+static void
+exportimage_composite_to_image_surface(
+    gerbv_project_t* gerbvProject, cairo_surface_t* cSurface, gerbv_render_info_t* renderInfo
+) {
+    gerbv_composite_layer_t layer;
+    cairo_surface_t*        layerSurface = NULL;
+    int                     i;
+
+    gerbv_composite_layers_to_surface(
+        cSurface,
+        gerbv_composite_pixel_from_color(
+            gerbvProject->background.red, gerbvProject->background.green, gerbvProject->background.blue
+        ),
+        NULL, 0
+    );
+
+    for (i = gerbvProject->last_loaded; i >= 0; i--) {
+        cairo_t* cr;
+
+        if (!gerbvProject->file[i] || !gerbvProject->file[i]->isVisible)
+            continue;
+
+        if (layerSurface == NULL) {
+            layerSurface =
+                cairo_image_surface_create(CAIRO_FORMAT_ARGB32, renderInfo->displayWidth, renderInfo->displayHeight);
+        }
+
+        cr = cairo_create(layerSurface);
+        cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+        cairo_paint(cr);
+        cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+        gerbv_render_layer_to_cairo_target(cr, gerbvProject->file[i], renderInfo);
+        cairo_destroy(cr);
+
+        gerbv_composite_layer_from_surface(&layer, layerSurface, gerbvProject->file[i]->alpha);
+        gerbv_composite_layers_over_surface(cSurface, &layer, 1);
+    }
+
+    if (layerSurface != NULL)
+        cairo_surface_destroy(layerSurface);
 }
 
 gerbv_render_info_t
@@ -73,7 +132,7 @@ gerbv_export_autoscale_project(gerbv_project_t* gerbvProject) {
     return renderInfo;
 }
 
-void
+gboolean
 gerbv_export_png_file_from_project_autoscaled(
     gerbv_project_t* gerbvProject, int widthInPixels, int heightInPixels, const gchar* filename
 ) {
@@ -82,63 +141,187 @@ gerbv_export_png_file_from_project_autoscaled(
     };
 
     gerbv_render_zoom_to_fit_display(gerbvProject, &renderInfo);
-    gerbv_export_png_file_from_project(gerbvProject, &renderInfo, filename);
+    return gerbv_export_png_file_from_project(gerbvProject, &renderInfo, filename);
 }
 
-void
+gboolean
 gerbv_export_png_file_from_project(
     gerbv_project_t* gerbvProject, gerbv_render_info_t* renderInfo, const gchar* filename
 ) {
+    gboolean         ok = TRUE;
     cairo_surface_t* cSurface =
         cairo_image_surface_create(CAIRO_FORMAT_ARGB32, renderInfo->displayWidth, renderInfo->displayHeight);
-    cairo_t* cairoTarget = cairo_create(cSurface);
-    gerbv_render_all_layers_to_cairo_target(gerbvProject, cairoTarget, renderInfo);
+    exportimage_composite_to_image_surface(gerbvProject, cSurface, renderInfo);
     if (CAIRO_STATUS_SUCCESS != cairo_surface_write_to_png(cSurface, filename)) {
         GERB_COMPILE_ERROR(_("Exporting error to file \"%s\""), filename);
+        ok = FALSE;
     }
-    cairo_destroy(cairoTarget);
     cairo_surface_destroy(cSurface);
+
+    return ok;
 }
 
-void
-gerbv_export_pdf_file_from_project_autoscaled(gerbv_project_t* gerbvProject, const gchar* filename) {
-    gerbv_render_info_t renderInfo = gerbv_export_autoscale_project(gerbvProject);
-    gerbv_export_pdf_file_from_project(gerbvProject, &renderInfo, filename);
+typedef struct {
+    gerbv_project_t*     project;
+    gerbv_render_info_t* renderInfo;
+    gchar**              filenames;
+    gint                 failed; /* set when a file couldn't be written */
+} exportimage_png_files_t;
+
+/* Write the PNG file of the layer numbered GPOINTER_TO_INT(data) - 1. The
+   layers are already spread over threads, so the layer is blended with
+   cairo rather than with the threaded compositor. */
+static void
+exportimage_png_layer_file(gpointer data, gpointer user_data) {
+    exportimage_png_files_t* files      = (exportimage_png_files_t*)user_data;
+    gint                     i          = GPOINTER_TO_INT(data) - 1;
+    gerbv_fileinfo_t*        fileInfo   = files->project->file[i];
+    GdkColor*                bg         = &files->project->background;
+    gerbv_render_info_t*     renderInfo = files->renderInfo;
+    cairo_surface_t*         cSurface;
+    cairo_t*                 cr;
+
+    cSurface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, renderInfo->displayWidth, renderInfo->displayHeight);
+    cr       = cairo_create(cSurface);
+
+    cairo_set_source_rgba(
+        cr, (double)bg->red / G_MAXUINT16, (double)bg->green / G_MAXUINT16, (double)bg->blue / G_MAXUINT16, 1
+    );
+    cairo_paint(cr);
+
+    cairo_push_group(cr);
+    gerbv_render_layer_to_cairo_target(cr, fileInfo, renderInfo);
+    cairo_pop_group_to_source(cr);
+    cairo_paint_with_alpha(cr, (double)fileInfo->alpha / G_MAXUINT16);
+    cairo_destroy(cr);
+
+    if (CAIRO_STATUS_SUCCESS != cairo_surface_write_to_png(cSurface, files->filenames[i])) {
+        GERB_COMPILE_ERROR(_("Exporting error to file \"%s\""), files->filenames[i]);
+        g_atomic_int_set(&files->failed, TRUE);
+    }
+
+    cairo_surface_destroy(cSurface);
 }
 
-void
-gerbv_export_pdf_file_from_project(
-    gerbv_project_t* gerbvProject, gerbv_render_info_t* renderInfo, const gchar* filename
+gboolean
+gerbv_export_png_files_from_project(
+    gerbv_project_t* gerbvProject, gerbv_render_info_t* renderInfo, gchar** filenames
 ) {
-    cairo_surface_t* cSurface = cairo_pdf_surface_create(filename, renderInfo->displayWidth, renderInfo->displayHeight);
+    exportimage_png_files_t files  = { gerbvProject, renderInfo, filenames, FALSE };
+    gint                    nFiles = 0, i;
+
+    /* the layers are only read while they are rendered, so all of them must
+       be loaded beforehand */
+    for (i = 0; i <= gerbvProject->last_loaded; i++) {
+        if (gerbvProject->file[i] && filenames[i]) {
+            gerbv_load_deferred_layer(gerbvProject->file[i]);
+            nFiles++;
+        }
+    }
+
+#if GLIB_CHECK_VERSION(2, 36, 0)
+    /* each layer caches what it renders in its own image, so different
+       layers can be rendered at the same time */
+    if (nFiles > 1) {
+        GThreadPool* pool = g_thread_pool_new(
+            exportimage_png_layer_file, &files, CLAMP((gint)g_get_num_processors(), 1, nFiles), TRUE, NULL
+        );
+
+        for (i = 0; i <= gerbvProject->last_loaded; i++) {
+            if (gerbvProject->file[i] && filenames[i])
+                g_thread_pool_push(pool, GINT_TO_POINTER(i + 1), NULL);
+        }
+
+        /* wait for all layers to be written */
+        g_thread_pool_free(pool, FALSE, TRUE);
+        return !files.failed;
+    }
+#endif
+
+    for (i = 0; i <= gerbvProject->last_loaded; i++) {
+        if (gerbvProject->file[i] && filenames[i])
+            exportimage_png_layer_file(GINT_TO_POINTER(i + 1), &files);
+    }
+
+    return !files.failed;
+}
 
-    exportimage_render_to_surface_and_destroy(gerbvProject, cSurface, renderInfo, filename);
+gboolean
+gerbv_export_pdf_file_from_project_autoscaled(gerbv_project_t* gerbvProject, const gchar* filename) {
+    gerbv_render_info_t renderInfo = gerbv_export_autoscale_project(gerbvProject);
+    return gerbv_export_pdf_file_from_project(gerbvProject, &renderInfo, filename);
 }
 
-void
+gboolean
 gerbv_export_postscript_file_from_project_autoscaled(gerbv_project_t* gerbvProject, const gchar* filename) {
     gerbv_render_info_t renderInfo = gerbv_export_autoscale_project(gerbvProject);
-    gerbv_export_postscript_file_from_project(gerbvProject, &renderInfo, filename);
+    return gerbv_export_postscript_file_from_project(gerbvProject, &renderInfo, filename);
 }
 
-void
+gboolean
 gerbv_export_postscript_file_from_project(
     gerbv_project_t* gerbvProject, gerbv_render_info_t* renderInfo, const gchar* filename
 ) {
     cairo_surface_t* cSurface = cairo_ps_surface_create(filename, renderInfo->displayWidth, renderInfo->displayHeight);
-    exportimage_render_to_surface_and_destroy(gerbvProject, cSurface, renderInfo, filename);
+    return exportimage_render_to_surface_and_destroy(gerbvProject, cSurface, renderInfo, filename);
 }
 
-void
+gboolean
 gerbv_export_svg_file_from_project_autoscaled(gerbv_project_t* gerbvProject, const gchar* filename) {
     gerbv_render_info_t renderInfo = gerbv_export_autoscale_project(gerbvProject);
-    gerbv_export_svg_file_from_project(gerbvProject, &renderInfo, filename);
+    return gerbv_export_svg_file_from_project(gerbvProject, &renderInfo, filename);
 }
 
-void
+gboolean
 gerbv_export_svg_file_from_project(
     gerbv_project_t* gerbvProject, gerbv_render_info_t* renderInfo, const gchar* filename
 ) {
     cairo_surface_t* cSurface = cairo_svg_surface_create(filename, renderInfo->displayWidth, renderInfo->displayHeight);
-    exportimage_render_to_surface_and_destroy(gerbvProject, cSurface, renderInfo, filename);
+    return exportimage_render_to_surface_and_destroy(gerbvProject, cSurface, renderInfo, filename);
+}
+
+gboolean
+gerbv_export_pdf_file_from_project(
+    gerbv_project_t* gerbvProject, gerbv_render_info_t* renderInfo, const gchar* filename
+) {
+    cairo_surface_t* cSurface = cairo_pdf_surface_create(filename, renderInfo->displayWidth, renderInfo->displayHeight);
+    return exportimage_render_to_surface_and_destroy(gerbvProject, cSurface, renderInfo, filename);
+}
+
+gboolean
+gerbv_export_pdf_pages_from_project(
+    gerbv_project_t* gerbvProject, gerbv_render_info_t* renderInfo, const gchar* filename
+) {
+    cairo_surface_t* cSurface = cairo_pdf_surface_create(filename, renderInfo->displayWidth, renderInfo->displayHeight);
+    cairo_t*         cairoTarget = cairo_create(cSurface);
+    gerbv_project_t  page        = *gerbvProject;
+    gboolean         ok;
+    gint             i;
+
+    /* a page per visible layer in the order of the layer list, each drawn
+       as a project holding only that layer */
+    page.last_loaded = 0;
+    for (i = 0; i <= gerbvProject->last_loaded; i++) {
+        if (!gerbvProject->file[i] || !gerbvProject->file[i]->isVisible)
+            continue;
+
+        gerbv_load_deferred_layer(gerbvProject->file[i]);
+        page.file = &gerbvProject->file[i];
+
+        cairo_save(cairoTarget);
+        gerbv_render_all_layers_to_cairo_target_for_vector_output(&page, cairoTarget, renderInfo);
+        cairo_restore(cairoTarget);
+        cairo_show_page(cairoTarget);
+    }
+    cairo_destroy(cairoTarget);
+
+    /* without any visible layer cairo finishes with a single blank page */
+    cairo_surface_finish(cSurface);
+    ok = (cairo_surface_status(cSurface) == CAIRO_STATUS_SUCCESS);
+    if (!ok)
+        GERB_COMPILE_ERROR(_("Exporting error to file \"%s\""), filename);
+
+    cairo_surface_destroy(cSurface);
+
+    return ok;
 }
@@ -34,9 +34,11 @@
 #include <glib.h>
 #include <math.h>
 
-#include <glib/gstdio.h>
 #include "gerbv.h"
 #include "common.h"
+#include "gerb_image.h"
+#include "export-drill.h"
+#include "export-writer.h"
 
 /* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
 #define dprintf \
@@ -48,24 +50,22 @@ gboolean
 gerbv_export_isel_drill_file_from_image(
     const gchar* filename, gerbv_image_t* inputImage, gerbv_user_transformation_t* transform
 ) {
-    FILE*        fd;
-    GArray*      apertureTable = g_array_new(FALSE, FALSE, sizeof(int));
-    gerbv_net_t* currentNet;
+    export_writer_t*    fd;
+    GArray*             apertureTable = g_array_new(FALSE, FALSE, sizeof(int));
+    GArray**            buckets;
+    gerbv_export_iter_t iter;
 
-    /* force gerbv to output decimals as dots (not commas for other locales) */
-    setlocale(LC_NUMERIC, "C");
-
-    if ((fd = g_fopen(filename, "w")) == NULL) {
+    if ((fd = export_writer_open(filename)) == NULL) {
         GERB_COMPILE_ERROR(_("Can't open file for writing: %s"), filename);
 
         return FALSE;
     }
 
-    /* duplicate the image, cleaning it in the process */
-    gerbv_image_t* image = gerbv_image_duplicate_image(inputImage, transform);
+    /* walk the image with the transform applied instead of duplicating it */
+    gerbv_image_export_iter_init(&iter, inputImage, transform);
 
     /* write header info */
-    fprintf(
+    export_writer_puts(
         fd,
         "IMF_PBL_V1.0\r\n"
         "\r\n"
@@ -99,10 +99,10 @@ gerbv_export_isel_drill_file_from_image(
     /* define all apertures */
     gerbv_aperture_t* currentAperture;
 
-    /* the image should already have been cleaned by a duplicate_image call, so we can safely
+    /* the apertures have been renumbered by the export iterator, so we can safely
        assume the aperture range is correct */
     for (int i = APERTURE_MIN; i < APERTURE_MAX; i++) {
-        currentAperture = image->aperture[i];
+        currentAperture = iter.aperture[i];
 
         if (!currentAperture)
             continue;
@@ -110,7 +110,9 @@ gerbv_export_isel_drill_file_from_image(
         switch (currentAperture->type) {
             case GERBV_APTYPE_CIRCLE:
                 /* add the "approved" aperture to our valid list */
-                fprintf(fd, "; TOOL %d - Diameter %1.3f mm\r\n", i + 1, COORD2MMS(currentAperture->parameter[0]));
+                export_writer_printf(
+                    fd, "; TOOL %d - Diameter %1.3f mm\r\n", i + 1, COORD2MMS(currentAperture->parameter[0])
+                );
                 g_array_append_val(apertureTable, i);
 
                 break;
@@ -118,46 +120,42 @@ gerbv_export_isel_drill_file_from_image(
         }
     }
 
-    /* write rest of image */
+    /* write rest of image, sorting the drills by tool in one pass over the nets */
+    buckets = export_drill_bucket_hits(&iter, apertureTable);
 
     for (guint i = 0; i < apertureTable->len; i++) {
         int currentAperture = g_array_index(apertureTable, int, i);
 
         /* write tool change */
-        fprintf(fd, "GETTOOL %d\r\n", currentAperture + 1);
-
-        /* run through all nets and look for drills using this aperture */
-        for (currentNet = image->netlist; currentNet; currentNet = currentNet->next) {
+        export_writer_printf(fd, "GETTOOL %d\r\n", currentAperture + 1);
 
-            if (currentNet->aperture != currentAperture)
-                continue;
+        for (guint j = 0; j < buckets[i]->len; j++) {
+            const export_drill_hit_t* hit = &g_array_index(buckets[i], export_drill_hit_t, j);
 
-            switch (currentNet->aperture_state) {
+            switch (hit->aperture_state) {
                 case GERBV_APERTURE_STATE_FLASH:
                     {
                         long xVal, yVal;
 
-                        xVal = (long)round(COORD2MMS(currentNet->stop_x) * 1e3);
-                        yVal = (long)round(COORD2MMS(currentNet->stop_y) * 1e3);
-                        fprintf(fd, "DRILL X%06ld Y%06ld\r\n", xVal, yVal);
+                        xVal = (long)round(COORD2MMS(hit->stop_x) * 1e3);
+                        yVal = (long)round(COORD2MMS(hit->stop_y) * 1e3);
+                        export_writer_printf(fd, "DRILL X%06ld Y%06ld\r\n", xVal, yVal);
                         break;
                     }
                 default:
                     GERB_COMPILE_WARNING(
                         _("Skipped to export of unsupported state %d "
                           "interpolation \"%s\""),
-                        currentNet->aperture_state, gerbv_interpolation_name(currentNet->interpolation)
+                        hit->aperture_state, gerbv_interpolation_name(hit->interpolation)
                     );
             }
         }
     }
+    export_drill_free_buckets(buckets, apertureTable->len);
     g_array_free(apertureTable, TRUE);
     /* write footer */
-    fprintf(fd, "PROGEND\r\n");
-    gerbv_destroy_image(image);
-    fclose(fd);
+    export_writer_printf(fd, "PROGEND\r\n");
+    gerbv_image_export_iter_clear(&iter);
 
-    /* return to the default locale */
-    setlocale(LC_NUMERIC, "");
-    return TRUE;
+    return export_writer_close(fd);
 }
@@ -0,0 +1,949 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file export-pdf.c
+    \brief PDF export, written directly instead of through cairo's PDF surface
+    \ingroup libgerbv
+
+    Each flashed aperture is a form XObject painted by every flash of it,
+    and each layer is an optional content group, so PDF viewers can show
+    and hide the layers. The content of a layer is compressed and written
+    out while it is generated, so the memory used doesn't grow with the
+    size of the board. Clear polarity is painted with the background color,
+    like cairo's vector output does.
+
+    The layers can also go on pages of their own, which share the forms, so
+    a document with a page per layer is written in one pass.
+
+    It has to be asked for, with --export=pdf-native; the default PDF export
+    still goes through cairo.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gerbv.h"
+
+#include <math.h>
+#include <string.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "common.h"
+#include "gerb_image.h"
+#include "export-writer.h"
+#include "export-vector.h"
+
+/* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
+#define dprintf \
+    if (DEBUG)  \
+    printf
+
+/* Decimals of coordinates in inches, of the transformation matrices and of
+   the color components */
+#define PDF_COORD_DECIMALS  5
+#define PDF_MATRIX_DECIMALS 9
+#define PDF_COLOR_DECIMALS  4
+
+/* Largest number written, small enough for export_writer_format_number()
+   not to use an exponent at PDF_MATRIX_DECIMALS */
+#define PDF_NUMBER_MAX 1e8
+
+/* Content is compressed and written in chunks of this size */
+#define PDF_CHUNK_SIZE (64 * 1024)
+
+/* The tracks gathered for a section are written out once they take this
+   many bytes */
+#define PDF_STROKES_MAX (1024 * 1024)
+
+/* Objects reserved before anything else is written */
+#define PDF_CATALOG_ID 1
+#define PDF_PAGES_ID   2
+
+typedef struct {
+    export_writer_t* w;
+    GArray*          offsets;  /* guint64 file offset of each object, by object number */
+    GString*         data;     /* content of the open stream not written yet */
+    gint             lengthId; /* object holding the length of the open stream */
+    guint64          start;    /* file offset of the data of the open stream */
+    GString*         xobjects; /* entries of the /XObject resources of the page */
+    gboolean         usesFont; /* TRUE once a label is written */
+#ifdef HAVE_ZLIB
+    z_stream zs;
+    guchar*  zbuffer;
+#endif
+} pdf_file_t;
+
+typedef struct {
+    pdf_file_t*     pdf;
+    gerbv_image_t*  image;
+    gint            fileIndex;
+    const GdkColor* layerColor;
+    const GdkColor* background;
+    gboolean        invertPolarity;
+
+    /* the open section, a group of nets sharing the layer and netstate */
+    gboolean          inSection;
+    gerbv_layer_t*    layer;
+    gerbv_netstate_t* state;
+    gboolean          dark; /* painted with the layer color, not the background */
+    GArray*           strokes;
+    guint             lastStroke;
+    gsize             strokeBytes;
+} pdf_export_t;
+
+/* ------------------------------------------------------------------ */
+/* Return the number of a new object, to be written with pdf_begin_object() */
+static gint
+pdf_reserve_object(pdf_file_t* pdf) {
+    guint64 offset = 0;
+
+    g_array_append_val(pdf->offsets, offset);
+
+    return pdf->offsets->len - 1;
+}
+
+/* ------------------------------------------------------------------ */
+static void
+pdf_begin_object(pdf_file_t* pdf, gint id) {
+    g_array_index(pdf->offsets, guint64, id) = export_writer_tell(pdf->w);
+    export_writer_printf(pdf->w, "%d 0 obj\n", id);
+}
+
+/* ------------------------------------------------------------------ */
+static void
+pdf_end_object(pdf_file_t* pdf) {
+    export_writer_puts(pdf->w, "endobj\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* Start the stream object id, whose dictionary has the entries of dict
+   besides its length and filter. The content is appended to pdf->data,
+   and written out by pdf_stream_flush() and pdf_end_stream(). */
+static void
+pdf_begin_stream(pdf_file_t* pdf, gint id, const gchar* dict) {
+    pdf->lengthId = pdf_reserve_object(pdf);
+    pdf_begin_object(pdf, id);
+    export_writer_printf(pdf->w, "<<%s /Length %d 0 R", dict, pdf->lengthId);
+#ifdef HAVE_ZLIB
+    /* the fastest level is several times faster, for a file only a
+       quarter larger */
+    memset(&pdf->zs, 0, sizeof(pdf->zs));
+    if (deflateInit(&pdf->zs, Z_BEST_SPEED) != Z_OK)
+        g_error("%s: can't initialize zlib", __func__);
+    export_writer_puts(pdf->w, " /Filter /FlateDecode");
+#endif
+    export_writer_puts(pdf->w, " >>\nstream\n");
+    pdf->start = export_writer_tell(pdf->w);
+}
+
+/* ------------------------------------------------------------------ */
+/* Write out the content gathered in pdf->data, all of it if finish is set */
+static void
+pdf_stream_flush(pdf_file_t* pdf, gboolean finish) {
+#ifdef HAVE_ZLIB
+    pdf->zs.next_in  = (Bytef*)pdf->data->str;
+    pdf->zs.avail_in = pdf->data->len;
+    do {
+        pdf->zs.next_out  = pdf->zbuffer;
+        pdf->zs.avail_out = PDF_CHUNK_SIZE;
+        deflate(&pdf->zs, finish ? Z_FINISH : Z_NO_FLUSH);
+        export_writer_write(pdf->w, (const gchar*)pdf->zbuffer, PDF_CHUNK_SIZE - pdf->zs.avail_out);
+    } while (pdf->zs.avail_out == 0);
+#else
+    export_writer_write(pdf->w, pdf->data->str, pdf->data->len);
+#endif
+    g_string_truncate(pdf->data, 0);
+}
+
+/* ------------------------------------------------------------------ */
+static void
+pdf_end_stream(pdf_file_t* pdf) {
+    glong length;
+
+    pdf_stream_flush(pdf, TRUE);
+#ifdef HAVE_ZLIB
+    deflateEnd(&pdf->zs);
+#endif
+    length = (glong)(export_writer_tell(pdf->w) - pdf->start);
+    export_writer_puts(pdf->w, "\nendstream\n");
+    pdf_end_object(pdf);
+
+    pdf_begin_object(pdf, pdf->lengthId);
+    export_writer_printf(pdf->w, "%ld\n", length);
+    pdf_end_object(pdf);
+}
+
+/* ------------------------------------------------------------------ */
+/* Append n numbers separated by spaces, followed by the operator op */
+static void
+pdf_append_numbers(GString* d, const gdouble* v, gint n, guint decimals, const gchar* op) {
+    gchar buffer[EXPORT_WRITER_NUMBER_SIZE];
+    gint  i;
+
+    for (i = 0; i < n; i++) {
+        /* PDF numbers have no exponent, keep the bogus ones in range */
+        gdouble value = isfinite(v[i]) ? CLAMP(v[i], -PDF_NUMBER_MAX, PDF_NUMBER_MAX) : 0;
+
+        g_string_append_len(d, buffer, export_writer_format_number(buffer, value, decimals));
+        g_string_append_c(d, ' ');
+    }
+    g_string_append(d, op);
+    g_string_append_c(d, '\n');
+}
+
+/* ------------------------------------------------------------------ */
+/* Append the point x,y followed by op, "m" or "l" */
+static void
+pdf_append_point(GString* d, gdouble x, gdouble y, const gchar* op) {
+    const gdouble v[] = { x, y };
+
+    pdf_append_numbers(d, v, 2, PDF_COORD_DECIMALS, op);
+}
+
+/* ------------------------------------------------------------------ */
+static void
+pdf_append_matrix(GString* d, const cairo_matrix_t* m) {
+    const gdouble v[] = { m->xx, m->yx, m->xy, m->yy, m->x0, m->y0 };
+
+    pdf_append_numbers(d, v, 6, PDF_MATRIX_DECIMALS, "cm");
+}
+
+/* ------------------------------------------------------------------ */
+/* Set the fill and stroke color */
+static void
+pdf_append_color(GString* d, const GdkColor* color) {
+    const gdouble v[] = { color->red / 65535.0, color->green / 65535.0, color->blue / 65535.0 };
+
+    pdf_append_numbers(d, v, 3, PDF_COLOR_DECIMALS, "rg");
+    pdf_append_numbers(d, v, 3, PDF_COLOR_DECIMALS, "RG");
+}
+
+/* ------------------------------------------------------------------ */
+/* Append an elliptic arc around cx,cy from angle1 to angle2 in radians,
+   starting at the current point, as Bézier curves of a quarter turn at
+   most */
+static void
+pdf_append_arc(GString* d, gdouble cx, gdouble cy, gdouble rx, gdouble ry, gdouble angle1, gdouble angle2) {
+    gint    steps = MAX(1, (gint)ceil(fabs(angle2 - angle1) / M_PI_2 - 1e-9));
+    gdouble step  = (angle2 - angle1) / steps;
+    gdouble k     = 4.0 / 3.0 * tan(step / 4);
+    gint    i;
+
+    for (i = 0; i < steps; i++) {
+        gdouble       a1  = angle1 + step * i, a2 = a1 + step;
+        const gdouble v[] = {
+            cx + rx * (cos(a1) - k * sin(a1)), cy + ry * (sin(a1) + k * cos(a1)),
+            cx + rx * (cos(a2) + k * sin(a2)), cy + ry * (sin(a2) - k * cos(a2)),
+            cx + rx * cos(a2),                 cy + ry * sin(a2),
+        };
+
+        pdf_append_numbers(d, v, 6, PDF_COORD_DECIMALS, "c");
+    }
+}
+
+/* ------------------------------------------------------------------ */
+static void
+pdf_move_to(GString* d, gdouble x, gdouble y) {
+    pdf_append_point(d, x, y, "m");
+}
+
+/* ------------------------------------------------------------------ */
+static void
+pdf_line_to(GString* d, gdouble x, gdouble y) {
+    pdf_append_point(d, x, y, "l");
+}
+
+/* ------------------------------------------------------------------ */
+static void
+pdf_close_path(GString* d) {
+    g_string_append(d, "h\n");
+}
+
+static const export_vector_path_t pdf_path = { pdf_move_to, pdf_line_to, pdf_append_arc, pdf_close_path };
+
+/* ------------------------------------------------------------------ */
+/* Append text as a string in parentheses, in the WinAnsi encoding of the
+   standard fonts */
+static void
+pdf_append_string(GString* d, const gchar* text) {
+    gchar*       converted = g_convert_with_fallback(text, -1, "WINDOWS-1252", "UTF-8", "?", NULL, NULL, NULL);
+    const gchar* p;
+
+    g_string_append_c(d, '(');
+    for (p = converted ? converted : text; *p != '\0'; p++) {
+        guchar c = (guchar)*p;
+
+        if (c == '(' || c == ')' || c == '\\')
+            g_string_append_printf(d, "\\%c", c);
+        else if (c < 0x20 || c > 0x7e)
+            g_string_append_printf(d, "\\%03o", c);
+        else
+            g_string_append_c(d, c);
+    }
+    g_string_append_c(d, ')');
+
+    g_free(converted);
+}
+
+/* ------------------------------------------------------------------ */
+/* Append text as a text string, in UTF-16 unless it is plain ASCII */
+static void
+pdf_append_text_string(GString* d, const gchar* text) {
+    const gchar* p;
+    gunichar2*   utf16;
+    glong        i, len;
+
+    for (p = text; *p != '\0' && (guchar)*p < 0x80; p++)
+        ;
+    if (*p == '\0' || (utf16 = g_utf8_to_utf16(text, -1, NULL, &len, NULL)) == NULL) {
+        pdf_append_string(d, text);
+        return;
+    }
+
+    g_string_append(d, "<FEFF");
+    for (i = 0; i < len; i++)
+        g_string_append_printf(d, "%04X", utf16[i]);
+    g_string_append_c(d, '>');
+
+    g_free(utf16);
+}
+
+/* ------------------------------------------------------------------ */
+/* Return TRUE if an aperture has primitives with exposure off, whose color
+   depends on the polarity it is flashed with */
+static gboolean
+pdf_aperture_has_clear(const gerbv_aperture_t* aperture) {
+    const gerbv_simplified_amacro_t* s;
+    gboolean                         dark = TRUE;
+
+    if (aperture->type != GERBV_APTYPE_MACRO)
+        return FALSE;
+
+    for (s = aperture->simplified; s != NULL; s = s->next) {
+        dark = export_vector_macro_primitive_dark(s, dark);
+        if (!dark)
+            return TRUE;
+    }
+
+    return FALSE;
+}
+
+/* ------------------------------------------------------------------ */
+/* Append one macro primitive, like gerbv_draw_amacro() draws it */
+static void
+pdf_append_macro_primitive(GString* d, const gerbv_simplified_amacro_t* s) {
+    const gdouble* p = s->parameter;
+    gdouble        diameter, step, r;
+    cairo_matrix_t m;
+    gint           i;
+
+    if (s->type != GERBV_APTYPE_MACRO_MOIRE) {
+        if (export_vector_macro_primitive(&pdf_path, d, s))
+            g_string_append(d, "f*\n");
+        return;
+    }
+
+    /* moirés are stroked */
+    diameter = p[MOIRE_OUTSIDE_DIAMETER] - p[MOIRE_CIRCLE_THICKNESS];
+    step     = 2 * (p[MOIRE_GAP_WIDTH] + p[MOIRE_CIRCLE_THICKNESS]);
+    r        = p[MOIRE_CROSSHAIR_LENGTH] / 2;
+
+    cairo_matrix_init_translate(&m, p[MOIRE_CENTER_X], p[MOIRE_CENTER_Y]);
+    cairo_matrix_rotate(&m, DEG2RAD(p[MOIRE_ROTATION]));
+
+    g_string_append(d, "q\n0 J\n");
+    pdf_append_matrix(d, &m);
+    for (i = 0; i < (gint)p[MOIRE_NUMBER_OF_CIRCLES] && diameter - step * i > 0; i++)
+        export_vector_circle(&pdf_path, d, 0, 0, (diameter - step * i) / 2);
+    if (i > 0) {
+        pdf_append_numbers(d, &p[MOIRE_CIRCLE_THICKNESS], 1, PDF_COORD_DECIMALS, "w");
+        g_string_append(d, "S\n");
+    }
+
+    pdf_append_numbers(d, &p[MOIRE_CROSSHAIR_THICKNESS], 1, PDF_COORD_DECIMALS, "w");
+    pdf_append_point(d, -r, 0, "m");
+    pdf_append_point(d, r, 0, "l");
+    pdf_append_point(d, 0, -r, "m");
+    pdf_append_point(d, 0, r, "l");
+    g_string_append(d, "S\nQ\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* Append the primitives of a macro. The ones with exposure off are painted
+   with otherColor, the color of the opposite polarity. */
+static void
+pdf_append_macro(GString* d, const gerbv_simplified_amacro_t* macro, const GdkColor* otherColor) {
+    const gerbv_simplified_amacro_t* s;
+    gboolean                         dark = TRUE;
+
+    for (s = macro; s != NULL; s = s->next) {
+        dark = export_vector_macro_primitive_dark(s, dark);
+        if (dark) {
+            pdf_append_macro_primitive(d, s);
+        } else {
+            g_string_append(d, "q\n");
+            pdf_append_color(d, otherColor);
+            pdf_append_macro_primitive(d, s);
+            g_string_append(d, "Q\n");
+        }
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Return the name of the form XObject of an aperture flashed dark or clear.
+   Both use the same one unless the aperture has clear primitives. */
+static gchar*
+pdf_aperture_name(pdf_export_t* e, gint number, gboolean dark) {
+    gerbv_aperture_t* aperture = e->image->aperture[number];
+
+    if (!dark && pdf_aperture_has_clear(aperture))
+        return g_strdup_printf("C%d_%d", e->fileIndex, number);
+
+    return g_strdup_printf("A%d_%d", e->fileIndex, number);
+}
+
+/* ------------------------------------------------------------------ */
+/* Write the form XObject painting a flash of an aperture. The fill color is
+   the one of the flash, only the primitives of macros with exposure off
+   set their own. */
+static void
+pdf_write_aperture_form(pdf_export_t* e, gint number, gboolean dark) {
+    pdf_file_t*       pdf      = e->pdf;
+    gerbv_aperture_t* aperture = e->image->aperture[number];
+    const gdouble*    p        = aperture->parameter;
+    GString*          d        = pdf->data;
+    GString*          dict     = g_string_new(" /Type /XObject /Subtype /Form /BBox [");
+    gdouble           extent;
+    gchar*            name;
+    gint              id;
+
+    switch (aperture->type) {
+        case GERBV_APTYPE_CIRCLE:
+        case GERBV_APTYPE_POLYGON: extent = p[0] / 2; break;
+        case GERBV_APTYPE_RECTANGLE:
+        case GERBV_APTYPE_OVAL: extent = MAX(p[0], p[1]); break;
+        case GERBV_APTYPE_MACRO: extent = export_vector_macro_extent(aperture->simplified); break;
+        default: extent = 0; break;
+    }
+    /* the extent is generous already, the margin covers rounding */
+    extent = fabs(extent) + 0.01;
+    {
+        const gdouble box[] = { -extent, -extent, extent, extent };
+
+        pdf_append_numbers(dict, box, 4, PDF_COORD_DECIMALS, "]");
+        g_string_truncate(dict, dict->len - 1);
+    }
+
+    id = pdf_reserve_object(pdf);
+    pdf_begin_stream(pdf, id, dict->str);
+
+    switch (aperture->type) {
+        case GERBV_APTYPE_CIRCLE:
+        case GERBV_APTYPE_RECTANGLE:
+        case GERBV_APTYPE_OVAL:
+        case GERBV_APTYPE_POLYGON:
+            export_vector_aperture(&pdf_path, d, aperture);
+            g_string_append(d, "f*\n");
+            break;
+        case GERBV_APTYPE_MACRO:
+            pdf_append_macro(d, aperture->simplified, dark ? e->background : e->layerColor);
+            break;
+        default:
+            GERB_COMPILE_WARNING(_("Unknown aperture type: %s"), _(gerbv_aperture_type_name(aperture->type)));
+            break;
+    }
+
+    pdf_end_stream(pdf);
+
+    name = pdf_aperture_name(e, number, dark);
+    g_string_append_printf(pdf->xobjects, "/%s %d 0 R\n", name, id);
+    g_free(name);
+    g_string_free(dict, TRUE);
+}
+
+/* ------------------------------------------------------------------ */
+static void
+pdf_write_strokes(pdf_export_t* e) {
+    GString* d = e->pdf->data;
+    guint    i;
+
+    for (i = 0; i < e->strokes->len; i++) {
+        export_vector_stroke_t* stroke = &g_array_index(e->strokes, export_vector_stroke_t, i);
+
+        pdf_append_numbers(d, &stroke->width, 1, PDF_COORD_DECIMALS, "w");
+        if (stroke->squareCap)
+            g_string_append(d, "2 J\n");
+        g_string_append_len(d, stroke->d->str, stroke->d->len);
+        g_string_append(d, stroke->squareCap ? "S\n1 J\n" : "S\n");
+        g_string_free(stroke->d, TRUE);
+
+        if (d->len >= PDF_CHUNK_SIZE)
+            pdf_stream_flush(e->pdf, FALSE);
+    }
+    g_array_set_size(e->strokes, 0);
+    e->strokeBytes = 0;
+}
+
+/* ------------------------------------------------------------------ */
+static void
+pdf_end_section(pdf_export_t* e) {
+    if (!e->inSection)
+        return;
+
+    pdf_write_strokes(e);
+    g_string_append(e->pdf->data, "Q\n");
+    e->inSection = FALSE;
+}
+
+/* ------------------------------------------------------------------ */
+/* Start the nets of layer and state, painted dark or clear */
+static void
+pdf_begin_section(pdf_export_t* e, gerbv_layer_t* layer, gerbv_netstate_t* state, gboolean dark) {
+    cairo_matrix_t m;
+
+    pdf_end_section(e);
+
+    e->layer = layer;
+    e->state = state;
+    e->dark  = dark;
+
+    /* like draw_image_to_cairo_target() and draw_apply_netstate_transformation() */
+    cairo_matrix_init_rotate(&m, layer->rotation);
+    export_vector_apply_netstate(&m, state);
+
+    g_string_append(e->pdf->data, "q\n");
+    pdf_append_color(e->pdf->data, dark ? e->layerColor : e->background);
+    pdf_append_matrix(e->pdf->data, &m);
+
+    e->inSection = TRUE;
+}
+
+/* ------------------------------------------------------------------ */
+/* Write one net moved by dx,dy, like draw_image_to_cairo_target() draws it */
+static void
+pdf_write_net(pdf_export_t* e, gerbv_net_t* net, gdouble dx, gdouble dy) {
+    gerbv_image_t*    image    = e->image;
+    gerbv_aperture_t* aperture = image->aperture[net->aperture];
+    GString*          d        = e->pdf->data;
+
+    if (net->interpolation == GERBV_INTERPOLATION_PAREA_START) {
+        if (export_vector_region(&pdf_path, d, gerbv_image_return_region(image, net), dx, dy))
+            g_string_append(d, "f*\n");
+        return;
+    }
+    if (net->interpolation == GERBV_INTERPOLATION_DELETED || aperture == NULL)
+        return;
+
+    switch (net->aperture_state) {
+        case GERBV_APERTURE_STATE_ON:
+            if (export_vector_rectangle_track(&pdf_path, d, aperture, net, dx, dy))
+                g_string_append(d, "f\n");
+            else
+                e->strokeBytes +=
+                    export_vector_stroke_track(&pdf_path, e->strokes, &e->lastStroke, net, aperture, dx, dy);
+            break;
+        case GERBV_APERTURE_STATE_FLASH:
+            {
+                gchar*        name = pdf_aperture_name(e, net->aperture, e->dark);
+                const gdouble v[]  = { 1, 0, 0, 1, net->stop_x + dx, net->stop_y + dy };
+
+                g_string_append(d, "q\n");
+                pdf_append_numbers(d, v, 6, PDF_COORD_DECIMALS, "cm");
+                g_string_append_printf(d, "/%s Do\nQ\n", name);
+                g_free(name);
+                break;
+            }
+        default: break;
+    }
+
+    if (e->strokeBytes >= PDF_STROKES_MAX)
+        pdf_write_strokes(e);
+}
+
+/* ------------------------------------------------------------------ */
+/* Write the PNP label of net, like draw_image_to_cairo_target() */
+static void
+pdf_write_label(pdf_export_t* e, gerbv_net_t* net, gboolean mirrorX, gboolean mirrorY) {
+    GString* d   = e->pdf->data;
+    gdouble  m[] = { mirrorY ? -1 : 1, 0, 0, mirrorX ? -1 : 1, 0, 0 };
+
+    if (!gerbv_image_return_label_mark(e->image, net, &m[4], &m[5]))
+        return;
+
+    g_string_append(d, "BT\n/F1 0.05 Tf\n");
+    pdf_append_numbers(d, m, 6, PDF_COORD_DECIMALS, "Tm");
+    pdf_append_string(d, net->label->str);
+    g_string_append(d, " Tj\nET\n");
+    e->pdf->usesFont = TRUE;
+}
+
+/* ------------------------------------------------------------------ */
+/* Return TRUE if nets of layer are painted with the layer color */
+static gboolean
+pdf_layer_dark(pdf_export_t* e, gerbv_layer_t* layer) {
+    return !((layer->polarity == GERBV_POLARITY_CLEAR) ^ e->invertPolarity);
+}
+
+/* ------------------------------------------------------------------ */
+/* Write the nets of the image */
+static void
+pdf_write_nets(pdf_export_t* e, const gerbv_user_transformation_t* transform) {
+    gerbv_image_t* image = e->image;
+    GString*       d     = e->pdf->data;
+    GString*       label = NULL;
+    gerbv_net_t*   net;
+    gerbv_layer_t* layer = NULL;
+
+    for (net = image->netlist->next; net != NULL; net = gerbv_image_return_next_renderable_object_cached(image, net)) {
+        gerbv_step_and_repeat_t* sr = &net->layer->stepAndRepeat;
+        gint                     ix, iy;
+
+        if (net->layer != layer) {
+            gerbv_knockout_t* ko = &net->layer->knockout;
+
+            pdf_end_section(e);
+            layer = net->layer;
+
+            if (ko->firstInstance) {
+                gboolean       dark = pdf_layer_dark(e, layer);
+                cairo_matrix_t m;
+
+                if (ko->polarity == GERBV_POLARITY_CLEAR)
+                    dark = !dark;
+                cairo_matrix_init_rotate(&m, layer->rotation);
+                g_string_append(d, "q\n");
+                pdf_append_color(d, dark ? e->layerColor : e->background);
+                export_vector_rectangle(
+                    &pdf_path, d, &m, ko->lowerLeftX - ko->border, ko->lowerLeftY - ko->border,
+                    ko->width + 2 * ko->border, ko->height + 2 * ko->border
+                );
+                g_string_append(d, "f\nQ\n");
+            }
+        }
+        if (!e->inSection || net->state != e->state)
+            pdf_begin_section(e, net->layer, net->state, pdf_layer_dark(e, net->layer));
+
+        if (net->label && net->label != label
+            && (image->layertype == GERBV_LAYERTYPE_PICKANDPLACE_TOP
+                || image->layertype == GERBV_LAYERTYPE_PICKANDPLACE_BOT)) {
+            label = net->label;
+            pdf_write_label(e, net, transform->mirrorAroundX, transform->mirrorAroundY);
+        }
+
+        for (ix = 0; ix < MAX(sr->X, 1); ix++)
+            for (iy = 0; iy < MAX(sr->Y, 1); iy++)
+                pdf_write_net(e, net, ix * sr->dist_X, iy * sr->dist_Y);
+
+        if (d->len >= PDF_CHUNK_SIZE)
+            pdf_stream_flush(e->pdf, FALSE);
+    }
+    pdf_end_section(e);
+}
+
+/* ------------------------------------------------------------------ */
+/* Write the forms of the flashed apertures, the optional content group and
+   the content stream of a layer. Returns the number of the stream, and that
+   of the group in groupId. */
+static gint
+pdf_write_layer(
+    pdf_file_t* pdf, gerbv_fileinfo_t* fileInfo, gint fileIndex, gerbv_render_info_t* renderInfo,
+    const GdkColor* background, gint* groupId
+) {
+    gerbv_image_t*               image     = fileInfo->image;
+    gerbv_user_transformation_t* transform = &fileInfo->transform;
+    gerbv_render_info_t*         r         = renderInfo;
+    GString*                     d         = pdf->data;
+    pdf_export_t                 e;
+    cairo_matrix_t               m;
+    guint8*                      flashed;
+    gerbv_net_t*                 net;
+    gdouble                      scaleX = transform->scaleX, scaleY = transform->scaleY;
+    gint                         i, contentId;
+
+    memset(&e, 0, sizeof(e));
+    e.pdf        = pdf;
+    e.image      = image;
+    e.fileIndex  = fileIndex;
+    e.layerColor = &fileInfo->color;
+    e.background = background;
+    e.strokes    = g_array_new(FALSE, FALSE, sizeof(export_vector_stroke_t));
+
+    e.invertPolarity = transform->inverted;
+    if (image->info->polarity == GERBV_POLARITY_NEGATIVE)
+        e.invertPolarity = !e.invertPolarity;
+
+    /* the forms first, for the polarities each aperture is flashed with */
+    flashed = g_new0(guint8, APERTURE_MAX);
+    for (net = image->netlist->next; net != NULL; net = gerbv_image_return_next_renderable_object_cached(image, net)) {
+        if (net->aperture_state == GERBV_APERTURE_STATE_FLASH && net->interpolation != GERBV_INTERPOLATION_DELETED
+            && net->aperture >= 0 && net->aperture < APERTURE_MAX && image->aperture[net->aperture] != NULL)
+            flashed[net->aperture] |= pdf_layer_dark(&e, net->layer) ? 1 : 2;
+    }
+    for (i = 0; i < APERTURE_MAX; i++) {
+        if (flashed[i] == 0)
+            continue;
+        if (pdf_aperture_has_clear(image->aperture[i])) {
+            if (flashed[i] & 1)
+                pdf_write_aperture_form(&e, i, TRUE);
+            if (flashed[i] & 2)
+                pdf_write_aperture_form(&e, i, FALSE);
+        } else {
+            pdf_write_aperture_form(&e, i, TRUE);
+        }
+    }
+    g_free(flashed);
+
+    *groupId = pdf_reserve_object(pdf);
+    pdf_begin_object(pdf, *groupId);
+    g_string_append(d, "<< /Type /OCG /Name ");
+    pdf_append_text_string(d, fileInfo->name ? fileInfo->name : "");
+    g_string_append(d, " >>\n");
+    export_writer_write(pdf->w, d->str, d->len);
+    g_string_truncate(d, 0);
+    pdf_end_object(pdf);
+
+    contentId = pdf_reserve_object(pdf);
+    pdf_begin_stream(pdf, contentId, "");
+    g_string_append_printf(d, "/OC /L%d BDC\nq\n", fileIndex);
+
+    if (e.invertPolarity) {
+        const gdouble page[] = { 0, 0, r->displayWidth, r->displayHeight };
+
+        pdf_append_color(d, e.layerColor);
+        pdf_append_numbers(d, page, 4, PDF_COORD_DECIMALS, "re");
+        g_string_append(d, "f\n");
+    }
+
+    /* inches with y up, like gerbv_render_cairo_set_scale_and_translation(),
+       then the transformations of draw_image_to_cairo_target() */
+    if (transform->mirrorAroundX)
+        scaleY = -scaleY;
+    if (transform->mirrorAroundY)
+        scaleX = -scaleX;
+    cairo_matrix_init_scale(&m, r->scaleFactorX, r->scaleFactorY);
+    cairo_matrix_translate(&m, -r->lowerLeftX, -r->lowerLeftY);
+    cairo_matrix_translate(&m, transform->translateX, transform->translateY);
+    cairo_matrix_scale(&m, scaleX, scaleY);
+    cairo_matrix_rotate(&m, transform->rotation);
+    cairo_matrix_translate(&m, image->info->imageJustifyOffsetActualA, image->info->imageJustifyOffsetActualB);
+    cairo_matrix_translate(&m, image->info->offsetA, image->info->offsetB);
+    cairo_matrix_rotate(&m, image->info->imageRotation);
+    pdf_append_matrix(d, &m);
+    g_string_append(d, "1 J\n1 j\n");
+
+    pdf_write_nets(&e, transform);
+
+    g_string_append(d, "Q\nEMC\n");
+    pdf_end_stream(pdf);
+
+    g_array_free(e.strokes, TRUE);
+
+    return contentId;
+}
+
+/* ------------------------------------------------------------------ */
+/* Write the visible layers of gerbvProject to filename, all on one page, or
+   each on its own page if pagePerLayer is TRUE. The forms of the apertures
+   and the font are shared by all pages. Return TRUE if it was written. */
+static gboolean
+pdf_export_project(
+    gerbv_project_t* gerbvProject, gerbv_render_info_t* renderInfo, const gchar* filename, gboolean pagePerLayer
+) {
+    GdkColor*  bg = &gerbvProject->background;
+    pdf_file_t pdf;
+    GString*   d;
+    GString*   properties = g_string_new(NULL);
+    GString*   groups     = g_string_new(NULL);
+    GString*   kids       = g_string_new(NULL);
+    gint*      contentIds = g_new0(gint, gerbvProject->last_loaded + 1);
+    gint*      groupIds   = g_new0(gint, gerbvProject->last_loaded + 1);
+    gint       fontId     = 0, backgroundId = 0, resourcesId, nPages = 0;
+    gint       i, j;
+    guint      n;
+    guint64    xref;
+    gboolean   ok;
+
+    memset(&pdf, 0, sizeof(pdf));
+    if ((pdf.w = export_writer_open(filename)) == NULL) {
+        GERB_COMPILE_ERROR(_("Can't open file for writing: %s"), filename);
+        g_string_free(properties, TRUE);
+        g_string_free(groups, TRUE);
+        g_string_free(kids, TRUE);
+        g_free(contentIds);
+        g_free(groupIds);
+        return FALSE;
+    }
+    pdf.offsets  = g_array_new(FALSE, FALSE, sizeof(guint64));
+    pdf.data     = d = g_string_sized_new(2 * PDF_CHUNK_SIZE);
+    pdf.xobjects = g_string_new(NULL);
+#ifdef HAVE_ZLIB
+    pdf.zbuffer = g_malloc(PDF_CHUNK_SIZE);
+#endif
+
+    /* object 0 heads the free list, the catalog and pages follow */
+    for (i = 0; i <= PDF_PAGES_ID; i++)
+        pdf_reserve_object(&pdf);
+
+    export_writer_puts(pdf.w, "%PDF-1.5\n%\xe2\xe3\xcf\xd3\n");
+
+    /* the background only when it isn't white or black, like
+       gerbv_render_all_layers_to_cairo_target_for_vector_output() */
+    if ((bg->red != 0xffff || bg->green != 0xffff || bg->blue != 0xffff)
+        && (bg->red != 0x0000 || bg->green != 0x0000 || bg->blue != 0x0000)) {
+        const gdouble page[] = { 0, 0, renderInfo->displayWidth, renderInfo->displayHeight };
+
+        backgroundId = pdf_reserve_object(&pdf);
+        pdf_begin_stream(&pdf, backgroundId, "");
+        pdf_append_color(d, bg);
+        pdf_append_numbers(d, page, 4, PDF_COORD_DECIMALS, "re");
+        g_string_append(d, "f\n");
+        pdf_end_stream(&pdf);
+    }
+
+    for (i = gerbvProject->last_loaded; i >= 0; i--) {
+        gerbv_fileinfo_t* fileInfo = gerbvProject->file[i];
+
+        if (fileInfo && fileInfo->isVisible) {
+            gerbv_load_deferred_layer(fileInfo);
+            contentIds[i] = pdf_write_layer(&pdf, fileInfo, i, renderInfo, bg, &groupIds[i]);
+        }
+    }
+
+    /* the groups in the order of the layer list, top first */
+    for (i = 0; i <= gerbvProject->last_loaded; i++) {
+        if (groupIds[i] == 0)
+            continue;
+        g_string_append_printf(properties, "/L%d %d 0 R\n", i, groupIds[i]);
+        g_string_append_printf(groups, " %d 0 R", groupIds[i]);
+    }
+
+    if (pdf.usesFont) {
+        fontId = pdf_reserve_object(&pdf);
+        pdf_begin_object(&pdf, fontId);
+        export_writer_puts(
+            pdf.w, "<< /Type /Font /Subtype /Type1 /BaseFont /Helvetica /Encoding /WinAnsiEncoding >>\n"
+        );
+        pdf_end_object(&pdf);
+    }
+
+    resourcesId = pdf_reserve_object(&pdf);
+    pdf_begin_object(&pdf, resourcesId);
+    export_writer_puts(pdf.w, "<<\n");
+    if (pdf.xobjects->len > 0)
+        export_writer_printf(pdf.w, "/XObject <<\n%s>>\n", pdf.xobjects->str);
+    if (properties->len > 0)
+        export_writer_printf(pdf.w, "/Properties <<\n%s>>\n", properties->str);
+    if (pdf.usesFont)
+        export_writer_printf(pdf.w, "/Font << /F1 %d 0 R >>\n", fontId);
+    export_writer_puts(pdf.w, ">>\n");
+    pdf_end_object(&pdf);
+
+    /* a page per layer in the order of the layer list, or all layers on one
+       page with the top one painted last. Without any visible layer the
+       loop ends with a blank page. */
+    for (i = 0; i <= gerbvProject->last_loaded || nPages == 0; i++) {
+        gint pageId;
+
+        if (pagePerLayer && i <= gerbvProject->last_loaded && contentIds[i] == 0)
+            continue;
+
+        pageId = pdf_reserve_object(&pdf);
+        pdf_begin_object(&pdf, pageId);
+        export_writer_printf(
+            pdf.w, "<< /Type /Page /Parent %d 0 R /MediaBox [0 0 %d %d]\n/Contents [", PDF_PAGES_ID,
+            renderInfo->displayWidth, renderInfo->displayHeight
+        );
+        if (backgroundId != 0)
+            export_writer_printf(pdf.w, " %d 0 R", backgroundId);
+        if (pagePerLayer && i <= gerbvProject->last_loaded) {
+            export_writer_printf(pdf.w, " %d 0 R", contentIds[i]);
+        } else {
+            for (j = gerbvProject->last_loaded; j >= 0; j--) {
+                if (contentIds[j] != 0)
+                    export_writer_printf(pdf.w, " %d 0 R", contentIds[j]);
+            }
+        }
+        export_writer_printf(pdf.w, " ]\n/Resources %d 0 R >>\n", resourcesId);
+        pdf_end_object(&pdf);
+
+        g_string_append_printf(kids, " %d 0 R", pageId);
+        nPages++;
+
+        if (!pagePerLayer)
+            break;
+    }
+
+    pdf_begin_object(&pdf, PDF_PAGES_ID);
+    export_writer_printf(pdf.w, "<< /Type /Pages /Kids [%s ] /Count %d >>\n", kids->str, nPages);
+    pdf_end_object(&pdf);
+
+    pdf_begin_object(&pdf, PDF_CATALOG_ID);
+    export_writer_printf(pdf.w, "<< /Type /Catalog /Pages %d 0 R", PDF_PAGES_ID);
+    if (groups->len > 0)
+        export_writer_printf(
+            pdf.w, "\n/OCProperties << /OCGs [%s ] /D << /Order [%s ] >> >>", groups->str, groups->str
+        );
+    export_writer_puts(pdf.w, " >>\n");
+    pdf_end_object(&pdf);
+
+    xref = export_writer_tell(pdf.w);
+    export_writer_printf(pdf.w, "xref\n0 %d\n0000000000 65535 f \n", (gint)pdf.offsets->len);
+    for (n = 1; n < pdf.offsets->len; n++)
+        export_writer_printf(pdf.w, "%010ld 00000 n \n", (glong)g_array_index(pdf.offsets, guint64, n));
+    export_writer_printf(
+        pdf.w, "trailer\n<< /Size %d /Root %d 0 R >>\nstartxref\n%ld\n%%%%EOF\n", (gint)pdf.offsets->len,
+        PDF_CATALOG_ID, (glong)xref
+    );
+
+    ok = export_writer_close(pdf.w);
+
+#ifdef HAVE_ZLIB
+    g_free(pdf.zbuffer);
+#endif
+    g_array_free(pdf.offsets, TRUE);
+    g_string_free(pdf.xobjects, TRUE);
+    g_string_free(d, TRUE);
+    g_string_free(properties, TRUE);
+    g_string_free(groups, TRUE);
+    g_string_free(kids, TRUE);
+    g_free(contentIds);
+    g_free(groupIds);
+
+    return ok;
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+gerbv_export_pdf_native_file_from_project(
+    gerbv_project_t* gerbvProject, gerbv_render_info_t* renderInfo, const gchar* filename
+) {
+    return pdf_export_project(gerbvProject, renderInfo, filename, FALSE);
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+gerbv_export_pdf_native_pages_from_project(
+    gerbv_project_t* gerbvProject, gerbv_render_info_t* renderInfo, const gchar* filename
+) {
+    return pdf_export_project(gerbvProject, renderInfo, filename, TRUE);
+}
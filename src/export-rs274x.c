@@ -29,9 +29,12 @@
 #include "gerbv.h"
 
 #include <math.h>
-#include <glib/gstdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "common.h"
+#include "gerb_image.h"
+#include "export-writer.h"
 
 #define dprintf \
     if (DEBUG)  \
@@ -39,15 +42,59 @@
 
 #define round(x) floor(x + 0.5)
 
+/* Coordinates are written in millionths of an inch, as %FSLAX36Y36*% says */
+#define EXPORT_RS274X_DECIMAL_COEFF 1e6
+
+/* Largest coordinate difference, in written units, whose products are still
+   exact when testing tracks for being collinear */
+#define EXPORT_RS274X_MERGE_MAX (1 << 30)
+
+/* Nets of two panel copies that differ by less than this, in inches, besides
+   the offset of the copy, are the same */
+#define EXPORT_RS274X_REPEAT_TOLERANCE 1e-9
+
+/* The pen position before the first block, which no coordinate equals, so
+   that block writes both X and Y */
+#define EXPORT_RS274X_NO_POSITION G_MINLONG
+
+/* The standard apertures have at most this many parameters */
+#define EXPORT_RS274X_STANDARD_PARAMETERS 5
+
+/*! Copies of the first nets of an image laid out on a grid, which the
+    optimized export writes once with a step and repeat */
+typedef struct {
+    guint   nets;           /* nets in each copy, counting the first net of the image */
+    gint    countX, countY; /* copies along each axis */
+    gdouble stepX, stepY;   /* between copies, in inches */
+    gdouble shiftX, shiftY; /* from the first copy to the lower left one */
+} export_rs274x_repeat_t;
+
+/*! What the optimized export has written so far, so it only writes what
+    changed */
+typedef struct {
+    export_writer_t* fd;
+    const gint*      alias;         /* the aperture each aperture is written as */
+    gdouble          shiftX;        /* added to every coordinate */
+    gdouble          shiftY;
+    glong            x, y;          /* where the last block left the pen, or EXPORT_RS274X_NO_POSITION */
+    gint             interpolation; /* the G code of the last draw, or 0 */
+    gint             aperture;
+    gerbv_polarity_t polarity;
+    gboolean         multiQuadrant; /* TRUE once G75 is written */
+    gboolean         insidePolygon;
+    gboolean         drawing;       /* TRUE if a track from x, y to drawX, drawY is waiting to be written */
+    glong            drawX, drawY;
+} export_rs274x_writer_t;
+
 void
-export_rs274x_write_macro(FILE* fd, gerbv_aperture_t* currentAperture, gint apertureNumber) {
+export_rs274x_write_macro(export_writer_t* fd, gerbv_aperture_t* currentAperture, gint apertureNumber) {
     gerbv_simplified_amacro_t* ls = currentAperture->simplified;
 
     /* write the macro portion first */
-    fprintf(fd, "%%AMMACRO%d*\n", apertureNumber);
+    export_writer_printf(fd, "%%AMMACRO%d*\n", apertureNumber);
     while (ls != NULL) {
         if (ls->type == GERBV_APTYPE_MACRO_CIRCLE) {
-            fprintf(
+            export_writer_printf(
                 fd, "1,%d,%f,%f,%f*\n", (int)ls->parameter[CIRCLE_EXPOSURE], ls->parameter[CIRCLE_DIAMETER],
                 ls->parameter[CIRCLE_CENTER_X], ls->parameter[CIRCLE_CENTER_Y]
             );
@@ -56,23 +103,23 @@ export_rs274x_write_macro(FILE* fd, gerbv_aperture_t* currentAperture, gint aper
             int numberOfPoints = (int)ls->parameter[OUTLINE_NUMBER_OF_POINTS];
 
             /* for Flatcam no new line after this 3 digits */
-            fprintf(fd, "4,%d,%d,", (int)ls->parameter[OUTLINE_EXPOSURE], numberOfPoints);
+            export_writer_printf(fd, "4,%d,%d,", (int)ls->parameter[OUTLINE_EXPOSURE], numberOfPoints);
             /* add 1 point for the starting point here */
             for (pointCounter = 0; pointCounter <= numberOfPoints; pointCounter++) {
-                fprintf(
+                export_writer_printf(
                     fd, "%f,%f,", ls->parameter[pointCounter * 2 + OUTLINE_FIRST_X],
                     ls->parameter[pointCounter * 2 + OUTLINE_FIRST_Y]
                 );
             }
-            fprintf(fd, "%f*\n", ls->parameter[pointCounter * 2 + OUTLINE_FIRST_X]);
+            export_writer_printf(fd, "%f*\n", ls->parameter[pointCounter * 2 + OUTLINE_FIRST_X]);
         } else if (ls->type == GERBV_APTYPE_MACRO_POLYGON) {
-            fprintf(
+            export_writer_printf(
                 fd, "5,%d,%d,%f,%f,%f,%f*\n", (int)ls->parameter[POLYGON_EXPOSURE],
                 (int)ls->parameter[POLYGON_NUMBER_OF_POINTS], ls->parameter[POLYGON_CENTER_X],
                 ls->parameter[POLYGON_CENTER_Y], ls->parameter[POLYGON_DIAMETER], ls->parameter[POLYGON_ROTATION]
             );
         } else if (ls->type == GERBV_APTYPE_MACRO_MOIRE) {
-            fprintf(
+            export_writer_printf(
                 fd, "6,%f,%f,%f,%f,%f,%d,%f,%f,%f*\n", ls->parameter[MOIRE_CENTER_X], ls->parameter[MOIRE_CENTER_Y],
                 ls->parameter[MOIRE_OUTSIDE_DIAMETER], ls->parameter[MOIRE_CIRCLE_THICKNESS],
                 ls->parameter[MOIRE_GAP_WIDTH], (int)ls->parameter[MOIRE_NUMBER_OF_CIRCLES],
@@ -80,25 +127,25 @@ export_rs274x_write_macro(FILE* fd, gerbv_aperture_t* currentAperture, gint aper
                 ls->parameter[MOIRE_ROTATION]
             );
         } else if (ls->type == GERBV_APTYPE_MACRO_THERMAL) {
-            fprintf(
+            export_writer_printf(
                 fd, "7,%f,%f,%f,%f,%f,%f*\n", ls->parameter[THERMAL_CENTER_X], ls->parameter[THERMAL_CENTER_Y],
                 ls->parameter[THERMAL_OUTSIDE_DIAMETER], ls->parameter[THERMAL_INSIDE_DIAMETER],
                 ls->parameter[THERMAL_CROSSHAIR_THICKNESS], ls->parameter[THERMAL_ROTATION]
             );
         } else if (ls->type == GERBV_APTYPE_MACRO_LINE20) {
-            fprintf(
+            export_writer_printf(
                 fd, "20,%d,%f,%f,%f,%f,%f,%f*\n", (int)ls->parameter[LINE20_EXPOSURE], ls->parameter[LINE20_LINE_WIDTH],
                 ls->parameter[LINE20_START_X], ls->parameter[LINE20_START_Y], ls->parameter[LINE20_END_X],
                 ls->parameter[LINE20_END_Y], ls->parameter[LINE20_ROTATION]
             );
         } else if (ls->type == GERBV_APTYPE_MACRO_LINE21) {
-            fprintf(
+            export_writer_printf(
                 fd, "21,%d,%f,%f,%f,%f,%f*\n", (int)ls->parameter[LINE21_EXPOSURE], ls->parameter[LINE21_WIDTH],
                 ls->parameter[LINE21_HEIGHT], ls->parameter[LINE21_CENTER_X], ls->parameter[LINE21_CENTER_Y],
                 ls->parameter[LINE21_ROTATION]
             );
         } else if (ls->type == GERBV_APTYPE_MACRO_LINE22) {
-            fprintf(
+            export_writer_printf(
                 fd, "22,%d,%f,%f,%f,%f,%f*\n", (int)ls->parameter[LINE22_EXPOSURE], ls->parameter[LINE22_WIDTH],
                 ls->parameter[LINE22_HEIGHT], ls->parameter[LINE22_LOWER_LEFT_X], ls->parameter[LINE22_LOWER_LEFT_Y],
                 ls->parameter[LINE22_ROTATION]
@@ -106,48 +153,52 @@ export_rs274x_write_macro(FILE* fd, gerbv_aperture_t* currentAperture, gint aper
         }
         ls = ls->next;
     }
-    fprintf(fd, "%%\n");
+    export_writer_printf(fd, "%%\n");
     /* and finally create an aperture definition to use the macro */
-    fprintf(fd, "%%ADD%dMACRO%d*%%\n", apertureNumber, apertureNumber);
+    export_writer_printf(fd, "%%ADD%dMACRO%d*%%\n", apertureNumber, apertureNumber);
 }
 
 void
-export_rs274x_write_apertures(FILE* fd, gerbv_image_t* image) {
+export_rs274x_write_apertures(export_writer_t* fd, gerbv_aperture_t** apertures, const gint* alias) {
     gerbv_aperture_t* currentAperture;
     gint              numberOfRequiredParameters = 0, numberOfOptionalParameters = 0, i, j;
 
-    /* the image should already have been cleaned by a duplicate_image call, so we can safely
+    /* the apertures have been renumbered by the export iterator, so we can safely
        assume the aperture range is correct */
     for (i = APERTURE_MIN; i < APERTURE_MAX; i++) {
         gboolean writeAperture = TRUE;
 
-        currentAperture = image->aperture[i];
+        currentAperture = apertures[i];
 
         if (!currentAperture)
             continue;
 
+        /* duplicates are written as the first aperture like them */
+        if (alias && alias[i] != i)
+            continue;
+
         switch (currentAperture->type) {
             case GERBV_APTYPE_CIRCLE:
-                fprintf(fd, "%%ADD%d", i);
-                fprintf(fd, "C,");
+                export_writer_printf(fd, "%%ADD%d", i);
+                export_writer_printf(fd, "C,");
                 numberOfRequiredParameters = 1;
                 numberOfOptionalParameters = 2;
                 break;
             case GERBV_APTYPE_RECTANGLE:
-                fprintf(fd, "%%ADD%d", i);
-                fprintf(fd, "R,");
+                export_writer_printf(fd, "%%ADD%d", i);
+                export_writer_printf(fd, "R,");
                 numberOfRequiredParameters = 2;
                 numberOfOptionalParameters = 2;
                 break;
             case GERBV_APTYPE_OVAL:
-                fprintf(fd, "%%ADD%d", i);
-                fprintf(fd, "O,");
+                export_writer_printf(fd, "%%ADD%d", i);
+                export_writer_printf(fd, "O,");
                 numberOfRequiredParameters = 2;
                 numberOfOptionalParameters = 2;
                 break;
             case GERBV_APTYPE_POLYGON:
-                fprintf(fd, "%%ADD%d", i);
-                fprintf(fd, "P,");
+                export_writer_printf(fd, "%%ADD%d", i);
+                export_writer_printf(fd, "P,");
                 numberOfRequiredParameters = 2;
                 numberOfOptionalParameters = 3;
                 break;
@@ -163,123 +214,447 @@ export_rs274x_write_apertures(FILE* fd, gerbv_image_t* image) {
                 if ((j < numberOfRequiredParameters) || (currentAperture->parameter[j] != 0)) {
                     /* print the "X" character to separate the parameters */
                     if (j > 0)
-                        fprintf(fd, "X");
-                    fprintf(fd, "%.4f", currentAperture->parameter[j]);
+                        export_writer_printf(fd, "X");
+                    export_writer_printf(fd, "%.4f", currentAperture->parameter[j]);
                 }
             }
-            fprintf(fd, "*%%\n");
+            export_writer_printf(fd, "*%%\n");
         }
     }
 }
 
 void
-export_rs274x_write_layer_change(gerbv_layer_t* oldLayer, gerbv_layer_t* newLayer, FILE* fd) {
+export_rs274x_write_layer_change(gerbv_layer_t* oldLayer, gerbv_layer_t* newLayer, export_writer_t* fd) {
     if (oldLayer->polarity != newLayer->polarity) {
         /* polarity changed */
         if ((newLayer->polarity == GERBV_POLARITY_CLEAR))
-            fprintf(fd, "%%LPC*%%\n");
+            export_writer_printf(fd, "%%LPC*%%\n");
         else
-            fprintf(fd, "%%LPD*%%\n");
+            export_writer_printf(fd, "%%LPD*%%\n");
     }
 }
 
 void
-export_rs274x_write_state_change(gerbv_netstate_t* oldState, gerbv_netstate_t* newState, FILE* fd) {}
+export_rs274x_write_state_change(gerbv_netstate_t* oldState, gerbv_netstate_t* newState, export_writer_t* fd) {}
+
+/* Return the number of parameters of the macro primitive ls that are written */
+static gint
+export_rs274x_macro_parameter_count(const gerbv_simplified_amacro_t* ls) {
+    switch (ls->type) {
+        case GERBV_APTYPE_MACRO_CIRCLE: return CIRCLE_CENTER_Y + 1;
+        case GERBV_APTYPE_MACRO_OUTLINE:
+            return CLAMP(OUTLINE_ROTATION_IDX(ls->parameter) + 1, OUTLINE_FIRST_X, APERTURE_PARAMETERS_MAX);
+        case GERBV_APTYPE_MACRO_POLYGON: return POLYGON_ROTATION + 1;
+        case GERBV_APTYPE_MACRO_MOIRE: return MOIRE_ROTATION + 1;
+        case GERBV_APTYPE_MACRO_THERMAL: return THERMAL_ROTATION + 1;
+        case GERBV_APTYPE_MACRO_LINE20: return LINE20_ROTATION + 1;
+        case GERBV_APTYPE_MACRO_LINE21: return LINE21_ROTATION + 1;
+        case GERBV_APTYPE_MACRO_LINE22: return LINE22_ROTATION + 1;
+        default: return 0;
+    }
+}
 
-gboolean
-gerbv_export_rs274x_file_from_image(
-    const gchar* filename, gerbv_image_t* inputImage, gerbv_user_transformation_t* transform
-) {
-    const double                 decimal_coeff = 1e6;
-    FILE*                        fd;
-    gerbv_netstate_t*            oldState;
-    gerbv_layer_t*               oldLayer;
-    gboolean                     insidePolygon = FALSE;
-    gerbv_user_transformation_t* thisTransform;
+/* Return TRUE if apertures a and b are written the same */
+static gboolean
+export_rs274x_same_aperture(const gerbv_aperture_t* a, const gerbv_aperture_t* b) {
+    const gerbv_simplified_amacro_t *la, *lb;
+    gint                             i, n;
 
-    // force gerbv to output decimals as dots (not commas for other locales)
-    setlocale(LC_NUMERIC, "C");
+    if (a->type != b->type)
+        return FALSE;
 
-    if (transform != NULL) {
-        thisTransform = transform;
-    } else {
-        static gerbv_user_transformation_t identityTransform = { 0, 0, 1, 1, 0, FALSE, FALSE, FALSE };
-        thisTransform                                        = &identityTransform;
+    if (a->type != GERBV_APTYPE_MACRO) {
+        for (i = 0; i < EXPORT_RS274X_STANDARD_PARAMETERS; i++) {
+            if (a->parameter[i] != b->parameter[i])
+                return FALSE;
+        }
+        return TRUE;
     }
-    if ((fd = g_fopen(filename, "w")) == NULL) {
-        GERB_COMPILE_ERROR(_("Can't open file for writing: %s"), filename);
+
+    for (la = a->simplified, lb = b->simplified; la != NULL && lb != NULL; la = la->next, lb = lb->next) {
+        if (la->type != lb->type)
+            return FALSE;
+
+        n = export_rs274x_macro_parameter_count(la);
+        for (i = 0; i < n; i++) {
+            if (la->parameter[i] != lb->parameter[i])
+                return FALSE;
+        }
+    }
+
+    return la == NULL && lb == NULL;
+}
+
+/* Set alias[i] to the first aperture written like aperture i, which is i
+   itself unless it duplicates an earlier one */
+static void
+export_rs274x_find_duplicate_apertures(gerbv_aperture_t** apertures, gint lastAperture, gint* alias) {
+    gint i, j;
+
+    for (i = 0; i < APERTURE_MAX; i++)
+        alias[i] = i;
+
+    for (i = APERTURE_MIN; i <= lastAperture; i++) {
+        if (apertures[i] == NULL)
+            continue;
+
+        for (j = APERTURE_MIN; j < i; j++) {
+            if (apertures[j] != NULL && alias[j] == j && export_rs274x_same_aperture(apertures[j], apertures[i])) {
+                dprintf("Aperture D%d is written as D%d\n", i, j);
+                alias[i] = j;
+                break;
+            }
+        }
+    }
+}
+
+/* Return TRUE if net b of image is net a moved by dx, dy. Merging an image
+   into another reuses the apertures like the copied ones, so the copies may
+   use other but equal apertures. */
+static gboolean
+export_rs274x_same_net_moved(gerbv_image_t* image, const gerbv_net_t* a, const gerbv_net_t* b, gdouble dx, gdouble dy) {
+    const gdouble tolerance = EXPORT_RS274X_REPEAT_TOLERANCE;
+
+    if (a->aperture_state != b->aperture_state || a->interpolation != b->interpolation
+        || (a->cirseg == NULL) != (b->cirseg == NULL))
+        return FALSE;
+
+    if (a->aperture != b->aperture
+        && (a->aperture < 0 || a->aperture >= APERTURE_MAX || b->aperture < 0 || b->aperture >= APERTURE_MAX
+            || image->aperture[a->aperture] == NULL || image->aperture[b->aperture] == NULL
+            || !export_rs274x_same_aperture(image->aperture[a->aperture], image->aperture[b->aperture])))
         return FALSE;
+
+    if (fabs(b->start_x - a->start_x - dx) > tolerance || fabs(b->start_y - a->start_y - dy) > tolerance
+        || fabs(b->stop_x - a->stop_x - dx) > tolerance || fabs(b->stop_y - a->stop_y - dy) > tolerance)
+        return FALSE;
+
+    return a->cirseg == NULL
+        || (fabs(b->cirseg->cp_x - a->cirseg->cp_x - dx) <= tolerance
+            && fabs(b->cirseg->cp_y - a->cirseg->cp_y - dy) <= tolerance);
+}
+
+static int
+export_rs274x_compare_doubles(const void* a, const void* b) {
+    gdouble da = *(const gdouble*)a, db = *(const gdouble*)b;
+
+    return (da > db) - (da < db);
+}
+
+/* Sort the n values and keep one of each, the ones less than half a written
+   unit apart being the same. If they are evenly spaced on the written grid,
+   return how many are left and set step to their spacing, else return 0. */
+static gint
+export_rs274x_grid_axis(gdouble* values, gint n, gdouble* step) {
+    const gdouble unit = 1 / EXPORT_RS274X_DECIMAL_COEFF;
+    gint          count = 1, i;
+
+    qsort(values, n, sizeof(gdouble), export_rs274x_compare_doubles);
+    for (i = 1; i < n; i++) {
+        if (values[i] - values[count - 1] > unit / 2)
+            values[count++] = values[i];
     }
 
-    /* duplicate the image, cleaning it in the process */
-    gerbv_image_t* image = gerbv_image_duplicate_image(inputImage, thisTransform);
+    *step = 0;
+    if (count == 1)
+        return 1;
 
-    /* write header info */
-    fprintf(fd, "G04 This is an RS-274x file exported by *\n");
-    fprintf(fd, "G04 gerbv version %s *\n", VERSION);
-    fprintf(fd, "G04 More information is available about gerbv at *\n");
-    fprintf(fd, "G04 https://gerbv.github.io/ *\n");
-    fprintf(fd, "G04 --End of header info--*\n");
-    fprintf(fd, "%%MOIN*%%\n");
-    fprintf(fd, "%%FSLAX36Y36*%%\n");
+    *step = round((values[count - 1] - values[0]) / (count - 1) * EXPORT_RS274X_DECIMAL_COEFF) * unit;
+    for (i = 1; i < count; i++) {
+        if (fabs(values[i] - values[0] - i * *step) > unit / 2)
+            return 0;
+    }
 
-    /* check the image info struct for any non-default settings */
-    /* image offset */
-    if ((image->info->offsetA > 0.0) || (image->info->offsetB > 0.0))
-        fprintf(fd, "%%IOA%fB%f*%%\n", image->info->offsetA, image->info->offsetB);
-    /* image polarity */
-    if (image->info->polarity == GERBV_POLARITY_CLEAR)
-        fprintf(fd, "%%IPNEG*%%\n");
-    else
-        fprintf(fd, "%%IPPOS*%%\n");
-    /* image name */
-    if (image->info->name)
-        fprintf(fd, "%%IN%s*%%\n", image->info->name);
-    /* plotter film */
-    if (image->info->plotterFilm)
-        fprintf(fd, "%%PF%s*%%\n", image->info->plotterFilm);
+    return count;
+}
 
-    /* image rotation */
-    if ((image->info->imageRotation != 0.0) || (thisTransform->rotation != 0.0))
-        fprintf(fd, "%%IR%d*%%\n", (int)round(RAD2DEG(image->info->imageRotation)) % 360);
-
-    if ((image->info->imageJustifyTypeA != GERBV_JUSTIFY_NOJUSTIFY)
-        || (image->info->imageJustifyTypeB != GERBV_JUSTIFY_NOJUSTIFY)) {
-        fprintf(fd, "%%IJA");
-        if (image->info->imageJustifyTypeA == GERBV_JUSTIFY_CENTERJUSTIFY)
-            fprintf(fd, "C");
-        else
-            fprintf(fd, "%.4f", image->info->imageJustifyOffsetA);
-        fprintf(fd, "B");
-        if (image->info->imageJustifyTypeB == GERBV_JUSTIFY_CENTERJUSTIFY)
-            fprintf(fd, "C");
-        else
-            fprintf(fd, "%.4f", image->info->imageJustifyOffsetB);
-        fprintf(fd, "*%%\n");
+/* Look for the nets of image being copies of the first ones moved to the
+   points of a grid, as merging the same file several times to make a panel
+   gives. None of the nets may be clear: a step and repeat draws each net at
+   every copy before the next net, which only paints the same as the copies
+   one after the other if nothing is cleared. */
+static gboolean
+export_rs274x_find_repeat(
+    gerbv_image_t* image, const gerbv_user_transformation_t* transform, export_rs274x_repeat_t* repeat
+) {
+    GPtrArray*    nets = g_ptr_array_new();
+    gerbv_net_t** net;
+    gdouble *     offsetX = NULL, *offsetY = NULL, *valuesX = NULL, *valuesY = NULL;
+    gboolean*     used  = NULL;
+    gboolean      found = FALSE;
+    guint         nets0, copies, k, i;
+
+    for (gerbv_net_t* currentNet = image->netlist; currentNet != NULL; currentNet = currentNet->next) {
+        gerbv_layer_t* layer = currentNet->layer;
+
+        if (layer == NULL || layer->polarity == GERBV_POLARITY_CLEAR
+            || layer->knockout.type != GERBV_KNOCKOUT_TYPE_NOKNOCKOUT || layer->stepAndRepeat.X != 1
+            || layer->stepAndRepeat.Y != 1) {
+            g_ptr_array_free(nets, TRUE);
+            return FALSE;
+        }
+        g_ptr_array_add(nets, currentNet);
     }
-    /* handle scale user orientation transforms */
-    if (fabs(thisTransform->scaleX - 1) > GERBV_PRECISION_LINEAR_INCH
-        || fabs(thisTransform->scaleY - 1) > GERBV_PRECISION_LINEAR_INCH) {
-        fprintf(fd, "%%SFA%.4fB%.4f*%%\n", thisTransform->scaleX, thisTransform->scaleY);
+    net = (gerbv_net_t**)nets->pdata;
+
+    /* try the smallest copies first, they make the shortest file */
+    for (nets0 = 1; !found && nets0 <= nets->len / 2; nets0++) {
+        gboolean matches = TRUE, insidePolygon = FALSE;
+        gint     countX, countY;
+
+        if (nets->len % nets0 != 0)
+            continue;
+        copies = nets->len / nets0;
+
+        for (k = 1; matches && k < copies; k++) {
+            gdouble dx = net[k * nets0]->start_x - net[0]->start_x;
+            gdouble dy = net[k * nets0]->start_y - net[0]->start_y;
+
+            for (i = 0; matches && i < nets0; i++)
+                matches = export_rs274x_same_net_moved(image, net[i], net[k * nets0 + i], dx, dy);
+        }
+        if (!matches)
+            continue;
+
+        /* a copy must not end inside an area fill */
+        for (i = 0; i < nets0; i++) {
+            if (net[i]->interpolation == GERBV_INTERPOLATION_PAREA_START)
+                insidePolygon = TRUE;
+            else if (net[i]->interpolation == GERBV_INTERPOLATION_PAREA_END)
+                insidePolygon = FALSE;
+        }
+        if (insidePolygon)
+            continue;
+
+        /* the offsets of the copies as written, the transformation moves
+           all of them alike but may rotate or scale them */
+        offsetX = g_renew(gdouble, offsetX, copies);
+        offsetY = g_renew(gdouble, offsetY, copies);
+        valuesX = g_renew(gdouble, valuesX, copies);
+        valuesY = g_renew(gdouble, valuesY, copies);
+        for (k = 0; k < copies; k++) {
+            offsetX[k] = net[k * nets0]->start_x - net[0]->start_x;
+            offsetY[k] = net[k * nets0]->start_y - net[0]->start_y;
+            gerbv_transform_coord(&offsetX[k], &offsetY[k], transform);
+            offsetX[k] -= transform->translateX;
+            offsetY[k] -= transform->translateY;
+            valuesX[k] = offsetX[k];
+            valuesY[k] = offsetY[k];
+        }
+
+        countX = export_rs274x_grid_axis(valuesX, copies, &repeat->stepX);
+        countY = export_rs274x_grid_axis(valuesY, copies, &repeat->stepY);
+        if (countX == 0 || countY == 0 || (guint)(countX * countY) != copies)
+            continue;
+
+        /* every point of the grid must hold exactly one copy */
+        used = g_renew(gboolean, used, copies);
+        memset(used, 0, copies * sizeof(gboolean));
+        for (k = 0; k < copies; k++) {
+            gint a = (countX > 1) ? (gint)round((offsetX[k] - valuesX[0]) / repeat->stepX) : 0;
+            gint b = (countY > 1) ? (gint)round((offsetY[k] - valuesY[0]) / repeat->stepY) : 0;
+
+            if (a < 0 || a >= countX || b < 0 || b >= countY || used[b * countX + a])
+                break;
+            used[b * countX + a] = TRUE;
+        }
+        if (k < copies)
+            continue;
+
+        repeat->nets   = nets0;
+        repeat->countX = countX;
+        repeat->countY = countY;
+        repeat->shiftX = valuesX[0];
+        repeat->shiftY = valuesY[0];
+        found          = TRUE;
     }
-    /* handle mirror image user orientation transform */
-    if ((thisTransform->mirrorAroundX) || (thisTransform->mirrorAroundY)) {
-        fprintf(fd, "%%MIA%dB%d*%%\n", thisTransform->mirrorAroundY, thisTransform->mirrorAroundX);
+
+    dprintf(
+        "Step and repeat: %s, %d x %d copies of %u nets\n", found ? "found" : "not found", found ? repeat->countX : 0,
+        found ? repeat->countY : 0, found ? repeat->nets : 0
+    );
+
+    g_free(offsetX);
+    g_free(offsetY);
+    g_free(valuesX);
+    g_free(valuesY);
+    g_free(used);
+    g_ptr_array_free(nets, TRUE);
+
+    return found;
+}
+
+/* Write a block with the coordinates that changed. interpolation is the G
+   code, or 0 if the block doesn't draw, and ij the arc center, or NULL. */
+static void
+export_rs274x_write_block(
+    export_rs274x_writer_t* w, gint interpolation, glong x, glong y, const glong* ij, gint dCode
+) {
+    if (interpolation != 0 && interpolation != w->interpolation) {
+        export_writer_printf(w->fd, "G%02d", interpolation);
+        w->interpolation = interpolation;
+    }
+    if (x != w->x)
+        export_writer_printf(w->fd, "X%ld", x);
+    if (y != w->y)
+        export_writer_printf(w->fd, "Y%ld", y);
+    if (ij != NULL)
+        export_writer_printf(w->fd, "I%ldJ%ld", ij[0], ij[1]);
+    export_writer_printf(w->fd, "D%02d*\n", dCode);
+
+    w->x = x;
+    w->y = y;
+}
+
+/* Write the track waiting to be extended, if any */
+static void
+export_rs274x_flush_draw(export_rs274x_writer_t* w) {
+    if (w->drawing) {
+        w->drawing = FALSE;
+        export_rs274x_write_block(w, 1, w->drawX, w->drawY, NULL, 1);
     }
+}
 
-    /* define all apertures */
-    fprintf(fd, "G04 --Define apertures--*\n");
-    export_rs274x_write_apertures(fd, image);
+/* Take the pen to x, y, unless it is there already */
+static void
+export_rs274x_move_to(export_rs274x_writer_t* w, glong x, glong y) {
+    if (x != w->x || y != w->y)
+        export_rs274x_write_block(w, 0, x, y, NULL, 2);
+}
 
-    /* write rest of image */
-    fprintf(fd, "G04 --Start main section--*\n");
-    gint         currentAperture = 0;
-    gerbv_net_t* currentNet;
+/* Return TRUE if the track from x0, y0 to x1, y1 goes on straight from the
+   waiting one */
+static gboolean
+export_rs274x_continues_draw(const export_rs274x_writer_t* w, glong x0, glong y0, glong x1, glong y1) {
+    gint64 ax = w->drawX - w->x, ay = w->drawY - w->y;
+    gint64 bx = x1 - x0, by = y1 - y0;
 
-    oldLayer = image->layers;
-    oldState = image->states;
+    if (x0 != w->drawX || y0 != w->drawY)
+        return FALSE;
+    if (MAX(ABS(ax), ABS(ay)) > EXPORT_RS274X_MERGE_MAX || MAX(ABS(bx), ABS(by)) > EXPORT_RS274X_MERGE_MAX)
+        return FALSE;
+
+    /* collinear, and not turning back over the waiting track */
+    return ax * by == ay * bx && ax * bx + ay * by > 0;
+}
+
+/* Write nets of iter, all of them if count is 0 */
+static void
+export_rs274x_write_nets_optimized(export_rs274x_writer_t* w, gerbv_export_iter_t* iter, guint count) {
+    const double coeff = EXPORT_RS274X_DECIMAL_COEFF;
+    gerbv_net_t* net;
+    guint        n;
+
+    for (n = 0; (count == 0 || n < count) && (net = gerbv_image_export_iter_next(iter)) != NULL; n++) {
+        glong    x0, y0, x1, y1, ij[2];
+        gboolean arc;
+
+        if (net->interpolation == GERBV_INTERPOLATION_DELETED)
+            continue;
+
+        if (net->layer->polarity != w->polarity
+            && (net->layer->polarity == GERBV_POLARITY_CLEAR || w->polarity == GERBV_POLARITY_CLEAR)) {
+            export_rs274x_flush_draw(w);
+            export_writer_printf(w->fd, (net->layer->polarity == GERBV_POLARITY_CLEAR) ? "%%LPC*%%\n" : "%%LPD*%%\n");
+        }
+        w->polarity = net->layer->polarity;
+
+        /* make sure the aperture number is a valid one, since sometimes the
+           loaded file may refer to invalid apertures */
+        if (net->aperture >= 0 && net->aperture < APERTURE_MAX && iter->aperture[net->aperture] != NULL
+            && w->alias[net->aperture] != w->aperture) {
+            export_rs274x_flush_draw(w);
+            w->aperture = w->alias[net->aperture];
+            export_writer_printf(w->fd, "D%02d*\n", w->aperture);
+        }
+
+        x0 = (glong)round((net->start_x + w->shiftX) * coeff);
+        y0 = (glong)round((net->start_y + w->shiftY) * coeff);
+        x1 = (glong)round((net->stop_x + w->shiftX) * coeff);
+        y1 = (glong)round((net->stop_y + w->shiftY) * coeff);
+
+        arc = (net->interpolation == GERBV_INTERPOLATION_CW_CIRCULAR
+               || net->interpolation == GERBV_INTERPOLATION_CCW_CIRCULAR);
+
+        switch (net->interpolation) {
+            case GERBV_INTERPOLATION_LINEARx1:
+            case GERBV_INTERPOLATION_LINEARx10:
+            case GERBV_INTERPOLATION_LINEARx01:
+            case GERBV_INTERPOLATION_LINEARx001:
+            case GERBV_INTERPOLATION_CW_CIRCULAR:
+            case GERBV_INTERPOLATION_CCW_CIRCULAR:
+                if (net->aperture_state == GERBV_APERTURE_STATE_OFF) {
+                    /* in an area fill a move starts a new contour, elsewhere
+                       the pen is only moved when something is drawn or
+                       flashed, so a row of moves is written as the last one */
+                    if (w->insidePolygon) {
+                        export_rs274x_flush_draw(w);
+                        export_rs274x_write_block(w, 0, x1, y1, NULL, 2);
+                    }
+                    break;
+                }
+                if (net->aperture_state == GERBV_APERTURE_STATE_FLASH) {
+                    export_rs274x_flush_draw(w);
+                    export_rs274x_write_block(w, 0, x1, y1, NULL, 3);
+                    break;
+                }
+                if (!arc && w->drawing && export_rs274x_continues_draw(w, x0, y0, x1, y1)) {
+                    w->drawX = x1;
+                    w->drawY = y1;
+                    break;
+                }
+                export_rs274x_flush_draw(w);
+                export_rs274x_move_to(w, x0, y0);
+                if (!arc) {
+                    w->drawing = TRUE;
+                    w->drawX   = x1;
+                    w->drawY   = y1;
+                    break;
+                }
+
+                /* always use multi-quadrant, since it's much easier to export */
+                if (!w->multiQuadrant) {
+                    export_writer_printf(w->fd, "G75*\n");
+                    w->multiQuadrant = TRUE;
+                }
+                ij[0] = (glong)round((net->cirseg->cp_x - net->start_x) * coeff);
+                ij[1] = (glong)round((net->cirseg->cp_y - net->start_y) * coeff);
+                export_rs274x_write_block(
+                    w, (net->interpolation == GERBV_INTERPOLATION_CW_CIRCULAR) ? 2 : 3, x1, y1, ij, 1
+                );
+                break;
+            case GERBV_INTERPOLATION_PAREA_START:
+                export_rs274x_flush_draw(w);
+                export_writer_printf(w->fd, "G36*\n");
+                w->insidePolygon = TRUE;
+                break;
+            case GERBV_INTERPOLATION_PAREA_END:
+                export_rs274x_flush_draw(w);
+                export_writer_printf(w->fd, "G37*\n");
+                w->insidePolygon = FALSE;
+                break;
+            default: break;
+        }
+    }
+
+    export_rs274x_flush_draw(w);
+}
+
+/* Write the nets of iter the way gerbv_image_duplicate_image() would copy them */
+static void
+export_rs274x_write_nets(export_writer_t* fd, gerbv_export_iter_t* iter) {
+    const double      decimal_coeff   = EXPORT_RS274X_DECIMAL_COEFF;
+    gerbv_netstate_t* oldState;
+    gerbv_layer_t*    oldLayer;
+    gboolean          insidePolygon   = FALSE;
+    gint              currentAperture = 0;
+    gerbv_net_t*      currentNet;
+
+    oldLayer = &iter->layer;
+    oldState = &iter->state;
     /* skip the first net, since it's always zero due to the way we parse things */
-    for (currentNet = image->netlist->next; currentNet; currentNet = currentNet->next) {
+    gerbv_image_export_iter_next(iter);
+    while ((currentNet = gerbv_image_export_iter_next(iter)) != NULL) {
         /* check for "layer" changes (RS274X commands) */
         if (currentNet->layer != oldLayer)
             export_rs274x_write_layer_change(oldLayer, currentNet->layer, fd);
@@ -291,8 +666,8 @@ gerbv_export_rs274x_file_from_image(
         /* check for tool changes */
         /* also, make sure the aperture number is a valid one, since sometimes
            the loaded file may refer to invalid apertures */
-        if ((currentNet->aperture != currentAperture) && (image->aperture[currentNet->aperture] != NULL)) {
-            fprintf(fd, "G54D%02d*\n", currentNet->aperture);
+        if ((currentNet->aperture != currentAperture) && (iter->aperture[currentNet->aperture] != NULL)) {
+            export_writer_printf(fd, "G54D%02d*\n", currentNet->aperture);
             currentAperture = currentNet->aperture;
         }
 
@@ -310,18 +685,18 @@ gerbv_export_rs274x_file_from_image(
                 if ((!insidePolygon) && (currentNet->aperture_state == GERBV_APERTURE_STATE_ON)) {
                     xVal = (long)round(currentNet->start_x * decimal_coeff);
                     yVal = (long)round(currentNet->start_y * decimal_coeff);
-                    fprintf(fd, "G01X%07ldY%07ldD02*\n", xVal, yVal);
+                    export_writer_printf(fd, "G01X%07ldY%07ldD02*\n", xVal, yVal);
                 }
                 xVal = (long)round(currentNet->stop_x * decimal_coeff);
                 yVal = (long)round(currentNet->stop_y * decimal_coeff);
-                fprintf(fd, "G01X%07ldY%07ld", xVal, yVal);
+                export_writer_printf(fd, "G01X%07ldY%07ld", xVal, yVal);
                 /* and finally, write the esposure value */
                 if (currentNet->aperture_state == GERBV_APERTURE_STATE_OFF)
-                    fprintf(fd, "D02*\n");
+                    export_writer_printf(fd, "D02*\n");
                 else if (currentNet->aperture_state == GERBV_APERTURE_STATE_ON)
-                    fprintf(fd, "D01*\n");
+                    export_writer_printf(fd, "D01*\n");
                 else
-                    fprintf(fd, "D03*\n");
+                    export_writer_printf(fd, "D03*\n");
                 break;
             case GERBV_INTERPOLATION_CW_CIRCULAR:
             case GERBV_INTERPOLATION_CCW_CIRCULAR:
@@ -330,7 +705,7 @@ gerbv_export_rs274x_file_from_image(
                 if ((!insidePolygon) && (currentNet->aperture_state == GERBV_APERTURE_STATE_ON)) {
                     xVal = (long)round(currentNet->start_x * decimal_coeff);
                     yVal = (long)round(currentNet->start_y * decimal_coeff);
-                    fprintf(fd, "G01X%07ldY%07ldD02*\n", xVal, yVal);
+                    export_writer_printf(fd, "G01X%07ldY%07ldD02*\n", xVal, yVal);
                 }
                 centerX = (long)round((currentNet->cirseg->cp_x - currentNet->start_x) * decimal_coeff);
                 centerY = (long)round((currentNet->cirseg->cp_y - currentNet->start_y) * decimal_coeff);
@@ -339,44 +714,182 @@ gerbv_export_rs274x_file_from_image(
 
                 /* always use multi-quadrant, since it's much easier to export */
                 /*  and most all software should support it */
-                fprintf(fd, "G75*\n");
+                export_writer_printf(fd, "G75*\n");
 
                 if (currentNet->interpolation == GERBV_INTERPOLATION_CW_CIRCULAR)
-                    fprintf(fd, "G02"); /* Clockwise */
+                    export_writer_printf(fd, "G02"); /* Clockwise */
                 else
-                    fprintf(fd, "G03"); /* Counter clockwise */
+                    export_writer_printf(fd, "G03"); /* Counter clockwise */
 
                 /* don't write the I and J values if the exposure is off */
                 if (currentNet->aperture_state == GERBV_APERTURE_STATE_ON)
-                    fprintf(fd, "X%07ldY%07ldI%07ldJ%07ld", endX, endY, centerX, centerY);
+                    export_writer_printf(fd, "X%07ldY%07ldI%07ldJ%07ld", endX, endY, centerX, centerY);
                 else
-                    fprintf(fd, "X%07ldY%07ld", endX, endY);
+                    export_writer_printf(fd, "X%07ldY%07ld", endX, endY);
                 /* and finally, write the esposure value */
                 if (currentNet->aperture_state == GERBV_APERTURE_STATE_OFF)
-                    fprintf(fd, "D02*\n");
+                    export_writer_printf(fd, "D02*\n");
                 else if (currentNet->aperture_state == GERBV_APERTURE_STATE_ON)
-                    fprintf(fd, "D01*\n");
+                    export_writer_printf(fd, "D01*\n");
                 else
-                    fprintf(fd, "D03*\n");
+                    export_writer_printf(fd, "D03*\n");
                 break;
             case GERBV_INTERPOLATION_PAREA_START:
-                fprintf(fd, "G36*\n");
+                export_writer_printf(fd, "G36*\n");
                 insidePolygon = TRUE;
                 break;
             case GERBV_INTERPOLATION_PAREA_END:
-                fprintf(fd, "G37*\n");
+                export_writer_printf(fd, "G37*\n");
                 insidePolygon = FALSE;
                 break;
             default: break;
         }
     }
 
-    fprintf(fd, "M02*\n");
+}
+
+/* Write the nets of iter as few blocks as possible, with a step and repeat
+   if the image is a panel of copies */
+static void
+export_rs274x_write_nets_compact(
+    export_writer_t* fd, gerbv_export_iter_t* iter, const gint* alias, gerbv_user_transformation_t* transform
+) {
+    export_rs274x_writer_t w = { 0 };
+    export_rs274x_repeat_t repeat;
+
+    w.fd       = fd;
+    w.alias    = alias;
+    w.x        = EXPORT_RS274X_NO_POSITION;
+    w.y        = EXPORT_RS274X_NO_POSITION;
+    w.aperture = -1;
+    w.polarity = GERBV_POLARITY_DARK;
+
+    if (iter->firstNet != NULL && export_rs274x_find_repeat(iter->image, transform, &repeat)) {
+        /* write the first copy where the lower left one goes, and repeat it */
+        w.shiftX = repeat.shiftX;
+        w.shiftY = repeat.shiftY;
+        export_writer_printf(fd, "%%SRX%dY%dI%.6fJ%.6f*%%\n", repeat.countX, repeat.countY, repeat.stepX, repeat.stepY);
+        /* readers needn't carry the position into the repeated block */
+        w.x = EXPORT_RS274X_NO_POSITION;
+        w.y = EXPORT_RS274X_NO_POSITION;
+        export_rs274x_write_nets_optimized(&w, iter, repeat.nets);
+        export_writer_printf(fd, "%%SR*%%\n");
+        return;
+    }
+
+    export_rs274x_write_nets_optimized(&w, iter, 0);
+}
 
-    gerbv_destroy_image(image);
-    fclose(fd);
+static gboolean
+export_rs274x_file(
+    const gchar* filename, gerbv_image_t* inputImage, gerbv_user_transformation_t* transform, gboolean compact
+) {
+    export_writer_t*             fd;
+    gerbv_user_transformation_t* thisTransform;
+    gerbv_export_iter_t          iter;
+    gint*                        alias = NULL;
 
-    // return to the default locale
-    setlocale(LC_NUMERIC, "");
-    return TRUE;
+    if (transform != NULL) {
+        thisTransform = transform;
+    } else {
+        static gerbv_user_transformation_t identityTransform = { 0, 0, 1, 1, 0, FALSE, FALSE, FALSE };
+        thisTransform                                        = &identityTransform;
+    }
+    if ((fd = export_writer_open(filename)) == NULL) {
+        GERB_COMPILE_ERROR(_("Can't open file for writing: %s"), filename);
+        return FALSE;
+    }
+
+    /* transform and renumber the nets while writing them, instead of duplicating the image */
+    gerbv_image_export_iter_init(&iter, inputImage, thisTransform);
+
+    /* write header info */
+    export_writer_printf(fd, "G04 This is an RS-274x file exported by *\n");
+    export_writer_printf(fd, "G04 gerbv version %s *\n", VERSION);
+    export_writer_printf(fd, "G04 More information is available about gerbv at *\n");
+    export_writer_printf(fd, "G04 https://gerbv.github.io/ *\n");
+    export_writer_printf(fd, "G04 --End of header info--*\n");
+    export_writer_printf(fd, "%%MOIN*%%\n");
+    export_writer_printf(fd, "%%FSLAX36Y36*%%\n");
+
+    /* check the image info struct for any non-default settings */
+    /* image offset */
+    if ((inputImage->info->offsetA > 0.0) || (inputImage->info->offsetB > 0.0))
+        export_writer_printf(fd, "%%IOA%fB%f*%%\n", inputImage->info->offsetA, inputImage->info->offsetB);
+    /* image polarity */
+    if (inputImage->info->polarity == GERBV_POLARITY_CLEAR)
+        export_writer_printf(fd, "%%IPNEG*%%\n");
+    else
+        export_writer_printf(fd, "%%IPPOS*%%\n");
+    /* image name */
+    if (inputImage->info->name)
+        export_writer_printf(fd, "%%IN%s*%%\n", inputImage->info->name);
+    /* plotter film */
+    if (inputImage->info->plotterFilm)
+        export_writer_printf(fd, "%%PF%s*%%\n", inputImage->info->plotterFilm);
+
+    /* image rotation */
+    if ((inputImage->info->imageRotation != 0.0) || (thisTransform->rotation != 0.0))
+        export_writer_printf(fd, "%%IR%d*%%\n", (int)round(RAD2DEG(inputImage->info->imageRotation)) % 360);
+
+    if ((inputImage->info->imageJustifyTypeA != GERBV_JUSTIFY_NOJUSTIFY)
+        || (inputImage->info->imageJustifyTypeB != GERBV_JUSTIFY_NOJUSTIFY)) {
+        export_writer_printf(fd, "%%IJA");
+        if (inputImage->info->imageJustifyTypeA == GERBV_JUSTIFY_CENTERJUSTIFY)
+            export_writer_printf(fd, "C");
+        else
+            export_writer_printf(fd, "%.4f", inputImage->info->imageJustifyOffsetA);
+        export_writer_printf(fd, "B");
+        if (inputImage->info->imageJustifyTypeB == GERBV_JUSTIFY_CENTERJUSTIFY)
+            export_writer_printf(fd, "C");
+        else
+            export_writer_printf(fd, "%.4f", inputImage->info->imageJustifyOffsetB);
+        export_writer_printf(fd, "*%%\n");
+    }
+    /* handle scale user orientation transforms */
+    if (fabs(thisTransform->scaleX - 1) > GERBV_PRECISION_LINEAR_INCH
+        || fabs(thisTransform->scaleY - 1) > GERBV_PRECISION_LINEAR_INCH) {
+        export_writer_printf(fd, "%%SFA%.4fB%.4f*%%\n", thisTransform->scaleX, thisTransform->scaleY);
+    }
+    /* handle mirror image user orientation transform */
+    if ((thisTransform->mirrorAroundX) || (thisTransform->mirrorAroundY)) {
+        export_writer_printf(fd, "%%MIA%dB%d*%%\n", thisTransform->mirrorAroundY, thisTransform->mirrorAroundX);
+    }
+
+    /* define all apertures */
+    export_writer_printf(fd, "G04 --Define apertures--*\n");
+    if (compact) {
+        alias = g_new(gint, APERTURE_MAX);
+        export_rs274x_find_duplicate_apertures(iter.aperture, iter.lastAperture, alias);
+    }
+    export_rs274x_write_apertures(fd, iter.aperture, alias);
+
+    /* write rest of image */
+    export_writer_printf(fd, "G04 --Start main section--*\n");
+    if (compact)
+        export_rs274x_write_nets_compact(fd, &iter, alias, thisTransform);
+    else
+        export_rs274x_write_nets(fd, &iter);
+
+
+    export_writer_printf(fd, "M02*\n");
+
+    gerbv_image_export_iter_clear(&iter);
+    g_free(alias);
+
+    return export_writer_close(fd);
+}
+
+gboolean
+gerbv_export_rs274x_file_from_image(
+    const gchar* filename, gerbv_image_t* inputImage, gerbv_user_transformation_t* transform
+) {
+    return export_rs274x_file(filename, inputImage, transform, FALSE);
+}
+
+gboolean
+gerbv_export_rs274x_file_from_image_compact(
+    const gchar* filename, gerbv_image_t* inputImage, gerbv_user_transformation_t* transform
+) {
+    return export_rs274x_file(filename, inputImage, transform, TRUE);
 }
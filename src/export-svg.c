@@ -0,0 +1,753 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file export-svg.c
+    \brief SVG export, written directly instead of through cairo's SVG surface
+    \ingroup libgerbv
+
+    cairo writes every flash as a separate path, so boards with many pads
+    give huge files. Here each flashed aperture is written once as a
+    \<symbol\> and every flash is a \<use\> of it, the tracks of each width
+    are joined into one stroked path, and clear polarity is done with masks
+    instead of painting the background color over the layers below.
+
+    It has to be asked for, with --export=svg-native; the default SVG export
+    still goes through cairo.
+*/
+
+#include "gerbv.h"
+
+#include <math.h>
+#include <string.h>
+
+#include "common.h"
+#include "gerb_image.h"
+#include "export-writer.h"
+#include "export-vector.h"
+
+/* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
+#define dprintf \
+    if (DEBUG)  \
+    printf
+
+/* Decimals of coordinates in inches, and of the transformation matrices */
+#define SVG_COORD_DECIMALS  5
+#define SVG_MATRIX_DECIMALS 9
+
+typedef enum {
+    SVG_PIECE_PAGE,     /* the whole page, for inverted images */
+    SVG_PIECE_KNOCKOUT, /* the knockout of the layer of first */
+    SVG_PIECE_NETS,     /* the nets from first up to end */
+} svg_piece_kind_t;
+
+/*! A part of an image drawn with one polarity */
+typedef struct {
+    svg_piece_kind_t kind;
+    gboolean         dark;
+    gerbv_net_t*     first;
+    gerbv_net_t*     end;
+} svg_piece_t;
+
+typedef struct {
+    export_writer_t*     w;
+    gerbv_image_t*       image;
+    gint                 fileIndex;
+    cairo_matrix_t       imageMatrix; /* from the image to the page, in inches */
+    gerbv_render_info_t* renderInfo;
+    gint                 nextId;
+
+    /* the open section, a group of nets sharing the layer and netstate */
+    gboolean          inSection;
+    gerbv_layer_t*    layer;
+    gerbv_netstate_t* state;
+    cairo_matrix_t    sectionMatrix;
+    gint              sectionId; /* 0 unless the section is stepped and repeated */
+    GArray*           strokes;
+    guint             lastStroke;
+} svg_export_t;
+
+/* ------------------------------------------------------------------ */
+static void
+svg_write_number(export_writer_t* w, gdouble value, guint decimals) {
+    gchar buffer[EXPORT_WRITER_NUMBER_SIZE];
+
+    buffer[export_writer_format_number(buffer, value, decimals)] = '\0';
+    export_writer_puts(w, buffer);
+}
+
+/* ------------------------------------------------------------------ */
+/* Write the attribute name="value" with a leading space */
+static void
+svg_write_attribute(export_writer_t* w, const gchar* name, gdouble value) {
+    export_writer_printf(w, " %s=\"", name);
+    svg_write_number(w, value, SVG_COORD_DECIMALS);
+    export_writer_putc(w, '"');
+}
+
+/* ------------------------------------------------------------------ */
+/* Write the attribute name="#rrggbb" with a leading space */
+static void
+svg_write_color(export_writer_t* w, const gchar* name, const GdkColor* color) {
+    gchar buffer[8];
+
+    g_snprintf(buffer, sizeof(buffer), "#%02x%02x%02x", color->red >> 8, color->green >> 8, color->blue >> 8);
+    export_writer_printf(w, " %s=\"%s\"", name, buffer);
+}
+
+/* ------------------------------------------------------------------ */
+static void
+svg_write_matrix(export_writer_t* w, const cairo_matrix_t* m) {
+    const gdouble v[] = { m->xx, m->yx, m->xy, m->yy, m->x0, m->y0 };
+    guint         i;
+
+    export_writer_puts(w, " transform=\"matrix(");
+    for (i = 0; i < G_N_ELEMENTS(v); i++) {
+        if (i > 0)
+            export_writer_putc(w, ' ');
+        svg_write_number(w, v[i], SVG_MATRIX_DECIMALS);
+    }
+    export_writer_puts(w, ")\"");
+}
+
+/* ------------------------------------------------------------------ */
+static void
+svg_append_number(GString* d, gdouble value) {
+    gchar buffer[EXPORT_WRITER_NUMBER_SIZE];
+
+    g_string_append_len(d, buffer, export_writer_format_number(buffer, value, SVG_COORD_DECIMALS));
+}
+
+/* ------------------------------------------------------------------ */
+/* Append command followed by the point x,y */
+static void
+svg_append_point(GString* d, gchar command, gdouble x, gdouble y) {
+    g_string_append_c(d, command);
+    svg_append_number(d, x);
+    g_string_append_c(d, ' ');
+    svg_append_number(d, y);
+}
+
+/* ------------------------------------------------------------------ */
+/* Append an elliptic arc around cx,cy from angle1 to angle2 in radians,
+   starting at the current point. The arc is split in quarters at most,
+   so the large arc flag is never needed. */
+static void
+svg_append_arc(GString* d, gdouble cx, gdouble cy, gdouble rx, gdouble ry, gdouble angle1, gdouble angle2) {
+    gint steps = MAX(1, (gint)ceil(fabs(angle2 - angle1) / M_PI_2 - 1e-9));
+    gint i;
+
+    for (i = 1; i <= steps; i++) {
+        gdouble angle = angle1 + (angle2 - angle1) * i / steps;
+
+        g_string_append_c(d, 'A');
+        svg_append_number(d, rx);
+        g_string_append_c(d, ' ');
+        svg_append_number(d, ry);
+        g_string_append_printf(d, " 0 0 %d ", (angle2 > angle1) ? 1 : 0);
+        svg_append_number(d, cx + rx * cos(angle));
+        g_string_append_c(d, ' ');
+        svg_append_number(d, cy + ry * sin(angle));
+    }
+}
+
+/* ------------------------------------------------------------------ */
+static void
+svg_move_to(GString* d, gdouble x, gdouble y) {
+    svg_append_point(d, 'M', x, y);
+}
+
+/* ------------------------------------------------------------------ */
+static void
+svg_line_to(GString* d, gdouble x, gdouble y) {
+    svg_append_point(d, 'L', x, y);
+}
+
+/* ------------------------------------------------------------------ */
+static void
+svg_close_path(GString* d) {
+    g_string_append_c(d, 'Z');
+}
+
+static const export_vector_path_t svg_path = { svg_move_to, svg_line_to, svg_append_arc, svg_close_path };
+
+/* ------------------------------------------------------------------ */
+/* Finish a path element, whose attributes the caller wrote, with the data
+   of d, and empty d */
+static void
+svg_end_path(export_writer_t* w, GString* d) {
+    export_writer_puts(w, " d=\"");
+    export_writer_puts(w, d->str);
+    export_writer_puts(w, "\"/>\n");
+    g_string_truncate(d, 0);
+}
+
+/* ------------------------------------------------------------------ */
+static void
+svg_write_path(export_writer_t* w, GString* d) {
+    export_writer_puts(w, "<path");
+    svg_end_path(w, d);
+}
+
+/* ------------------------------------------------------------------ */
+/* Write the mask of id that hides what the nested output draws, over the
+   rectangle x,y of size width x height. Close it with svg_end_mask(). */
+static void
+svg_begin_mask(export_writer_t* w, const gchar* id, gdouble x, gdouble y, gdouble width, gdouble height) {
+    export_writer_printf(w, "<mask id=\"%s\" maskUnits=\"userSpaceOnUse\"", id);
+    svg_write_attribute(w, "x", x);
+    svg_write_attribute(w, "y", y);
+    svg_write_attribute(w, "width", width);
+    svg_write_attribute(w, "height", height);
+    export_writer_puts(w, ">\n<rect fill=\"#fff\"");
+    svg_write_attribute(w, "x", x);
+    svg_write_attribute(w, "y", y);
+    svg_write_attribute(w, "width", width);
+    svg_write_attribute(w, "height", height);
+    export_writer_puts(w, "/>\n<g color=\"#000\" fill=\"currentColor\">\n");
+}
+
+/* ------------------------------------------------------------------ */
+static void
+svg_end_mask(export_writer_t* w) {
+    export_writer_puts(w, "</g>\n</mask>\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* Write one macro primitive, like gerbv_draw_amacro() draws it */
+static void
+svg_write_macro_primitive(export_writer_t* w, const gerbv_simplified_amacro_t* s, GString* d) {
+    const gdouble* p = s->parameter;
+    gdouble        diameter, step, r;
+    cairo_matrix_t m;
+    gint           i;
+
+    if (s->type != GERBV_APTYPE_MACRO_MOIRE) {
+        if (export_vector_macro_primitive(&svg_path, d, s))
+            svg_write_path(w, d);
+        return;
+    }
+
+    /* moirés are stroked */
+    diameter = p[MOIRE_OUTSIDE_DIAMETER] - p[MOIRE_CIRCLE_THICKNESS];
+    step     = 2 * (p[MOIRE_GAP_WIDTH] + p[MOIRE_CIRCLE_THICKNESS]);
+    r        = p[MOIRE_CROSSHAIR_LENGTH] / 2;
+
+    cairo_matrix_init_translate(&m, p[MOIRE_CENTER_X], p[MOIRE_CENTER_Y]);
+    cairo_matrix_rotate(&m, DEG2RAD(p[MOIRE_ROTATION]));
+
+    export_writer_puts(w, "<g fill=\"none\" stroke=\"currentColor\" stroke-linecap=\"butt\"");
+    svg_write_matrix(w, &m);
+    export_writer_puts(w, ">\n");
+
+    for (i = 0; i < (gint)p[MOIRE_NUMBER_OF_CIRCLES] && diameter - step * i > 0; i++)
+        export_vector_circle(&svg_path, d, 0, 0, (diameter - step * i) / 2);
+    if (d->len > 0) {
+        export_writer_puts(w, "<path");
+        svg_write_attribute(w, "stroke-width", p[MOIRE_CIRCLE_THICKNESS]);
+        svg_end_path(w, d);
+    }
+
+    svg_append_point(d, 'M', -r, 0);
+    svg_append_point(d, 'L', r, 0);
+    svg_append_point(d, 'M', 0, -r);
+    svg_append_point(d, 'L', 0, r);
+    export_writer_puts(w, "<path");
+    svg_write_attribute(w, "stroke-width", p[MOIRE_CROSSHAIR_THICKNESS]);
+    svg_end_path(w, d);
+
+    export_writer_puts(w, "</g>\n");
+}
+
+/* ------------------------------------------------------------------ */
+/* Write the primitives of a macro. The ones with exposure off cut the
+   primitives before them with a mask, like cairo_push_group() does. */
+static void
+svg_write_macro(export_writer_t* w, const gerbv_simplified_amacro_t* macro, const gchar* id, GString* d) {
+    const gerbv_simplified_amacro_t* s;
+    gdouble                          extent = export_vector_macro_extent(macro) * 1.5 + 0.1;
+    gboolean                         dark, runDark;
+    gint                             nClear = 0, run;
+
+    /* count the runs of clear primitives following dark ones */
+    dark = runDark = TRUE;
+    for (s = macro; s != NULL; s = s->next) {
+        dark = export_vector_macro_primitive_dark(s, dark);
+        if (!dark && runDark)
+            nClear++;
+        runDark = dark;
+    }
+
+    /* masks first, each holding a run of clear primitives */
+    dark = runDark = TRUE;
+    run            = 0;
+    for (s = macro; s != NULL; s = s->next) {
+        dark = export_vector_macro_primitive_dark(s, dark);
+        if (!dark && runDark) {
+            gchar* maskId = g_strdup_printf("%sm%d", id, ++run);
+
+            svg_begin_mask(w, maskId, -extent, -extent, 2 * extent, 2 * extent);
+            g_free(maskId);
+        } else if (dark && !runDark) {
+            svg_end_mask(w);
+        }
+        if (!dark)
+            svg_write_macro_primitive(w, s, d);
+        runDark = dark;
+    }
+    if (!runDark)
+        svg_end_mask(w);
+
+    /* then the dark primitives, inside a group per mask */
+    for (run = nClear; run > 0; run--)
+        export_writer_printf(w, "<g mask=\"url(#%sm%d)\">\n", id, run);
+
+    dark = runDark = TRUE;
+    for (s = macro; s != NULL; s = s->next) {
+        dark = export_vector_macro_primitive_dark(s, dark);
+        if (!dark && runDark)
+            export_writer_puts(w, "</g>\n");
+        if (dark)
+            svg_write_macro_primitive(w, s, d);
+        runDark = dark;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Write the symbol flashes of aperture use */
+static void
+svg_write_aperture_symbol(svg_export_t* e, gint number, gerbv_aperture_t* aperture) {
+    export_writer_t* w = e->w;
+    GString*         d = g_string_new(NULL);
+    gchar*           id;
+
+    id = g_strdup_printf("a%d_%d", e->fileIndex, number);
+    export_writer_printf(w, "<symbol id=\"%s\" overflow=\"visible\">\n", id);
+
+    switch (aperture->type) {
+        case GERBV_APTYPE_CIRCLE:
+        case GERBV_APTYPE_RECTANGLE:
+        case GERBV_APTYPE_OVAL:
+        case GERBV_APTYPE_POLYGON: export_vector_aperture(&svg_path, d, aperture); break;
+        case GERBV_APTYPE_MACRO: svg_write_macro(w, aperture->simplified, id, d); break;
+        default:
+            GERB_COMPILE_WARNING(_("Unknown aperture type: %s"), _(gerbv_aperture_type_name(aperture->type)));
+            break;
+    }
+
+    if (d->len > 0)
+        svg_write_path(w, d);
+    export_writer_puts(w, "</symbol>\n");
+
+    g_string_free(d, TRUE);
+    g_free(id);
+}
+
+/* ------------------------------------------------------------------ */
+static void
+svg_write_strokes(svg_export_t* e) {
+    guint i;
+
+    for (i = 0; i < e->strokes->len; i++) {
+        export_vector_stroke_t* stroke = &g_array_index(e->strokes, export_vector_stroke_t, i);
+
+        export_writer_puts(e->w, "<path fill=\"none\" stroke=\"currentColor\"");
+        svg_write_attribute(e->w, "stroke-width", stroke->width);
+        if (stroke->squareCap)
+            export_writer_puts(e->w, " stroke-linecap=\"square\"");
+        svg_end_path(e->w, stroke->d);
+        g_string_free(stroke->d, TRUE);
+    }
+    g_array_set_size(e->strokes, 0);
+}
+
+/* ------------------------------------------------------------------ */
+static void
+svg_end_section(svg_export_t* e) {
+    gerbv_step_and_repeat_t* sr = &e->layer->stepAndRepeat;
+    gint                     ix, iy;
+
+    if (!e->inSection)
+        return;
+
+    svg_write_strokes(e);
+    export_writer_puts(e->w, "</g>\n");
+
+    /* the other steps and repeats reuse the first one */
+    for (ix = 0; e->sectionId != 0 && ix < sr->X; ix++) {
+        for (iy = 0; iy < sr->Y; iy++) {
+            gdouble x = ix * sr->dist_X, y = iy * sr->dist_Y;
+
+            if (ix == 0 && iy == 0)
+                continue;
+
+            export_writer_printf(e->w, "<use xlink:href=\"#s%d\"", e->sectionId);
+            cairo_matrix_transform_distance(&e->sectionMatrix, &x, &y);
+            svg_write_attribute(e->w, "x", x);
+            svg_write_attribute(e->w, "y", y);
+            export_writer_puts(e->w, "/>\n");
+        }
+    }
+
+    e->inSection = FALSE;
+}
+
+/* ------------------------------------------------------------------ */
+/* Start a group for the nets of layer and state */
+static void
+svg_begin_section(svg_export_t* e, gerbv_layer_t* layer, gerbv_netstate_t* state) {
+    svg_end_section(e);
+
+    e->layer         = layer;
+    e->state         = state;
+    e->sectionMatrix = e->imageMatrix;
+    cairo_matrix_rotate(&e->sectionMatrix, layer->rotation);
+    export_vector_apply_netstate(&e->sectionMatrix, state);
+
+    e->sectionId = 0;
+    export_writer_puts(e->w, "<g");
+    if (layer->stepAndRepeat.X * layer->stepAndRepeat.Y > 1) {
+        e->sectionId = ++e->nextId;
+        export_writer_printf(e->w, " id=\"s%d\"", e->sectionId);
+    }
+    svg_write_matrix(e->w, &e->sectionMatrix);
+    export_writer_puts(e->w, ">\n");
+
+    e->inSection = TRUE;
+}
+
+/* ------------------------------------------------------------------ */
+/* Write one net, like draw_image_to_cairo_target() draws it */
+static void
+svg_write_net(svg_export_t* e, gerbv_net_t* net, GString* d) {
+    gerbv_image_t*    image    = e->image;
+    gerbv_aperture_t* aperture = image->aperture[net->aperture];
+
+    if (net->interpolation == GERBV_INTERPOLATION_PAREA_START) {
+        if (export_vector_region(&svg_path, d, gerbv_image_return_region(image, net), 0, 0))
+            svg_write_path(e->w, d);
+        return;
+    }
+    if (net->interpolation == GERBV_INTERPOLATION_DELETED || aperture == NULL)
+        return;
+
+    switch (net->aperture_state) {
+        case GERBV_APERTURE_STATE_ON:
+            if (export_vector_rectangle_track(&svg_path, d, aperture, net, 0, 0))
+                svg_write_path(e->w, d);
+            else
+                export_vector_stroke_track(&svg_path, e->strokes, &e->lastStroke, net, aperture, 0, 0);
+            break;
+        case GERBV_APERTURE_STATE_FLASH:
+            export_writer_printf(e->w, "<use xlink:href=\"#a%d_%d\"", e->fileIndex, net->aperture);
+            svg_write_attribute(e->w, "x", net->stop_x);
+            svg_write_attribute(e->w, "y", net->stop_y);
+            export_writer_puts(e->w, "/>\n");
+            break;
+        default: break;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Write the PNP label of net, like draw_image_to_cairo_target() */
+static void
+svg_write_label(svg_export_t* e, gerbv_net_t* net, gboolean mirrorX, gboolean mirrorY) {
+    cairo_matrix_t m;
+    gchar*         text;
+
+    cairo_matrix_init(&m, mirrorY ? -1 : 1, 0, 0, mirrorX ? 1 : -1, 0, 0);
+    if (!gerbv_image_return_label_mark(e->image, net, &m.x0, &m.y0))
+        return;
+
+    text = g_markup_escape_text(net->label->str, -1);
+    export_writer_puts(e->w, "<text font-size=\"0.05\"");
+    svg_write_matrix(e->w, &m);
+    export_writer_printf(e->w, ">%s</text>\n", text);
+    g_free(text);
+}
+
+/* ------------------------------------------------------------------ */
+static void
+svg_write_piece(svg_export_t* e, const svg_piece_t* piece, const gerbv_user_transformation_t* transform) {
+    gerbv_render_info_t* r = e->renderInfo;
+    GString*             d = g_string_new(NULL);
+    GString*             label = NULL;
+    gerbv_net_t*         net;
+
+    switch (piece->kind) {
+        case SVG_PIECE_PAGE:
+            export_writer_puts(e->w, "<rect");
+            svg_write_attribute(e->w, "x", r->lowerLeftX);
+            svg_write_attribute(e->w, "y", r->lowerLeftY);
+            svg_write_attribute(e->w, "width", r->displayWidth / r->scaleFactorX);
+            svg_write_attribute(e->w, "height", r->displayHeight / r->scaleFactorY);
+            export_writer_puts(e->w, "/>\n");
+            break;
+        case SVG_PIECE_KNOCKOUT:
+            {
+                gerbv_knockout_t* ko = &piece->first->layer->knockout;
+                cairo_matrix_t    m  = e->imageMatrix;
+
+                cairo_matrix_rotate(&m, piece->first->layer->rotation);
+                export_vector_rectangle(
+                    &svg_path, d, &m, ko->lowerLeftX - ko->border, ko->lowerLeftY - ko->border,
+                    ko->width + 2 * ko->border, ko->height + 2 * ko->border
+                );
+                svg_write_path(e->w, d);
+                break;
+            }
+        case SVG_PIECE_NETS:
+            for (net = piece->first; net != piece->end;
+                 net = gerbv_image_return_next_renderable_object_cached(e->image, net)) {
+                if (!e->inSection || net->layer != e->layer || net->state != e->state)
+                    svg_begin_section(e, net->layer, net->state);
+
+                if (net->label && net->label != label
+                    && (e->image->layertype == GERBV_LAYERTYPE_PICKANDPLACE_TOP
+                        || e->image->layertype == GERBV_LAYERTYPE_PICKANDPLACE_BOT)) {
+                    label = net->label;
+                    svg_write_label(e, net, transform->mirrorAroundX, transform->mirrorAroundY);
+                }
+
+                svg_write_net(e, net, d);
+            }
+            svg_end_section(e);
+            break;
+    }
+
+    g_string_free(d, TRUE);
+}
+
+/* ------------------------------------------------------------------ */
+/* Split the image into pieces of one polarity, and note which apertures
+   are flashed */
+static GArray*
+svg_image_pieces(gerbv_image_t* image, gboolean invertPolarity, gboolean* flashed) {
+    GArray*        pieces = g_array_new(FALSE, FALSE, sizeof(svg_piece_t));
+    gerbv_layer_t* layer  = NULL;
+    svg_piece_t    piece;
+    gerbv_net_t*   net;
+
+    if (invertPolarity) {
+        piece.kind  = SVG_PIECE_PAGE;
+        piece.dark  = TRUE;
+        piece.first = piece.end = NULL;
+        g_array_append_val(pieces, piece);
+    }
+
+    for (net = image->netlist->next; net != NULL; net = gerbv_image_return_next_renderable_object_cached(image, net)) {
+        if (net->layer != layer) {
+            gboolean layerDark = !((net->layer->polarity == GERBV_POLARITY_CLEAR) ^ invertPolarity);
+
+            if (pieces->len > 0)
+                g_array_index(pieces, svg_piece_t, pieces->len - 1).end = net;
+
+            if (net->layer->knockout.firstInstance) {
+                piece.kind  = SVG_PIECE_KNOCKOUT;
+                piece.dark  = (net->layer->knockout.polarity == GERBV_POLARITY_CLEAR) ? !layerDark : layerDark;
+                piece.first = net;
+                piece.end   = net;
+                g_array_append_val(pieces, piece);
+            }
+
+            piece.kind  = SVG_PIECE_NETS;
+            piece.dark  = layerDark;
+            piece.first = net;
+            piece.end   = NULL;
+            g_array_append_val(pieces, piece);
+
+            layer = net->layer;
+        }
+
+        if (net->aperture_state == GERBV_APERTURE_STATE_FLASH && net->interpolation != GERBV_INTERPOLATION_DELETED
+            && net->aperture >= 0 && net->aperture < APERTURE_MAX && image->aperture[net->aperture] != NULL)
+            flashed[net->aperture] = TRUE;
+    }
+
+    /* clearing what isn't there yet does nothing */
+    while (pieces->len > 0 && !g_array_index(pieces, svg_piece_t, 0).dark)
+        g_array_remove_index(pieces, 0);
+
+    return pieces;
+}
+
+/* ------------------------------------------------------------------ */
+static void
+svg_write_layer(
+    export_writer_t* w, gerbv_fileinfo_t* fileInfo, gint fileIndex, gerbv_render_info_t* renderInfo, gint* nextId
+) {
+    gerbv_image_t*               image     = fileInfo->image;
+    gerbv_user_transformation_t* transform = &fileInfo->transform;
+    gerbv_render_info_t*         r         = renderInfo;
+    svg_export_t                 e;
+    GArray*                      pieces;
+    gboolean*                    flashed;
+    gboolean                     invertPolarity, runDark;
+    guint                        i, nFlashed;
+    gint                         nClear = 0, run;
+    gdouble                      scaleX = transform->scaleX, scaleY = transform->scaleY;
+    gdouble                      maskX, maskY, maskWidth, maskHeight;
+
+    memset(&e, 0, sizeof(e));
+    e.w          = w;
+    e.image      = image;
+    e.fileIndex  = fileIndex;
+    e.renderInfo = renderInfo;
+    e.nextId     = *nextId;
+    e.strokes    = g_array_new(FALSE, FALSE, sizeof(export_vector_stroke_t));
+
+    /* the transformations of draw_image_to_cairo_target() */
+    if (transform->mirrorAroundX)
+        scaleY = -scaleY;
+    if (transform->mirrorAroundY)
+        scaleX = -scaleX;
+    cairo_matrix_init_translate(&e.imageMatrix, transform->translateX, transform->translateY);
+    cairo_matrix_scale(&e.imageMatrix, scaleX, scaleY);
+    cairo_matrix_rotate(&e.imageMatrix, transform->rotation);
+    cairo_matrix_translate(
+        &e.imageMatrix, image->info->imageJustifyOffsetActualA, image->info->imageJustifyOffsetActualB
+    );
+    cairo_matrix_translate(&e.imageMatrix, image->info->offsetA, image->info->offsetB);
+    cairo_matrix_rotate(&e.imageMatrix, image->info->imageRotation);
+
+    invertPolarity = transform->inverted;
+    if (image->info->polarity == GERBV_POLARITY_NEGATIVE)
+        invertPolarity = !invertPolarity;
+
+    flashed = g_new0(gboolean, APERTURE_MAX);
+    pieces  = svg_image_pieces(image, invertPolarity, flashed);
+
+    export_writer_puts(w, "<g");
+    svg_write_color(w, "color", &fileInfo->color);
+    export_writer_puts(w, " fill=\"currentColor\">\n");
+
+    for (i = 0, nFlashed = 0; i < APERTURE_MAX; i++) {
+        if (!flashed[i])
+            continue;
+        if (nFlashed++ == 0)
+            export_writer_puts(w, "<defs>\n");
+        svg_write_aperture_symbol(&e, i, image->aperture[i]);
+    }
+    if (nFlashed > 0)
+        export_writer_puts(w, "</defs>\n");
+
+    /* clear pieces are masks over the dark ones before them, a little
+       larger than the page */
+    maskWidth  = r->displayWidth / r->scaleFactorX;
+    maskHeight = r->displayHeight / r->scaleFactorY;
+    maskX      = r->lowerLeftX - maskWidth / 100;
+    maskY      = r->lowerLeftY - maskHeight / 100;
+    maskWidth *= 1.02;
+    maskHeight *= 1.02;
+
+    runDark = TRUE;
+    for (i = 0; i < pieces->len; i++) {
+        svg_piece_t* piece = &g_array_index(pieces, svg_piece_t, i);
+
+        if (!piece->dark && runDark) {
+            gchar* id = g_strdup_printf("m%d", e.nextId + ++nClear);
+
+            svg_begin_mask(w, id, maskX, maskY, maskWidth, maskHeight);
+            g_free(id);
+        } else if (piece->dark && !runDark) {
+            svg_end_mask(w);
+        }
+        if (!piece->dark)
+            svg_write_piece(&e, piece, transform);
+        runDark = piece->dark;
+    }
+    if (!runDark)
+        svg_end_mask(w);
+
+    for (run = nClear; run > 0; run--)
+        export_writer_printf(w, "<g mask=\"url(#m%d)\">\n", e.nextId + run);
+
+    runDark = TRUE;
+    for (i = 0; i < pieces->len; i++) {
+        svg_piece_t* piece = &g_array_index(pieces, svg_piece_t, i);
+
+        if (!piece->dark && runDark)
+            export_writer_puts(w, "</g>\n");
+        if (piece->dark)
+            svg_write_piece(&e, piece, transform);
+        runDark = piece->dark;
+    }
+
+    export_writer_puts(w, "</g>\n");
+
+    *nextId = e.nextId + nClear;
+    g_array_free(e.strokes, TRUE);
+    g_array_free(pieces, TRUE);
+    g_free(flashed);
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+gerbv_export_svg_native_file_from_project(
+    gerbv_project_t* gerbvProject, gerbv_render_info_t* renderInfo, const gchar* filename
+) {
+    GdkColor*        bg = &gerbvProject->background;
+    export_writer_t* w;
+    cairo_matrix_t   page;
+    gint             nextId = 0;
+    gint             i;
+
+    if ((w = export_writer_open(filename)) == NULL) {
+        GERB_COMPILE_ERROR(_("Can't open file for writing: %s"), filename);
+        return FALSE;
+    }
+
+    export_writer_puts(
+        w, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+           "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\" version=\"1.1\""
+    );
+    export_writer_printf(w, " width=\"%dpt\" height=\"%dpt\"", renderInfo->displayWidth, renderInfo->displayHeight);
+    export_writer_printf(w, " viewBox=\"0 0 %d %d\">\n", renderInfo->displayWidth, renderInfo->displayHeight);
+
+    /* the background only when it isn't white or black, like
+       gerbv_render_all_layers_to_cairo_target_for_vector_output() */
+    if ((bg->red != 0xffff || bg->green != 0xffff || bg->blue != 0xffff)
+        && (bg->red != 0x0000 || bg->green != 0x0000 || bg->blue != 0x0000)) {
+        export_writer_puts(w, "<rect width=\"100%\" height=\"100%\"");
+        svg_write_color(w, "fill", bg);
+        export_writer_puts(w, "/>\n");
+    }
+
+    /* inches with y up, like gerbv_render_cairo_set_scale_and_translation() */
+    cairo_matrix_init(
+        &page, renderInfo->scaleFactorX, 0, 0, -renderInfo->scaleFactorY,
+        -renderInfo->lowerLeftX * renderInfo->scaleFactorX,
+        renderInfo->lowerLeftY * renderInfo->scaleFactorY + renderInfo->displayHeight
+    );
+    export_writer_puts(w, "<g fill-rule=\"evenodd\" stroke-linecap=\"round\" stroke-linejoin=\"round\"");
+    svg_write_matrix(w, &page);
+    export_writer_puts(w, ">\n");
+
+    for (i = gerbvProject->last_loaded; i >= 0; i--) {
+        gerbv_fileinfo_t* fileInfo = gerbvProject->file[i];
+
+        if (fileInfo && fileInfo->isVisible) {
+            gerbv_load_deferred_layer(fileInfo);
+            svg_write_layer(w, fileInfo, i, renderInfo, &nextId);
+        }
+    }
+
+    export_writer_puts(w, "</g>\n</svg>\n");
+
+    return export_writer_close(w);
+}
@@ -0,0 +1,539 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file export-vector.c
+    \brief Geometry shared by the SVG and PDF exporters
+    \ingroup libgerbv
+
+    Both exporters draw apertures, macros, regions and tracks the way
+    draw.c does, only in a different path syntax. The shapes are worked out
+    here once, and each exporter passes the functions that write its path
+    operators.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+
+#include "gerbv.h"
+#include "common.h"
+#include "gerb_image.h"
+#include "export-vector.h"
+
+/* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
+#define dprintf \
+    if (DEBUG)  \
+    printf
+
+/* ------------------------------------------------------------------ */
+void
+export_vector_apply_netstate(cairo_matrix_t* m, const gerbv_netstate_t* state) {
+    cairo_matrix_scale(m, state->scaleA, state->scaleB);
+    cairo_matrix_translate(m, state->offsetA, state->offsetB);
+    switch (state->mirrorState) {
+        case GERBV_MIRROR_STATE_FLIPA: cairo_matrix_scale(m, -1, 1); break;
+        case GERBV_MIRROR_STATE_FLIPB: cairo_matrix_scale(m, 1, -1); break;
+        case GERBV_MIRROR_STATE_FLIPAB: cairo_matrix_scale(m, -1, -1); break;
+        default: break;
+    }
+    if (state->axisSelect == GERBV_AXIS_SELECT_SWAPAB) {
+        cairo_matrix_rotate(m, M_PI + M_PI_2);
+        cairo_matrix_scale(m, 1, -1);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+void
+export_vector_circle(const export_vector_path_t* path, GString* d, gdouble cx, gdouble cy, gdouble r) {
+    path->move_to(d, cx + r, cy);
+    path->arc(d, cx, cy, r, r, 0, 2 * M_PI);
+    path->close_path(d);
+}
+
+/* ------------------------------------------------------------------ */
+void
+export_vector_polygon(
+    const export_vector_path_t* path, GString* d, const cairo_matrix_t* m, const gdouble* points, gint n
+) {
+    gint i;
+
+    for (i = 0; i < n; i++) {
+        gdouble x = points[2 * i], y = points[2 * i + 1];
+
+        cairo_matrix_transform_point(m, &x, &y);
+        if (i == 0)
+            path->move_to(d, x, y);
+        else
+            path->line_to(d, x, y);
+    }
+    path->close_path(d);
+}
+
+/* ------------------------------------------------------------------ */
+void
+export_vector_rectangle(
+    const export_vector_path_t* path, GString* d, const cairo_matrix_t* m, gdouble x, gdouble y, gdouble width,
+    gdouble height
+) {
+    const gdouble points[] = { x, y, x + width, y, x + width, y + height, x, y + height };
+
+    export_vector_polygon(path, d, m, points, 4);
+}
+
+/* ------------------------------------------------------------------ */
+/* Append the regular polygon of n corners on a circle of diameter, the
+   first one on the x axis, mapped by m */
+static void
+export_vector_regular_polygon(
+    const export_vector_path_t* path, GString* d, const cairo_matrix_t* m, gdouble diameter, gint n
+) {
+    gdouble* points;
+    gint     i;
+
+    if (n <= 0)
+        return;
+
+    points = g_new(gdouble, 2 * n);
+    for (i = 0; i < n; i++) {
+        points[2 * i]     = cos(i * 2 * M_PI / n) * diameter / 2;
+        points[2 * i + 1] = sin(i * 2 * M_PI / n) * diameter / 2;
+    }
+    export_vector_polygon(path, d, m, points, n);
+    g_free(points);
+}
+
+/* ------------------------------------------------------------------ */
+/* Like gerbv_draw_aperture_hole() */
+static void
+export_vector_aperture_hole(
+    const export_vector_path_t* path, GString* d, const cairo_matrix_t* m, gdouble dimensionX, gdouble dimensionY
+) {
+    if (dimensionX == 0)
+        return;
+
+    if (dimensionY != 0)
+        export_vector_rectangle(path, d, m, -dimensionX / 2, -dimensionY / 2, dimensionX, dimensionY);
+    else
+        export_vector_circle(path, d, m->x0, m->y0, dimensionX / 2);
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+export_vector_aperture(const export_vector_path_t* path, GString* d, const gerbv_aperture_t* aperture) {
+    const gdouble* p = aperture->parameter;
+    cairo_matrix_t m;
+
+    cairo_matrix_init_identity(&m);
+
+    switch (aperture->type) {
+        case GERBV_APTYPE_CIRCLE:
+            export_vector_circle(path, d, 0, 0, p[0] / 2);
+            export_vector_aperture_hole(path, d, &m, p[1], p[2]);
+            return TRUE;
+        case GERBV_APTYPE_RECTANGLE:
+            export_vector_rectangle(path, d, &m, -p[0] / 2, -p[1] / 2, p[0], p[1]);
+            export_vector_aperture_hole(path, d, &m, p[2], p[3]);
+            return TRUE;
+        case GERBV_APTYPE_OVAL:
+            if (p[0] < p[1]) {
+                gdouble r = p[0] / 2, s = (p[1] - p[0]) / 2;
+
+                path->move_to(d, r, s);
+                path->arc(d, 0, s, r, r, 0, M_PI);
+                path->line_to(d, -r, -s);
+                path->arc(d, 0, -s, r, r, M_PI, 2 * M_PI);
+            } else {
+                gdouble r = p[1] / 2, s = (p[0] - p[1]) / 2;
+
+                path->move_to(d, -s, r);
+                path->arc(d, -s, 0, r, r, M_PI_2, M_PI + M_PI_2);
+                path->line_to(d, s, -r);
+                path->arc(d, s, 0, r, r, -M_PI_2, M_PI_2);
+            }
+            path->close_path(d);
+            export_vector_aperture_hole(path, d, &m, p[2], p[3]);
+            return TRUE;
+        case GERBV_APTYPE_POLYGON:
+            /* the hole turns with the polygon, like in gerbv_draw_polygon() */
+            cairo_matrix_rotate(&m, DEG2RAD(p[2]));
+            export_vector_regular_polygon(path, d, &m, p[0], (gint)p[1]);
+            export_vector_aperture_hole(path, d, &m, p[3], p[4]);
+            return TRUE;
+        default: return FALSE;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+gdouble
+export_vector_macro_extent(const gerbv_simplified_amacro_t* s) {
+    gdouble extent = 0;
+
+    for (; s != NULL; s = s->next) {
+        const gdouble* p = s->parameter;
+        gdouble        e = 0;
+        gint           i;
+
+        switch (s->type) {
+            case GERBV_APTYPE_MACRO_CIRCLE:
+                e = fabs(p[CIRCLE_CENTER_X]) + fabs(p[CIRCLE_CENTER_Y]) + p[CIRCLE_DIAMETER];
+                break;
+            case GERBV_APTYPE_MACRO_OUTLINE:
+                for (i = 0; i <= (gint)p[OUTLINE_NUMBER_OF_POINTS]; i++)
+                    e = MAX(e, fabs(p[OUTLINE_X_IDX_OF_POINT(i)]) + fabs(p[OUTLINE_Y_IDX_OF_POINT(i)]));
+                break;
+            case GERBV_APTYPE_MACRO_POLYGON:
+                e = fabs(p[POLYGON_CENTER_X]) + fabs(p[POLYGON_CENTER_Y]) + p[POLYGON_DIAMETER];
+                break;
+            case GERBV_APTYPE_MACRO_MOIRE:
+                e = fabs(p[MOIRE_CENTER_X]) + fabs(p[MOIRE_CENTER_Y]) + p[MOIRE_OUTSIDE_DIAMETER]
+                  + p[MOIRE_CROSSHAIR_LENGTH];
+                break;
+            case GERBV_APTYPE_MACRO_THERMAL:
+                e = fabs(p[THERMAL_CENTER_X]) + fabs(p[THERMAL_CENTER_Y]) + p[THERMAL_OUTSIDE_DIAMETER];
+                break;
+            case GERBV_APTYPE_MACRO_LINE20:
+                e = MAX(fabs(p[LINE20_START_X]) + fabs(p[LINE20_START_Y]),
+                        fabs(p[LINE20_END_X]) + fabs(p[LINE20_END_Y]))
+                  + p[LINE20_LINE_WIDTH];
+                break;
+            case GERBV_APTYPE_MACRO_LINE21:
+                e = fabs(p[LINE21_CENTER_X]) + fabs(p[LINE21_CENTER_Y]) + p[LINE21_WIDTH] + p[LINE21_HEIGHT];
+                break;
+            case GERBV_APTYPE_MACRO_LINE22:
+                e = fabs(p[LINE22_LOWER_LEFT_X]) + fabs(p[LINE22_LOWER_LEFT_Y]) + p[LINE22_WIDTH] + p[LINE22_HEIGHT];
+                break;
+            default: break;
+        }
+        extent = MAX(extent, e);
+    }
+
+    return extent;
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+export_vector_macro_primitive_dark(const gerbv_simplified_amacro_t* s, gboolean dark) {
+    gdouble exposure;
+
+    switch (s->type) {
+        case GERBV_APTYPE_MACRO_CIRCLE: exposure = s->parameter[CIRCLE_EXPOSURE]; break;
+        case GERBV_APTYPE_MACRO_OUTLINE: exposure = s->parameter[OUTLINE_EXPOSURE]; break;
+        case GERBV_APTYPE_MACRO_POLYGON: exposure = s->parameter[POLYGON_EXPOSURE]; break;
+        case GERBV_APTYPE_MACRO_LINE20: exposure = s->parameter[LINE20_EXPOSURE]; break;
+        case GERBV_APTYPE_MACRO_LINE21: exposure = s->parameter[LINE21_EXPOSURE]; break;
+        case GERBV_APTYPE_MACRO_LINE22: exposure = s->parameter[LINE22_EXPOSURE]; break;
+        default: return dark;
+    }
+
+    if (exposure == 0.0)
+        return FALSE;
+    if (exposure == 1.0)
+        return TRUE;
+    if (exposure == 2.0)
+        return !dark;
+
+    return dark;
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+export_vector_macro_primitive(const export_vector_path_t* path, GString* d, const gerbv_simplified_amacro_t* s) {
+    const gdouble* p = s->parameter;
+    cairo_matrix_t m;
+    gint           i;
+
+    cairo_matrix_init_identity(&m);
+
+    switch (s->type) {
+        case GERBV_APTYPE_MACRO_CIRCLE:
+            export_vector_circle(path, d, p[CIRCLE_CENTER_X], p[CIRCLE_CENTER_Y], p[CIRCLE_DIAMETER] / 2);
+            return TRUE;
+        case GERBV_APTYPE_MACRO_OUTLINE:
+            cairo_matrix_rotate(&m, DEG2RAD(p[OUTLINE_ROTATION_IDX(p)]));
+            export_vector_polygon(path, d, &m, &p[OUTLINE_FIRST_X], (gint)p[OUTLINE_NUMBER_OF_POINTS] + 1);
+            return TRUE;
+        case GERBV_APTYPE_MACRO_POLYGON:
+            if ((gint)p[POLYGON_NUMBER_OF_POINTS] <= 0)
+                return FALSE;
+            cairo_matrix_translate(&m, p[POLYGON_CENTER_X], p[POLYGON_CENTER_Y]);
+            cairo_matrix_rotate(&m, DEG2RAD(p[POLYGON_ROTATION]));
+            export_vector_regular_polygon(path, d, &m, p[POLYGON_DIAMETER], (gint)p[POLYGON_NUMBER_OF_POINTS]);
+            return TRUE;
+        case GERBV_APTYPE_MACRO_MOIRE: return FALSE;
+        case GERBV_APTYPE_MACRO_THERMAL:
+            {
+                gdouble inside = p[THERMAL_INSIDE_DIAMETER] / 2, outside = p[THERMAL_OUTSIDE_DIAMETER] / 2;
+                gdouble startAngle1 = asin(p[THERMAL_CROSSHAIR_THICKNESS] / p[THERMAL_INSIDE_DIAMETER]);
+                gdouble endAngle1   = M_PI_2 - startAngle1;
+                gdouble endAngle2   = asin(p[THERMAL_CROSSHAIR_THICKNESS] / p[THERMAL_OUTSIDE_DIAMETER]);
+                gdouble startAngle2 = M_PI_2 - endAngle2;
+                gdouble cx = p[THERMAL_CENTER_X], cy = p[THERMAL_CENTER_Y];
+
+                for (i = 0; i < 4; i++) {
+                    gdouble rotation = DEG2RAD(p[THERMAL_ROTATION]) + i * M_PI_2;
+
+                    path->move_to(
+                        d, cx + inside * cos(rotation + startAngle1), cy + inside * sin(rotation + startAngle1)
+                    );
+                    path->arc(d, cx, cy, inside, inside, rotation + startAngle1, rotation + endAngle1);
+                    path->line_to(
+                        d, cx + outside * cos(rotation + startAngle2), cy + outside * sin(rotation + startAngle2)
+                    );
+                    path->arc(d, cx, cy, outside, outside, rotation + startAngle2, rotation + endAngle2);
+                    path->close_path(d);
+                }
+                return TRUE;
+            }
+        case GERBV_APTYPE_MACRO_LINE20:
+            {
+                gdouble dx = p[LINE20_END_X] - p[LINE20_START_X], dy = p[LINE20_END_Y] - p[LINE20_START_Y];
+                gdouble len = hypot(dx, dy), half = p[LINE20_LINE_WIDTH] / 2;
+                gdouble nx = (len > 0) ? -dy / len * half : 0, ny = (len > 0) ? dx / len * half : half;
+                gdouble points[] = {
+                    p[LINE20_START_X] + nx, p[LINE20_START_Y] + ny, p[LINE20_END_X] + nx, p[LINE20_END_Y] + ny,
+                    p[LINE20_END_X] - nx,   p[LINE20_END_Y] - ny,   p[LINE20_START_X] - nx, p[LINE20_START_Y] - ny,
+                };
+
+                cairo_matrix_rotate(&m, DEG2RAD(p[LINE20_ROTATION]));
+                export_vector_polygon(path, d, &m, points, 4);
+                return TRUE;
+            }
+        case GERBV_APTYPE_MACRO_LINE21:
+            cairo_matrix_rotate(&m, DEG2RAD(p[LINE21_ROTATION]));
+            export_vector_rectangle(
+                path, d, &m, p[LINE21_CENTER_X] - p[LINE21_WIDTH] / 2, p[LINE21_CENTER_Y] - p[LINE21_HEIGHT] / 2,
+                p[LINE21_WIDTH], p[LINE21_HEIGHT]
+            );
+            return TRUE;
+        case GERBV_APTYPE_MACRO_LINE22:
+            cairo_matrix_rotate(&m, DEG2RAD(p[LINE22_ROTATION]));
+            export_vector_rectangle(
+                path, d, &m, p[LINE22_LOWER_LEFT_X], p[LINE22_LOWER_LEFT_Y], p[LINE22_WIDTH], p[LINE22_HEIGHT]
+            );
+            return TRUE;
+        default:
+            GERB_COMPILE_WARNING(_("Unknown macro type: %s"), gerbv_aperture_type_name(s->type));
+            return FALSE;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+export_vector_region(
+    const export_vector_path_t* path, GString* d, gerbv_image_region_t* region, gdouble dx, gdouble dy
+) {
+    const gdouble* v          = region->coords;
+    gboolean       hasCurrent = FALSE;
+    guint          i;
+
+    if (!region->closed)
+        return FALSE;
+
+    for (i = 0; i < region->n_ops; i++) {
+        gdouble angle1, angle2, x, y;
+
+        switch (region->ops[i]) {
+            case GERBV_REGION_OP_MOVE_TO:
+                path->move_to(d, v[0] + dx, v[1] + dy);
+                hasCurrent = TRUE;
+                v += 2;
+                break;
+            case GERBV_REGION_OP_LINE_TO:
+                if (hasCurrent)
+                    path->line_to(d, v[0] + dx, v[1] + dy);
+                else
+                    path->move_to(d, v[0] + dx, v[1] + dy);
+                hasCurrent = TRUE;
+                v += 2;
+                break;
+            case GERBV_REGION_OP_ARC:
+            case GERBV_REGION_OP_ARC_NEGATIVE:
+                /* the angles are normalized like cairo_arc() and cairo_arc_negative() do */
+                angle1 = v[3];
+                angle2 = v[4];
+                if (region->ops[i] == GERBV_REGION_OP_ARC) {
+                    while (angle2 < angle1)
+                        angle2 += 2 * M_PI;
+                } else {
+                    while (angle2 > angle1)
+                        angle2 -= 2 * M_PI;
+                }
+                x = v[0] + dx + v[2] * cos(angle1);
+                y = v[1] + dy + v[2] * sin(angle1);
+                if (hasCurrent)
+                    path->line_to(d, x, y);
+                else
+                    path->move_to(d, x, y);
+                path->arc(d, v[0] + dx, v[1] + dy, v[2], v[2], angle1, angle2);
+                hasCurrent = TRUE;
+                v += 5;
+                break;
+            default: break;
+        }
+    }
+    if (hasCurrent)
+        path->close_path(d);
+
+    return hasCurrent;
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+export_vector_rectangle_track(
+    const export_vector_path_t* path, GString* d, const gerbv_aperture_t* aperture, const gerbv_net_t* net,
+    gdouble dx, gdouble dy
+) {
+    gdouble hx = aperture->parameter[0] / 2, hy = aperture->parameter[1] / 2;
+    gdouble x1 = net->start_x + dx, y1 = net->start_y + dy;
+    gdouble x2 = net->stop_x + dx, y2 = net->stop_y + dy;
+
+    if (aperture->type != GERBV_APTYPE_RECTANGLE)
+        return FALSE;
+
+    switch (net->interpolation) {
+        case GERBV_INTERPOLATION_LINEARx1:
+        case GERBV_INTERPOLATION_LINEARx10:
+        case GERBV_INTERPOLATION_LINEARx01:
+        case GERBV_INTERPOLATION_LINEARx001: break;
+        default: return FALSE;
+    }
+
+    if (x1 > x2)
+        hx = -hx;
+    if (y1 > y2)
+        hy = -hy;
+    path->move_to(d, x1 - hx, y1 - hy);
+    path->line_to(d, x1 - hx, y1 + hy);
+    path->line_to(d, x2 - hx, y2 + hy);
+    path->line_to(d, x2 + hx, y2 + hy);
+    path->line_to(d, x2 + hx, y2 - hy);
+    path->line_to(d, x1 + hx, y1 - hy);
+    path->close_path(d);
+
+    return TRUE;
+}
+
+/* ------------------------------------------------------------------ */
+/* Return the stroke of width in strokes, adding it if there is none yet */
+static export_vector_stroke_t*
+export_vector_stroke(GArray* strokes, guint* lastStroke, gdouble width, gboolean squareCap) {
+    export_vector_stroke_t* stroke;
+    export_vector_stroke_t  new;
+    guint                   i;
+
+    if (*lastStroke < strokes->len) {
+        stroke = &g_array_index(strokes, export_vector_stroke_t, *lastStroke);
+        if (stroke->width == width && stroke->squareCap == squareCap)
+            return stroke;
+    }
+
+    for (i = 0; i < strokes->len; i++) {
+        stroke = &g_array_index(strokes, export_vector_stroke_t, i);
+        if (stroke->width == width && stroke->squareCap == squareCap) {
+            *lastStroke = i;
+            return stroke;
+        }
+    }
+
+    new.width     = width;
+    new.squareCap = squareCap;
+    new.d         = g_string_new(NULL);
+    new.lastX     = 0;
+    new.lastY     = 0;
+    g_array_append_val(strokes, new);
+    *lastStroke = strokes->len - 1;
+
+    return &g_array_index(strokes, export_vector_stroke_t, *lastStroke);
+}
+
+/* ------------------------------------------------------------------ */
+/* Continue the path of stroke at x,y, or start a new subpath there. A
+   track starting where the last one ended continues its subpath, which
+   looks the same with round caps and joins. */
+static void
+export_vector_stroke_move_to(const export_vector_path_t* path, export_vector_stroke_t* stroke, gdouble x, gdouble y) {
+    if (stroke->d->len == 0 || stroke->squareCap || fabs(x - stroke->lastX) > GERBV_PRECISION_LINEAR_INCH
+        || fabs(y - stroke->lastY) > GERBV_PRECISION_LINEAR_INCH)
+        path->move_to(stroke->d, x, y);
+}
+
+/* ------------------------------------------------------------------ */
+gsize
+export_vector_stroke_track(
+    const export_vector_path_t* path, GArray* strokes, guint* lastStroke, const gerbv_net_t* net,
+    const gerbv_aperture_t* aperture, gdouble dx, gdouble dy
+) {
+    export_vector_stroke_t* stroke;
+    gsize                   len;
+
+    if (aperture->parameter[0] <= 0)
+        return 0;
+
+    switch (net->interpolation) {
+        case GERBV_INTERPOLATION_LINEARx1:
+        case GERBV_INTERPOLATION_LINEARx10:
+        case GERBV_INTERPOLATION_LINEARx01:
+        case GERBV_INTERPOLATION_LINEARx001:
+            if (aperture->type != GERBV_APTYPE_CIRCLE && aperture->type != GERBV_APTYPE_OVAL
+                && aperture->type != GERBV_APTYPE_POLYGON)
+                return 0;
+
+            stroke = export_vector_stroke(strokes, lastStroke, aperture->parameter[0], FALSE);
+            len    = stroke->d->len;
+            export_vector_stroke_move_to(path, stroke, net->start_x + dx, net->start_y + dy);
+            path->line_to(stroke->d, net->stop_x + dx, net->stop_y + dy);
+            stroke->lastX = net->stop_x + dx;
+            stroke->lastY = net->stop_y + dy;
+            return stroke->d->len - len;
+        case GERBV_INTERPOLATION_CW_CIRCULAR:
+        case GERBV_INTERPOLATION_CCW_CIRCULAR:
+            {
+                gerbv_cirseg_t* c      = net->cirseg;
+                gdouble         angle1 = DEG2RAD(c->angle1), angle2 = DEG2RAD(c->angle2);
+                gdouble         rx = c->width / 2, ry = c->height / 2;
+                gdouble         cx = c->cp_x + dx, cy = c->cp_y + dy;
+
+                /* like cairo_arc() and cairo_arc_negative() with the angles
+                   draw_image_to_cairo_target() gives them */
+                if (angle2 > angle1) {
+                    while (angle2 - angle1 > 2 * M_PI)
+                        angle2 -= 2 * M_PI;
+                } else {
+                    while (angle1 - angle2 > 2 * M_PI)
+                        angle2 += 2 * M_PI;
+                }
+
+                stroke = export_vector_stroke(
+                    strokes, lastStroke, aperture->parameter[0], aperture->type == GERBV_APTYPE_RECTANGLE
+                );
+                len = stroke->d->len;
+                export_vector_stroke_move_to(path, stroke, cx + rx * cos(angle1), cy + ry * sin(angle1));
+                if (angle1 == angle2)
+                    path->line_to(stroke->d, cx + rx * cos(angle2), cy + ry * sin(angle2));
+                else
+                    path->arc(stroke->d, cx, cy, rx, ry, angle1, angle2);
+                stroke->lastX = cx + rx * cos(angle2);
+                stroke->lastY = cy + ry * sin(angle2);
+                return stroke->d->len - len;
+            }
+        default: return 0;
+    }
+}
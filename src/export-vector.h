@@ -0,0 +1,117 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file export-vector.h
+    \brief Header info for the geometry shared by the SVG and PDF exporters
+    \ingroup libgerbv
+*/
+
+#ifndef EXPORT_VECTOR_H
+#define EXPORT_VECTOR_H
+
+#include <glib.h>
+#include <cairo.h>
+
+#include "gerbv.h"
+#include "gerb_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*! How an exporter appends path data to a string, in its own syntax */
+typedef struct {
+    void (*move_to)(GString* d, gdouble x, gdouble y);
+    void (*line_to)(GString* d, gdouble x, gdouble y);
+    /* an elliptic arc around cx,cy from angle1 to angle2 in radians, starting
+       at the current point */
+    void (*arc)(GString* d, gdouble cx, gdouble cy, gdouble rx, gdouble ry, gdouble angle1, gdouble angle2);
+    void (*close_path)(GString* d);
+} export_vector_path_t;
+
+/*! The tracks of one width, stroked as a single path */
+typedef struct {
+    gdouble  width;
+    gboolean squareCap; /* arcs drawn with a rectangular aperture */
+    GString* d;         /* the path data */
+    gdouble  lastX, lastY;
+} export_vector_stroke_t;
+
+/* Apply the scaling, offset, mirroring and axis swap of state to m, like
+   draw_apply_netstate_transformation() */
+void export_vector_apply_netstate(cairo_matrix_t* m, const gerbv_netstate_t* state);
+
+void export_vector_circle(const export_vector_path_t* path, GString* d, gdouble cx, gdouble cy, gdouble r);
+
+/* Append the closed polygon of n points, mapped by m */
+void export_vector_polygon(
+    const export_vector_path_t* path, GString* d, const cairo_matrix_t* m, const gdouble* points, gint n
+);
+
+/* Append the rectangle from x,y of size width x height, mapped by m */
+void export_vector_rectangle(
+    const export_vector_path_t* path, GString* d, const cairo_matrix_t* m, gdouble x, gdouble y, gdouble width,
+    gdouble height
+);
+
+/* Append the outline of a circle, rectangle, oval or polygon aperture
+   around the origin, with its hole, to be filled even-odd. Returns FALSE,
+   appending nothing, for other apertures. */
+gboolean export_vector_aperture(const export_vector_path_t* path, GString* d, const gerbv_aperture_t* aperture);
+
+/* Return how far from the origin the primitives of a macro can reach */
+gdouble export_vector_macro_extent(const gerbv_simplified_amacro_t* s);
+
+/* Return the exposure of a macro primitive, given the one before it.
+   Moirés and thermals have none and keep the previous one. */
+gboolean export_vector_macro_primitive_dark(const gerbv_simplified_amacro_t* s, gboolean dark);
+
+/* Append the outline of a macro primitive, like gerbv_draw_amacro() draws
+   it, to be filled even-odd. Returns FALSE if nothing was appended, for
+   moirés, which are stroked, and primitives without area. */
+gboolean
+export_vector_macro_primitive(const export_vector_path_t* path, GString* d, const gerbv_simplified_amacro_t* s);
+
+/* Append a G36/G37 region from its cached outline, moved by dx,dy, like
+   draw_render_region(). Returns FALSE if it has no outline. */
+gboolean export_vector_region(
+    const export_vector_path_t* path, GString* d, gerbv_image_region_t* region, gdouble dx, gdouble dy
+);
+
+/* Append the outline a rectangular aperture sweeps along a linear track,
+   moved by dx,dy, to be filled. Returns FALSE, appending nothing, for
+   other tracks, which are stroked. */
+gboolean export_vector_rectangle_track(
+    const export_vector_path_t* path, GString* d, const gerbv_aperture_t* aperture, const gerbv_net_t* net,
+    gdouble dx, gdouble dy
+);
+
+/* Add a track drawn with aperture, moved by dx,dy, to the stroke of its
+   width in strokes, like draw_image_to_cairo_target() draws it. Returns
+   the number of bytes added. */
+gsize export_vector_stroke_track(
+    const export_vector_path_t* path, GArray* strokes, guint* lastStroke, const gerbv_net_t* net,
+    const gerbv_aperture_t* aperture, gdouble dx, gdouble dy
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EXPORT_VECTOR_H */
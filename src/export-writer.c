@@ -0,0 +1,361 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file export-writer.c
+    \brief Buffered output of the text exporters
+    \ingroup libgerbv
+
+    The RS-274X, drill, ISEL and gEDA PCB exporters write mostly short
+    numbers. Formatting them here instead of with fprintf() avoids parsing a
+    format string for every coordinate, and doesn't depend on LC_NUMERIC, so
+    the exporters no longer have to switch the global locale to "C" and can
+    run on several threads at once.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <float.h>
+
+#include <glib/gstdio.h>
+
+#include "gerbv.h"
+#include "common.h"
+#include "export-writer.h"
+
+/* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
+#define dprintf \
+    if (DEBUG)  \
+    printf
+
+#define EXPORT_WRITER_BUFFER_SIZE (256 * 1024)
+
+/* Longest number export_writer_int() writes without padding: 20 digits and a sign */
+#define EXPORT_WRITER_INT_SIZE 24
+
+/* Numbers scaled above this are left to g_ascii_formatd(), the rounding
+   error of the scaling is far below EXPORT_WRITER_TIE_MARGIN there */
+#define EXPORT_WRITER_FAST_MAX 1e9
+
+/* Scaled numbers this close to a tie are left to g_ascii_formatd() too, as
+   only it rounds them exactly like printf() */
+#define EXPORT_WRITER_TIE_MARGIN 1e-6
+
+struct export_writer {
+    FILE*    fd;
+    gchar*   filename;
+    gchar*   buffer;
+    gsize    used;    /* Bytes of buffer waiting to be written */
+    guint64  written; /* Bytes written to fd so far */
+    gint64   start;   /* Monotonic time the file was opened, for the throughput */
+    gboolean failed;  /* TRUE once a write failed */
+};
+
+static const gdouble export_writer_power_of_ten[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8 };
+
+/* ------------------------------------------------------------------ */
+static void
+export_writer_flush(export_writer_t* w) {
+    if (w->used == 0)
+        return;
+
+    if (!w->failed && fwrite(w->buffer, 1, w->used, w->fd) != w->used)
+        w->failed = TRUE;
+
+    w->written += w->used;
+    w->used = 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Return room for len bytes at the end of the buffer, len must be at most
+   EXPORT_WRITER_BUFFER_SIZE */
+static inline gchar*
+export_writer_reserve(export_writer_t* w, gsize len) {
+    gchar* p;
+
+    if (w->used + len > EXPORT_WRITER_BUFFER_SIZE)
+        export_writer_flush(w);
+
+    p = w->buffer + w->used;
+    w->used += len;
+
+    return p;
+}
+
+/* ------------------------------------------------------------------ */
+/* Write the digits of value, zero padded to at least width, which is never
+   more than a few characters */
+static void
+export_writer_digits(export_writer_t* w, guint64 value, guint width) {
+    gchar  digits[EXPORT_WRITER_INT_SIZE];
+    guint  n = 0;
+    gchar* p;
+
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+
+    if (width > n)
+        memset(export_writer_reserve(w, width - n), '0', width - n);
+
+    p = export_writer_reserve(w, n);
+    while (n > 0)
+        *p++ = digits[--n];
+}
+
+/* ------------------------------------------------------------------ */
+void
+export_writer_write(export_writer_t* w, const gchar* data, gsize len) {
+    while (len > EXPORT_WRITER_BUFFER_SIZE) {
+        memcpy(export_writer_reserve(w, EXPORT_WRITER_BUFFER_SIZE), data, EXPORT_WRITER_BUFFER_SIZE);
+        data += EXPORT_WRITER_BUFFER_SIZE;
+        len -= EXPORT_WRITER_BUFFER_SIZE;
+    }
+    memcpy(export_writer_reserve(w, len), data, len);
+}
+
+/* ------------------------------------------------------------------ */
+export_writer_t*
+export_writer_open(const gchar* filename) {
+    export_writer_t* w;
+    FILE*            fd;
+
+    if ((fd = g_fopen(filename, "w")) == NULL)
+        return NULL;
+
+    w           = g_new0(export_writer_t, 1);
+    w->fd       = fd;
+    w->filename = g_strdup(filename);
+    w->buffer   = g_malloc(EXPORT_WRITER_BUFFER_SIZE);
+    w->start    = g_get_monotonic_time();
+
+    return w;
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+export_writer_close(export_writer_t* w) {
+    gboolean ok;
+    gdouble  seconds;
+
+    export_writer_flush(w);
+    ok = !w->failed && !ferror(w->fd);
+    if (fclose(w->fd) != 0)
+        ok = FALSE;
+
+    if (!ok)
+        GERB_COMPILE_ERROR(_("Error writing file: %s"), w->filename);
+
+    seconds = (g_get_monotonic_time() - w->start) / (gdouble)G_USEC_PER_SEC;
+    dprintf(
+        "Wrote %" G_GUINT64_FORMAT " bytes to %s in %.3f s (%.1f MB/s)\n", w->written, w->filename, seconds,
+        (seconds > 0) ? w->written / seconds / 1e6 : 0.0
+    );
+
+    g_free(w->buffer);
+    g_free(w->filename);
+    g_free(w);
+
+    return ok;
+}
+
+/* ------------------------------------------------------------------ */
+guint64
+export_writer_tell(export_writer_t* w) {
+    return w->written + w->used;
+}
+
+/* ------------------------------------------------------------------ */
+void
+export_writer_putc(export_writer_t* w, gchar c) {
+    *export_writer_reserve(w, 1) = c;
+}
+
+/* ------------------------------------------------------------------ */
+void
+export_writer_puts(export_writer_t* w, const gchar* s) {
+    export_writer_write(w, s, strlen(s));
+}
+
+/* ------------------------------------------------------------------ */
+/* Write value in decimal, zero padded to width characters like "%0*ld" */
+static void
+export_writer_int(export_writer_t* w, glong value, guint width) {
+    guint64 magnitude;
+
+    if (value < 0) {
+        export_writer_putc(w, '-');
+        /* the sign counts in the width, as with printf() */
+        width     = (width > 0) ? width - 1 : 0;
+        magnitude = -(guint64)value;
+    } else {
+        magnitude = (guint64)value;
+    }
+
+    export_writer_digits(w, magnitude, width);
+}
+
+/* ------------------------------------------------------------------ */
+/* Write value with the given number of decimals, like "%.*f" in the C locale */
+static void
+export_writer_fixed(export_writer_t* w, gdouble value, guint decimals) {
+    gchar   format[16];
+    gchar*  buffer;
+    gsize   len;
+    gdouble scaled, whole, fraction;
+
+    if (decimals < G_N_ELEMENTS(export_writer_power_of_ten) && isfinite(value)) {
+        scaled = fabs(value) * export_writer_power_of_ten[decimals];
+
+        if (scaled < EXPORT_WRITER_FAST_MAX) {
+            whole    = floor(scaled);
+            fraction = scaled - whole;
+
+            if (fabs(fraction - 0.5) > EXPORT_WRITER_TIE_MARGIN) {
+                guint64 n    = (guint64)whole + (fraction > 0.5);
+                guint64 unit = (guint64)export_writer_power_of_ten[decimals];
+
+                /* printf() keeps the sign of values that round to zero */
+                if (signbit(value))
+                    export_writer_putc(w, '-');
+
+                export_writer_digits(w, n / unit, 1);
+                if (decimals > 0) {
+                    export_writer_putc(w, '.');
+                    export_writer_digits(w, n % unit, decimals);
+                }
+                return;
+            }
+        }
+    }
+
+    /* huge numbers, ties and special values */
+    g_snprintf(format, sizeof(format), "%%.%uf", decimals);
+    len    = DBL_MAX_10_EXP + decimals + 8;
+    buffer = g_malloc(len);
+    export_writer_puts(w, g_ascii_formatd(buffer, len, format, value));
+    g_free(buffer);
+}
+
+/* ------------------------------------------------------------------ */
+void
+export_writer_printf(export_writer_t* w, const gchar* format, ...) {
+    va_list      args;
+    const gchar* p;
+
+    va_start(args, format);
+    for (p = format; *p != '\0'; p++) {
+        const gchar* literal = p;
+        gboolean     isLong  = FALSE;
+        guint        width = 0, precision = 6;
+
+        if (*p != '%') {
+            while (p[1] != '\0' && p[1] != '%')
+                p++;
+            export_writer_write(w, literal, p - literal + 1);
+            continue;
+        }
+
+        /* only zero padding is supported, "%5d" is written like "%05d" */
+        p++;
+        while (g_ascii_isdigit(*p))
+            width = 10 * width + (*p++ - '0');
+        if (*p == '.') {
+            precision = 0;
+            p++;
+            while (g_ascii_isdigit(*p))
+                precision = 10 * precision + (*p++ - '0');
+        }
+        if (*p == 'l') {
+            isLong = TRUE;
+            p++;
+        }
+
+        switch (*p) {
+            case '%': export_writer_putc(w, '%'); break;
+            case 'c': export_writer_putc(w, (gchar)va_arg(args, int)); break;
+            case 's':
+                {
+                    const gchar* s = va_arg(args, const gchar*);
+
+                    export_writer_puts(w, s ? s : "(null)");
+                    break;
+                }
+            case 'd': export_writer_int(w, isLong ? va_arg(args, glong) : va_arg(args, gint), width); break;
+            case 'f': export_writer_fixed(w, va_arg(args, gdouble), precision); break;
+            default:
+                g_warning("%s: unsupported conversion in \"%s\"", __func__, format);
+                va_end(args);
+                return;
+        }
+    }
+    va_end(args);
+}
+
+/* ------------------------------------------------------------------ */
+gsize
+export_writer_format_number(gchar* buffer, gdouble value, guint decimals) {
+    static const gdouble power[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+    gchar                digits[EXPORT_WRITER_NUMBER_SIZE];
+    gchar*               p = buffer;
+    guint64              n, whole, fraction;
+    guint                i, len = 0;
+
+    if (!isfinite(value) || fabs(value) * power[decimals] >= 1e18) {
+        g_ascii_formatd(buffer, EXPORT_WRITER_NUMBER_SIZE, "%g", isfinite(value) ? value : 0.0);
+        return strlen(buffer);
+    }
+
+    n = (guint64)llround(fabs(value) * power[decimals]);
+    if (n == 0) {
+        *p = '0';
+        return 1;
+    }
+    if (value < 0)
+        *p++ = '-';
+
+    whole    = n / (guint64)power[decimals];
+    fraction = n % (guint64)power[decimals];
+
+    do {
+        digits[len++] = '0' + whole % 10;
+        whole /= 10;
+    } while (whole != 0);
+    while (len > 0)
+        *p++ = digits[--len];
+
+    if (fraction != 0) {
+        *p++ = '.';
+        for (i = decimals; fraction % 10 == 0; i--)
+            fraction /= 10;
+        for (len = i; len > 0; len--) {
+            p[len - 1] = '0' + fraction % 10;
+            fraction /= 10;
+        }
+        p += i;
+    }
+
+    return p - buffer;
+}
@@ -0,0 +1,68 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file export-writer.h
+    \brief Header info for the buffered output of the text exporters
+    \ingroup libgerbv
+*/
+
+#ifndef EXPORT_WRITER_H
+#define EXPORT_WRITER_H
+
+#include <glib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct export_writer export_writer_t;
+
+/* Open filename for writing. Returns NULL if it can't be opened, leaving the
+ * error message to the caller. */
+export_writer_t* export_writer_open(const gchar* filename);
+
+/* Flush and close the file, and free w. Returns FALSE, after reporting the
+ * error, if any of the output couldn't be written. */
+gboolean export_writer_close(export_writer_t* w);
+
+/* Return the number of bytes written so far, including those still buffered */
+guint64 export_writer_tell(export_writer_t* w);
+
+void export_writer_putc(export_writer_t* w, gchar c);
+void export_writer_puts(export_writer_t* w, const gchar* s);
+void export_writer_write(export_writer_t* w, const gchar* data, gsize len);
+
+/* Longest number export_writer_format_number() writes */
+#define EXPORT_WRITER_NUMBER_SIZE 40
+
+/* Write value to buffer, which must hold EXPORT_WRITER_NUMBER_SIZE bytes,
+ * rounded to at most decimals (up to 9) decimals and without trailing zeros,
+ * and return its length. The buffer is not terminated. */
+gsize export_writer_format_number(gchar* buffer, gdouble value, guint decimals);
+
+/* Like fprintf(), but always in the C locale. Only %%, %c, %s, %d and %ld
+ * with an optional zero padded width, and %f with an optional precision are
+ * understood, which covers what the exporters write. */
+void export_writer_printf(export_writer_t* w, const gchar* format, ...) G_GNUC_PRINTF(2, 3);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* EXPORT_WRITER_H */
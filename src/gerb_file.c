@@ -44,6 +44,12 @@
 #endif
 #include <errno.h>
 #include <glib/gstdio.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
 
 #include "common.h"
 #include "gerbv.h"
@@ -54,14 +60,606 @@
     if (DEBUG)  \
     printf
 
+/* Bytes kept before ptr when the streaming window slides, so gerb_ungetc()
+   and parsers stepping back a few characters don't force a reread */
+#define GERB_FILE_LOOKBEHIND 64
+
+/* Longest number gerb_fgetint() and gerb_fgetdouble() are expected to see */
+#define GERB_FILE_MAX_NUMBER 64
+
+/* Total size of the file contents kept by gerb_fopen_cached() */
+#define GERB_FILE_CACHE_MAX_SIZE (64 * 1024 * 1024)
+
+/* Contents of a file shared by gerb_fopen_cached() */
+struct gerb_file_cached {
+    char*   data;     /* The whole file, decompressed and NUL terminated */
+    goffset datalen;  /* Length of data */
+    goffset size;     /* Size of the file on disk when it was read */
+    gint64  mtime;    /* Modification time of the file when it was read */
+    gint    refcount; /* Open files reading data, plus one while it is in the cache */
+};
+
+G_LOCK_DEFINE_STATIC(gerb_file_cache);
+static GHashTable* gerb_file_cache     = NULL; /* Path to gerb_file_cached */
+static goffset     gerb_file_cache_len = 0;    /* Total datalen of the cached files */
+
+static int
+gerb_file_seek(FILE* f, goffset offset) {
+#if defined(WIN32)
+    return _fseeki64(f, offset, SEEK_SET);
+#elif defined(HAVE_FSEEKO)
+    return fseeko(f, (off_t)offset, SEEK_SET);
+#else
+    return fseek(f, (long)offset, SEEK_SET);
+#endif
+}
+
+/* Make sure the streaming window holds the byte at ptr and, unless the file
+   ends first, the ahead bytes following it. Returns FALSE on read errors. */
+static gboolean
+gerb_file_fill_window(gerb_file_t* fd, gsize ahead) {
+    goffset windowEnd = fd->windowStart + (goffset)fd->windowLen;
+    goffset start;
+
+    if (!fd->streaming)
+        return TRUE;
+
+    if (fd->ptr >= fd->windowStart && (fd->ptr + (goffset)ahead <= windowEnd || windowEnd == fd->datalen)
+        && fd->ptr <= windowEnd)
+        return TRUE;
+
+    start = MAX(fd->ptr - GERB_FILE_LOOKBEHIND, 0);
+    dprintf("     Moving window to offset %" G_GINT64_FORMAT "\n", (gint64)start);
+
+    if (gerb_file_seek(fd->fd, start) != 0) {
+        fd->windowLen = 0;
+        return FALSE;
+    }
+    fd->windowStart         = start;
+    fd->windowLen           = fread(fd->data, 1, GERB_FILE_WINDOW_SIZE, fd->fd);
+    fd->data[fd->windowLen] = '\0';
+
+    return fd->ptr <= fd->windowStart + (goffset)fd->windowLen;
+}
+
+/* Compressed input is read from the file in chunks of this size */
+#define GERB_FILE_DECODE_CHUNK (64 * 1024)
+
+typedef enum {
+    GERB_FILE_PLAIN,
+    GERB_FILE_GZIP,
+    GERB_FILE_ZSTD,
+} gerb_file_compression_t;
+
+struct gerb_file_decoder {
+    gerb_file_compression_t type;
+    guint8*                 input;    /* compressed bytes read from fd->fd */
+    gsize                   inputPos; /* next unused byte in input */
+    gsize                   inputLen; /* number of valid bytes in input */
+    gboolean                inputEOF; /* all of fd->fd has been read */
+    gsize                   capacity;   /* size of the window fd->data, not counting the terminating NUL */
+    gsize                   decoded;    /* number of decompressed bytes in fd->data, from fd->windowStart on */
+    gboolean                finished;   /* the end of the compressed data was reached */
+    gboolean                failed;     /* the compressed data is corrupt or truncated */
+    gboolean                reported;   /* failed has been reported to the user */
+    gboolean                background; /* decompress on a thread */
+#ifdef HAVE_ZLIB
+    z_stream zs;
+#endif
+#ifdef HAVE_ZSTD
+    ZSTD_DStream* zds;
+#endif
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    GThread* thread;  /* background decoder, NULL when decoding in the caller */
+    GMutex   lock;    /* protects decoded, the window, running and cancel while thread is set */
+    GCond    cond;    /* signalled whenever decoded or running change */
+    gboolean running; /* the thread has not finished yet */
+    gboolean cancel;  /* ask the thread to stop */
+#endif
+};
+
+static gerb_file_compression_t
+gerb_file_detect_compression(FILE* f) {
+    guint8 magic[4];
+    size_t len = fread(magic, 1, sizeof(magic), f);
+
+    rewind(f);
+
+    if (len >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+        return GERB_FILE_GZIP;
+    if (len == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+        return GERB_FILE_ZSTD;
+
+    return GERB_FILE_PLAIN;
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+/* Read the next chunk of compressed input once the previous one is used up */
+static void
+gerb_file_decoder_read_input(struct gerb_file_decoder* dec, FILE* f) {
+    if (dec->inputPos < dec->inputLen || dec->inputEOF)
+        return;
+
+    dec->inputPos = 0;
+    dec->inputLen = fread(dec->input, 1, GERB_FILE_DECODE_CHUNK, f);
+    if (dec->inputLen == 0)
+        dec->inputEOF = TRUE;
+}
+
+/* Decompress up to outLen bytes into out, returns the number of bytes
+   produced. Sets dec->finished at the end of the data, and dec->failed if
+   the data is corrupt. Doesn't touch anything outside dec and out, so it
+   may run on the background thread. */
+static gsize
+gerb_file_decoder_run(struct gerb_file_decoder* dec, FILE* f, char* out, gsize outLen) {
+    gsize produced = 0;
+
+    while (produced < outLen && !dec->finished && !dec->failed) {
+        gsize inputBefore, producedBefore = produced;
+
+        gerb_file_decoder_read_input(dec, f);
+        inputBefore = dec->inputPos;
+
+        switch (dec->type) {
+#ifdef HAVE_ZLIB
+            case GERB_FILE_GZIP:
+                {
+                    int ret;
+
+                    dec->zs.next_in   = dec->input + dec->inputPos;
+                    dec->zs.avail_in  = dec->inputLen - dec->inputPos;
+                    dec->zs.next_out  = (Bytef*)out + produced;
+                    dec->zs.avail_out = MIN(outLen - produced, G_MAXUINT32);
+
+                    ret = inflate(&dec->zs, Z_NO_FLUSH);
+                    dec->inputPos = dec->inputLen - dec->zs.avail_in;
+                    produced      = (char*)dec->zs.next_out - out;
+
+                    if (ret == Z_STREAM_END) {
+                        /* another gzip member may follow */
+                        gerb_file_decoder_read_input(dec, f);
+                        if (dec->inputPos == dec->inputLen)
+                            dec->finished = TRUE;
+                        else
+                            inflateReset(&dec->zs);
+                    } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                        dec->failed = TRUE;
+                    }
+                    break;
+                }
+#endif
+#ifdef HAVE_ZSTD
+            case GERB_FILE_ZSTD:
+                {
+                    ZSTD_inBuffer  in  = { dec->input + dec->inputPos, dec->inputLen - dec->inputPos, 0 };
+                    ZSTD_outBuffer zso = { out + produced, outLen - produced, 0 };
+                    size_t         ret = ZSTD_decompressStream(dec->zds, &zso, &in);
+
+                    dec->inputPos += in.pos;
+                    produced += zso.pos;
+
+                    if (ZSTD_isError(ret)) {
+                        dec->failed = TRUE;
+                    } else if (ret == 0) {
+                        /* end of a frame, another one may follow */
+                        gerb_file_decoder_read_input(dec, f);
+                        if (dec->inputPos == dec->inputLen)
+                            dec->finished = TRUE;
+                    }
+                    break;
+                }
+#endif
+            default: dec->failed = TRUE; break;
+        }
+
+        /* no progress with all input read means the data was cut short */
+        if (!dec->finished && dec->inputEOF && dec->inputPos == inputBefore && produced == producedBefore)
+            dec->failed = TRUE;
+    }
+
+    return produced;
+}
+
+/* Make the window bigger, only called while nothing else holds a pointer
+   into fd->data */
+static gboolean
+gerb_file_decoder_grow(gerb_file_t* fd) {
+    struct gerb_file_decoder* dec = fd->decoder;
+    gsize                     capacity = dec->capacity * 2;
+    char*                     data     = g_try_realloc(fd->data, capacity + 1);
+
+    if (data == NULL)
+        return FALSE;
+
+    /* unused space is kept zeroed, so it always terminates the data */
+    memset(data + dec->capacity, 0, capacity + 1 - dec->capacity);
+    fd->data      = data;
+    dec->capacity = capacity;
+
+    return TRUE;
+}
+
+/* Make room in a full window by dropping what is more than
+   GERB_FILE_LOOKBEHIND bytes behind ptr, or by growing it when nothing can
+   be dropped. Only called while the decoder isn't writing to fd->data. */
+static gboolean
+gerb_file_decoder_make_room(gerb_file_t* fd) {
+    struct gerb_file_decoder* dec  = fd->decoder;
+    goffset                   keep = MAX(fd->ptr - GERB_FILE_LOOKBEHIND, fd->windowStart);
+    gsize                     drop = (gsize)MIN(keep - fd->windowStart, (goffset)dec->decoded);
+
+    if (drop == 0)
+        return gerb_file_decoder_grow(fd);
+
+    dprintf("     Moving decompression window by %" G_GSIZE_FORMAT " bytes\n", drop);
+    memmove(fd->data, fd->data + drop, dec->decoded - drop);
+    memset(fd->data + dec->decoded - drop, 0, drop);
+    dec->decoded -= drop;
+    fd->windowStart += (goffset)drop;
+
+    return TRUE;
+}
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+static gpointer
+gerb_file_decoder_thread(gpointer data) {
+    gerb_file_t*              fd  = (gerb_file_t*)data;
+    struct gerb_file_decoder* dec = fd->decoder;
+
+    for (;;) {
+        gsize    room, produced;
+        gboolean cancel;
+        char*    out;
+
+        /* the reader moves or grows a full window, then wakes us up */
+        g_mutex_lock(&dec->lock);
+        while (dec->decoded == dec->capacity && !dec->cancel)
+            g_cond_wait(&dec->cond, &dec->lock);
+        room   = dec->capacity - dec->decoded;
+        cancel = dec->cancel;
+        out    = fd->data + dec->decoded;
+        g_mutex_unlock(&dec->lock);
+
+        if (cancel)
+            break;
+
+        /* the window only changes while it is full, so out stays valid */
+        produced = gerb_file_decoder_run(dec, fd->fd, out, MIN(room, 4 * GERB_FILE_DECODE_CHUNK));
+
+        g_mutex_lock(&dec->lock);
+        dec->decoded += produced;
+        g_cond_broadcast(&dec->cond);
+        g_mutex_unlock(&dec->lock);
+
+        if (dec->finished || dec->failed)
+            break;
+    }
+
+    g_mutex_lock(&dec->lock);
+    dec->running = FALSE;
+    g_cond_broadcast(&dec->cond);
+    g_mutex_unlock(&dec->lock);
+
+    return NULL;
+}
+
+static void
+gerb_file_decoder_start_thread(gerb_file_t* fd) {
+    struct gerb_file_decoder* dec = fd->decoder;
+
+    dec->running = TRUE;
+    dec->thread  = g_thread_new("gerbv-decompress", gerb_file_decoder_thread, fd);
+}
+
+static void
+gerb_file_decoder_stop_thread(gerb_file_t* fd, gboolean cancel) {
+    struct gerb_file_decoder* dec = fd->decoder;
+
+    if (dec->thread == NULL)
+        return;
+
+    g_mutex_lock(&dec->lock);
+    dec->cancel = cancel;
+    g_cond_broadcast(&dec->cond);
+    g_mutex_unlock(&dec->lock);
+
+    g_thread_join(dec->thread);
+    dec->thread = NULL;
+    dec->cancel = FALSE;
+}
+#endif
+
+/* Start decompressing over from the beginning of the file, for readers
+   going back to data that has already left the window */
+static void
+gerb_file_decoder_restart(gerb_file_t* fd) {
+    struct gerb_file_decoder* dec = fd->decoder;
+
+    dprintf("     Decompressing %s again from the start\n", fd->filename);
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    gerb_file_decoder_stop_thread(fd, TRUE);
+#endif
+
+    switch (dec->type) {
+#ifdef HAVE_ZLIB
+        case GERB_FILE_GZIP: inflateReset(&dec->zs); break;
+#endif
+#ifdef HAVE_ZSTD
+        case GERB_FILE_ZSTD: ZSTD_initDStream(dec->zds); break;
+#endif
+        default: break;
+    }
+
+    rewind(fd->fd);
+    dec->inputPos = 0;
+    dec->inputLen = 0;
+    dec->inputEOF = FALSE;
+    dec->finished = FALSE;
+    dec->failed   = FALSE;
+    dec->decoded  = 0;
+    memset(fd->data, 0, dec->capacity + 1);
+    fd->windowStart = 0;
+    fd->datalen     = 0;
+
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    if (dec->background)
+        gerb_file_decoder_start_thread(fd);
+#endif
+}
+#endif /* HAVE_ZLIB || HAVE_ZSTD */
+
+/* Free the decompression state, either because all data has been
+   decompressed or because the file is being closed */
+static void
+gerb_file_decoder_free(gerb_file_t* fd) {
+    struct gerb_file_decoder* dec = fd->decoder;
+
+    if (dec == NULL)
+        return;
+
+#if (defined(HAVE_ZLIB) || defined(HAVE_ZSTD)) && GLIB_CHECK_VERSION(2, 32, 0)
+    gerb_file_decoder_stop_thread(fd, TRUE);
+    g_mutex_clear(&dec->lock);
+    g_cond_clear(&dec->cond);
+#endif
+#ifdef HAVE_ZLIB
+    if (dec->type == GERB_FILE_GZIP)
+        inflateEnd(&dec->zs);
+#endif
+#ifdef HAVE_ZSTD
+    if (dec->type == GERB_FILE_ZSTD)
+        ZSTD_freeDStream(dec->zds);
+#endif
+
+    fd->datalen = fd->windowStart + (goffset)dec->decoded;
+    g_free(dec->input);
+    g_free(dec);
+    fd->decoder = NULL;
+}
+
+/* Decompress until the window holds ptr and the ahead bytes after it,
+   unless the data ends first. Returns TRUE if the byte at ptr is
+   available. */
+static gboolean
+gerb_file_decode_more(gerb_file_t* fd, gsize ahead) {
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+    struct gerb_file_decoder* dec  = fd->decoder;
+    goffset                   want = fd->ptr + (goffset)ahead;
+
+    if (dec != NULL && fd->ptr < fd->windowStart)
+        gerb_file_decoder_restart(fd);
+
+    while (dec != NULL && fd->datalen < want) {
+#if GLIB_CHECK_VERSION(2, 32, 0)
+        if (dec->thread) {
+            gboolean running;
+
+            g_mutex_lock(&dec->lock);
+            for (;;) {
+                fd->datalen = fd->windowStart + (goffset)dec->decoded;
+                if (fd->datalen >= want || !dec->running)
+                    break;
+
+                /* the thread waits for room, it isn't writing to the window */
+                if (dec->decoded == dec->capacity && !dec->cancel) {
+                    if (!gerb_file_decoder_make_room(fd)) {
+                        dec->failed = TRUE;
+                        dec->cancel = TRUE;
+                    }
+                    g_cond_broadcast(&dec->cond);
+                } else {
+                    g_cond_wait(&dec->cond, &dec->lock);
+                }
+            }
+            running = dec->running;
+            g_mutex_unlock(&dec->lock);
+
+            if (running)
+                break;
+
+            /* the thread stopped at the end of the data */
+            gerb_file_decoder_stop_thread(fd, FALSE);
+        } else
+#endif
+        {
+            if (dec->finished || dec->failed)
+                break;
+            if (dec->decoded == dec->capacity && !gerb_file_decoder_make_room(fd))
+                dec->failed = TRUE;
+            else
+                dec->decoded += gerb_file_decoder_run(
+                    dec, fd->fd, fd->data + dec->decoded, MIN(dec->capacity - dec->decoded, 4 * GERB_FILE_DECODE_CHUNK)
+                );
+            fd->datalen = fd->windowStart + (goffset)dec->decoded;
+        }
+    }
+
+    /* the flags belong to the thread while it runs */
+    if (dec != NULL
+#if GLIB_CHECK_VERSION(2, 32, 0)
+        && dec->thread == NULL
+#endif
+        && (dec->finished || dec->failed)) {
+        if (dec->failed && !dec->reported) {
+            GERB_COMPILE_ERROR(_("Compressed data in \"%s\" is corrupt or truncated"), fd->filename);
+            dec->reported = TRUE;
+        }
+
+        /* a file that fit in the window is kept like a plain one, otherwise
+           the decoder is needed to start over */
+        if (fd->windowStart == 0)
+            gerb_file_decoder_free(fd);
+    }
+#endif
+
+    return fd->ptr >= fd->windowStart && fd->ptr < fd->datalen;
+}
+
+/* Set up decompression of a gzip or zstd file into fd->data */
+static gboolean
+gerb_file_decoder_open(gerb_file_t* fd, gerb_file_compression_t type, goffset compressedLen, gerb_file_flags_t flags) {
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+    struct gerb_file_decoder* dec      = g_new0(struct gerb_file_decoder, 1);
+    guint64                   expected = 0;
+    gboolean                  ok       = FALSE;
+
+    dec->type   = type;
+    dec->input  = g_malloc(GERB_FILE_DECODE_CHUNK);
+    fd->decoder = dec;
+#if GLIB_CHECK_VERSION(2, 32, 0)
+    g_mutex_init(&dec->lock);
+    g_cond_init(&dec->cond);
+#endif
+
+    switch (type) {
+#ifdef HAVE_ZLIB
+        case GERB_FILE_GZIP:
+            {
+                guint8 trailer[4];
+
+                /* the gzip trailer holds the uncompressed size modulo 4 GB */
+                if (compressedLen > 4 && gerb_file_seek(fd->fd, compressedLen - 4) == 0
+                    && fread(trailer, 1, 4, fd->fd) == 4)
+                    expected = trailer[0] | (trailer[1] << 8) | (trailer[2] << 16) | ((guint32)trailer[3] << 24);
+                rewind(fd->fd);
+
+                /* 15 window bits, plus 16 to only accept the gzip wrapper */
+                ok = (inflateInit2(&dec->zs, 15 + 16) == Z_OK);
+                break;
+            }
+#endif
+#ifdef HAVE_ZSTD
+        case GERB_FILE_ZSTD:
+            {
+                unsigned long long size;
+
+                dec->zds = ZSTD_createDStream();
+                if (dec->zds == NULL)
+                    break;
+                ZSTD_initDStream(dec->zds);
+
+                gerb_file_decoder_read_input(dec, fd->fd);
+                size = ZSTD_getFrameContentSize(dec->input, dec->inputLen);
+                if (size != ZSTD_CONTENTSIZE_UNKNOWN && size != ZSTD_CONTENTSIZE_ERROR)
+                    expected = size;
+                ok = TRUE;
+                break;
+            }
+#endif
+        default:
+            GERB_COMPILE_ERROR(
+                _("\"%s\" is %s compressed, but gerbv was built without support for it"), fd->filename,
+                type == GERB_FILE_GZIP ? "gzip" : "zstd"
+            );
+            gerb_file_decoder_free(fd);
+            errno = ENOTSUP;
+            return FALSE;
+    }
+
+    /* the window is as big as the data claims to be, up to
+       GERB_FILE_WINDOW_SIZE, so most files still end up whole in memory */
+    if (expected == 0)
+        expected = (guint64)compressedLen * 4;
+    dec->capacity = (gsize)CLAMP(expected, GERB_FILE_DECODE_CHUNK, GERB_FILE_WINDOW_SIZE);
+
+    if (ok)
+        fd->data = g_try_malloc0(dec->capacity + 1);
+    if (fd->data == NULL) {
+        gerb_file_decoder_free(fd);
+        errno = ENOMEM;
+        return FALSE;
+    }
+
+#if GLIB_CHECK_VERSION(2, 36, 0)
+    /* with a single processor the thread only adds hand-off cost, so decode
+       in the caller instead */
+    if ((flags & GERB_FILE_BACKGROUND_DECODE) && g_get_num_processors() > 1) {
+        dprintf("     Decompressing on a background thread\n");
+        dec->background = TRUE;
+        gerb_file_decoder_start_thread(fd);
+        return TRUE;
+    }
+#endif
+
+    /* fill the first window right away, the rest is decompressed as it is
+       read */
+    dprintf("     Decompressing\n");
+    gerb_file_decode_more(fd, dec->capacity);
+
+    return TRUE;
+#else
+    GERB_COMPILE_ERROR(
+        _("\"%s\" is %s compressed, but gerbv was built without support for it"), fd->filename,
+        type == GERB_FILE_GZIP ? "gzip" : "zstd"
+    );
+    errno = ENOTSUP;
+    return FALSE;
+#endif
+}
+
+/* Pointer to the byte at ptr */
+static inline char*
+gerb_file_current(gerb_file_t* fd) {
+    return fd->data + (fd->ptr - fd->windowStart);
+}
+
+/* Pointer to the number at ptr for strtol() and strtod(). For files that
+   are read through a window, it is copied to buf, so they only see bytes
+   in the window and, for compressed files, bytes that the background
+   decoder has already finished writing. */
+static const char*
+gerb_file_number(gerb_file_t* fd, char buf[GERB_FILE_MAX_NUMBER + 1]) {
+    goffset end;
+    gsize   len = 0;
+
+    if (fd->streaming)
+        gerb_file_fill_window(fd, GERB_FILE_MAX_NUMBER);
+    else if (fd->decoder != NULL)
+        gerb_file_decode_more(fd, GERB_FILE_MAX_NUMBER);
+
+    if (!fd->streaming && fd->decoder == NULL)
+        return gerb_file_current(fd);
+
+    end = fd->streaming ? fd->windowStart + (goffset)fd->windowLen : fd->datalen;
+    if (fd->ptr >= fd->windowStart && fd->ptr < end) {
+        len = (gsize)MIN(end - fd->ptr, GERB_FILE_MAX_NUMBER);
+        memcpy(buf, gerb_file_current(fd), len);
+    }
+    buf[len] = '\0';
+
+    return buf;
+}
+
 gerb_file_t*
-gerb_fopen(const char* filename) {
-    gerb_file_t* fd;
-    struct stat  statinfo;
+gerb_fopen_with_flags(const char* filename, gerb_file_flags_t flags) {
+    gerb_file_t*            fd;
+    struct stat             statinfo;
+    gerb_file_compression_t compression;
 
     dprintf("---> Entering gerb_fopen, filename = %s\n", filename);
 
-    fd = g_new(gerb_file_t, 1);
+    fd = g_new0(gerb_file_t, 1);
     if (fd == NULL) {
         return NULL;
     }
@@ -92,78 +690,270 @@ gerb_fopen(const char* filename) {
     }
 
     dprintf("     Checking statinfo.st_size\n");
-    if ((int)statinfo.st_size == 0) {
+    if (statinfo.st_size == 0) {
         fclose(fd->fd);
         g_free(fd);
         errno = EIO; /* More compatible with the world outside Linux */
         return NULL;
     }
 
+    dprintf("     Setting filename\n");
+    fd->filename = g_strdup(filename);
+
+    dprintf("     Checking for compression\n");
+    compression = gerb_file_detect_compression(fd->fd);
+    if (compression != GERB_FILE_PLAIN) {
+        /* parsers see the decompressed data, ptr and datalen count decompressed bytes */
+        if (!gerb_file_decoder_open(fd, compression, (goffset)statinfo.st_size, flags)) {
+            int err = errno;
+
+            fclose(fd->fd);
+            g_free(fd->data);
+            g_free(fd->filename);
+            g_free(fd);
+            errno = err;
+            return NULL;
+        }
+
+        dprintf("<--- Leaving gerb_fopen\n");
+        return fd;
+    }
+
+    fd->datalen = (goffset)statinfo.st_size;
+
 #ifdef HAVE_SYS_MMAN_H
 
-    dprintf("     Doing mmap\n");
-    fd->datalen = (int)statinfo.st_size;
-    fd->data    = (char*)mmap(0, statinfo.st_size, PROT_READ, MAP_PRIVATE, fd->fileno, 0);
-    if (fd->data == MAP_FAILED) {
-        fclose(fd->fd);
-        g_free(fd);
-        fd = NULL;
+    /* the whole file has to fit in the address space to be mapped */
+    if (!(flags & GERB_FILE_STREAMING) && (guint64)fd->datalen <= G_MAXSIZE) {
+        dprintf("     Doing mmap\n");
+        fd->data = (char*)mmap(0, (size_t)fd->datalen, PROT_READ, MAP_PRIVATE, fd->fileno, 0);
+        if (fd->data == MAP_FAILED) {
+            dprintf("     mmap failed, falling back to streaming\n");
+            fd->data = NULL;
+        } else {
+            fd->mapped    = TRUE;
+            fd->windowLen = (gsize)fd->datalen;
+        }
     }
 
-#else
-    /* all systems without mmap, not only MINGW32 */
+#endif
 
-    dprintf("     Doing calloc\n");
-    fd->datalen = (int)statinfo.st_size;
-    fd->data    = calloc(1, statinfo.st_size + 1);
+    /* all systems without mmap, not only MINGW32, and files we couldn't map */
     if (fd->data == NULL) {
-        fclose(fd->fd);
-        g_free(fd);
+        dprintf("     Allocating streaming window\n");
+        fd->streaming = TRUE;
+        fd->data      = g_try_malloc(GERB_FILE_WINDOW_SIZE + 1);
+        if (fd->data == NULL || !gerb_file_fill_window(fd, GERB_FILE_WINDOW_SIZE)) {
+            fclose(fd->fd);
+            g_free(fd->data);
+            g_free(fd->filename);
+            g_free(fd);
+            errno = EIO;
+            return NULL;
+        }
+    }
+
+    dprintf("<--- Leaving gerb_fopen\n");
+    return fd;
+} /* gerb_fopen_with_flags */
+
+gerb_file_t*
+gerb_fopen(const char* filename) {
+    return gerb_fopen_with_flags(filename, GERB_FILE_DEFAULT);
+} /* gerb_fopen */
+
+gerb_file_t*
+gerb_fopen_streaming(const char* filename) {
+    return gerb_fopen_with_flags(filename, GERB_FILE_STREAMING);
+} /* gerb_fopen_streaming */
+
+static void
+gerb_file_cached_unref(struct gerb_file_cached* cached) {
+    gboolean last;
+
+    G_LOCK(gerb_file_cache);
+    last = (--cached->refcount == 0);
+    G_UNLOCK(gerb_file_cache);
+
+    if (last) {
+        g_free(cached->data);
+        g_free(cached);
+    }
+}
+
+/* Read all of filename into a new cache entry */
+static struct gerb_file_cached*
+gerb_file_cached_read(const char* filename) {
+    struct gerb_file_cached* cached;
+    gerb_file_t*             fd;
+    struct stat              statinfo;
+
+    fd = gerb_fopen(filename);
+    if (fd == NULL)
+        return NULL;
+
+    if (fstat(fd->fileno, &statinfo) < 0) {
+        gerb_fclose(fd);
+        errno = EIO;
         return NULL;
     }
-    if (fread((void*)fd->data, 1, statinfo.st_size, fd->fd) != statinfo.st_size) {
-        fclose(fd->fd);
-        g_free(fd->data);
-        g_free(fd);
+
+    cached        = g_new0(struct gerb_file_cached, 1);
+    cached->size  = (goffset)statinfo.st_size;
+    cached->mtime = (gint64)statinfo.st_mtime;
+
+    if (fd->decoder != NULL) {
+        /* decompress everything through the window */
+        GString* data = g_string_sized_new(fd->decoder->capacity);
+
+        while (gerb_file_decode_more(fd, GERB_FILE_DECODE_CHUNK)) {
+            g_string_append_len(data, gerb_file_current(fd), fd->datalen - fd->ptr);
+            fd->ptr = fd->datalen;
+        }
+        cached->datalen = data->len;
+        cached->data    = g_string_free(data, FALSE);
+    } else if (!fd->mapped && !fd->streaming) {
+        cached->data    = fd->data;
+        cached->datalen = fd->datalen;
+        fd->data        = NULL;
+    } else if ((guint64)fd->datalen < G_MAXSIZE && (cached->data = g_try_malloc((gsize)fd->datalen + 1)) != NULL) {
+        cached->datalen = fd->datalen;
+        if (fd->mapped)
+            memcpy(cached->data, fd->data, (size_t)fd->datalen);
+        else if (gerb_file_seek(fd->fd, 0) != 0
+                 || fread(cached->data, 1, (size_t)fd->datalen, fd->fd) != (size_t)fd->datalen) {
+            g_free(cached->data);
+            cached->data = NULL;
+        }
+    }
+    gerb_fclose(fd);
+
+    if (cached->data == NULL) {
+        g_free(cached);
+        errno = EIO;
         return NULL;
     }
-    rewind(fd->fd);
+    cached->data[cached->datalen] = '\0';
 
-#endif
+    return cached;
+}
 
-    dprintf("     Setting filename\n");
-    fd->filename = g_strdup(filename);
+gerb_file_t*
+gerb_fopen_cached(const char* filename) {
+    struct gerb_file_cached* cached = NULL;
+    struct gerb_file_cached* stale  = NULL;
+    gpointer                 key    = NULL;
+    gerb_file_t*             fd;
+    GStatBuf                 statinfo;
+
+    /* let gerb_fopen() report anything unusual */
+    if (g_stat(filename, &statinfo) < 0 || !S_ISREG(statinfo.st_mode) || statinfo.st_size == 0)
+        return gerb_fopen(filename);
+
+    G_LOCK(gerb_file_cache);
+    if (gerb_file_cache != NULL)
+        g_hash_table_lookup_extended(gerb_file_cache, filename, &key, (gpointer*)&cached);
+    if (cached != NULL) {
+        if (cached->size == (goffset)statinfo.st_size && cached->mtime == (gint64)statinfo.st_mtime) {
+            cached->refcount++;
+        } else {
+            dprintf("     %s changed, dropping it from the cache\n", filename);
+            gerb_file_cache_len -= cached->datalen;
+            g_hash_table_steal(gerb_file_cache, filename);
+            g_free(key);
+            stale  = cached;
+            cached = NULL;
+        }
+    }
+    G_UNLOCK(gerb_file_cache);
+
+    if (stale != NULL)
+        gerb_file_cached_unref(stale);
+
+    if (cached == NULL) {
+        cached = gerb_file_cached_read(filename);
+        if (cached == NULL)
+            return NULL;
+
+        cached->refcount = 1;
+        G_LOCK(gerb_file_cache);
+        if (gerb_file_cache == NULL)
+            gerb_file_cache = g_hash_table_new_full(
+                g_str_hash, g_str_equal, g_free, (GDestroyNotify)gerb_file_cached_unref
+            );
+        /* another caller may have read it meanwhile, keep theirs */
+        if (gerb_file_cache_len + cached->datalen <= GERB_FILE_CACHE_MAX_SIZE
+            && g_hash_table_lookup(gerb_file_cache, filename) == NULL) {
+            cached->refcount++;
+            gerb_file_cache_len += cached->datalen;
+            g_hash_table_insert(gerb_file_cache, g_strdup(filename), cached);
+        }
+        G_UNLOCK(gerb_file_cache);
+    } else {
+        dprintf("     Reading %s from the cache\n", filename);
+    }
+
+    fd            = g_new0(gerb_file_t, 1);
+    fd->fileno    = -1;
+    fd->data      = cached->data;
+    fd->datalen   = cached->datalen;
+    fd->windowLen = (gsize)cached->datalen;
+    fd->filename  = g_strdup(filename);
+    fd->cached    = cached;
 
-    dprintf("<--- Leaving gerb_fopen\n");
     return fd;
-} /* gerb_fopen */
+} /* gerb_fopen_cached */
+
+void
+gerb_file_clear_cache(void) {
+    GHashTable* cache;
+
+    G_LOCK(gerb_file_cache);
+    cache               = gerb_file_cache;
+    gerb_file_cache     = NULL;
+    gerb_file_cache_len = 0;
+    G_UNLOCK(gerb_file_cache);
+
+    /* entries still being read are freed when their last file is closed */
+    if (cache != NULL)
+        g_hash_table_destroy(cache);
+} /* gerb_file_clear_cache */
 
 int
 gerb_fgetc(gerb_file_t* fd) {
 
-    if (fd->ptr >= fd->datalen)
+    if (fd->decoder != NULL) {
+        if ((fd->ptr < fd->windowStart || fd->ptr >= fd->datalen) && !gerb_file_decode_more(fd, 1))
+            return EOF;
+    } else if (fd->ptr >= fd->datalen) {
+        return EOF;
+    }
+
+    if (fd->streaming && !gerb_file_fill_window(fd, 1))
         return EOF;
 
-    return (int)fd->data[fd->ptr++];
+    return (int)fd->data[fd->ptr++ - fd->windowStart];
 } /* gerb_fgetc */
 
 int
 gerb_fgetint(gerb_file_t* fd, int* len) {
-    long int result;
-    char*    end;
+    char        buf[GERB_FILE_MAX_NUMBER + 1];
+    long int    result;
+    const char* start = gerb_file_number(fd, buf);
+    char*       end;
 
     errno  = 0;
-    result = strtol(fd->data + fd->ptr, &end, 10);
+    result = strtol(start, &end, 10);
     if (errno) {
         GERB_COMPILE_ERROR(_("Failed to read integer"));
         return 0;
     }
 
     if (len) {
-        *len = end - (fd->data + fd->ptr);
+        *len = end - start;
     }
 
-    fd->ptr = end - fd->data;
+    fd->ptr += end - start;
 
     if (len && (result < 0))
         *len -= 1;
@@ -173,27 +963,59 @@ gerb_fgetint(gerb_file_t* fd, int* len) {
 
 double
 gerb_fgetdouble(gerb_file_t* fd) {
-    double result;
-    char*  end;
+    char        buf[GERB_FILE_MAX_NUMBER + 1];
+    double      result;
+    const char* start = gerb_file_number(fd, buf);
+    char*       end;
 
     errno  = 0;
-    result = strtod(fd->data + fd->ptr, &end);
+    result = strtod(start, &end);
     if (errno) {
         GERB_COMPILE_ERROR(_("Failed to read double"));
         return 0.0;
     }
 
-    fd->ptr = end - fd->data;
+    fd->ptr += end - start;
 
     return result;
 } /* gerb_fgetdouble */
 
+/* gerb_fgetstring() for files read through a window or still being
+   decompressed, the string may span several chunks of data */
+static char*
+gerb_fgetstring_streaming(gerb_file_t* fd, char term) {
+    GString* str   = g_string_new(NULL);
+    goffset  start = fd->ptr;
+
+    for (;;) {
+        goffset before = fd->ptr;
+        char    c      = (char)gerb_fgetc(fd);
+
+        if (fd->ptr == before)
+            break; /* end of file */
+
+        if (c == term) {
+            gerb_ungetc(fd);
+            return g_string_free(str, FALSE);
+        }
+        g_string_append_c(str, c);
+    }
+
+    fd->ptr = start;
+    g_string_free(str, TRUE);
+
+    return NULL;
+} /* gerb_fgetstring_streaming */
+
 char*
 gerb_fgetstring(gerb_file_t* fd, char term) {
     char* strend = NULL;
     char* newstr;
     char *i, *iend;
-    int   len;
+    gsize len;
+
+    if (fd->streaming || fd->decoder)
+        return gerb_fgetstring_streaming(fd, term);
 
     iend = fd->data + fd->datalen;
     for (i = fd->data + fd->ptr; i < iend; i++) {
@@ -226,18 +1048,62 @@ gerb_ungetc(gerb_file_t* fd) {
     return;
 } /* gerb_ungetc */
 
+const char*
+gerb_fbuffer(gerb_file_t* fd, goffset* len) {
+    if (fd->streaming || fd->decoder != NULL)
+        return NULL;
+
+    *len = fd->datalen - fd->ptr;
+
+    return fd->data + fd->ptr;
+} /* gerb_fbuffer */
+
+char*
+gerb_fgets(char* buf, int size, gerb_file_t* fd) {
+    int len = 0;
+
+    while (len < size - 1) {
+        goffset before = fd->ptr;
+        int     c      = gerb_fgetc(fd);
+
+        if (fd->ptr == before)
+            break; /* end of file */
+
+        buf[len++] = (char)c;
+        if (c == '\n')
+            break;
+    }
+
+    if (len == 0)
+        return NULL;
+
+    buf[len] = '\0';
+
+    return buf;
+} /* gerb_fgets */
+
+void
+gerb_frewind(gerb_file_t* fd) {
+    fd->ptr = 0;
+} /* gerb_frewind */
+
 void
 gerb_fclose(gerb_file_t* fd) {
     if (fd) {
+        gerb_file_decoder_free(fd);
         g_free(fd->filename);
 
+        if (fd->cached) {
+            gerb_file_cached_unref(fd->cached);
+        } else if (fd->mapped) {
 #ifdef HAVE_SYS_MMAN_H
-        if (munmap(fd->data, fd->datalen) < 0)
-            GERB_FATAL_ERROR("munmap: %s", strerror(errno));
-#else
-        g_free(fd->data);
+            if (munmap(fd->data, (size_t)fd->datalen) < 0)
+                GERB_FATAL_ERROR("munmap: %s", strerror(errno));
 #endif
-        if (fclose(fd->fd) == EOF)
+        } else {
+            g_free(fd->data);
+        }
+        if (fd->fd != NULL && fclose(fd->fd) == EOF)
             GERB_FATAL_ERROR("fclose: %s", strerror(errno));
         g_free(fd);
     }
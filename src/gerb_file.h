@@ -30,24 +30,63 @@
 #define GERB_FILE_H
 
 #include <stdio.h>
+#include <glib.h>
+
+/* Size of the buffer used by the streaming reader, and the most
+   decompressed data kept in memory at a time */
+#define GERB_FILE_WINDOW_SIZE (1024 * 1024)
+
+/* Options for gerb_fopen_with_flags() */
+typedef enum {
+    GERB_FILE_DEFAULT           = 0,
+    GERB_FILE_STREAMING         = 1 << 0, /* read plain files through a sliding window instead of mapping them */
+    GERB_FILE_BACKGROUND_DECODE = 1 << 1, /* decompress gzip/zstd input on a thread while it is being parsed, if there is more than one processor */
+} gerb_file_flags_t;
+
+struct gerb_file_decoder;
+struct gerb_file_cached;
 
 typedef struct file {
-    FILE* fd;       /* File descriptor */
-    int   fileno;   /* The integer version of fd */
-    char* data;     /* Pointer to data mmaped in. May not be changed, use ptr */
-    int   datalen;  /* Length of mmaped data ie file length */
-    int   ptr;      /* Index in data where we are reading */
-    char* filename; /* File name */
+    FILE*    fd;          /* File descriptor */
+    int      fileno;      /* The integer version of fd */
+    char*    data;        /* Pointer to data mmaped in, or the streaming window. May not be changed, use ptr */
+    goffset  datalen;     /* File length, or the end of the data decompressed so far */
+    goffset  ptr;         /* Offset in the file where we are reading */
+    char*    filename;    /* File name */
+    gboolean mapped;      /* TRUE if data is mmaped in */
+    gboolean streaming;   /* TRUE if data only holds a window of the file */
+    goffset  windowStart; /* File offset of data[0] */
+    gsize    windowLen;   /* Number of valid bytes in data */
+
+    struct gerb_file_decoder* decoder; /* Decompression state while compressed input is being read, or NULL */
+    struct gerb_file_cached*  cached;  /* Shared contents data points into, from gerb_fopen_cached(), or NULL */
 } gerb_file_t;
 
+/* Open a file for parsing. gzip and zstd compressed files are recognized by
+   their magic bytes and decompressed transparently, as they are read. */
 gerb_file_t* gerb_fopen(const char* filename);
+/* Like gerb_fopen(), but always read through a sliding window of
+   GERB_FILE_WINDOW_SIZE bytes instead of mapping the whole file */
+gerb_file_t* gerb_fopen_streaming(const char* filename);
+gerb_file_t* gerb_fopen_with_flags(const char* filename, gerb_file_flags_t flags);
+/* Like gerb_fopen(), but read from a copy of the (decompressed) contents that
+   is kept until gerb_file_clear_cache(), and shared by every later open of
+   the same file while its size and modification time are unchanged */
+gerb_file_t* gerb_fopen_cached(const char* filename);
+void         gerb_file_clear_cache(void);
 int          gerb_fgetc(gerb_file_t* fd);
 int          gerb_fgetint(gerb_file_t* fd, int* len); /* If len != NULL, returns number
                                  of chars parsed in len */
 double gerb_fgetdouble(gerb_file_t* fd);
 char*  gerb_fgetstring(gerb_file_t* fd, char term);
 void   gerb_ungetc(gerb_file_t* fd);
-void   gerb_fclose(gerb_file_t* fd);
+/* Return the unread rest of the file and its length in len, if the whole
+   file is in memory. Returns NULL if it has to be read with gerb_fgetc() */
+const char* gerb_fbuffer(gerb_file_t* fd, goffset* len);
+/* Read a line like fgets(), used by the file type checks */
+char* gerb_fgets(char* buf, int size, gerb_file_t* fd);
+void  gerb_frewind(gerb_file_t* fd);
+void  gerb_fclose(gerb_file_t* fd);
 
 /** Search for files in directories pointed out by paths, a NULL terminated
  * list of directories to search. If a string in paths starts with a $, then
@@ -37,10 +37,100 @@
 #include "gerber.h"
 #include "amacro.h"
 
+/* Nets and arc parameters copied by one merge, allocated together */
 typedef struct {
-    int oldAperture;
-    int newAperture;
-} gerb_translation_entry_t;
+    guint8* start;
+    gsize   size;    /* in bytes */
+    gsize   objSize; /* of each object in it */
+    guint   live;    /* objects in it that haven't been freed yet */
+} gerbv_image_block_t;
+
+/* Guards the arcs cache of all images, which renderers fill as they draw */
+G_LOCK_DEFINE_STATIC(gerbv_image_arcs);
+
+/* Return the index of the last block starting at or before p, or -1 */
+static gint
+gerbv_image_find_block(const GArray* blocks, gconstpointer p) {
+    gint low = 0, high = (gint)blocks->len - 1, found = -1;
+
+    while (low <= high) {
+        gint mid = (low + high) / 2;
+
+        if ((gconstpointer)g_array_index(blocks, gerbv_image_block_t, mid).start <= p) {
+            found = mid;
+            low   = mid + 1;
+        } else {
+            high = mid - 1;
+        }
+    }
+
+    return found;
+}
+
+/* Allocate count objects of objSize bytes in one block owned by image, adding its size to bytes */
+static gpointer
+gerbv_image_alloc_block(gerbv_image_t* image, gsize objSize, guint count, gsize* bytes) {
+    gerbv_image_block_t block;
+
+    if (count == 0)
+        return NULL;
+
+    if (image->blocks == NULL)
+        image->blocks = g_array_new(FALSE, FALSE, sizeof(gerbv_image_block_t));
+
+    block.start   = g_malloc(objSize * count);
+    block.size    = objSize * count;
+    block.objSize = objSize;
+    block.live    = count;
+    g_array_insert_val(image->blocks, gerbv_image_find_block(image->blocks, block.start) + 1, block);
+    *bytes += block.size;
+
+    return block.start;
+}
+
+/* Free a net or cirseg of objSize bytes of image, which may be part of a block,
+   taking what is released off bytes */
+static void
+gerbv_image_free_object(gerbv_image_t* image, gpointer p, gsize objSize, gsize* bytes) {
+    gerbv_image_block_t* block;
+    gint                 i;
+
+    if (p == NULL)
+        return;
+
+    if (image->blocks != NULL && (i = gerbv_image_find_block(image->blocks, p)) >= 0) {
+        block = &g_array_index(image->blocks, gerbv_image_block_t, i);
+        if ((guint8*)p < block->start + block->size) {
+            /* the block goes once all of its objects have */
+            if (--block->live == 0) {
+                *bytes -= block->size;
+                g_free(block->start);
+                g_array_remove_index(image->blocks, i);
+            }
+            return;
+        }
+    }
+
+    *bytes -= objSize;
+    g_free(p);
+}
+
+/* ------------------------------------------------------------------ */
+gerbv_net_t*
+gerbv_image_new_net(gerbv_image_t* image) {
+    image->netBytes += sizeof(gerbv_net_t);
+    image->nNets++;
+
+    return g_new0(gerbv_net_t, 1);
+}
+
+/* ------------------------------------------------------------------ */
+gerbv_cirseg_t*
+gerbv_image_new_cirseg(gerbv_image_t* image) {
+    image->cirsegBytes += sizeof(gerbv_cirseg_t);
+
+    return g_new0(gerbv_cirseg_t, 1);
+}
 
 gerbv_image_t*
 gerbv_create_image(gerbv_image_t* image, const gchar* type) {
@@ -52,7 +142,7 @@ gerbv_create_image(gerbv_image_t* image, const gchar* type) {
     }
 
     /* Malloc space for image->netlist */
-    if (NULL == (image->netlist = g_new0(gerbv_net_t, 1))) {
+    if (NULL == (image->netlist = gerbv_image_new_net(image))) {
         g_free(image);
         return NULL;
     }
@@ -107,24 +197,32 @@ gerbv_destroy_image(gerbv_image_t* image) {
     gerbv_layer_t*             layer;
     gerbv_netstate_t*          state;
     gerbv_simplified_amacro_t *sam, *sam2;
+    GHashTable*                freedSimplified;
 
     if (image == NULL)
         return;
 
     /*
-     * Free apertures
+     * Free apertures. Apertures using the same macro with the same
+     * parameters share their simplified macro list, free it only once.
      */
+    freedSimplified = g_hash_table_new(g_direct_hash, g_direct_equal);
     for (i = 0; i < APERTURE_MAX; i++)
         if (image->aperture[i] != NULL) {
-            for (sam = image->aperture[i]->simplified; sam != NULL;) {
-                sam2 = sam->next;
-                g_free(sam);
-                sam = sam2;
+            sam = image->aperture[i]->simplified;
+            if (sam != NULL && g_hash_table_lookup(freedSimplified, sam) == NULL) {
+                g_hash_table_insert(freedSimplified, sam, sam);
+                while (sam != NULL) {
+                    sam2 = sam->next;
+                    g_free(sam);
+                    sam = sam2;
+                }
             }
 
             g_free(image->aperture[i]);
             image->aperture[i] = NULL;
         }
+    g_hash_table_destroy(freedSimplified);
 
     /*
      * Free aperture macro
@@ -157,15 +255,18 @@ gerbv_destroy_image(gerbv_image_t* image) {
         tmp = net;
         net = net->next;
         if (tmp->cirseg != NULL) {
-            g_free(tmp->cirseg);
+            gerbv_image_free_object(image, tmp->cirseg, sizeof(gerbv_cirseg_t), &image->cirsegBytes);
             tmp->cirseg = NULL;
         }
-        if (tmp->label) {
-            g_string_free(tmp->label, TRUE);
-        }
-        g_free(tmp);
+        gerbv_image_free_object(image, tmp, sizeof(gerbv_net_t), &image->netBytes);
         tmp = NULL;
     }
+    if (image->blocks != NULL) {
+        /* nets unlinked without being freed */
+        for (i = 0; i < (int)image->blocks->len; i++)
+            g_free(g_array_index(image->blocks, gerbv_image_block_t, i).start);
+        g_array_free(image->blocks, TRUE);
+    }
     for (layer = image->layers; layer != NULL;) {
         gerbv_layer_t* tempLayer = layer;
 
@@ -179,6 +280,9 @@ gerbv_destroy_image(gerbv_image_t* image) {
         state = state->next;
         g_free(tempState);
     }
+    gerbv_image_invalidate_caches(image);
+    if (image->labels != NULL)
+        g_hash_table_destroy(image->labels);
     gerbv_stats_destroy(image->gerbv_stats);
     gerbv_drill_stats_destroy(image->drill_stats);
 
@@ -316,6 +420,8 @@ gerbv_image_duplicate_layer(gerbv_layer_t* oldLayer) {
 
     *newLayer      = *oldLayer;
     newLayer->name = g_strdup(oldLayer->name);
+    /* don't share the rest of the old image's layers */
+    newLayer->next = NULL;
     return newLayer;
 }
 
@@ -323,7 +429,8 @@ static gerbv_netstate_t*
 gerbv_image_duplicate_state(gerbv_netstate_t* oldState) {
     gerbv_netstate_t* newState = g_new(gerbv_netstate_t, 1);
 
-    *newState = *oldState;
+    *newState      = *oldState;
+    newState->next = NULL;
     return newState;
 }
 
@@ -353,23 +460,333 @@ gerbv_image_duplicate_aperture(gerbv_aperture_t* oldAperture) {
     return newAperture;
 }
 
+typedef struct {
+    guint scale_circle;
+    guint scale_line_macro;
+    guint scale_poly_macro;
+    guint scale_thermo_macro;
+    guint scale_moire_macro;
+    guint unknown_aperture;
+    guint unknown_macro_aperture;
+    guint rotate_oval;
+    guint rotate_rect;
+} gerb_transform_errors_t;
+
+/* Return a new aperture with trans applied to it, or NULL if the aperture
+   doesn't need to (or can't) be transformed */
+static gerbv_aperture_t*
+gerbv_image_transform_aperture(
+    gerbv_aperture_t* aperture, gerbv_user_transformation_t* trans, gerb_transform_errors_t* errors
+) {
+    gerbv_aperture_type_t      aper_type = aperture->type;
+    gerbv_aperture_t*          aper;
+    gerbv_simplified_amacro_t* sam;
+
+    switch (aper_type) {
+        case GERBV_APTYPE_NONE:
+        case GERBV_APTYPE_POLYGON: break;
+
+        case GERBV_APTYPE_CIRCLE:
+            if (trans->scaleX == trans->scaleY && trans->scaleX == 1.0) {
+                break;
+            }
+
+            if (trans->scaleX == trans->scaleY) {
+                aper = gerbv_image_duplicate_aperture(aperture);
+                aper->parameter[0] *= trans->scaleX;
+
+                return aper;
+            } else {
+                errors->scale_circle++;
+            }
+            break;
+
+        case GERBV_APTYPE_RECTANGLE:
+        case GERBV_APTYPE_OVAL:
+            if (trans->scaleX == 1.0 && trans->scaleY == 1.0
+                && fabs(fabs(trans->rotation) - M_PI) < GERBV_PRECISION_ANGLE_RAD)
+                break;
+
+            aper = gerbv_image_duplicate_aperture(aperture);
+            aper->parameter[0] *= trans->scaleX;
+            aper->parameter[1] *= trans->scaleY;
+
+            if (fabs(fabs(trans->rotation) - M_PI_2) < GERBV_PRECISION_ANGLE_RAD
+                || fabs(fabs(trans->rotation) - (M_PI + M_PI_2)) < GERBV_PRECISION_ANGLE_RAD) {
+                double t           = aper->parameter[0];
+                aper->parameter[0] = aper->parameter[1];
+                aper->parameter[1] = t;
+            } else {
+                if (aper_type == GERBV_APTYPE_RECTANGLE)
+                    errors->rotate_rect++; /* TODO: make line21 macro */
+                else
+                    errors->rotate_oval++;
+
+                g_free(aper);
+                break;
+            }
+
+            return aper;
+
+            break;
+
+        case GERBV_APTYPE_MACRO:
+            aper = gerbv_image_duplicate_aperture(aperture);
+            sam  = aper->simplified;
+
+            for (; sam != NULL; sam = sam->next) {
+                switch (sam->type) {
+                    case GERBV_APTYPE_MACRO_CIRCLE:
+
+                        /* TODO: test circle macro center rotation */
+                        sam->parameter[CIRCLE_CENTER_X] *= trans->scaleX;
+                        sam->parameter[CIRCLE_CENTER_Y] *= trans->scaleY;
+                        gerbv_rotate_coord(
+                            sam->parameter + CIRCLE_CENTER_X, sam->parameter + CIRCLE_CENTER_Y, trans->rotation
+                        );
+
+                        if (trans->scaleX != trans->scaleY) {
+                            errors->scale_circle++;
+                            break;
+                        }
+                        sam->parameter[CIRCLE_DIAMETER] *= trans->scaleX;
+                        break;
+
+                    case GERBV_APTYPE_MACRO_LINE20:
+                        /* Vector line rectangle */
+                        if (trans->scaleX == trans->scaleY) {
+                            sam->parameter[LINE20_LINE_WIDTH] *= trans->scaleX;
+                        } else if (sam->parameter[LINE20_START_X] == sam->parameter[LINE20_END_X]) {
+                            sam->parameter[LINE20_LINE_WIDTH] *= trans->scaleX; /* Vertical */
+                        } else if (sam->parameter[LINE20_START_Y] == sam->parameter[LINE20_END_Y]) {
+                            sam->parameter[LINE20_LINE_WIDTH] *= trans->scaleY; /* Horizontal */
+                        } else {
+                            /* TODO: make outline macro */
+                            errors->scale_line_macro++;
+                            break;
+                        }
+
+                        sam->parameter[LINE20_START_X] *= trans->scaleX;
+                        sam->parameter[LINE20_START_Y] *= trans->scaleY;
+                        sam->parameter[LINE20_END_X] *= trans->scaleX;
+                        sam->parameter[LINE20_END_Y] *= trans->scaleY;
+
+                        /* LINE20_START_X, LINE20_START_Y,
+                         * LINE20_END_X, LINE20_END_Y are not
+                         * rotated, change only rotation angle */
+                        sam->parameter[LINE20_ROTATION] += RAD2DEG(trans->rotation);
+                        break;
+
+/* Compile time check if LINE21 and LINE22 parameters indexes are equal */
+#if (LINE21_WIDTH != LINE22_WIDTH) || (LINE21_HEIGHT != LINE22_HEIGHT) || (LINE21_ROTATION != LINE22_ROTATION) \
+|| (LINE21_CENTER_X != LINE22_LOWER_LEFT_X) || (LINE21_CENTER_Y != LINE22_LOWER_LEFT_Y)
+#error "LINE21 and LINE22 indexes are not equal"
+#endif
+
+                    case GERBV_APTYPE_MACRO_LINE21:
+                        /* Centered line rectangle */
+                    case GERBV_APTYPE_MACRO_LINE22:
+                        /* Lower left line rectangle */
+
+                        /* Using LINE21 parameters array
+                         * indexes for LINE21 and LINE22, as
+                         * they are equal */
+                        if (trans->scaleX == trans->scaleY) {
+                            sam->parameter[LINE21_WIDTH] *= trans->scaleX;
+                            sam->parameter[LINE21_HEIGHT] *= trans->scaleX;
+
+                        } else if (fabs(sam->parameter[LINE21_ROTATION]) == 0 || fabs(sam->parameter[LINE21_ROTATION]) == 180) {
+                            sam->parameter[LINE21_WIDTH] *= trans->scaleX;
+                            sam->parameter[LINE21_HEIGHT] *= trans->scaleY;
+
+                        } else if (fabs(sam->parameter[LINE21_ROTATION]) == 90 || fabs(sam->parameter[LINE21_ROTATION]) == 270) {
+                            double t;
+                            t                             = sam->parameter[LINE21_WIDTH];
+                            sam->parameter[LINE21_WIDTH]  = trans->scaleY * sam->parameter[LINE21_HEIGHT];
+                            sam->parameter[LINE21_HEIGHT] = trans->scaleX * t;
+                        } else {
+                            /* TODO: make outline macro */
+                            errors->scale_line_macro++;
+                            break;
+                        }
+
+                        sam->parameter[LINE21_CENTER_X] *= trans->scaleX;
+                        sam->parameter[LINE21_CENTER_Y] *= trans->scaleY;
+
+                        sam->parameter[LINE21_ROTATION] += RAD2DEG(trans->rotation);
+                        gerbv_rotate_coord(
+                            sam->parameter + LINE21_CENTER_X, sam->parameter + LINE21_CENTER_Y, trans->rotation
+                        );
+                        break;
+
+                    case GERBV_APTYPE_MACRO_OUTLINE:
+                        for (int i = 0; i < 1 + sam->parameter[OUTLINE_NUMBER_OF_POINTS]; i++) {
+                            sam->parameter[OUTLINE_X_IDX_OF_POINT(i)] *= trans->scaleX;
+                            sam->parameter[OUTLINE_Y_IDX_OF_POINT(i)] *= trans->scaleY;
+                        }
+
+                        sam->parameter[OUTLINE_ROTATION_IDX(sam->parameter)] += RAD2DEG(trans->rotation);
+                        break;
+#if 0
+{
+/* TODO */
+#include "main.h"
+gerbv_selection_item_t sItem = {sourceImage, currentNet};
+selection_add_item (&screen.selectionInfo, &sItem);
+}
+#endif
+
+                    case GERBV_APTYPE_MACRO_POLYGON:
+                        if (trans->scaleX == trans->scaleY) {
+                            sam->parameter[POLYGON_CENTER_X] *= trans->scaleX;
+                            sam->parameter[POLYGON_CENTER_Y] *= trans->scaleX;
+                            sam->parameter[POLYGON_DIAMETER] *= trans->scaleX;
+                        } else {
+                            /* TODO: make outline macro */
+                            errors->scale_poly_macro++;
+                            break;
+                        }
+
+                        sam->parameter[POLYGON_ROTATION] += RAD2DEG(trans->rotation);
+                        break;
+
+                    case GERBV_APTYPE_MACRO_MOIRE:
+                        if (trans->scaleX == trans->scaleY) {
+                            sam->parameter[MOIRE_CENTER_X] *= trans->scaleX;
+                            sam->parameter[MOIRE_CENTER_Y] *= trans->scaleX;
+                            sam->parameter[MOIRE_OUTSIDE_DIAMETER] *= trans->scaleX;
+                            sam->parameter[MOIRE_CIRCLE_THICKNESS] *= trans->scaleX;
+                            sam->parameter[MOIRE_GAP_WIDTH] *= trans->scaleX;
+                            sam->parameter[MOIRE_CROSSHAIR_THICKNESS] *= trans->scaleX;
+                            sam->parameter[MOIRE_CROSSHAIR_LENGTH] *= trans->scaleX;
+                        } else {
+                            errors->scale_moire_macro++;
+                            break;
+                        }
+
+                        sam->parameter[MOIRE_ROTATION] += RAD2DEG(trans->rotation);
+                        break;
+
+                    case GERBV_APTYPE_MACRO_THERMAL:
+                        if (trans->scaleX == trans->scaleY) {
+                            sam->parameter[THERMAL_CENTER_X] *= trans->scaleX;
+                            sam->parameter[THERMAL_CENTER_Y] *= trans->scaleX;
+                            sam->parameter[THERMAL_INSIDE_DIAMETER] *= trans->scaleX;
+                            sam->parameter[THERMAL_OUTSIDE_DIAMETER] *= trans->scaleX;
+                            sam->parameter[THERMAL_CROSSHAIR_THICKNESS] *= trans->scaleX;
+                        } else {
+                            errors->scale_thermo_macro++;
+                            break;
+                        }
+
+                        sam->parameter[THERMAL_ROTATION] += RAD2DEG(trans->rotation);
+                        break;
+
+                    default:
+                        /* TODO: free aper if it is skipped (i.e. unused)? */
+                        errors->unknown_macro_aperture++;
+                }
+            }
+
+            return aper;
+
+            break;
+        default: errors->unknown_aperture++;
+    }
+
+    return NULL;
+}
+
+static void
+gerbv_image_report_transform_errors(const gerb_transform_errors_t* errors, gerbv_user_transformation_t* trans) {
+    if (errors->rotate_rect)
+        GERB_COMPILE_ERROR(
+            ngettext(
+                "Can't rotate %u rectangular aperture to %.2f "
+                "degrees (non 90 multiply)!",
+                "Can't rotate %u rectangular apertures to %.2f "
+                "degrees (non 90 multiply)!",
+                errors->rotate_rect
+            ),
+            errors->rotate_rect, RAD2DEG(trans->rotation)
+        );
+
+    if (errors->scale_line_macro)
+        GERB_COMPILE_ERROR(
+            ngettext("Can't scale %u line macro!", "Can't scale %u line macros!", errors->scale_line_macro),
+            errors->scale_line_macro
+        );
+
+    if (errors->scale_poly_macro)
+        GERB_COMPILE_ERROR(
+            ngettext("Can't scale %u polygon macro!", "Can't scale %u polygon macros!", errors->scale_poly_macro),
+            errors->scale_poly_macro
+        );
+
+    if (errors->scale_thermo_macro)
+        GERB_COMPILE_ERROR(
+            ngettext("Can't scale %u thermal macro!", "Can't scale %u thermal macros!", errors->scale_poly_macro),
+            errors->scale_poly_macro
+        );
+
+    if (errors->scale_moire_macro)
+        GERB_COMPILE_ERROR(
+            ngettext("Can't scale %u moire macro!", "Can't scale %u moire macros!", errors->scale_poly_macro),
+            errors->scale_poly_macro
+        );
+
+    if (errors->rotate_oval)
+        GERB_COMPILE_ERROR(
+            ngettext(
+                "Can't rotate %u oval aperture to %.2f "
+                "degrees (non 90 multiply)!",
+                "Can't rotate %u oval apertures to %.2f "
+                "degrees (non 90 multiply)!",
+                errors->rotate_oval
+            ),
+            errors->rotate_oval, RAD2DEG(trans->rotation)
+        );
+
+    if (errors->scale_circle)
+        GERB_COMPILE_ERROR(
+            ngettext(
+                "Can't scale %u circle aperture to ellipse!", "Can't scale %u circle apertures to ellipse!",
+                errors->scale_circle
+            ),
+            errors->scale_circle
+        );
+
+    if (errors->unknown_aperture)
+        GERB_COMPILE_ERROR(
+            ngettext(
+                "Skipped %u aperture with unknown type!", "Skipped %u apertures with unknown type!",
+                errors->unknown_aperture
+            ),
+            errors->unknown_aperture
+        );
+
+    if (errors->unknown_macro_aperture)
+        GERB_COMPILE_ERROR(
+            ngettext("Skipped %u macro aperture!", "Skipped %u macro apertures!", errors->unknown_macro_aperture),
+            errors->unknown_macro_aperture
+        );
+}
+
 static void
 gerbv_image_copy_all_nets(
     gerbv_image_t* sourceImage, gerbv_image_t* destImage, gerbv_layer_t* lastLayer, gerbv_netstate_t* lastState,
-    gerbv_net_t* lastNet, gerbv_user_transformation_t* trans, GArray* translationTable
+    gerbv_net_t* lastNet, gerbv_user_transformation_t* trans, const gint* translationTable
 ) {
     /* NOTE: destImage already contains apertures and data,
      * latest data is: lastLayer, lastState, lastNet. */
 
-    gerbv_net_t *              currentNet, *newNet;
-    gerbv_aperture_type_t      aper_type;
-    gerbv_aperture_t*          aper;
-    gerbv_simplified_amacro_t* sam;
-    int*                       trans_apers  = NULL; /* Transformed apertures */
-    int                        aper_last_id = 0;
-    guint err_scale_circle = 0, err_scale_line_macro = 0, err_scale_poly_macro = 0, err_scale_thermo_macro = 0,
-          err_scale_moire_macro = 0, err_unknown_aperture = 0, err_unknown_macro_aperture = 0, err_rotate_oval = 0,
-          err_rotate_rect = 0;
+    gerbv_net_t *           currentNet, *newNet, *newNets;
+    gerbv_cirseg_t*         newCirsegs;
+    gerbv_aperture_t*       aper;
+    int*                    trans_apers  = NULL; /* Transformed apertures */
+    int                     aper_last_id = 0;
+    guint                   nNets        = 0, nCirsegs = 0;
+    gerb_transform_errors_t errors       = { 0 };
 
     if (trans && (trans->mirrorAroundX || trans->mirrorAroundY)) {
         if (sourceImage->layertype != GERBV_LAYERTYPE_DRILL) {
@@ -403,6 +820,22 @@ gerbv_image_copy_all_nets(
             trans_apers[i] = -1;
     }
 
+    /* allocate the copies all at once, rather than a net at a time */
+    for (currentNet = sourceImage->netlist; currentNet != NULL; currentNet = currentNet->next) {
+        nNets++;
+        if (currentNet->cirseg)
+            nCirsegs++;
+    }
+    newNets    = gerbv_image_alloc_block(destImage, sizeof(gerbv_net_t), nNets, &destImage->netBytes);
+    newCirsegs = gerbv_image_alloc_block(destImage, sizeof(gerbv_cirseg_t), nCirsegs, &destImage->cirsegBytes);
+    destImage->nNets += nNets;
+
+    if (lastNet == NULL && nNets > 0) {
+        /* the copies replace the placeholder net the image was created with */
+        gerbv_image_free_object(destImage, destImage->netlist, sizeof(gerbv_net_t), &destImage->netBytes);
+        destImage->nNets--;
+    }
+
     for (currentNet = sourceImage->netlist; currentNet != NULL; currentNet = currentNet->next) {
 
         /* Check for any new layers and duplicate them if needed */
@@ -418,16 +851,16 @@ gerbv_image_copy_all_nets(
         }
 
         /* Create and copy the actual net over */
-        newNet  = g_new(gerbv_net_t, 1);
+        newNet  = newNets++;
         *newNet = *currentNet;
 
         if (currentNet->cirseg) {
-            newNet->cirseg    = g_new(gerbv_cirseg_t, 1);
+            newNet->cirseg    = newCirsegs++;
             *(newNet->cirseg) = *(currentNet->cirseg);
         }
 
         if (currentNet->label)
-            newNet->label = g_string_new(currentNet->label->str);
+            newNet->label = gerbv_image_intern_label(destImage, currentNet->label->str);
         else
             newNet->label = NULL;
 
@@ -442,18 +875,9 @@ gerbv_image_copy_all_nets(
         lastNet = newNet;
 
         /* Check if we need to translate the aperture number */
-        if (translationTable) {
-            for (guint i = 0; i < translationTable->len; i++) {
-                gerb_translation_entry_t translationEntry;
-
-                translationEntry = g_array_index(translationTable, gerb_translation_entry_t, i);
-
-                if (translationEntry.oldAperture == newNet->aperture) {
-                    newNet->aperture = translationEntry.newAperture;
-                    break;
-                }
-            }
-        }
+        if (translationTable && newNet->aperture >= 0 && newNet->aperture < APERTURE_MAX
+            && translationTable[newNet->aperture] >= 0)
+            newNet->aperture = translationTable[newNet->aperture];
 
         if (trans == NULL)
             continue;
@@ -481,296 +905,21 @@ gerbv_image_copy_all_nets(
         }
 
         /* Transforming apertures */
-        aper_type = destImage->aperture[newNet->aperture]->type;
-        switch (aper_type) {
-            case GERBV_APTYPE_NONE:
-            case GERBV_APTYPE_POLYGON: break;
-
-            case GERBV_APTYPE_CIRCLE:
-                if (trans->scaleX == trans->scaleY && trans->scaleX == 1.0) {
-                    break;
-                }
-
-                if (trans->scaleX == trans->scaleY) {
-                    aper = gerbv_image_duplicate_aperture(destImage->aperture[newNet->aperture]);
-                    aper->parameter[0] *= trans->scaleX;
-
-                    trans_apers[newNet->aperture]     = ++aper_last_id;
-                    destImage->aperture[aper_last_id] = aper;
-                    newNet->aperture                  = aper_last_id;
-                } else {
-                    err_scale_circle++;
-                }
-                break;
-
-            case GERBV_APTYPE_RECTANGLE:
-            case GERBV_APTYPE_OVAL:
-                if (trans->scaleX == 1.0 && trans->scaleY == 1.0
-                    && fabs(fabs(trans->rotation) - M_PI) < GERBV_PRECISION_ANGLE_RAD)
-                    break;
-
-                aper = gerbv_image_duplicate_aperture(destImage->aperture[newNet->aperture]);
-                aper->parameter[0] *= trans->scaleX;
-                aper->parameter[1] *= trans->scaleY;
-
-                if (fabs(fabs(trans->rotation) - M_PI_2) < GERBV_PRECISION_ANGLE_RAD
-                    || fabs(fabs(trans->rotation) - (M_PI + M_PI_2)) < GERBV_PRECISION_ANGLE_RAD) {
-                    double t           = aper->parameter[0];
-                    aper->parameter[0] = aper->parameter[1];
-                    aper->parameter[1] = t;
-                } else {
-                    if (aper_type == GERBV_APTYPE_RECTANGLE)
-                        err_rotate_rect++; /* TODO: make line21 macro */
-                    else
-                        err_rotate_oval++;
-
-                    break;
-                }
-
-                trans_apers[newNet->aperture]     = ++aper_last_id;
-                destImage->aperture[aper_last_id] = aper;
-                newNet->aperture                  = aper_last_id;
-
-                break;
-
-            case GERBV_APTYPE_MACRO:
-                aper = gerbv_image_duplicate_aperture(destImage->aperture[newNet->aperture]);
-                sam  = aper->simplified;
-
-                for (; sam != NULL; sam = sam->next) {
-                    switch (sam->type) {
-                        case GERBV_APTYPE_MACRO_CIRCLE:
-
-                            /* TODO: test circle macro center rotation */
-                            sam->parameter[CIRCLE_CENTER_X] *= trans->scaleX;
-                            sam->parameter[CIRCLE_CENTER_Y] *= trans->scaleY;
-                            gerbv_rotate_coord(
-                                sam->parameter + CIRCLE_CENTER_X, sam->parameter + CIRCLE_CENTER_Y, trans->rotation
-                            );
-
-                            if (trans->scaleX != trans->scaleY) {
-                                err_scale_circle++;
-                                break;
-                            }
-                            sam->parameter[CIRCLE_DIAMETER] *= trans->scaleX;
-                            break;
-
-                        case GERBV_APTYPE_MACRO_LINE20:
-                            /* Vector line rectangle */
-                            if (trans->scaleX == trans->scaleY) {
-                                sam->parameter[LINE20_LINE_WIDTH] *= trans->scaleX;
-                            } else if (sam->parameter[LINE20_START_X] == sam->parameter[LINE20_END_X]) {
-                                sam->parameter[LINE20_LINE_WIDTH] *= trans->scaleX; /* Vertical */
-                            } else if (sam->parameter[LINE20_START_Y] == sam->parameter[LINE20_END_Y]) {
-                                sam->parameter[LINE20_LINE_WIDTH] *= trans->scaleY; /* Horizontal */
-                            } else {
-                                /* TODO: make outline macro */
-                                err_scale_line_macro++;
-                                break;
-                            }
-
-                            sam->parameter[LINE20_START_X] *= trans->scaleX;
-                            sam->parameter[LINE20_START_Y] *= trans->scaleY;
-                            sam->parameter[LINE20_END_X] *= trans->scaleX;
-                            sam->parameter[LINE20_END_Y] *= trans->scaleY;
-
-                            /* LINE20_START_X, LINE20_START_Y,
-                             * LINE20_END_X, LINE20_END_Y are not
-                             * rotated, change only rotation angle */
-                            sam->parameter[LINE20_ROTATION] += RAD2DEG(trans->rotation);
-                            break;
-
-/* Compile time check if LINE21 and LINE22 parameters indexes are equal */
-#if (LINE21_WIDTH != LINE22_WIDTH) || (LINE21_HEIGHT != LINE22_HEIGHT) || (LINE21_ROTATION != LINE22_ROTATION) \
-    || (LINE21_CENTER_X != LINE22_LOWER_LEFT_X) || (LINE21_CENTER_Y != LINE22_LOWER_LEFT_Y)
-#error "LINE21 and LINE22 indexes are not equal"
-#endif
-
-                        case GERBV_APTYPE_MACRO_LINE21:
-                            /* Centered line rectangle */
-                        case GERBV_APTYPE_MACRO_LINE22:
-                            /* Lower left line rectangle */
-
-                            /* Using LINE21 parameters array
-                             * indexes for LINE21 and LINE22, as
-                             * they are equal */
-                            if (trans->scaleX == trans->scaleY) {
-                                sam->parameter[LINE21_WIDTH] *= trans->scaleX;
-                                sam->parameter[LINE21_HEIGHT] *= trans->scaleX;
-
-                            } else if (fabs(sam->parameter[LINE21_ROTATION]) == 0 || fabs(sam->parameter[LINE21_ROTATION]) == 180) {
-                                sam->parameter[LINE21_WIDTH] *= trans->scaleX;
-                                sam->parameter[LINE21_HEIGHT] *= trans->scaleY;
-
-                            } else if (fabs(sam->parameter[LINE21_ROTATION]) == 90 || fabs(sam->parameter[LINE21_ROTATION]) == 270) {
-                                double t;
-                                t                             = sam->parameter[LINE21_WIDTH];
-                                sam->parameter[LINE21_WIDTH]  = trans->scaleY * sam->parameter[LINE21_HEIGHT];
-                                sam->parameter[LINE21_HEIGHT] = trans->scaleX * t;
-                            } else {
-                                /* TODO: make outline macro */
-                                err_scale_line_macro++;
-                                break;
-                            }
-
-                            sam->parameter[LINE21_CENTER_X] *= trans->scaleX;
-                            sam->parameter[LINE21_CENTER_Y] *= trans->scaleY;
-
-                            sam->parameter[LINE21_ROTATION] += RAD2DEG(trans->rotation);
-                            gerbv_rotate_coord(
-                                sam->parameter + LINE21_CENTER_X, sam->parameter + LINE21_CENTER_Y, trans->rotation
-                            );
-                            break;
-
-                        case GERBV_APTYPE_MACRO_OUTLINE:
-                            for (int i = 0; i < 1 + sam->parameter[OUTLINE_NUMBER_OF_POINTS]; i++) {
-                                sam->parameter[OUTLINE_X_IDX_OF_POINT(i)] *= trans->scaleX;
-                                sam->parameter[OUTLINE_Y_IDX_OF_POINT(i)] *= trans->scaleY;
-                            }
-
-                            sam->parameter[OUTLINE_ROTATION_IDX(sam->parameter)] += RAD2DEG(trans->rotation);
-                            break;
-#if 0
-{
-/* TODO */
-#include "main.h"
-gerbv_selection_item_t sItem = {sourceImage, currentNet};
-selection_add_item (&screen.selectionInfo, &sItem);
-}
-#endif
-
-                        case GERBV_APTYPE_MACRO_POLYGON:
-                            if (trans->scaleX == trans->scaleY) {
-                                sam->parameter[POLYGON_CENTER_X] *= trans->scaleX;
-                                sam->parameter[POLYGON_CENTER_Y] *= trans->scaleX;
-                                sam->parameter[POLYGON_DIAMETER] *= trans->scaleX;
-                            } else {
-                                /* TODO: make outline macro */
-                                err_scale_poly_macro++;
-                                break;
-                            }
-
-                            sam->parameter[POLYGON_ROTATION] += RAD2DEG(trans->rotation);
-                            break;
-
-                        case GERBV_APTYPE_MACRO_MOIRE:
-                            if (trans->scaleX == trans->scaleY) {
-                                sam->parameter[MOIRE_CENTER_X] *= trans->scaleX;
-                                sam->parameter[MOIRE_CENTER_Y] *= trans->scaleX;
-                                sam->parameter[MOIRE_OUTSIDE_DIAMETER] *= trans->scaleX;
-                                sam->parameter[MOIRE_CIRCLE_THICKNESS] *= trans->scaleX;
-                                sam->parameter[MOIRE_GAP_WIDTH] *= trans->scaleX;
-                                sam->parameter[MOIRE_CROSSHAIR_THICKNESS] *= trans->scaleX;
-                                sam->parameter[MOIRE_CROSSHAIR_LENGTH] *= trans->scaleX;
-                            } else {
-                                err_scale_moire_macro++;
-                                break;
-                            }
-
-                            sam->parameter[MOIRE_ROTATION] += RAD2DEG(trans->rotation);
-                            break;
-
-                        case GERBV_APTYPE_MACRO_THERMAL:
-                            if (trans->scaleX == trans->scaleY) {
-                                sam->parameter[THERMAL_CENTER_X] *= trans->scaleX;
-                                sam->parameter[THERMAL_CENTER_Y] *= trans->scaleX;
-                                sam->parameter[THERMAL_INSIDE_DIAMETER] *= trans->scaleX;
-                                sam->parameter[THERMAL_OUTSIDE_DIAMETER] *= trans->scaleX;
-                                sam->parameter[THERMAL_CROSSHAIR_THICKNESS] *= trans->scaleX;
-                            } else {
-                                err_scale_thermo_macro++;
-                                break;
-                            }
-
-                            sam->parameter[THERMAL_ROTATION] += RAD2DEG(trans->rotation);
-                            break;
-
-                        default:
-                            /* TODO: free aper if it is skipped (i.e. unused)? */
-                            err_unknown_macro_aperture++;
-                    }
-                }
-
-                trans_apers[newNet->aperture]     = ++aper_last_id;
-                destImage->aperture[aper_last_id] = aper;
-                newNet->aperture                  = aper_last_id;
+        aper = gerbv_image_transform_aperture(destImage->aperture[newNet->aperture], trans, &errors);
+        if (aper == NULL)
+            continue;
 
-                break;
-            default: err_unknown_aperture++;
-        }
+        trans_apers[newNet->aperture]     = ++aper_last_id;
+        destImage->aperture[aper_last_id] = aper;
+        newNet->aperture                  = aper_last_id;
     }
 
-    if (err_rotate_rect)
-        GERB_COMPILE_ERROR(
-            ngettext(
-                "Can't rotate %u rectangular aperture to %.2f "
-                "degrees (non 90 multiply)!",
-                "Can't rotate %u rectangular apertures to %.2f "
-                "degrees (non 90 multiply)!",
-                err_rotate_rect
-            ),
-            err_rotate_rect, RAD2DEG(trans->rotation)
-        );
-
-    if (err_scale_line_macro)
-        GERB_COMPILE_ERROR(
-            ngettext("Can't scale %u line macro!", "Can't scale %u line macros!", err_scale_line_macro),
-            err_scale_line_macro
-        );
-
-    if (err_scale_poly_macro)
-        GERB_COMPILE_ERROR(
-            ngettext("Can't scale %u polygon macro!", "Can't scale %u polygon macros!", err_scale_poly_macro),
-            err_scale_poly_macro
-        );
-
-    if (err_scale_thermo_macro)
-        GERB_COMPILE_ERROR(
-            ngettext("Can't scale %u thermal macro!", "Can't scale %u thermal macros!", err_scale_poly_macro),
-            err_scale_poly_macro
-        );
-
-    if (err_scale_moire_macro)
-        GERB_COMPILE_ERROR(
-            ngettext("Can't scale %u moire macro!", "Can't scale %u moire macros!", err_scale_poly_macro),
-            err_scale_poly_macro
-        );
-
-    if (err_rotate_oval)
-        GERB_COMPILE_ERROR(
-            ngettext(
-                "Can't rotate %u oval aperture to %.2f "
-                "degrees (non 90 multiply)!",
-                "Can't rotate %u oval apertures to %.2f "
-                "degrees (non 90 multiply)!",
-                err_rotate_oval
-            ),
-            err_rotate_oval, RAD2DEG(trans->rotation)
-        );
-
-    if (err_scale_circle)
-        GERB_COMPILE_ERROR(
-            ngettext(
-                "Can't scale %u circle aperture to ellipse!", "Can't scale %u circle apertures to ellipse!",
-                err_scale_circle
-            ),
-            err_scale_circle
-        );
-
-    if (err_unknown_aperture)
-        GERB_COMPILE_ERROR(
-            ngettext(
-                "Skipped %u aperture with unknown type!", "Skipped %u apertures with unknown type!",
-                err_unknown_aperture
-            ),
-            err_unknown_aperture
-        );
-
-    if (err_unknown_macro_aperture)
-        GERB_COMPILE_ERROR(
-            ngettext("Skipped %u macro aperture!", "Skipped %u macro apertures!", err_unknown_macro_aperture),
-            err_unknown_macro_aperture
-        );
+    gerbv_image_report_transform_errors(&errors, trans);
+
+    /* the next merge into destImage can start from here instead of walking all of it */
+    destImage->tailNet   = lastNet;
+    destImage->tailLayer = lastLayer;
+    destImage->tailState = lastState;
 
     g_free(trans_apers);
 }
@@ -788,8 +937,10 @@ gerbv_image_find_existing_aperture_match(gerbv_aperture_t* checkAperture, gerbv_
                 /* check all parameters match too */
                 isMatch = TRUE;
                 for (j = 0; j < APERTURE_PARAMETERS_MAX; j++) {
-                    if (imageToSearch->aperture[i]->parameter[j] != checkAperture->parameter[j])
+                    if (imageToSearch->aperture[i]->parameter[j] != checkAperture->parameter[j]) {
                         isMatch = FALSE;
+                        break;
+                    }
                 }
                 if (isMatch)
                     return i;
@@ -799,6 +950,49 @@ gerbv_image_find_existing_aperture_match(gerbv_aperture_t* checkAperture, gerbv_
     return 0;
 }
 
+/* Leading parameters an aperture is hashed by, which tell the standard apertures apart */
+#define GERBV_IMAGE_APERTURE_HASH_PARAMETERS 5
+
+/* Hash an aperture by what gerbv_image_find_existing_aperture_match() compares */
+static guint
+gerbv_image_aperture_hash(gconstpointer key) {
+    const gerbv_aperture_t* aperture = key;
+    guint                   hash     = (guint)aperture->type * 31 + (guint)aperture->unit;
+    int                     j;
+
+    for (j = 0; j < GERBV_IMAGE_APERTURE_HASH_PARAMETERS; j++) {
+        /* adding zero makes -0.0 hash like 0.0, which it compares equal to */
+        gdouble parameter = aperture->parameter[j] + 0.0;
+        guint64 bits;
+
+        memcpy(&bits, &parameter, sizeof(bits));
+        hash = hash * 31 + (guint)(bits ^ (bits >> 32));
+    }
+
+    return hash;
+}
+
+/* Compare apertures like gerbv_image_find_existing_aperture_match() does */
+static gboolean
+gerbv_image_aperture_equal(gconstpointer a, gconstpointer b) {
+    const gerbv_aperture_t *apertureA = a, *apertureB = b;
+    int                     j;
+
+    if (apertureA->type != apertureB->type || apertureA->unit != apertureB->unit)
+        return FALSE;
+
+    /* most of the parameters are unused zeros, which compare much faster as bytes */
+    if (memcmp(apertureA->parameter, apertureB->parameter, sizeof(apertureA->parameter)) == 0)
+        return TRUE;
+
+    for (j = 0; j < APERTURE_PARAMETERS_MAX; j++) {
+        if (apertureA->parameter[j] != apertureB->parameter[j])
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
 int
 gerbv_image_find_unused_aperture_number(int startIndex, gerbv_image_t* image) {
     int i;
@@ -816,7 +1010,7 @@ gerbv_image_duplicate_image(gerbv_image_t* sourceImage, gerbv_user_transformatio
     gerbv_image_t* newImage = gerbv_create_image(NULL, sourceImage->info->type);
     int            i;
     int            lastUsedApertureNumber = APERTURE_MIN - 1;
-    GArray*        apertureNumberTable    = g_array_new(FALSE, FALSE, sizeof(gerb_translation_entry_t));
+    gint*          apertureNumberTable    = g_new(gint, APERTURE_MAX);
 
     newImage->layertype = sourceImage->layertype;
     /* copy information layer over */
@@ -833,11 +1027,12 @@ gerbv_image_duplicate_image(gerbv_image_t* sourceImage, gerbv_user_transformatio
             gerbv_aperture_t* newAperture = gerbv_image_duplicate_aperture(sourceImage->aperture[i]);
 
             lastUsedApertureNumber = gerbv_image_find_unused_aperture_number(lastUsedApertureNumber + 1, newImage);
-            /* store the aperture numbers (new and old) in the translation table */
-            gerb_translation_entry_t translationEntry = { i, lastUsedApertureNumber };
-            g_array_append_val(apertureNumberTable, translationEntry);
+            /* store the new aperture number in the translation table */
+            apertureNumberTable[i] = lastUsedApertureNumber;
 
             newImage->aperture[lastUsedApertureNumber] = newAperture;
+        } else {
+            apertureNumberTable[i] = -1;
         }
     }
 
@@ -846,7 +1041,7 @@ gerbv_image_duplicate_image(gerbv_image_t* sourceImage, gerbv_user_transformatio
     gerbv_image_copy_all_nets(
         sourceImage, newImage, newImage->layers, newImage->states, NULL, transform, apertureNumberTable
     );
-    g_array_free(apertureNumberTable, TRUE);
+    g_free(apertureNumberTable);
     return newImage;
 }
 
@@ -854,21 +1049,32 @@ void
 gerbv_image_copy_image(
     gerbv_image_t* sourceImage, gerbv_user_transformation_t* transform, gerbv_image_t* destinationImage
 ) {
-    int     lastUsedApertureNumber = APERTURE_MIN - 1;
-    int     i;
-    GArray* apertureNumberTable = g_array_new(FALSE, FALSE, sizeof(gerb_translation_entry_t));
+    int         lastUsedApertureNumber = APERTURE_MIN - 1;
+    int         i;
+    gint*       apertureNumberTable = g_new(gint, APERTURE_MAX);
+    GHashTable* existingApertures;
+
+    /* map the destination's apertures to their numbers once, rather than searching
+       all of them for every aperture copied. The lowest numbered match is the one
+       gerbv_image_find_existing_aperture_match() would find, so it is kept. */
+    existingApertures = g_hash_table_new(gerbv_image_aperture_hash, gerbv_image_aperture_equal);
+    for (i = 1; i < APERTURE_MAX; i++) {
+        gerbv_aperture_t* aperture = destinationImage->aperture[i];
+
+        if (aperture != NULL && aperture->simplified == NULL
+            && g_hash_table_lookup(existingApertures, aperture) == NULL)
+            g_hash_table_insert(existingApertures, aperture, GINT_TO_POINTER(i));
+    }
 
     /* copy apertures over */
     for (i = 0; i < APERTURE_MAX; i++) {
         if (sourceImage->aperture[i] != NULL) {
-            gint existingAperture =
-                gerbv_image_find_existing_aperture_match(sourceImage->aperture[i], destinationImage);
+            gint existingAperture = GPOINTER_TO_INT(g_hash_table_lookup(existingApertures, sourceImage->aperture[i]));
 
             /* if we already have an existing aperture in the destination image that matches what
                we want, just use it instead */
             if (existingAperture > 0) {
-                gerb_translation_entry_t translationEntry = { i, existingAperture };
-                g_array_append_val(apertureNumberTable, translationEntry);
+                apertureNumberTable[i] = existingAperture;
             }
             /* else, create a new aperture and put it in the destination image */
             else {
@@ -876,28 +1082,181 @@ gerbv_image_copy_image(
 
                 lastUsedApertureNumber =
                     gerbv_image_find_unused_aperture_number(lastUsedApertureNumber + 1, destinationImage);
-                /* store the aperture numbers (new and old) in the translation table */
-                gerb_translation_entry_t translationEntry = { i, lastUsedApertureNumber };
-                g_array_append_val(apertureNumberTable, translationEntry);
+                /* store the new aperture number in the translation table */
+                apertureNumberTable[i] = lastUsedApertureNumber;
 
                 destinationImage->aperture[lastUsedApertureNumber] = newAperture;
+                /* later apertures of the source may match it, like they would have before */
+                if (newAperture->simplified == NULL)
+                    g_hash_table_insert(existingApertures, newAperture, GINT_TO_POINTER(lastUsedApertureNumber));
             }
+        } else {
+            apertureNumberTable[i] = -1;
         }
     }
-    /* find the last layer, state, and net in the linked chains */
-    gerbv_netstate_t* lastState;
-    gerbv_layer_t*    lastLayer;
-    gerbv_net_t*      lastNet;
+    g_hash_table_destroy(existingApertures);
+    /* find the last layer, state, and net in the linked chains, starting
+       from where the previous merge into this image stopped */
+    gerbv_netstate_t* lastState = destinationImage->tailState ? destinationImage->tailState : destinationImage->states;
+    gerbv_layer_t*    lastLayer = destinationImage->tailLayer ? destinationImage->tailLayer : destinationImage->layers;
+    gerbv_net_t*      lastNet   = destinationImage->tailNet ? destinationImage->tailNet : destinationImage->netlist;
 
-    for (lastState = destinationImage->states; lastState->next; lastState = lastState->next) {}
-    for (lastLayer = destinationImage->layers; lastLayer->next; lastLayer = lastLayer->next) {}
-    for (lastNet = destinationImage->netlist; lastNet->next; lastNet = lastNet->next) {}
+    for (; lastState->next; lastState = lastState->next) {}
+    for (; lastLayer->next; lastLayer = lastLayer->next) {}
+    for (; lastNet->next; lastNet = lastNet->next) {}
 
     /* and then copy them all to the destination image, using the aperture translation table we just built */
     gerbv_image_copy_all_nets(
         sourceImage, destinationImage, lastLayer, lastState, lastNet, transform, apertureNumberTable
     );
-    g_array_free(apertureNumberTable, TRUE);
+    g_free(apertureNumberTable);
+}
+
+/* Return the number net's aperture is exported as, transforming the aperture
+   the first time a net uses it if errors isn't NULL */
+static gint
+gerbv_image_export_iter_aperture(gerbv_export_iter_t* iter, gint aperture, gerb_transform_errors_t* errors) {
+    gerbv_user_transformation_t* trans = iter->transform;
+
+    if (aperture >= 0 && aperture < APERTURE_MAX && iter->renumber[aperture] >= 0)
+        aperture = iter->renumber[aperture];
+
+    if (trans == NULL || aperture < 0 || aperture >= APERTURE_MAX || iter->aperture[aperture] == NULL)
+        return aperture;
+
+    if (trans->scaleX == 1.0 && trans->scaleY == 1.0 && fabs(trans->rotation) < GERBV_PRECISION_ANGLE_RAD)
+        return aperture;
+
+    if (iter->transformed[aperture] == -1 && errors != NULL && iter->lastAperture < APERTURE_MAX - 1) {
+        gerbv_aperture_t* aper = gerbv_image_transform_aperture(iter->aperture[aperture], trans, errors);
+
+        if (aper != NULL) {
+            iter->transformed[aperture]        = ++iter->lastAperture;
+            iter->aperture[iter->lastAperture] = aper;
+        }
+    }
+
+    if (iter->transformed[aperture] != -1)
+        return iter->transformed[aperture];
+
+    return aperture;
+}
+
+void
+gerbv_image_export_iter_init(gerbv_export_iter_t* iter, gerbv_image_t* image, gerbv_user_transformation_t* transform) {
+    gerb_transform_errors_t errors = { 0 };
+    gerbv_net_t*            net;
+    int                     i;
+
+    memset(iter, 0, sizeof(*iter));
+    iter->image       = image;
+    iter->transform   = transform;
+    iter->aperture    = g_new0(gerbv_aperture_t*, APERTURE_MAX);
+    iter->renumber    = g_new(gint, APERTURE_MAX);
+    iter->transformed = g_new(gint, APERTURE_MAX);
+    iter->firstNet    = image->netlist;
+
+    /* what the first net's layer and state are compared against in a duplicated image */
+    iter->layer.stepAndRepeat.X = 1;
+    iter->layer.stepAndRepeat.Y = 1;
+    iter->layer.polarity        = GERBV_POLARITY_DARK;
+    iter->state.scaleA          = 1;
+    iter->state.scaleB          = 1;
+
+    /* number the apertures from APERTURE_MIN up, like gerbv_image_duplicate_image() does,
+       but borrow them from the image instead of copying them */
+    iter->lastAperture = APERTURE_MIN - 1;
+    for (i = 0; i < APERTURE_MAX; i++) {
+        iter->transformed[i] = -1;
+        iter->renumber[i]    = -1;
+        if (image->aperture[i] != NULL && iter->lastAperture < APERTURE_MAX - 1) {
+            iter->renumber[i]                  = ++iter->lastAperture;
+            iter->aperture[iter->lastAperture] = image->aperture[i];
+        }
+    }
+    iter->firstTransformed = iter->lastAperture + 1;
+
+    if (transform && (transform->mirrorAroundX || transform->mirrorAroundY)) {
+        if (image->layertype != GERBV_LAYERTYPE_DRILL) {
+            GERB_COMPILE_ERROR(
+                _("Exporting mirrored file "
+                  "is not supported!")
+            );
+            iter->firstNet = NULL;
+        }
+    }
+
+    if (transform && transform->inverted) {
+        GERB_COMPILE_ERROR(
+            _("Exporting inverted file "
+              "is not supported!")
+        );
+        iter->firstNet = NULL;
+    }
+
+    /* exporters write all apertures before the nets, so find the transformed
+       ones first, in the order the nets use them */
+    if (iter->firstNet && transform) {
+        for (net = iter->firstNet; net != NULL; net = net->next)
+            gerbv_image_export_iter_aperture(iter, net->aperture, &errors);
+
+        gerbv_image_report_transform_errors(&errors, transform);
+    }
+
+    iter->nextNet = iter->firstNet;
+}
+
+gerbv_net_t*
+gerbv_image_export_iter_next(gerbv_export_iter_t* iter) {
+    gerbv_net_t* source = iter->nextNet;
+    gerbv_net_t* net    = &iter->net;
+
+    if (source == NULL)
+        return NULL;
+
+    iter->nextNet = source->next;
+
+    *net      = *source;
+    net->next = NULL;
+    if (source->cirseg) {
+        iter->cirseg = *source->cirseg;
+        net->cirseg  = &iter->cirseg;
+    }
+    net->aperture = gerbv_image_export_iter_aperture(iter, source->aperture, NULL);
+
+    if (iter->transform) {
+        gerbv_transform_coord(&net->start_x, &net->start_y, iter->transform);
+        gerbv_transform_coord(&net->stop_x, &net->stop_y, iter->transform);
+        if (net->cirseg)
+            gerbv_transform_coord(&net->cirseg->cp_x, &net->cirseg->cp_y, iter->transform);
+    }
+
+    return net;
+}
+
+void
+gerbv_image_export_iter_rewind(gerbv_export_iter_t* iter) {
+    iter->nextNet = iter->firstNet;
+}
+
+void
+gerbv_image_export_iter_clear(gerbv_export_iter_t* iter) {
+    gerbv_simplified_amacro_t *sam, *next;
+    int                        i;
+
+    /* only the transformed apertures belong to the iterator */
+    for (i = iter->firstTransformed; i <= iter->lastAperture; i++) {
+        for (sam = iter->aperture[i]->simplified; sam != NULL; sam = next) {
+            next = sam->next;
+            g_free(sam);
+        }
+        g_free(iter->aperture[i]);
+    }
+
+    g_free(iter->aperture);
+    g_free(iter->renumber);
+    g_free(iter->transformed);
+    memset(iter, 0, sizeof(*iter));
 }
 
 void
@@ -930,6 +1289,147 @@ gerbv_image_delete_net(gerbv_net_t* currentNet) {
     currentNet->interpolation = GERBV_INTERPOLATION_DELETED;
 }
 
+guint
+gerbv_image_compact(gerbv_image_t* image) {
+    gerbv_net_t *     net, *prev, *next;
+    gerbv_layer_t *   layer, *prevLayer;
+    gerbv_netstate_t *state, *prevState;
+    GHashTable *      usedLayers, *usedStates, *keptSimplified, *freedSimplified;
+    guint8 *          usedApertures, *deletedApertures;
+    gerbv_amacro_t*   amacro;
+    guint             freed = 0;
+    int               i;
+
+    if (image == NULL || image->netlist == NULL)
+        return 0;
+
+    /* the first net is a placeholder the parsers start from, it always stays */
+    deletedApertures = g_new0(guint8, APERTURE_MAX);
+    for (prev = image->netlist, net = prev->next; net != NULL; net = next) {
+        next = net->next;
+        if (net->interpolation != GERBV_INTERPOLATION_DELETED) {
+            prev = net;
+            continue;
+        }
+
+        if (net->aperture >= 0 && net->aperture < APERTURE_MAX)
+            deletedApertures[net->aperture] = TRUE;
+        prev->next = next;
+        gerbv_image_free_object(image, net->cirseg, sizeof(gerbv_cirseg_t), &image->cirsegBytes);
+        gerbv_image_free_object(image, net, sizeof(gerbv_net_t), &image->netBytes);
+        freed++;
+    }
+    image->nNets -= freed;
+
+    if (freed == 0) {
+        g_free(deletedApertures);
+        return 0;
+    }
+
+    /* regions are keyed by their start net, which may have been freed */
+    gerbv_image_invalidate_caches(image);
+
+    usedLayers    = g_hash_table_new(g_direct_hash, g_direct_equal);
+    usedStates    = g_hash_table_new(g_direct_hash, g_direct_equal);
+    usedApertures = g_new0(guint8, APERTURE_MAX);
+    for (net = image->netlist; net != NULL; net = net->next) {
+        g_hash_table_insert(usedLayers, net->layer, net->layer);
+        g_hash_table_insert(usedStates, net->state, net->state);
+        if (net->aperture >= 0 && net->aperture < APERTURE_MAX)
+            usedApertures[net->aperture] = TRUE;
+    }
+
+    /* like the first net, the first layer and netstate always stay */
+    for (prevLayer = image->layers; (layer = prevLayer->next) != NULL;) {
+        if (g_hash_table_lookup(usedLayers, layer) != NULL) {
+            prevLayer = layer;
+            continue;
+        }
+        prevLayer->next = layer->next;
+        g_free(layer->name);
+        g_free(layer);
+    }
+    for (prevState = image->states; (state = prevState->next) != NULL;) {
+        if (g_hash_table_lookup(usedStates, state) != NULL) {
+            prevState = state;
+            continue;
+        }
+        prevState->next = state->next;
+        g_free(state);
+    }
+
+    /* simplified macros may be shared with apertures that stay */
+    keptSimplified  = g_hash_table_new(g_direct_hash, g_direct_equal);
+    freedSimplified = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (i = 0; i < APERTURE_MAX; i++) {
+        if (image->aperture[i] != NULL && usedApertures[i] && image->aperture[i]->simplified != NULL)
+            g_hash_table_insert(keptSimplified, image->aperture[i]->simplified, image->aperture[i]);
+    }
+    for (i = 0; i < APERTURE_MAX; i++) {
+        gerbv_simplified_amacro_t *sam, *sam2;
+
+        /* apertures the file defines but never used are kept, so saving
+           the image doesn't drop their definitions */
+        if (image->aperture[i] == NULL || usedApertures[i] || !deletedApertures[i])
+            continue;
+
+        sam = image->aperture[i]->simplified;
+        if (sam != NULL && g_hash_table_lookup(keptSimplified, sam) == NULL
+            && g_hash_table_lookup(freedSimplified, sam) == NULL) {
+            g_hash_table_insert(freedSimplified, sam, sam);
+            while (sam != NULL) {
+                sam2 = sam->next;
+                g_free(sam);
+                sam = sam2;
+            }
+        }
+        g_free(image->aperture[i]);
+        image->aperture[i] = NULL;
+    }
+
+    /* the macros remember the lists they produced while the file was
+       parsed, forget them rather than keep pointers to freed ones */
+    if (g_hash_table_size(freedSimplified) > 0) {
+        for (amacro = image->amacro; amacro != NULL; amacro = amacro->next) {
+            if (amacro->simplified != NULL) {
+                g_hash_table_destroy(amacro->simplified);
+                amacro->simplified = NULL;
+            }
+        }
+    }
+
+    g_hash_table_destroy(keptSimplified);
+    g_hash_table_destroy(freedSimplified);
+    g_hash_table_destroy(usedLayers);
+    g_hash_table_destroy(usedStates);
+    g_free(usedApertures);
+    g_free(deletedApertures);
+
+    return freed;
+}
+
+static void
+gerbv_image_label_destroy(gpointer data) {
+    g_string_free((GString*)data, TRUE);
+}
+
+GString*
+gerbv_image_intern_label(gerbv_image_t* image, const gchar* text) {
+    GString* label;
+
+    if (image->labels == NULL)
+        image->labels = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, gerbv_image_label_destroy);
+
+    label = g_hash_table_lookup(image->labels, text);
+    if (label == NULL) {
+        label = g_string_new(text);
+        /* the key is the string's own buffer, which is never modified */
+        g_hash_table_insert(image->labels, label->str, label);
+    }
+
+    return label;
+}
+
 void
 gerbv_image_create_rectangle_object(
     gerbv_image_t* image, gdouble coordinateX, gdouble coordinateY, gdouble width, gdouble height
@@ -940,11 +1440,11 @@ gerbv_image_create_rectangle_object(
     for (currentNet = image->netlist; currentNet->next; currentNet = currentNet->next) {}
 
     /* create the polygon start node */
-    currentNet                = gerber_create_new_net(currentNet, NULL, NULL);
+    currentNet                = gerber_create_new_net(image, currentNet, NULL, NULL);
     currentNet->interpolation = GERBV_INTERPOLATION_PAREA_START;
 
     /* go to start point (we need this to create correct RS274X export code) */
-    currentNet                 = gerber_create_new_net(currentNet, NULL, NULL);
+    currentNet                 = gerber_create_new_net(image, currentNet, NULL, NULL);
     currentNet->interpolation  = GERBV_INTERPOLATION_LINEARx1;
     currentNet->aperture_state = GERBV_APERTURE_STATE_OFF;
     currentNet->start_x        = coordinateX;
@@ -953,7 +1453,7 @@ gerbv_image_create_rectangle_object(
     currentNet->stop_y         = coordinateY;
 
     /* draw the 4 corners */
-    currentNet                 = gerber_create_new_net(currentNet, NULL, NULL);
+    currentNet                 = gerber_create_new_net(image, currentNet, NULL, NULL);
     currentNet->interpolation  = GERBV_INTERPOLATION_LINEARx1;
     currentNet->aperture_state = GERBV_APERTURE_STATE_ON;
     currentNet->start_x        = coordinateX;
@@ -963,7 +1463,7 @@ gerbv_image_create_rectangle_object(
     gerber_update_min_and_max(&currentNet->boundingBox, currentNet->stop_x, currentNet->stop_y, 0, 0, 0, 0);
     gerber_update_image_min_max(&currentNet->boundingBox, 0, 0, image);
 
-    currentNet                 = gerber_create_new_net(currentNet, NULL, NULL);
+    currentNet                 = gerber_create_new_net(image, currentNet, NULL, NULL);
     currentNet->interpolation  = GERBV_INTERPOLATION_LINEARx1;
     currentNet->aperture_state = GERBV_APERTURE_STATE_ON;
     currentNet->stop_x         = coordinateX + width;
@@ -971,7 +1471,7 @@ gerbv_image_create_rectangle_object(
     gerber_update_min_and_max(&currentNet->boundingBox, currentNet->stop_x, currentNet->stop_y, 0, 0, 0, 0);
     gerber_update_image_min_max(&currentNet->boundingBox, 0, 0, image);
 
-    currentNet                 = gerber_create_new_net(currentNet, NULL, NULL);
+    currentNet                 = gerber_create_new_net(image, currentNet, NULL, NULL);
     currentNet->interpolation  = GERBV_INTERPOLATION_LINEARx1;
     currentNet->aperture_state = GERBV_APERTURE_STATE_ON;
     currentNet->stop_x         = coordinateX;
@@ -979,7 +1479,7 @@ gerbv_image_create_rectangle_object(
     gerber_update_min_and_max(&currentNet->boundingBox, currentNet->stop_x, currentNet->stop_y, 0, 0, 0, 0);
     gerber_update_image_min_max(&currentNet->boundingBox, 0, 0, image);
 
-    currentNet                 = gerber_create_new_net(currentNet, NULL, NULL);
+    currentNet                 = gerber_create_new_net(image, currentNet, NULL, NULL);
     currentNet->interpolation  = GERBV_INTERPOLATION_LINEARx1;
     currentNet->aperture_state = GERBV_APERTURE_STATE_ON;
     currentNet->stop_x         = coordinateX;
@@ -988,7 +1488,7 @@ gerbv_image_create_rectangle_object(
     gerber_update_image_min_max(&currentNet->boundingBox, 0, 0, image);
 
     /* create the polygon end node */
-    currentNet                = gerber_create_new_net(currentNet, NULL, NULL);
+    currentNet                = gerber_create_new_net(image, currentNet, NULL, NULL);
     currentNet->interpolation = GERBV_INTERPOLATION_PAREA_END;
 
     return;
@@ -1040,7 +1540,7 @@ gerbv_image_create_arc_object(
         return;
 
     /* draw the arc */
-    currentNet                 = gerber_create_new_net(currentNet, NULL, NULL);
+    currentNet                 = gerber_create_new_net(image, currentNet, NULL, NULL);
     currentNet->interpolation  = GERBV_INTERPOLATION_CCW_CIRCULAR;
     currentNet->aperture_state = GERBV_APERTURE_STATE_ON;
     currentNet->aperture       = apertureIndex;
@@ -1048,7 +1548,7 @@ gerbv_image_create_arc_object(
     currentNet->start_y        = centerY + (sin(DEG2RAD(startAngle)) * radius);
     currentNet->stop_x         = centerX + (cos(DEG2RAD(endAngle)) * radius);
     currentNet->stop_y         = centerY + (sin(DEG2RAD(endAngle)) * radius);
-    currentNet->cirseg         = g_new0(gerbv_cirseg_t, 1);
+    currentNet->cirseg         = gerbv_image_new_cirseg(image);
     *(currentNet->cirseg)      = cirSeg;
 
     gdouble angleDiff = currentNet->cirseg->angle2 - currentNet->cirseg->angle1;
@@ -1082,7 +1582,7 @@ gerbv_image_create_line_object(
         return;
 
     /* draw the line */
-    currentNet                = gerber_create_new_net(currentNet, NULL, NULL);
+    currentNet                = gerber_create_new_net(image, currentNet, NULL, NULL);
     currentNet->interpolation = GERBV_INTERPOLATION_LINEARx1;
 
     /* if the start and end coordinates are the same, use a "flash" aperture state */
@@ -1144,6 +1644,8 @@ gerbv_image_reduce_area_of_selected_objects(
         gerbv_image_t*         image      = sItem.image;
         gerbv_net_t*           currentNet = sItem.net;
 
+        gerbv_image_invalidate_caches(image);
+
         /* determine the object type first */
         minX = HUGE_VAL;
         maxX = -HUGE_VAL;
@@ -1234,6 +1736,8 @@ gerbv_image_move_selected_objects(GArray* selectionArray, gdouble translationX,
         gerbv_selection_item_t sItem      = g_array_index(selectionArray, gerbv_selection_item_t, i);
         gerbv_net_t*           currentNet = sItem.net;
 
+        gerbv_image_invalidate_caches(sItem.image);
+
         if (currentNet->interpolation == GERBV_INTERPOLATION_PAREA_START) {
             /* if it's a polygon, step through every vertex and translate the point */
             for (currentNet = currentNet->next; currentNet; currentNet = currentNet->next) {
@@ -1272,6 +1776,424 @@ gerbv_image_return_next_renderable_object(gerbv_net_t* oldNet) {
     }
 }
 
+static void
+gerbv_image_region_destroy(gpointer data) {
+    gerbv_image_region_t* region = data;
+
+    g_free(region->ops);
+    g_free(region->coords);
+    g_free(region);
+}
+
+static void
+gerbv_image_region_update_box(gerbv_render_size_t* box, gdouble x1, gdouble y1, gdouble x2, gdouble y2) {
+    box->left   = MIN(box->left, x1);
+    box->right  = MAX(box->right, x2);
+    box->bottom = MIN(box->bottom, y1);
+    box->top    = MAX(box->top, y2);
+}
+
+/* Walk the nets of a G36/G37 region once and store its outline as flat
+ * operation and coordinate arrays, with the arc angles already in radians */
+static gerbv_image_region_t*
+gerbv_image_build_region(gerbv_net_t* startNet) {
+    gerbv_image_region_t* region = g_new0(gerbv_image_region_t, 1);
+    GByteArray*           ops    = g_byte_array_new();
+    GArray*               coords = g_array_new(FALSE, FALSE, sizeof(gdouble));
+    gerbv_net_t*          currentNet;
+    gdouble               v[5];
+    guint8                op;
+
+    region->boundingBox.left   = HUGE_VAL;
+    region->boundingBox.right  = -HUGE_VAL;
+    region->boundingBox.bottom = HUGE_VAL;
+    region->boundingBox.top    = -HUGE_VAL;
+
+    for (currentNet = startNet->next; currentNet != NULL; currentNet = currentNet->next) {
+        if (currentNet->interpolation == GERBV_INTERPOLATION_PAREA_END) {
+            region->closed  = TRUE;
+            region->nextNet = currentNet->next;
+            break;
+        }
+
+        v[0] = currentNet->stop_x;
+        v[1] = currentNet->stop_y;
+
+        if (ops->len == 0) {
+            op = GERBV_REGION_OP_MOVE_TO;
+            g_array_append_vals(coords, v, 2);
+            gerbv_image_region_update_box(&region->boundingBox, v[0], v[1], v[0], v[1]);
+            g_byte_array_append(ops, &op, 1);
+            continue;
+        }
+
+        switch (currentNet->interpolation) {
+            case GERBV_INTERPOLATION_LINEARx1:
+            case GERBV_INTERPOLATION_LINEARx10:
+            case GERBV_INTERPOLATION_LINEARx01:
+            case GERBV_INTERPOLATION_LINEARx001:
+                op = GERBV_REGION_OP_LINE_TO;
+                g_array_append_vals(coords, v, 2);
+                gerbv_image_region_update_box(&region->boundingBox, v[0], v[1], v[0], v[1]);
+                break;
+            case GERBV_INTERPOLATION_CW_CIRCULAR:
+            case GERBV_INTERPOLATION_CCW_CIRCULAR:
+                if (currentNet->cirseg == NULL)
+                    continue;
+
+                if (currentNet->cirseg->angle2 > currentNet->cirseg->angle1)
+                    op = GERBV_REGION_OP_ARC;
+                else
+                    op = GERBV_REGION_OP_ARC_NEGATIVE;
+
+                v[0] = currentNet->cirseg->cp_x;
+                v[1] = currentNet->cirseg->cp_y;
+                v[2] = currentNet->cirseg->width / 2.0;
+                v[3] = DEG2RAD(currentNet->cirseg->angle1);
+                v[4] = DEG2RAD(currentNet->cirseg->angle2);
+                g_array_append_vals(coords, v, 5);
+                gerbv_image_region_update_box(&region->boundingBox, v[0] - v[2], v[1] - v[2], v[0] + v[2], v[1] + v[2]);
+                break;
+            default: continue;
+        }
+
+        g_byte_array_append(ops, &op, 1);
+    }
+
+    region->n_ops  = ops->len;
+    region->ops    = g_byte_array_free(ops, FALSE);
+    region->coords = (gdouble*)g_array_free(coords, FALSE);
+
+    return region;
+}
+
+gerbv_image_region_t*
+gerbv_image_return_region(gerbv_image_t* image, gerbv_net_t* startNet) {
+    gerbv_image_region_t* region;
+
+    if (image->regions == NULL)
+        image->regions = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, gerbv_image_region_destroy);
+
+    region = g_hash_table_lookup(image->regions, startNet);
+    if (region == NULL) {
+        region = gerbv_image_build_region(startNet);
+        g_hash_table_insert(image->regions, startNet, region);
+    }
+
+    return region;
+}
+
+static gsize
+gerbv_image_error_list_memory_usage(const gerbv_error_list_t* error) {
+    gsize size = 0;
+
+    for (; error != NULL; error = error->next) {
+        size += sizeof(gerbv_error_list_t);
+        if (error->error_text)
+            size += strlen(error->error_text) + 1;
+    }
+
+    return size;
+}
+
+static gsize
+gerbv_image_aperture_list_memory_usage(const gerbv_aperture_list_t* aperture) {
+    gsize size = 0;
+
+    for (; aperture != NULL; aperture = aperture->next)
+        size += sizeof(gerbv_aperture_list_t);
+
+    return size;
+}
+
+void
+gerbv_image_add_memory_usage(const gerbv_image_t* image, gerbv_memory_usage_t* usage) {
+    const gerbv_layer_t*    layer;
+    const gerbv_netstate_t* state;
+    const gerbv_amacro_t*   amacro;
+    GHashTable*             countedSimplified;
+    GHashTableIter          iter;
+    gpointer                value;
+    gsize                   before = usage->nets + usage->cirsegs + usage->labels + usage->apertures + usage->simplified
+                 + usage->amacros + usage->layers + usage->stats + usage->caches;
+    int i;
+
+    if (image == NULL)
+        return;
+
+    /* kept as nets come and go, so this doesn't have to walk a netlist of millions;
+       blocks of merged nets count in full until the last of them is freed */
+    usage->nets += sizeof(gerbv_image_t) + image->netBytes;
+    usage->cirsegs += image->cirsegBytes;
+    usage->n_nets += image->nNets;
+
+    /* labels are interned, so each one is counted once */
+    if (image->labels != NULL) {
+        g_hash_table_iter_init(&iter, image->labels);
+        while (g_hash_table_iter_next(&iter, NULL, &value))
+            usage->labels += sizeof(GString) + ((GString*)value)->allocated_len;
+    }
+
+    /* the aperture table is part of the image itself */
+    usage->apertures += sizeof(image->aperture);
+    countedSimplified = g_hash_table_new(g_direct_hash, g_direct_equal);
+    for (i = 0; i < APERTURE_MAX; i++) {
+        const gerbv_simplified_amacro_t* sam;
+
+        if (image->aperture[i] == NULL)
+            continue;
+
+        usage->apertures += sizeof(gerbv_aperture_t);
+        usage->n_apertures++;
+
+        sam = image->aperture[i]->simplified;
+        if (sam == NULL || g_hash_table_lookup(countedSimplified, sam) != NULL)
+            continue;
+
+        g_hash_table_insert(countedSimplified, (gpointer)sam, (gpointer)sam);
+        for (; sam != NULL; sam = sam->next)
+            usage->simplified += sizeof(gerbv_simplified_amacro_t);
+    }
+    g_hash_table_destroy(countedSimplified);
+
+    for (amacro = image->amacro; amacro != NULL; amacro = amacro->next) {
+        const gerbv_instruction_t* instruction;
+
+        usage->amacros += sizeof(gerbv_amacro_t) + amacro->nuf_code * sizeof(gerbv_instruction_t);
+        if (amacro->name)
+            usage->amacros += strlen(amacro->name) + 1;
+        for (instruction = amacro->program; instruction != NULL; instruction = instruction->next)
+            usage->amacros += sizeof(gerbv_instruction_t);
+        /* the memoized results are private to gerber.c, estimate their keys */
+        if (amacro->simplified != NULL)
+            usage->amacros +=
+                g_hash_table_size(amacro->simplified) * (4 * sizeof(gdouble) + amacro->nuf_locals * sizeof(double));
+    }
+
+    for (layer = image->layers; layer != NULL; layer = layer->next) {
+        usage->layers += sizeof(gerbv_layer_t);
+        if (layer->name)
+            usage->layers += strlen(layer->name) + 1;
+    }
+    for (state = image->states; state != NULL; state = state->next)
+        usage->layers += sizeof(gerbv_netstate_t);
+
+    if (image->gerbv_stats != NULL) {
+        usage->stats += sizeof(gerbv_stats_t) + gerbv_image_error_list_memory_usage(image->gerbv_stats->error_list)
+                      + gerbv_image_aperture_list_memory_usage(image->gerbv_stats->aperture_list)
+                      + gerbv_image_aperture_list_memory_usage(image->gerbv_stats->D_code_list);
+    }
+    if (image->drill_stats != NULL) {
+        const gerbv_drill_list_t* drill;
+
+        usage->stats +=
+            sizeof(gerbv_drill_stats_t) + gerbv_image_error_list_memory_usage(image->drill_stats->error_list);
+        if (image->drill_stats->detect)
+            usage->stats += strlen(image->drill_stats->detect) + 1;
+        for (drill = image->drill_stats->drill_list; drill != NULL; drill = drill->next) {
+            usage->stats += sizeof(gerbv_drill_list_t);
+            if (drill->drill_unit)
+                usage->stats += strlen(drill->drill_unit) + 1;
+        }
+    }
+
+    if (image->regions != NULL) {
+        g_hash_table_iter_init(&iter, image->regions);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            const gerbv_image_region_t* region = value;
+            guint                       op;
+
+            usage->caches += sizeof(gerbv_image_region_t) + region->n_ops;
+            for (op = 0; op < region->n_ops; op++) {
+                if (region->ops[op] == GERBV_REGION_OP_ARC || region->ops[op] == GERBV_REGION_OP_ARC_NEGATIVE)
+                    usage->caches += 5 * sizeof(gdouble);
+                else
+                    usage->caches += 2 * sizeof(gdouble);
+            }
+        }
+    }
+    if (image->labelMarks != NULL)
+        usage->caches += g_hash_table_size(image->labelMarks) * 2 * sizeof(gdouble);
+    G_LOCK(gerbv_image_arcs);
+    if (image->arcs != NULL) {
+        g_hash_table_iter_init(&iter, image->arcs);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+            const gerbv_image_arc_polyline_t* polyline;
+
+            for (polyline = value; polyline != NULL; polyline = polyline->next)
+                usage->caches += sizeof(gerbv_image_arc_polyline_t) + 2 * polyline->n_points * sizeof(gdouble);
+        }
+    }
+    G_UNLOCK(gerbv_image_arcs);
+
+    usage->total += usage->nets + usage->cirsegs + usage->labels + usage->apertures + usage->simplified + usage->amacros
+                  + usage->layers + usage->stats + usage->caches - before;
+}
+
+/* Most segments a single arc is flattened into */
+#define GERBV_IMAGE_ARC_MAX_SEGMENTS 1024
+
+/* Most buckets an arc is kept flattened for at once */
+#define GERBV_IMAGE_ARC_MAX_BUCKETS 2
+
+static void
+gerbv_image_arc_polyline_destroy(gpointer data) {
+    gerbv_image_arc_polyline_t *polyline = data, *next;
+
+    for (; polyline != NULL; polyline = next) {
+        next = polyline->next;
+        g_free(polyline->points);
+        g_free(polyline);
+    }
+}
+
+/* Flatten an arc of the ellipse with the cirseg's width and height, using
+ * chords that stay within tolerance of the larger radius */
+static void
+gerbv_image_flatten_arc(gerbv_image_arc_polyline_t* polyline, const gerbv_cirseg_t* cirseg, gdouble tolerance) {
+    gdouble rx     = fabs(cirseg->width) / 2.0;
+    gdouble ry     = fabs(cirseg->height) / 2.0;
+    gdouble r      = MAX(rx, ry);
+    gdouble angle1 = DEG2RAD(cirseg->angle1);
+    gdouble sweep  = DEG2RAD(cirseg->angle2 - cirseg->angle1);
+    guint   segments, i;
+
+    if (r > tolerance)
+        segments = (guint)CLAMP(ceil(fabs(sweep) / (2.0 * acos(1.0 - tolerance / r))), 1, GERBV_IMAGE_ARC_MAX_SEGMENTS);
+    else
+        segments = 1;
+
+    polyline->n_points = segments + 1;
+    polyline->points   = g_renew(gdouble, polyline->points, 2 * polyline->n_points);
+    for (i = 0; i <= segments; i++) {
+        gdouble angle = angle1 + sweep * i / segments;
+
+        polyline->points[2 * i]     = rx * cos(angle);
+        polyline->points[2 * i + 1] = ry * sin(angle);
+    }
+}
+
+const gerbv_image_arc_polyline_t*
+gerbv_image_return_arc_polyline(gerbv_image_t* image, gerbv_net_t* net, gdouble tolerance) {
+    gerbv_image_arc_polyline_t *first, *polyline, *last;
+    gint                        bucket;
+    guint                       n;
+
+    if (net->cirseg == NULL)
+        return NULL;
+
+    tolerance = MAX(tolerance, 1e-9);
+    bucket    = (gint)floor(log2(tolerance));
+
+    G_LOCK(gerbv_image_arcs);
+
+    if (image->arcs == NULL)
+        image->arcs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, gerbv_image_arc_polyline_destroy);
+
+    first = g_hash_table_lookup(image->arcs, net);
+    for (polyline = first, n = 0, last = NULL; polyline != NULL; last = polyline, polyline = polyline->next, n++) {
+        if (polyline->bucket == bucket) {
+            G_UNLOCK(gerbv_image_arcs);
+            return polyline;
+        }
+    }
+
+    if (n < GERBV_IMAGE_ARC_MAX_BUCKETS) {
+        polyline = g_new0(gerbv_image_arc_polyline_t, 1);
+    } else {
+        /* reuse the oldest bucket, at the end of the chain */
+        polyline = last;
+        for (last = first; last->next != polyline; last = last->next) {}
+        last->next = NULL;
+    }
+    /* the newest bucket goes first, without destroying the chain it now heads */
+    polyline->next = first;
+    g_hash_table_steal(image->arcs, net);
+    g_hash_table_insert(image->arcs, net, polyline);
+
+    /* flatten for the bucket, not the exact tolerance, so the result only depends on the bucket */
+    polyline->bucket = bucket;
+    gerbv_image_flatten_arc(polyline, net->cirseg, ldexp(1.0, bucket));
+
+    G_UNLOCK(gerbv_image_arcs);
+
+    return polyline;
+}
+
+gboolean
+gerbv_image_return_label_mark(gerbv_image_t* image, gerbv_net_t* startNet, gdouble* x, gdouble* y) {
+    gerbv_net_t* net;
+    gdouble*     mark;
+
+    if (startNet->label == NULL)
+        return FALSE;
+
+    if (image->labelMarks == NULL)
+        image->labelMarks = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, g_free);
+
+    mark = g_hash_table_lookup(image->labelMarks, startNet);
+    if (mark == NULL) {
+        mark    = g_new(gdouble, 2);
+        mark[0] = HUGE_VAL;
+        mark[1] = -HUGE_VAL;
+
+        /* labels are interned, so all nets of the same part share the pointer */
+        for (net = startNet; net != NULL && net->label == startNet->label;
+             net = gerbv_image_return_next_renderable_object(net)) {
+            /* Search top left corner */
+            if (net->boundingBox.top != HUGE_VAL) {
+                /* Bounding box not calculated */
+                mark[0] = MIN(mark[0], net->boundingBox.left);
+                mark[1] = MAX(mark[1], net->boundingBox.top);
+            } else {
+                mark[0] = MIN(mark[0], net->stop_x);
+                mark[1] = MAX(mark[1], net->stop_y + 0.01 / 2);
+                /* 0.01 default line width */
+            }
+        }
+        g_hash_table_insert(image->labelMarks, startNet, mark);
+    }
+
+    *x = mark[0];
+    *y = mark[1];
+
+    return TRUE;
+}
+
+void
+gerbv_image_invalidate_caches(gerbv_image_t* image) {
+    if (image == NULL)
+        return;
+
+    if (image->regions != NULL) {
+        g_hash_table_destroy(image->regions);
+        image->regions = NULL;
+    }
+    if (image->labelMarks != NULL) {
+        g_hash_table_destroy(image->labelMarks);
+        image->labelMarks = NULL;
+    }
+    G_LOCK(gerbv_image_arcs);
+    if (image->arcs != NULL) {
+        g_hash_table_destroy(image->arcs);
+        image->arcs = NULL;
+    }
+    G_UNLOCK(gerbv_image_arcs);
+
+    /* nets, layers and states may have been freed */
+    image->tailNet   = NULL;
+    image->tailLayer = NULL;
+    image->tailState = NULL;
+}
+
+gerbv_net_t*
+gerbv_image_return_next_renderable_object_cached(gerbv_image_t* image, gerbv_net_t* oldNet) {
+    if (oldNet->interpolation == GERBV_INTERPOLATION_PAREA_START)
+        return gerbv_image_return_region(image, oldNet)->nextNet;
+
+    return oldNet->next;
+}
+
 void
 gerbv_image_create_dummy_apertures(gerbv_image_t* parsed_image) {
     gerbv_net_t* currentNet;
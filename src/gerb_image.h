@@ -67,6 +67,91 @@ gerbv_layer_t* gerbv_image_return_new_layer(gerbv_layer_t* previousLayer);
 
 gerbv_netstate_t* gerbv_image_return_new_netstate(gerbv_netstate_t* previousState);
 
+/* Allocate a zeroed net or arc for image, counted in its memory usage. The net isn't linked anywhere */
+gerbv_net_t*    gerbv_image_new_net(gerbv_image_t* image);
+gerbv_cirseg_t* gerbv_image_new_cirseg(gerbv_image_t* image);
+
+/*! Path operations stored in a cached region outline */
+typedef enum {
+    GERBV_REGION_OP_MOVE_TO,     /*!< start the outline at x,y */
+    GERBV_REGION_OP_LINE_TO,     /*!< straight edge to x,y */
+    GERBV_REGION_OP_ARC,         /*!< counterclockwise arc cx,cy,radius,angle1,angle2 (radians) */
+    GERBV_REGION_OP_ARC_NEGATIVE /*!< clockwise arc cx,cy,radius,angle1,angle2 (radians) */
+} gerbv_region_op_t;
+
+/*! A G36/G37 region outline flattened into contiguous arrays, so redraws
+ *  don't have to walk the netlist and convert arcs for every vertex */
+typedef struct {
+    gerbv_net_t*        nextNet;     /*!< the first net following the region */
+    gerbv_render_size_t boundingBox; /*!< bounding box of all region vertices */
+    gboolean            closed;      /*!< FALSE if the region is missing its PAREA_END net */
+    guint               n_ops;       /*!< the number of path operations */
+    guint8*             ops;         /*!< the path operations (gerbv_region_op_t) */
+    gdouble*            coords;      /*!< 2 coordinates per move/line, 5 per arc */
+} gerbv_image_region_t;
+
+/* Return the cached outline of the region started by startNet, building it on first use */
+gerbv_image_region_t* gerbv_image_return_region(gerbv_image_t* image, gerbv_net_t* startNet);
+
+/*! An arc net flattened into a polyline, for renderers that can't draw arcs themselves */
+typedef struct gerbv_image_arc_polyline {
+    gint                             bucket;   /*!< the zoom bucket it was flattened for */
+    guint                            n_points; /*!< the number of points, including both ends of the arc */
+    gdouble*                         points;   /*!< x,y pairs relative to the arc center */
+    struct gerbv_image_arc_polyline* next;     /*!< the same arc flattened for another bucket */
+} gerbv_image_arc_polyline_t;
+
+/* Return the cached polyline of the arc net, flattened so it is never further
+ * than tolerance from the true arc. Tolerances are rounded down to a power of
+ * two, so the polyline is reused until the zoom changes by a factor of two.
+ * Each arc keeps the polylines of the last two buckets it was asked for, so
+ * drawing and hit testing at different scales don't evict each other. The
+ * cache is locked, so layers of different images, or of the same image at
+ * the same scale, can be rendered from several threads at once. */
+const gerbv_image_arc_polyline_t*
+gerbv_image_return_arc_polyline(gerbv_image_t* image, gerbv_net_t* net, gdouble tolerance);
+
+/*! Streams the nets of an image the way gerbv_image_duplicate_image() would
+ *  copy them, with the user transformation applied and the apertures
+ *  renumbered from APERTURE_MIN, without copying the image */
+typedef struct {
+    gerbv_image_t*               image;            /*!< the image being exported */
+    gerbv_user_transformation_t* transform;        /*!< applied to every net, may be NULL */
+    gerbv_aperture_t**           aperture;         /*!< the exported apertures, indexed by their new number */
+    gerbv_layer_t                layer;            /*!< what the first net's layer is compared against */
+    gerbv_netstate_t             state;            /*!< what the first net's state is compared against */
+    gerbv_net_t                  net;              /*!< the net last returned by gerbv_image_export_iter_next() */
+    gerbv_cirseg_t               cirseg;           /*!< the arc of net, if it has one */
+    gerbv_net_t*                 firstNet;         /*!< NULL if the transform can't be exported */
+    gerbv_net_t*                 nextNet;          /*!< the next net to export */
+    gint*                        renumber;         /*!< the new number of each aperture in image, or -1 */
+    gint*                        transformed;      /*!< the transformed copy of each new aperture, or -1 */
+    gint                         firstTransformed; /*!< the transformed copies, owned by the iterator, start here */
+    gint                         lastAperture;     /*!< the highest aperture number in use */
+} gerbv_export_iter_t;
+
+/* Start exporting image with transform applied, transform may be NULL */
+void
+gerbv_image_export_iter_init(gerbv_export_iter_t* iter, gerbv_image_t* image, gerbv_user_transformation_t* transform);
+
+/* Return the next net, or NULL after the last one. The net is only valid until the next call */
+gerbv_net_t* gerbv_image_export_iter_next(gerbv_export_iter_t* iter);
+
+/* Start again from the first net */
+void gerbv_image_export_iter_rewind(gerbv_export_iter_t* iter);
+
+void gerbv_image_export_iter_clear(gerbv_export_iter_t* iter);
+
+/* Return the cached top left corner of the PNP part whose label starts at startNet,
+ * or FALSE if startNet has no label */
+gboolean gerbv_image_return_label_mark(gerbv_image_t* image, gerbv_net_t* startNet, gdouble* x, gdouble* y);
+
+/* Drop all cached region outlines, label positions and flattened arcs, must be called after nets are modified */
+void gerbv_image_invalidate_caches(gerbv_image_t* image);
+
+/* Like gerbv_image_return_next_renderable_object(), but skips regions using the cache */
+gerbv_net_t* gerbv_image_return_next_renderable_object_cached(gerbv_image_t* image, gerbv_net_t* oldNet);
+
 #ifdef __cplusplus
 }
 #endif
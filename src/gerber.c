@@ -39,6 +39,7 @@
 #include "common.h"
 #include "gerb_image.h"
 #include "gerber.h"
+#include "gerber_lexer.h"
 #include "gerb_stats.h"
 #include "amacro.h"
 
@@ -52,9 +53,13 @@
 #define MAXL 200
 
 /* Local function prototypes */
-static void parse_G_code(gerb_file_t* fd, gerb_state_t* state, gerbv_image_t* image, long int* line_num_p);
-static void parse_D_code(gerb_file_t* fd, gerb_state_t* state, gerbv_image_t* image, long int* line_num_p);
-static int  parse_M_code(gerb_file_t* fd, gerbv_image_t* image, long int* line_num_p);
+static void parse_G_code(
+    gerb_file_t* fd, gerber_lexer_t* lex, gerb_state_t* state, gerbv_image_t* image, long int* line_num_p
+);
+static void parse_D_code(
+    gerb_file_t* fd, gerber_lexer_t* lex, gerb_state_t* state, gerbv_image_t* image, long int* line_num_p
+);
+static int parse_M_code(gerb_file_t* fd, gerber_lexer_t* lex, gerbv_image_t* image, long int* line_num_p);
 static void parse_rs274x(
     gint levelOfRecursion, gerb_file_t* fd, gerbv_image_t* image, gerb_state_t* state, gerbv_net_t* curr_net,
     gerbv_stats_t* stats, gchar* directoryPath, long int* line_num_p
@@ -80,8 +85,10 @@ cairo_matrix_t currentMatrix;
 
 /* --------------------------------------------------------- */
 gerbv_net_t*
-gerber_create_new_net(gerbv_net_t* currentNet, gerbv_layer_t* layer, gerbv_netstate_t* state) {
-    gerbv_net_t* newNet = g_new0(gerbv_net_t, 1);
+gerber_create_new_net(
+    gerbv_image_t* image, gerbv_net_t* currentNet, gerbv_layer_t* layer, gerbv_netstate_t* state
+) {
+    gerbv_net_t* newNet = gerbv_image_new_net(image);
 
     currentNet->next = newNet;
     if (layer)
@@ -140,8 +147,9 @@ gerber_parse_file_segment(
     gerbv_render_size_t boundingBoxNew = { HUGE_VAL, -HUGE_VAL, HUGE_VAL, -HUGE_VAL }, boundingBox = boundingBoxNew;
     gerbv_error_list_t* error_list = stats->error_list;
     long int            line_num   = 1;
+    gerber_lexer_t*     lex        = gerber_lexer_new(fd);
 
-    while ((read = gerb_fgetc(fd)) != EOF) {
+    while ((read = gerber_lexer_getc(lex, fd)) != EOF) {
         /* figure out the scale, since we need to normalize
        all dimensions to inches */
         if (state->state->unit == GERBV_UNIT_MM)
@@ -151,16 +159,16 @@ gerber_parse_file_segment(
         switch ((char)(read & 0xff)) {
             case 'G':
                 dprintf("... Found G code at line %ld\n", line_num);
-                parse_G_code(fd, state, image, &line_num);
+                parse_G_code(fd, lex, state, image, &line_num);
                 break;
             case 'D':
                 dprintf("... Found D code at line %ld\n", line_num);
-                parse_D_code(fd, state, image, &line_num);
+                parse_D_code(fd, lex, state, image, &line_num);
                 break;
             case 'M':
                 dprintf("... Found M code at line %ld\n", line_num);
 
-                switch (parse_M_code(fd, image, &line_num)) {
+                switch (parse_M_code(fd, lex, image, &line_num)) {
                     case 1:
                     case 2:
                     case 3: foundEOF = TRUE; break;
@@ -173,7 +181,7 @@ gerber_parse_file_segment(
                 break;
             case 'X':
                 stats->X++;
-                coord = gerb_fgetint(fd, &len);
+                coord = gerber_lexer_getint(lex, fd, &len);
                 if (image->format)
                     add_trailing_zeros_if_omitted(
                         &coord, image->format->x_int + image->format->x_dec - len, image->format
@@ -189,7 +197,7 @@ gerber_parse_file_segment(
 
             case 'Y':
                 stats->Y++;
-                coord = gerb_fgetint(fd, &len);
+                coord = gerber_lexer_getint(lex, fd, &len);
                 if (image->format)
                     add_trailing_zeros_if_omitted(
                         &coord, image->format->y_int + image->format->y_dec - len, image->format
@@ -205,7 +213,7 @@ gerber_parse_file_segment(
 
             case 'I':
                 stats->I++;
-                coord = gerb_fgetint(fd, &len);
+                coord = gerber_lexer_getint(lex, fd, &len);
                 if (image->format)
                     add_trailing_zeros_if_omitted(
                         &coord, image->format->x_int + image->format->x_dec - len, image->format
@@ -217,7 +225,7 @@ gerber_parse_file_segment(
 
             case 'J':
                 stats->J++;
-                coord = gerb_fgetint(fd, &len);
+                coord = gerber_lexer_getint(lex, fd, &len);
                 if (image->format)
                     add_trailing_zeros_if_omitted(
                         &coord, image->format->y_int + image->format->y_dec - len, image->format
@@ -290,7 +298,7 @@ gerber_parse_file_segment(
                     state->prev_y = state->curr_y;
                     break;
                 }
-                curr_net = gerber_create_new_net(curr_net, state->layer, state->state);
+                curr_net = gerber_create_new_net(image, curr_net, state->layer, state->state);
                 /*
                  * Scale to given coordinate format
                  * XXX only "omit leading zeros".
@@ -314,7 +322,7 @@ gerber_parse_file_segment(
                         {
                             int cw = (state->interpolation == GERBV_INTERPOLATION_CW_CIRCULAR);
 
-                            curr_net->cirseg = g_new0(gerbv_cirseg_t, 1);
+                            curr_net->cirseg = gerbv_image_new_cirseg(image);
                             if (state->mq_on) {
                                 calc_cirseg_mq(curr_net, cw, delta_cp_x, delta_cp_y);
                             } else {
@@ -384,12 +392,12 @@ gerber_parse_file_segment(
                     if (state->aperture_state == GERBV_APERTURE_STATE_OFF
                         && state->interpolation != GERBV_INTERPOLATION_PAREA_START && polygonPoints > 0) {
                         curr_net->interpolation = GERBV_INTERPOLATION_PAREA_END;
-                        curr_net                = gerber_create_new_net(curr_net, state->layer, state->state);
+                        curr_net                = gerber_create_new_net(image, curr_net, state->layer, state->state);
                         curr_net->interpolation = GERBV_INTERPOLATION_PAREA_START;
                         state->parea_start_node->boundingBox = boundingBox;
                         state->parea_start_node              = curr_net;
                         polygonPoints                        = 0;
-                        curr_net          = gerber_create_new_net(curr_net, state->layer, state->state);
+                        curr_net          = gerber_create_new_net(image, curr_net, state->layer, state->state);
                         curr_net->start_x = (double)state->prev_x / x_scale;
                         curr_net->start_y = (double)state->prev_y / y_scale;
                         curr_net->stop_x  = (double)state->curr_x / x_scale;
@@ -678,6 +686,8 @@ gerber_parse_file_segment(
                 );
         } /* switch((char) (read & 0xff)) */
     }
+    gerber_lexer_free(lex);
+
     return foundEOF;
 }
 
@@ -748,6 +758,120 @@ parse_gerb(gerb_file_t* fd, gchar* directoryPath) {
     return image;
 } /* parse_gerb */
 
+/* ------------------------------------------------------------------- */
+/*! Reads just enough of a Gerber file to stand in for it until it is
+ *  needed: all extended commands (format, units, apertures, macros) and
+ *  the extents of the X and Y coordinates, without building any nets.
+ *  The extents ignore aperture sizes, arcs and step and repeat, so they
+ *  are only an estimate until parse_gerb() reads the file for real.
+ */
+gerbv_image_t*
+parse_gerb_header(gerb_file_t* fd, gchar* directoryPath) {
+    gerb_state_t*  state = NULL;
+    gerbv_image_t* image = NULL;
+    gerbv_stats_t* stats;
+    long int       line_num = 1;
+    int            read, coord, len, c;
+    double         x, y, scale;
+    gboolean       done = FALSE;
+
+    setlocale(LC_NUMERIC, "C");
+
+    state = g_new0(gerb_state_t, 1);
+    image = gerbv_create_image(image, "RS274-X (Gerber) File");
+    if (image == NULL)
+        GERB_FATAL_ERROR("malloc image failed in %s()", __FUNCTION__);
+    image->layertype   = GERBV_LAYERTYPE_RS274X;
+    image->gerbv_stats = gerbv_stats_new();
+    if (image->gerbv_stats == NULL)
+        GERB_FATAL_ERROR("malloc gerbv_stats failed in %s()", __FUNCTION__);
+
+    stats        = image->gerbv_stats;
+    state->layer = image->layers;
+    state->state = image->states;
+
+    while (!done && (read = gerb_fgetc(fd)) != EOF) {
+        switch ((char)(read & 0xff)) {
+            case '%':
+                /* the same as gerber_parse_file_segment(), for every command in the block */
+                do {
+                    parse_rs274x(0, fd, image, state, image->netlist, stats, directoryPath, &line_num);
+                    do {
+                        c = gerb_fgetc(fd);
+                        if (c == '\n')
+                            line_num++;
+                    } while (c == '\0' || c == '\t' || c == ' ' || c == '\n' || c == '\r');
+                    if (c != EOF && c != '%')
+                        gerb_ungetc(fd);
+                } while (c != EOF && c != '%');
+                break;
+            case 'G':
+                switch (gerb_fgetint(fd, NULL)) {
+                    case 4:
+                        /* a comment can hold any letter */
+                        while ((c = gerb_fgetc(fd)) != EOF && c != '*')
+                            ;
+                        break;
+                    case 70:
+                        state->state->unit = GERBV_UNIT_INCH;
+                        break;
+                    case 71:
+                        state->state->unit = GERBV_UNIT_MM;
+                        break;
+                }
+                break;
+            case 'M':
+                if (gerb_fgetint(fd, NULL) == 2)
+                    done = TRUE;
+                break;
+            case 'X':
+            case 'Y':
+                coord = gerb_fgetint(fd, &len);
+                if (image->format == NULL)
+                    break;
+
+                scale = (state->state->unit == GERBV_UNIT_MM) ? 25.4 : 1.0;
+                if (read == 'X') {
+                    add_trailing_zeros_if_omitted(
+                        &coord, image->format->x_int + image->format->x_dec - len, image->format
+                    );
+                    if (image->format->coordinate == GERBV_COORDINATE_INCREMENTAL)
+                        state->curr_x += coord;
+                    else
+                        state->curr_x = coord;
+                    x                  = state->curr_x / pow(10.0, image->format->x_dec) / scale;
+                    image->info->min_x = MIN(image->info->min_x, x);
+                    image->info->max_x = MAX(image->info->max_x, x);
+                } else {
+                    add_trailing_zeros_if_omitted(
+                        &coord, image->format->y_int + image->format->y_dec - len, image->format
+                    );
+                    if (image->format->coordinate == GERBV_COORDINATE_INCREMENTAL)
+                        state->curr_y += coord;
+                    else
+                        state->curr_y = coord;
+                    y                  = state->curr_y / pow(10.0, image->format->y_dec) / scale;
+                    image->info->min_y = MIN(image->info->min_y, y);
+                    image->info->max_y = MAX(image->info->max_y, y);
+                }
+                break;
+            case 'D':
+            case 'I':
+            case 'J': gerb_fgetint(fd, NULL); break;
+            case '\n': line_num++; break;
+            default: break;
+        }
+    }
+    g_free(state);
+
+    dprintf(
+        "Pre-scanned %s, extents %g,%g to %g,%g\n", fd->filename, image->info->min_x, image->info->min_y,
+        image->info->max_x, image->info->max_y
+    );
+
+    return image;
+} /* parse_gerb_header */
+
 /* ------------------------------------------------------------------- */
 /*! Checks for signs that this is a RS-274X file
  *  Returns TRUE if it is, FALSE if not.
@@ -773,7 +897,7 @@ gerber_is_rs274x_p(gerb_file_t* fd, gboolean* returnFoundBinary) {
     if (buf == NULL)
         GERB_FATAL_ERROR("malloc buf failed while checking for rs274x in %s()", __FUNCTION__);
 
-    while (fgets(buf, MAXL, fd->fd) != NULL) {
+    while (gerb_fgets(buf, MAXL, fd) != NULL) {
         dprintf("buf = \"%s\"\n", buf);
         len = strlen(buf);
 
@@ -825,7 +949,7 @@ gerber_is_rs274x_p(gerb_file_t* fd, gboolean* returnFoundBinary) {
             }
         }
     }
-    rewind(fd->fd);
+    gerb_frewind(fd);
     free(buf);
 
     *returnFoundBinary = found_binary;
@@ -862,7 +986,7 @@ gerber_is_rs274d_p(gerb_file_t* fd) {
     if (buf == NULL)
         GERB_FATAL_ERROR("malloc buf failed while checking for rs274d in %s()", __FUNCTION__);
 
-    while (fgets(buf, MAXL, fd->fd) != NULL) {
+    while (gerb_fgets(buf, MAXL, fd) != NULL) {
         len = strlen(buf);
 
         /* First look through the file for indications of its type */
@@ -906,7 +1030,7 @@ gerber_is_rs274d_p(gerb_file_t* fd) {
             }
         }
     }
-    rewind(fd->fd);
+    gerb_frewind(fd);
     free(buf);
 
     /* Now form logical expression determining if the file is RS-274D */
@@ -923,14 +1047,14 @@ gerber_is_rs274d_p(gerb_file_t* fd) {
  *  state.  It also updates the G stats counters
  */
 static void
-parse_G_code(gerb_file_t* fd, gerb_state_t* state, gerbv_image_t* image, long int* line_num_p) {
+parse_G_code(gerb_file_t* fd, gerber_lexer_t* lex, gerb_state_t* state, gerbv_image_t* image, long int* line_num_p) {
     int                 op_int;
     gerbv_format_t*     format     = image->format;
     gerbv_stats_t*      stats      = image->gerbv_stats;
     gerbv_error_list_t* error_list = stats->error_list;
     int                 c;
 
-    op_int = gerb_fgetint(fd, NULL);
+    op_int = gerber_lexer_getint(lex, fd, NULL);
 
     /* Emphasize text with new line '\n' in the beginning */
     dprintf("\n     Found G%02d at line %ld (%s)\n", op_int, *line_num_p, gerber_g_code_name(op_int));
@@ -1068,12 +1192,12 @@ parse_G_code(gerb_file_t* fd, gerb_state_t* state, gerbv_image_t* image, long in
  *  state.  It also updates the D stats counters
  */
 static void
-parse_D_code(gerb_file_t* fd, gerb_state_t* state, gerbv_image_t* image, long int* line_num_p) {
+parse_D_code(gerb_file_t* fd, gerber_lexer_t* lex, gerb_state_t* state, gerbv_image_t* image, long int* line_num_p) {
     int                 a;
     gerbv_stats_t*      stats      = image->gerbv_stats;
     gerbv_error_list_t* error_list = stats->error_list;
 
-    a = gerb_fgetint(fd, NULL);
+    a = gerber_lexer_getint(lex, fd, NULL);
     dprintf("     Found D%02d code at line %ld\n", a, *line_num_p);
 
     switch (a) {
@@ -1121,11 +1245,11 @@ parse_D_code(gerb_file_t* fd, gerb_state_t* state, gerbv_image_t* image, long in
 
 /* ------------------------------------------------------------------ */
 static int
-parse_M_code(gerb_file_t* fd, gerbv_image_t* image, long int* line_num_p) {
+parse_M_code(gerb_file_t* fd, gerber_lexer_t* lex, gerbv_image_t* image, long int* line_num_p) {
     int            op_int;
     gerbv_stats_t* stats = image->gerbv_stats;
 
-    op_int = gerb_fgetint(fd, NULL);
+    op_int = gerber_lexer_getint(lex, fd, NULL);
 
     switch (op_int) {
         case 0: /* Program stop */ stats->M0++; return 1;
@@ -1406,7 +1530,7 @@ parse_rs274x(
                     if (levelOfRecursion < 10) {
                         gerb_file_t* includefd = NULL;
 
-                        includefd = gerb_fopen(fullPath);
+                        includefd = gerb_fopen_cached(fullPath);
                         if (includefd) {
                             gerber_parse_file_segment(
                                 levelOfRecursion + 1, image, state, curr_net, stats, includefd, directoryPath
@@ -1849,35 +1973,74 @@ pop(macro_stack_t* s, double* value) {
     return 0;
 } /* pop */
 
+/*
+ * Result of running an aperture macro, memoized in amacro->simplified. The
+ * simplified list is shared by all apertures with the same key, and owned
+ * by them.
+ */
+typedef struct {
+    gerbv_simplified_amacro_t* simplified;
+    int                        clearOperatorUsed;
+    int                        handled;
+    gdouble                    scale;          /* key: file unit scale */
+    unsigned int               nuf_parameters; /* key: the nuf_locals parameters the macro can read */
+    double                     parameter[];
+} simplified_amacro_entry_t;
+
+static guint
+simplified_amacro_entry_hash(gconstpointer key) {
+    const simplified_amacro_entry_t* entry = key;
+    const guchar*                    p     = (const guchar*)entry->parameter;
+    gsize                            len   = entry->nuf_parameters * sizeof(double);
+    guint32                          hash  = 2166136261u; /* FNV-1a */
+    gsize                            i;
+
+    for (i = 0; i < sizeof(gdouble); i++)
+        hash = (hash ^ ((const guchar*)&entry->scale)[i]) * 16777619u;
+    for (i = 0; i < len; i++)
+        hash = (hash ^ p[i]) * 16777619u;
+
+    return hash;
+}
+
+static gboolean
+simplified_amacro_entry_equal(gconstpointer a, gconstpointer b) {
+    const simplified_amacro_entry_t* ea = a;
+    const simplified_amacro_entry_t* eb = b;
+
+    /* compare bits rather than values, so -0.0 and NaN parameters are kept apart */
+    return ea->nuf_parameters == eb->nuf_parameters && memcmp(&ea->scale, &eb->scale, sizeof(gdouble)) == 0
+        && memcmp(ea->parameter, eb->parameter, ea->nuf_parameters * sizeof(double)) == 0;
+}
+
 /* ------------------------------------------------------------------ */
 static int
-simplify_aperture_macro(gerbv_aperture_t* aperture, gdouble scale) {
+run_aperture_macro(
+    gerbv_amacro_t* amacro, const double* parameter, gdouble scale, gerbv_simplified_amacro_t** simplified,
+    int* clearOperatorUsedp
+) {
     const int                  extra_stack_size = 10;
     macro_stack_t*             s;
     gerbv_instruction_t*       ip;
+    unsigned int               pc;
     int                        handled = 1, nuf_parameters = 0, i, j, clearOperatorUsed = FALSE;
     double*                    lp; /* Local copy of parameters */
     double                     tmp[2] = { 0.0, 0.0 };
     gerbv_aperture_type_t      type   = GERBV_APTYPE_NONE;
     gerbv_simplified_amacro_t* sam;
 
-    if (aperture == NULL)
-        GERB_FATAL_ERROR(_("aperture NULL in simplify aperture macro"));
-
-    if (aperture->amacro == NULL)
-        GERB_FATAL_ERROR(_("aperture->amacro NULL in simplify aperture macro"));
-
     /* Allocate stack for VM */
-    s = new_stack(aperture->amacro->nuf_push + extra_stack_size);
+    s = new_stack(amacro->nuf_push + extra_stack_size);
     if (s == NULL)
         GERB_FATAL_ERROR("malloc stack failed in %s()", __FUNCTION__);
 
-    /* Make a copy of the parameter list that we can rewrite if necessary */
-    lp = g_new(double, APERTURE_PARAMETERS_MAX);
+    /* Make a copy of the parameters the program uses, so it can rewrite them */
+    lp = g_new(double, MAX(amacro->nuf_locals, 1));
 
-    memcpy(lp, aperture->parameter, sizeof(double) * APERTURE_PARAMETERS_MAX);
+    memcpy(lp, parameter, sizeof(double) * amacro->nuf_locals);
 
-    for (ip = aperture->amacro->program; ip != NULL; ip = ip->next) {
+    for (pc = 0; pc < amacro->nuf_code; pc++) {
+        ip = &amacro->code[pc];
         switch (ip->opcode) {
             case GERBV_OPCODE_NOP: break;
             case GERBV_OPCODE_PUSH: push(s, ip->data.fval); break;
@@ -2097,11 +2260,11 @@ simplify_aperture_macro(gerbv_aperture_t* aperture, gdouble scale) {
                      * of simplified aperture macros. If first entry, put it
                      * in the top.
                      */
-                    if (aperture->simplified == NULL) {
-                        aperture->simplified = sam;
+                    if (*simplified == NULL) {
+                        *simplified = sam;
                     } else {
                         gerbv_simplified_amacro_t* tmp_sam;
-                        tmp_sam = aperture->simplified;
+                        tmp_sam = *simplified;
                         while (tmp_sam->next != NULL) {
                             tmp_sam = tmp_sam->next;
                         }
@@ -2130,10 +2293,51 @@ simplify_aperture_macro(gerbv_aperture_t* aperture, gdouble scale) {
     free_stack(s);
     g_free(lp);
 
+    *clearOperatorUsedp = clearOperatorUsed;
+    return handled;
+} /* run_aperture_macro */
+
+/* ------------------------------------------------------------------ */
+static int
+simplify_aperture_macro(gerbv_aperture_t* aperture, gdouble scale) {
+    gerbv_amacro_t*            amacro;
+    simplified_amacro_entry_t* entry;
+    simplified_amacro_entry_t* cached;
+
+    if (aperture == NULL)
+        GERB_FATAL_ERROR(_("aperture NULL in simplify aperture macro"));
+
+    if (aperture->amacro == NULL)
+        GERB_FATAL_ERROR(_("aperture->amacro NULL in simplify aperture macro"));
+
+    amacro = aperture->amacro;
+    if (amacro->simplified == NULL)
+        amacro->simplified =
+            g_hash_table_new_full(simplified_amacro_entry_hash, simplified_amacro_entry_equal, g_free, NULL);
+
+    entry = g_malloc(sizeof(simplified_amacro_entry_t) + sizeof(double) * amacro->nuf_locals);
+    entry->simplified     = NULL;
+    entry->scale          = scale;
+    entry->nuf_parameters = amacro->nuf_locals;
+    memcpy(entry->parameter, aperture->parameter, sizeof(double) * amacro->nuf_locals);
+
+    cached = g_hash_table_lookup(amacro->simplified, entry);
+    if (cached != NULL) {
+        dprintf("  Reusing the simplified aperture macro \"%s\"\n", amacro->name);
+        g_free(entry);
+        entry = cached;
+    } else {
+        entry->handled =
+            run_aperture_macro(amacro, aperture->parameter, scale, &entry->simplified, &entry->clearOperatorUsed);
+        g_hash_table_insert(amacro->simplified, entry, entry);
+    }
+
+    aperture->simplified = entry->simplified;
+
     /* store a flag to let the renderer know if it should expect any "clear"
        primatives */
-    aperture->parameter[0] = (gdouble)clearOperatorUsed;
-    return handled;
+    aperture->parameter[0] = (gdouble)entry->clearOperatorUsed;
+    return entry->handled;
 } /* simplify_aperture_macro */
 
 /* ------------------------------------------------------------------ */
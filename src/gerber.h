@@ -61,9 +61,12 @@ typedef struct gerb_state {
  * parse gerber file pointed to by fd
  */
 gerbv_image_t* parse_gerb(gerb_file_t* fd, gchar* directoryPath);
+gerbv_image_t* parse_gerb_header(gerb_file_t* fd, gchar* directoryPath);
 gboolean       gerber_is_rs274x_p(gerb_file_t* fd, gboolean* returnFoundBinary);
 gboolean       gerber_is_rs274d_p(gerb_file_t* fd);
-gerbv_net_t*   gerber_create_new_net(gerbv_net_t* currentNet, gerbv_layer_t* layer, gerbv_netstate_t* state);
+gerbv_net_t*   gerber_create_new_net(
+    gerbv_image_t* image, gerbv_net_t* currentNet, gerbv_layer_t* layer, gerbv_netstate_t* state
+);
 
 gboolean gerber_create_new_aperture(
     gerbv_image_t* image, int* indexNumber, gerbv_aperture_type_t apertureType, gdouble parameter1, gdouble parameter2
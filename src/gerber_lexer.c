@@ -0,0 +1,365 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ *
+ * gerber_lexer.c -- this file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** \file gerber_lexer.c
+    \brief Parallel RS-274X lexer
+    \ingroup libgerbv
+
+    Splits a large Gerber file into chunks that end just after a '*', and has
+    worker threads turn every code letter with a number (G, D, M, X, Y, I, J)
+    into a token, while the parser consumes earlier chunks. Since no number
+    can extend past a '*', every token is exactly what gerb_fgetc() followed
+    by gerb_fgetint() would read at its offset, whatever the parser state.
+
+    The parser only uses a token when it starts exactly at fd->ptr, and falls
+    back to reading fd for everything else: whitespace, extended commands,
+    comments, and letters the lexer picked up inside them. So the parsed image
+    is the same with or without the lexer.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "common.h"
+#include "gerbv.h"
+#include "gerb_file.h"
+#include "gerber_lexer.h"
+
+/* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
+#define dprintf \
+    if (DEBUG)  \
+    printf
+
+#define GERBER_LEXER_MAX_THREADS 16
+
+/* Number of worker threads set with gerber_lexer_set_threads(), 0 for one per processor */
+static gint gerber_lexer_threads = 0;
+
+typedef struct {
+    guint32 offset;   /* Offset of the code letter from the start of the chunk */
+    gint32  value;    /* The number following it, as gerb_fgetint() returns it */
+    guint16 advance;  /* Number of characters gerb_fgetint() consumes */
+    gchar   code;     /* The code letter */
+    gchar   negative; /* TRUE if the number was negative, gerb_fgetint() doesn't count the sign in len */
+} gerber_token_t;
+
+typedef struct {
+    goffset         start;    /* File offset of the first byte of the chunk */
+    goffset         end;      /* File offset just past the last byte of the chunk */
+    gerber_token_t* tokens;   /* Tokens in file order */
+    guint           nTokens;  /* Number of tokens */
+    guint           capacity; /* Allocated size of tokens */
+    gint            chunk;    /* The chunk held in this slot once it is lexed, or -1 */
+} gerber_lexer_slot_t;
+
+struct gerber_lexer {
+    const char* data;      /* The whole file */
+    goffset     datalen;   /* Length of the file */
+    gint        nChunks;   /* Number of chunks the file is split into */
+    gint        nSlots;    /* Number of chunks that can be lexed ahead of the parser */
+    gint        nThreads;  /* Number of worker threads */
+    gint        nextChunk; /* Next chunk for a worker to lex */
+    gint        released;  /* The parser is done with all chunks before this */
+    gboolean    cancel;    /* Tells the workers to stop */
+
+    gerber_lexer_slot_t* slots;
+#if GLIB_CHECK_VERSION(2, 36, 0)
+    GThread* threads[GERBER_LEXER_MAX_THREADS];
+    GMutex   lock;
+    GCond    cond;
+#endif
+
+    /* parser side */
+    gint                 chunk;         /* Chunk being read */
+    gerber_lexer_slot_t* slot;          /* Its slot, or NULL if it isn't ready yet */
+    guint                token;         /* Next token to look at in slot */
+    gerber_token_t       current;       /* Token returned by the last gerber_lexer_getc() */
+    goffset              currentOffset; /* File offset of current, or -1 if there is none */
+};
+
+#if GLIB_CHECK_VERSION(2, 36, 0)
+/* ------------------------------------------------------------------ */
+/* Return the file offset where chunk starts, just past the first '*' at or
+   after its nominal start */
+static goffset
+gerber_lexer_chunk_start(const gerber_lexer_t* lex, gint chunk) {
+    goffset     from = (goffset)chunk * GERBER_LEXER_CHUNK_SIZE;
+    const char* star;
+
+    if (chunk == 0)
+        return 0;
+    if (from >= lex->datalen)
+        return lex->datalen;
+
+    star = memchr(lex->data + from, '*', (size_t)(lex->datalen - from));
+
+    return star ? star - lex->data + 1 : lex->datalen;
+}
+
+/* ------------------------------------------------------------------ */
+static void
+gerber_lexer_lex_chunk(const gerber_lexer_t* lex, gerber_lexer_slot_t* slot, gint chunk) {
+    const char* p;
+    const char* end;
+
+    slot->start   = gerber_lexer_chunk_start(lex, chunk);
+    slot->end     = gerber_lexer_chunk_start(lex, chunk + 1);
+    slot->nTokens = 0;
+
+    /* token offsets are 32 bits, leave absurdly long chunks to the parser */
+    if (slot->end - slot->start > G_MAXUINT32)
+        return;
+
+    end = lex->data + slot->end;
+    for (p = lex->data + slot->start; p < end; p++) {
+        gerber_token_t* token;
+        long int        result;
+        char*           number;
+
+        switch (*p) {
+            case 'G':
+            case 'D':
+            case 'M':
+            case 'X':
+            case 'Y':
+            case 'I':
+            case 'J': break;
+            default: continue;
+        }
+
+        /* the same conversion as gerb_fgetint(), which reports errors itself */
+        errno  = 0;
+        result = strtol(p + 1, &number, 10);
+        if (errno || number - (p + 1) > G_MAXUINT16)
+            continue;
+
+        if (slot->nTokens == slot->capacity) {
+            slot->capacity = MAX(2 * slot->capacity, 4096);
+            slot->tokens   = g_renew(gerber_token_t, slot->tokens, slot->capacity);
+        }
+        token           = &slot->tokens[slot->nTokens++];
+        token->offset   = (guint32)(p - lex->data - slot->start);
+        token->value    = (gint32)result;
+        token->advance  = (guint16)(number - (p + 1));
+        token->code     = *p;
+        token->negative = (result < 0);
+
+        /* the number can't hold another code letter */
+        p = number - 1;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+static gpointer
+gerber_lexer_thread(gpointer data) {
+    gerber_lexer_t* lex = (gerber_lexer_t*)data;
+
+    g_mutex_lock(&lex->lock);
+    while (1) {
+        gerber_lexer_slot_t* slot;
+        gint                 chunk;
+
+        /* don't overwrite chunks the parser hasn't finished with */
+        while (!lex->cancel && lex->nextChunk < lex->nChunks && lex->nextChunk >= lex->released + lex->nSlots)
+            g_cond_wait(&lex->cond, &lex->lock);
+
+        if (lex->cancel || lex->nextChunk >= lex->nChunks)
+            break;
+
+        chunk = lex->nextChunk++;
+        slot  = &lex->slots[chunk % lex->nSlots];
+        g_mutex_unlock(&lex->lock);
+
+        gerber_lexer_lex_chunk(lex, slot, chunk);
+
+        g_mutex_lock(&lex->lock);
+        slot->chunk = chunk;
+        g_cond_broadcast(&lex->cond);
+    }
+    g_mutex_unlock(&lex->lock);
+
+    return NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/* Return the token starting at offset, if there is one */
+static const gerber_token_t*
+gerber_lexer_find(gerber_lexer_t* lex, goffset offset) {
+    gerber_lexer_slot_t* slot;
+
+    while (1) {
+        if (lex->slot == NULL) {
+            if (lex->chunk >= lex->nChunks)
+                return NULL;
+
+            slot = &lex->slots[lex->chunk % lex->nSlots];
+            g_mutex_lock(&lex->lock);
+            while (slot->chunk != lex->chunk)
+                g_cond_wait(&lex->cond, &lex->lock);
+            g_mutex_unlock(&lex->lock);
+
+            lex->slot  = slot;
+            lex->token = 0;
+        }
+
+        if (offset < lex->slot->end)
+            break;
+
+        /* done with this chunk, let a worker reuse its slot */
+        g_mutex_lock(&lex->lock);
+        lex->slot->chunk = -1;
+        lex->released++;
+        g_cond_broadcast(&lex->cond);
+        g_mutex_unlock(&lex->lock);
+
+        lex->slot = NULL;
+        lex->chunk++;
+    }
+
+    slot = lex->slot;
+    if (offset < slot->start)
+        return NULL;
+
+    /* tokens are skipped when the parser reads past them from fd */
+    offset -= slot->start;
+    while (lex->token < slot->nTokens && slot->tokens[lex->token].offset < offset)
+        lex->token++;
+
+    if (lex->token < slot->nTokens && slot->tokens[lex->token].offset == offset)
+        return &slot->tokens[lex->token++];
+
+    return NULL;
+}
+#endif
+
+/* ------------------------------------------------------------------ */
+void
+gerber_lexer_set_threads(gint nThreads) {
+    g_atomic_int_set(&gerber_lexer_threads, MAX(nThreads, 0));
+}
+
+/* ------------------------------------------------------------------ */
+gerber_lexer_t*
+gerber_lexer_new(gerb_file_t* fd) {
+#if GLIB_CHECK_VERSION(2, 36, 0)
+    gerber_lexer_t* lex;
+    gint            nThreads, i;
+
+    /* the workers need the whole file at once */
+    if (fd->streaming || fd->decoder != NULL || fd->datalen < GERBER_LEXER_MIN_SIZE)
+        return NULL;
+
+    nThreads = g_atomic_int_get(&gerber_lexer_threads);
+    if (nThreads == 0)
+        nThreads = (gint)g_get_num_processors();
+    nThreads = MIN(nThreads, GERBER_LEXER_MAX_THREADS);
+    if (nThreads < 2)
+        return NULL;
+
+    lex                = g_new0(gerber_lexer_t, 1);
+    lex->data          = fd->data;
+    lex->datalen       = fd->datalen;
+    lex->nChunks       = (gint)((fd->datalen + GERBER_LEXER_CHUNK_SIZE - 1) / GERBER_LEXER_CHUNK_SIZE);
+    lex->nSlots        = 2 * nThreads;
+    lex->nThreads      = nThreads;
+    lex->slots         = g_new0(gerber_lexer_slot_t, lex->nSlots);
+    lex->currentOffset = -1;
+    g_mutex_init(&lex->lock);
+    g_cond_init(&lex->cond);
+
+    for (i = 0; i < lex->nSlots; i++)
+        lex->slots[i].chunk = -1;
+
+    dprintf("Lexing %s in %d chunks on %d threads\n", fd->filename, lex->nChunks, nThreads);
+
+    for (i = 0; i < nThreads; i++)
+        lex->threads[i] = g_thread_new("gerbv-lexer", gerber_lexer_thread, lex);
+
+    return lex;
+#else
+    return NULL;
+#endif
+}
+
+/* ------------------------------------------------------------------ */
+void
+gerber_lexer_free(gerber_lexer_t* lex) {
+#if GLIB_CHECK_VERSION(2, 36, 0)
+    gint i;
+
+    if (lex == NULL)
+        return;
+
+    g_mutex_lock(&lex->lock);
+    lex->cancel = TRUE;
+    g_cond_broadcast(&lex->cond);
+    g_mutex_unlock(&lex->lock);
+
+    for (i = 0; i < lex->nThreads; i++)
+        g_thread_join(lex->threads[i]);
+
+    for (i = 0; i < lex->nSlots; i++)
+        g_free(lex->slots[i].tokens);
+
+    g_mutex_clear(&lex->lock);
+    g_cond_clear(&lex->cond);
+    g_free(lex->slots);
+    g_free(lex);
+#endif
+}
+
+/* ------------------------------------------------------------------ */
+int
+gerber_lexer_getc(gerber_lexer_t* lex, gerb_file_t* fd) {
+#if GLIB_CHECK_VERSION(2, 36, 0)
+    if (lex != NULL) {
+        const gerber_token_t* token = gerber_lexer_find(lex, fd->ptr);
+
+        if (token != NULL) {
+            lex->current       = *token;
+            lex->currentOffset = fd->ptr;
+            fd->ptr++;
+            return token->code;
+        }
+        lex->currentOffset = -1;
+    }
+#endif
+
+    return gerb_fgetc(fd);
+}
+
+/* ------------------------------------------------------------------ */
+int
+gerber_lexer_getint(gerber_lexer_t* lex, gerb_file_t* fd, int* len) {
+    if (lex == NULL || lex->currentOffset < 0 || lex->currentOffset + 1 != fd->ptr)
+        return gerb_fgetint(fd, len);
+
+    lex->currentOffset = -1;
+    fd->ptr += lex->current.advance;
+    if (len)
+        *len = lex->current.advance - lex->current.negative;
+
+    return lex->current.value;
+}
@@ -0,0 +1,64 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ *
+ * gerber_lexer.h -- this file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 51
+ * Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** \file gerber_lexer.h
+    \brief Header info for the parallel RS-274X lexer
+    \ingroup libgerbv
+*/
+
+#ifndef GERBER_LEXER_H
+#define GERBER_LEXER_H
+
+#include "gerb_file.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bytes of the file lexed at a time by one thread */
+#define GERBER_LEXER_CHUNK_SIZE (1024 * 1024)
+
+/* Smaller files are parsed straight from the file */
+#define GERBER_LEXER_MIN_SIZE (8 * GERBER_LEXER_CHUNK_SIZE)
+
+typedef struct gerber_lexer gerber_lexer_t;
+
+/* Lex on nThreads worker threads from now on, or on one per processor if
+ * nThreads is 0 (the default). Fewer than 2 turns the parallel lexer off. */
+void gerber_lexer_set_threads(gint nThreads);
+
+/* Start lexing fd on worker threads. Returns NULL if the file is too small
+ * to be worth it or isn't entirely in memory, in which case the functions
+ * below simply read from fd. */
+gerber_lexer_t* gerber_lexer_new(gerb_file_t* fd);
+void            gerber_lexer_free(gerber_lexer_t* lex);
+
+/* Same as gerb_fgetc(), but returns a pre-lexed code letter when there is one at fd->ptr */
+int gerber_lexer_getc(gerber_lexer_t* lex, gerb_file_t* fd);
+
+/* Same as gerb_fgetint(), but returns the pre-lexed number following the code
+ * letter just returned by gerber_lexer_getc() */
+int gerber_lexer_getint(gerber_lexer_t* lex, gerb_file_t* fd, int* len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* GERBER_LEXER_H */
@@ -168,10 +168,11 @@ gerbv_create_project(void) {
         on future file loads */
     returnProject->path = g_get_current_dir();
     /* Will be updated to 0 when first Gerber is loaded */
-    returnProject->last_loaded         = -1;
-    returnProject->max_files           = 1;
-    returnProject->check_before_delete = TRUE;
-    returnProject->file                = g_new0(gerbv_fileinfo_t*, returnProject->max_files);
+    returnProject->last_loaded              = -1;
+    returnProject->max_files                = 1;
+    returnProject->check_before_delete      = TRUE;
+    returnProject->background_decompression = TRUE;
+    returnProject->file                     = g_new0(gerbv_fileinfo_t*, returnProject->max_files);
 
     return returnProject;
 }
@@ -196,6 +197,8 @@ gerbv_destroy_project(gerbv_project_t* gerbvProject) {
     /* destroy the fileinfo array */
     g_free(gerbvProject->file);
     g_free(gerbvProject);
+    /* include files read for this project */
+    gerb_file_clear_cache();
 }
 
 /* ------------------------------------------------------------------ */
@@ -252,6 +255,12 @@ gerbv_save_layer_from_index(gerbv_project_t* gerbvProject, gint index, gchar* fi
     gerbv_fileinfo_t*            file  = gerbvProject->file[index];
     gerbv_user_transformation_t* trans = &file->transform;
 
+    if (!gerbv_load_deferred_layer(file))
+        return FALSE;
+
+    /* don't carry what was deleted while editing into the saved file */
+    gerbv_image_compact(file->image);
+
     switch (file->image->layertype) {
         case GERBV_LAYERTYPE_RS274X:
             if (trans) {
@@ -314,6 +323,9 @@ void
 gerbv_revert_all_files(gerbv_project_t* gerbvProject) {
     int idx;
 
+    /* pick up changed include files even if their size and time stamp didn't change */
+    gerb_file_clear_cache();
+
     for (idx = 0; idx <= gerbvProject->last_loaded; idx++) {
         if (gerbvProject->file[idx] && gerbvProject->file[idx]->fullPathname) {
             (void)gerbv_revert_file(gerbvProject, idx);
@@ -450,7 +462,7 @@ gerbv_open_image(
     gerb_file_t*         fd;
     gerbv_image_t *      parsed_image = NULL, *parsed_image2 = NULL;
     gint                 retv      = -1;
-    gboolean             isPnpFile = FALSE, foundBinary;
+    gboolean             isPnpFile = FALSE, foundBinary, deferred = FALSE;
     gerbv_HID_Attribute* attr_list = NULL;
     int                  n_attr    = 0;
     /* If we're reloading, we'll pass in our file format attribute list
@@ -479,7 +491,9 @@ gerbv_open_image(
 
     dprintf("In open_image, about to try opening filename = %s\n", filename);
 
-    fd = gerb_fopen(filename);
+    fd = gerb_fopen_with_flags(
+        filename, gerbvProject->background_decompression ? GERB_FILE_BACKGROUND_DECODE : GERB_FILE_DEFAULT
+    );
     if (fd == NULL) {
         GERB_COMPILE_ERROR(_("Trying to open \"%s\": %s"), filename, strerror(errno));
         return -1;
@@ -498,7 +512,12 @@ gerbv_open_image(
             /* figure out the directory path in case parse_gerb needs to
              * load any include files */
             gchar* currentLoadDirectory = g_path_get_dirname(filename);
-            parsed_image                = parse_gerb(fd, currentLoadDirectory);
+            if (gerbvProject->lazy_open && !reload) {
+                parsed_image = parse_gerb_header(fd, currentLoadDirectory);
+                deferred     = TRUE;
+            } else {
+                parsed_image = parse_gerb(fd, currentLoadDirectory);
+            }
             g_free(currentLoadDirectory);
         }
     } else if (drill_file_p(fd, &foundBinary)) {
@@ -575,6 +594,8 @@ gerbv_open_image(
 
     /* Set layer_dirty flag to FALSE */
     gerbvProject->file[idx]->layer_dirty = FALSE;
+    gerbvProject->file[idx]->deferred    = deferred;
+    gerbvProject->file[idx]->loadFailed  = FALSE;
 
     /* for PNP place files, we may need to add a second image for the other
        board side */
@@ -591,6 +612,92 @@ gerbv_open_image(
     return retv;
 } /* open_image */
 
+/* ------------------------------------------------------------------ */
+gboolean
+gerbv_load_deferred_layer(gerbv_fileinfo_t* fileInfo) {
+    gerb_file_t*   fd;
+    gerbv_image_t* parsed_image;
+    gchar*         currentLoadDirectory;
+
+    if (fileInfo == NULL || !fileInfo->deferred)
+        return TRUE;
+
+    /* don't try again on every redraw if the file went away */
+    if (fileInfo->loadFailed)
+        return FALSE;
+
+    dprintf("Loading deferred layer %s\n", fileInfo->fullPathname);
+
+    fd = gerb_fopen(fileInfo->fullPathname);
+    if (fd == NULL) {
+        GERB_COMPILE_ERROR(_("Trying to open \"%s\": %s"), fileInfo->fullPathname, strerror(errno));
+        fileInfo->loadFailed = TRUE;
+        return FALSE;
+    }
+
+    currentLoadDirectory = g_path_get_dirname(fileInfo->fullPathname);
+    parsed_image         = parse_gerb(fd, currentLoadDirectory);
+    g_free(currentLoadDirectory);
+    gerb_fclose(fd);
+
+    if (parsed_image == NULL) {
+        fileInfo->loadFailed = TRUE;
+        return FALSE;
+    }
+
+    if (gerbv_image_verify(parsed_image) & GERB_IMAGE_MISSING_APERTURES)
+        gerbv_image_create_dummy_apertures(parsed_image);
+
+    gerbv_destroy_image(fileInfo->image);
+    fileInfo->image    = parsed_image;
+    fileInfo->deferred = FALSE;
+
+    return TRUE;
+} /* gerbv_load_deferred_layer */
+
+/* ------------------------------------------------------------------ */
+gboolean
+gerbv_load_next_deferred_layer(gerbv_project_t* gerbvProject) {
+    int i;
+
+    for (i = 0; i <= gerbvProject->last_loaded; i++) {
+        if (gerbvProject->file[i] && gerbvProject->file[i]->deferred && !gerbvProject->file[i]->loadFailed) {
+            gerbv_load_deferred_layer(gerbvProject->file[i]);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+} /* gerbv_load_next_deferred_layer */
+
+/* ------------------------------------------------------------------ */
+void
+gerbv_fileinfo_add_memory_usage(const gerbv_fileinfo_t* fileInfo, gerbv_memory_usage_t* usage) {
+    cairo_surface_t* surface = (cairo_surface_t*)fileInfo->privateRenderData;
+
+    gerbv_image_add_memory_usage(fileInfo->image, usage);
+
+    if (surface != NULL && cairo_surface_get_type(surface) == CAIRO_SURFACE_TYPE_IMAGE) {
+        gsize size = (gsize)cairo_image_surface_get_stride(surface) * cairo_image_surface_get_height(surface);
+
+        usage->surfaces += size;
+        usage->total += size;
+    }
+} /* gerbv_fileinfo_add_memory_usage */
+
+/* ------------------------------------------------------------------ */
+void
+gerbv_project_get_memory_usage(const gerbv_project_t* gerbvProject, gerbv_memory_usage_t* usage) {
+    int i;
+
+    memset(usage, 0, sizeof(gerbv_memory_usage_t));
+    for (i = 0; i <= gerbvProject->last_loaded; i++) {
+        if (gerbvProject->file[i])
+            gerbv_fileinfo_add_memory_usage(gerbvProject->file[i], usage);
+    }
+} /* gerbv_project_get_memory_usage */
+
+/* ------------------------------------------------------------------ */
 gerbv_image_t*
 gerbv_create_rs274x_image_from_filename(const gchar* filename) {
     gerbv_image_t* returnImage;
@@ -624,7 +731,6 @@ gerbv_render_get_boundingbox(gerbv_project_t* gerbvProject, gerbv_render_size_t*
 
     for (i = 0; i <= gerbvProject->last_loaded; i++) {
         if (gerbvProject->file[i] && gerbvProject->file[i]->isVisible) {
-
             info = gerbvProject->file[i]->image->info;
             /*
              * Find the biggest image and use as a size reference
@@ -733,11 +839,60 @@ gerbv_render_translate_to_fit_display(gerbv_project_t* gerbvProject, gerbv_rende
         ((bb.top + bb.bottom) / 2.0) - ((double)renderInfo->displayHeight / 2.0 / renderInfo->scaleFactorY);
 }
 
+/* ------------------------------------------------------------------ */
+static gboolean
+gerbv_render_gdk_pixmap_matches(GdkPixmap* scratch, GdkPixmap* target, gint width, gint height, gint depth) {
+    gint scratchWidth, scratchHeight;
+
+    if (!scratch || gdk_drawable_get_screen(scratch) != gdk_drawable_get_screen(target)
+        || gdk_drawable_get_depth(scratch) != depth)
+        return FALSE;
+
+    gdk_drawable_get_size(scratch, &scratchWidth, &scratchHeight);
+    return scratchWidth == width && scratchHeight == height;
+}
+
+/* Make sure the scratch pixmaps fit the output, keeping the ones given if
+   they already do */
+static void
+gerbv_render_get_gdk_scratch_pixmaps(
+    GdkPixmap* pixmap, gerbv_render_info_t* renderInfo, GdkPixmap** colorStamp, GdkPixmap** clipmask
+) {
+    gint width = renderInfo->displayWidth, height = renderInfo->displayHeight;
+
+    if (!gerbv_render_gdk_pixmap_matches(*colorStamp, pixmap, width, height, gdk_drawable_get_depth(pixmap))) {
+        if (*colorStamp)
+            gdk_pixmap_unref(*colorStamp);
+        *colorStamp = gdk_pixmap_new(pixmap, width, height, -1);
+    }
+    if (!gerbv_render_gdk_pixmap_matches(*clipmask, pixmap, width, height, 1)) {
+        if (*clipmask)
+            gdk_pixmap_unref(*clipmask);
+        *clipmask = gdk_pixmap_new(NULL, width, height, 1);
+    }
+}
+
 /* ------------------------------------------------------------------ */
 void
 gerbv_render_to_pixmap_using_gdk(
     gerbv_project_t* gerbvProject, GdkPixmap* pixmap, gerbv_render_info_t* renderInfo,
     gerbv_selection_info_t* selectionInfo, GdkColor* selectionColor
+) {
+    GdkPixmap *colorStamp = NULL, *clipmask = NULL;
+
+    gerbv_render_to_pixmap_using_gdk_with_scratch(
+        gerbvProject, pixmap, renderInfo, selectionInfo, selectionColor, &colorStamp, &clipmask
+    );
+    gdk_pixmap_unref(colorStamp);
+    gdk_pixmap_unref(clipmask);
+}
+
+/* ------------------------------------------------------------------ */
+void
+gerbv_render_to_pixmap_using_gdk_with_scratch(
+    gerbv_project_t* gerbvProject, GdkPixmap* pixmap, gerbv_render_info_t* renderInfo,
+    gerbv_selection_info_t* selectionInfo, GdkColor* selectionColor, GdkPixmap** scratchColorStamp,
+    GdkPixmap** scratchClipmask
 ) {
     GdkGC*     gc = gdk_gc_new(pixmap);
     GdkPixmap *colorStamp, *clipmask;
@@ -752,10 +907,11 @@ gerbv_render_to_pixmap_using_gdk(
     gdk_draw_rectangle(pixmap, gc, TRUE, 0, 0, -1, -1);
 
     /*
-     * Allocate the pixmap and the clipmask (a one pixel pixmap)
+     * Get the pixmap and the clipmask (a one bit pixmap)
      */
-    colorStamp = gdk_pixmap_new(pixmap, renderInfo->displayWidth, renderInfo->displayHeight, -1);
-    clipmask   = gdk_pixmap_new(NULL, renderInfo->displayWidth, renderInfo->displayHeight, 1);
+    gerbv_render_get_gdk_scratch_pixmaps(pixmap, renderInfo, scratchColorStamp, scratchClipmask);
+    colorStamp = *scratchColorStamp;
+    clipmask   = *scratchClipmask;
 
     /*
      * This now allows drawing several layers on top of each other.
@@ -849,8 +1005,6 @@ gerbv_render_to_pixmap_using_gdk(
         }
     }
 
-    gdk_pixmap_unref(colorStamp);
-    gdk_pixmap_unref(clipmask);
     gdk_gc_unref(gc);
 }
 
@@ -372,6 +372,12 @@ typedef enum {
     GERBV_RENDER_TYPE_MAX                 /*!< End-of-enum indicator */
 } gerbv_render_types_t;
 
+/*! The order the drill exporter writes the holes of each tool in */
+typedef enum {
+    GERBV_DRILL_ORDER_FILE,   /*!< the order they have in the image */
+    GERBV_DRILL_ORDER_HILBERT /*!< along a Hilbert curve over the board, to shorten the travel between holes */
+} gerbv_drill_order_t;
+
 /*
  * The following typedef's are taken directly from src/hid.h in the
  * pcb project.  The names are kept the same to make it easier to
@@ -443,6 +449,10 @@ typedef struct amacro {
     gerbv_instruction_t* program;
     unsigned int         nuf_push; /* Nuf pushes in program to estimate stack size */
     struct amacro*       next;
+    gerbv_instruction_t* code;       /* program as a flat array without the NOPs (private) */
+    unsigned int         nuf_code;   /* Nuf instructions in code */
+    unsigned int         nuf_locals; /* Highest $n the program reads or writes */
+    GHashTable*          simplified; /* simplified results keyed by scale and parameters (private) */
 } gerbv_amacro_t;
 
 typedef struct gerbv_simplified_amacro {
@@ -454,7 +464,7 @@ typedef struct gerbv_simplified_amacro {
 typedef struct gerbv_aperture {
     gerbv_aperture_type_t      type;
     gerbv_amacro_t*            amacro;
-    gerbv_simplified_amacro_t* simplified;
+    gerbv_simplified_amacro_t* simplified; /* may be shared with other apertures of the image, don't modify */
     double                     parameter[APERTURE_PARAMETERS_MAX];
     int                        nuf_parameters;
     gerbv_unit_t               unit;
@@ -675,7 +685,7 @@ typedef struct gerbv_net {
     gerbv_interpolation_t  interpolation;  /*!< the path interpolation method (linear/etc) */
     gerbv_cirseg_t*        cirseg;         /*!< information for arc nets */
     struct gerbv_net*      next;           /*!< the next net in the array */
-    GString*               label;          /*!< a label string for this net */
+    GString*               label;          /*!< label owned by the image, see gerbv_image_intern_label() */
     gerbv_layer_t*         layer;          /*!< the RS274X layer this net belongs to */
     gerbv_netstate_t*      state;          /*!< the RS274X state this net belongs to */
 } gerbv_net_t;
@@ -739,6 +749,17 @@ typedef struct {
     gerbv_net_t*         netlist;     /*!< an array of all geometric entities in the layer */
     gerbv_stats_t*       gerbv_stats; /*!< RS274X statistics for the layer */
     gerbv_drill_stats_t* drill_stats; /*!< Excellon drill statistics for the layer */
+    GHashTable*          regions;     /*!< cached G36/G37 region outlines keyed by their start net (private) */
+    GHashTable*          labels;      /*!< interned net labels keyed by their text (private) */
+    GHashTable*          labelMarks;  /*!< cached PNP label positions keyed by their first net (private) */
+    GHashTable*          arcs;        /*!< cached flattened arcs keyed by their net (private) */
+    gerbv_net_t*         tailNet;     /*!< a net near the end of netlist, to append merged nets (private) */
+    gerbv_layer_t*       tailLayer;   /*!< a layer near the end of layers (private) */
+    gerbv_netstate_t*    tailState;   /*!< a state near the end of states (private) */
+    GArray*              blocks;      /*!< nets and arcs allocated together by merges (private) */
+    gsize                netBytes;    /*!< bytes allocated for nets, kept as they come and go (private) */
+    gsize                cirsegBytes; /*!< bytes allocated for arc parameters, kept likewise (private) */
+    guint                nNets;       /*!< number of nets in netlist, kept likewise (private) */
 } gerbv_image_t;
 
 /*!  Holds information related to an individual layer that is part of a project */
@@ -753,6 +774,8 @@ typedef struct {
     gerbv_user_transformation_t
              transform;   /*!< user-specified transformation for this layer (mirroring, translating, etc) */
     gboolean layer_dirty; /*!< True if layer has been modified since last save */
+    gboolean deferred;    /*!< TRUE if image only holds a pre-scan of the file, see gerbv_load_deferred_layer() */
+    gboolean loadFailed;  /*!< TRUE if loading a deferred layer failed, so image still holds the pre-scan */
 } gerbv_fileinfo_t;
 
 /*!  The top-level structure used in libgerbv.  A gerbv_project_t groups together
@@ -770,8 +793,27 @@ typedef struct {
     gchar*             execpath;                 /*!< the path to executed version of Gerbv */
     gchar*             execname;                 /*!< the path plus executible name for Gerbv */
     gchar*             project;                  /*!< the default name for the private project file */
+    gboolean           background_decompression; /*!< TRUE to decompress layers on another processor while parsing */
+    gboolean           lazy_open;                /*!< TRUE to only pre-scan RS-274X layers when opening them */
 } gerbv_project_t;
 
+/*!  Approximate heap memory held by a layer or project, in bytes */
+typedef struct {
+    gsize nets;        /*!< the netlist */
+    gsize cirsegs;     /*!< arc parameters of the nets */
+    gsize labels;      /*!< net labels */
+    gsize apertures;   /*!< the aperture table and the apertures in it */
+    gsize simplified;  /*!< simplified aperture macros */
+    gsize amacros;     /*!< aperture macro programs */
+    gsize layers;      /*!< RS274X layers and netstates */
+    gsize stats;       /*!< RS274X or drill statistics, including their error lists */
+    gsize caches;      /*!< cached region outlines and label positions */
+    gsize surfaces;    /*!< rendered surfaces kept for the layer */
+    gsize total;       /*!< the sum of all of the above */
+    guint n_nets;      /*!< the number of nets */
+    guint n_apertures; /*!< the number of defined apertures */
+} gerbv_memory_usage_t;
+
 /*! Color of layer */
 typedef struct {
     unsigned char red;
@@ -821,6 +863,35 @@ gerbv_image_t* gerbv_image_duplicate_image(
 void gerbv_image_delete_net(gerbv_net_t* currentNet /*!< the net to delete */
 );
 
+//! Free the nets deleted from an image, and the layers, netstates and apertures no other net uses
+/*! Deleted nets are only marked as such, until this removes them from the netlist.
+    Nets that were deleted must not be selected or referenced anywhere else.
+    An aperture is only freed when deleted nets used it and no remaining net does,
+    and is then missing from saved files too. Apertures the file defines without
+    ever using them are kept, and still saved.
+  \return the number of nets freed */
+guint gerbv_image_compact(gerbv_image_t* image /*!< the image to compact */
+);
+
+//! Return the label string owned by the image for the given text, creating it on first use
+/*! All nets with the same label share the returned string, so labels can be compared
+    by pointer. It is freed with the image and must not be modified or freed by the caller.
+
+    This changes the ownership of gerbv_net_t::label. Before, every net owned its
+    own GString and gerbv_destroy_image() freed it. Code that attaches labels to
+    nets has to use this function instead of g_string_new(), and code that changed
+    or freed a net's label has to intern a new one and let the image free it. */
+GString* gerbv_image_intern_label(
+    gerbv_image_t* image, /*!< the image the label is used in */
+    const gchar*   text   /*!< the text of the label */
+);
+
+//! Add the memory held by an image to usage, which must have been zeroed first
+void gerbv_image_add_memory_usage(
+    const gerbv_image_t*  image, /*!< the image to measure */
+    gerbv_memory_usage_t* usage  /*!< the totals to add to */
+);
+
 gboolean gerbv_image_reduce_area_of_selected_objects(
     GArray* selectionArray, gdouble areaReduction, gint paneRows, gint paneColumns, gdouble paneSeparation
 );
@@ -878,6 +949,27 @@ int gerbv_open_image(
     gboolean forceLoadFile
 );
 
+//! Fully parse a layer that was opened in lazy mode, if it hasn't been yet. Returns FALSE if the file can't be read.
+//! The render and bounding box functions draw whatever image a layer holds, so load the layers first
+gboolean gerbv_load_deferred_layer(gerbv_fileinfo_t* fileInfo /*!< the layer to load */
+);
+
+//! Fully parse the first layer still waiting for it, skipping ones that failed to load. Returns FALSE if there was none
+gboolean gerbv_load_next_deferred_layer(gerbv_project_t* gerbvProject /*!< the project to look in */
+);
+
+//! Add the memory held by a layer, including its rendered surface, to usage
+void gerbv_fileinfo_add_memory_usage(
+    const gerbv_fileinfo_t* fileInfo, /*!< the layer to measure */
+    gerbv_memory_usage_t*   usage     /*!< the totals to add to, zeroed first */
+);
+
+//! Fill in the memory held by all layers of a project
+void gerbv_project_get_memory_usage(
+    const gerbv_project_t* gerbvProject, /*!< the project to measure */
+    gerbv_memory_usage_t*  usage         /*!< returns the totals */
+);
+
 void gerbv_render_get_boundingbox(gerbv_project_t* gerbvProject, gerbv_render_size_t* boundingbox);
 
 //! Calculate the zoom and translations to fit the rendered scene inside the given scene size
@@ -893,6 +985,16 @@ void gerbv_render_to_pixmap_using_gdk(
     gerbv_selection_info_t* selectionInfo, GdkColor* selectionColor
 );
 
+//! Render a project to a GDK pixmap like gerbv_render_to_pixmap_using_gdk(), drawing each layer through the
+//! caller's scratch pixmaps, which are only reallocated when the size or screen changes. The caller frees them
+//! with gdk_pixmap_unref() once it is done rendering.
+void gerbv_render_to_pixmap_using_gdk_with_scratch(
+    gerbv_project_t* gerbvProject, GdkPixmap* pixmap, gerbv_render_info_t* renderInfo,
+    gerbv_selection_info_t* selectionInfo, GdkColor* selectionColor,
+    GdkPixmap** colorStamp, /*!< the pixmap filled with each layer's color, or NULL to allocate one */
+    GdkPixmap** clipmask    /*!< the 1 bit mask each layer is drawn into, or NULL to allocate one */
+);
+
 #ifndef RENDER_USING_GDK
 void gerbv_render_all_layers_to_cairo_target_for_vector_output(
     gerbv_project_t* gerbvProject, cairo_t* cr, gerbv_render_info_t* renderInfo
@@ -920,7 +1022,8 @@ double gerbv_get_tool_diameter(int toolNumber);
 int gerbv_process_tools_file(const char* toolFileName);
 
 //! Render a project to a PNG file, autoscaling the layers to fit inside the specified image dimensions
-void gerbv_export_png_file_from_project_autoscaled(
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_png_file_from_project_autoscaled(
     gerbv_project_t* gerbvProject,   /*!< the project to render */
     int              widthInPixels,  /*!< the width of the rendered picture (in pixels) */
     int              heightInPixels, /*!< the height of the rendered picture (in pixels) */
@@ -928,49 +1031,101 @@ void gerbv_export_png_file_from_project_autoscaled(
 );
 
 //! Render a project to a PNG file using user-specified render info
-void gerbv_export_png_file_from_project(
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_png_file_from_project(
     gerbv_project_t*     gerbvProject, /*!< the project to render */
     gerbv_render_info_t* renderInfo,   /*!< the render settings for the rendered image */
     const gchar*         filename      /*!< the filename for the exported PNG file */
 );
 
+//! Render each layer of a project to a PNG file of its own using user-specified render info, rendering several
+//! layers at once. The layers are rendered whether they are visible or not.
+//! \return TRUE if every file was written, or FALSE if not
+gboolean gerbv_export_png_files_from_project(
+    gerbv_project_t*     gerbvProject, /*!< the project to render */
+    gerbv_render_info_t* renderInfo,   /*!< the render settings for the rendered images */
+    gchar**              filenames     /*!< the PNG file for each file of the project, or NULL to skip it */
+);
+
 //! Render a project to a PDF file, autoscaling the layers to fit inside the specified image dimensions
-void gerbv_export_pdf_file_from_project_autoscaled(
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_pdf_file_from_project_autoscaled(
     gerbv_project_t* gerbvProject, /*!< the project to render */
     const gchar*     filename      /*!< the filename for the exported PDF file */
 );
 
 //! Render a project to a PDF file using user-specified render info
-void gerbv_export_pdf_file_from_project(
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_pdf_file_from_project(
+    gerbv_project_t*     gerbvProject, /*!< the project to render */
+    gerbv_render_info_t* renderInfo,   /*!< the render settings for the rendered image */
+    const gchar*         filename      /*!< the filename for the exported PDF file */
+);
+
+//! Render each visible layer of a project to its own page of a PDF file using user-specified render info
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_pdf_pages_from_project(
+    gerbv_project_t*     gerbvProject, /*!< the project to render */
+    gerbv_render_info_t* renderInfo,   /*!< the render settings for the rendered pages */
+    const gchar*         filename      /*!< the filename for the exported PDF file */
+);
+
+//! Render a project to a PDF file using user-specified render info, with gerbv's own PDF writer instead of cairo's
+//! PDF surface. Each flashed aperture is a form drawn by every flash of it, and each layer is an optional content
+//! group.
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_pdf_native_file_from_project(
     gerbv_project_t*     gerbvProject, /*!< the project to render */
     gerbv_render_info_t* renderInfo,   /*!< the render settings for the rendered image */
     const gchar*         filename      /*!< the filename for the exported PDF file */
 );
 
+//! Render each visible layer of a project to its own page of a PDF file like
+//! gerbv_export_pdf_native_file_from_project() does, with the pages sharing the aperture forms
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_pdf_native_pages_from_project(
+    gerbv_project_t*     gerbvProject, /*!< the project to render */
+    gerbv_render_info_t* renderInfo,   /*!< the render settings for the rendered pages */
+    const gchar*         filename      /*!< the filename for the exported PDF file */
+);
+
 //! Render a project to a Postscript file, autoscaling the layers to fit inside the specified image dimensions
-void gerbv_export_postscript_file_from_project_autoscaled(
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_postscript_file_from_project_autoscaled(
     gerbv_project_t* gerbvProject, /*!< the project to render */
     const gchar*     filename      /*!< the filename for the exported Postscript file */
 );
 
 //! Render a project to a Postscript file using user-specified render info
-void gerbv_export_postscript_file_from_project(
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_postscript_file_from_project(
     gerbv_project_t*     gerbvProject, /*!< the project to render */
     gerbv_render_info_t* renderInfo,   /*!< the render settings for the rendered image */
     const gchar*         filename      /*!< the filename for the exported Postscript file */
 );
 
 //! Render a project to a SVG file, autoscaling the layers to fit inside the specified image dimensions
-void gerbv_export_svg_file_from_project_autoscaled(
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_svg_file_from_project_autoscaled(
     gerbv_project_t* gerbvProject, /*!< the project to render */
     const gchar*     filename      /*!< the filename for the exported   file */
 );
 
-//! Render a project to a   file using user-specified render info
-void gerbv_export_svg_file_from_project(
+//! Render a project to a SVG file using user-specified render info
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_svg_file_from_project(
+    gerbv_project_t*     gerbvProject, /*!< the project to render */
+    gerbv_render_info_t* renderInfo,   /*!< the render settings for the rendered image */
+    const gchar*         filename      /*!< the filename for the exported SVG file */
+);
+
+//! Render a project to a SVG file using user-specified render info, with gerbv's own SVG writer instead of cairo's
+//! SVG surface. Each flashed aperture is written only once and referenced by every flash of it.
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_svg_native_file_from_project(
     gerbv_project_t*     gerbvProject, /*!< the project to render */
     gerbv_render_info_t* renderInfo,   /*!< the render settings for the rendered image */
-    const gchar*         filename      /*!< the filename for the exported   file */
+    const gchar*         filename      /*!< the filename for the exported SVG file */
 );
 
 //! Export an image to a new file in DXF format
@@ -995,6 +1150,17 @@ gboolean gerbv_export_rs274x_file_from_image(
     gerbv_user_transformation_t* transform /*!< the transformation to apply before exporting */
 );
 
+//! Export an image to a new file in RS274X format, written as compactly as
+//! the format allows: coordinates only when they change, collinear tracks
+//! merged, duplicate apertures written once, and a panel of copies of the
+//! same nets written once with a step and repeat
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_rs274x_file_from_image_compact(
+    const gchar*                 filename, /*!< the filename for the new file */
+    gerbv_image_t*               image,    /*!< the image to export */
+    gerbv_user_transformation_t* transform /*!< the transformation to apply before exporting */
+);
+
 //! Export an image to a new file in Excellon drill format
 //! \return TRUE if successful, or FALSE if not
 gboolean gerbv_export_drill_file_from_image(
@@ -1003,6 +1169,16 @@ gboolean gerbv_export_drill_file_from_image(
     gerbv_user_transformation_t* transform /*!< the transformation to apply before exporting */
 );
 
+//! Export an image to a new file in Excellon drill format, writing the holes of each tool in the given order
+//! \return TRUE if successful, or FALSE if not
+gboolean gerbv_export_drill_file_from_image_ordered(
+    const gchar*                 filename,  /*!< the filename for the new file */
+    gerbv_image_t*               image,     /*!< the image to export */
+    gerbv_user_transformation_t* transform, /*!< the transformation to apply before exporting */
+    gerbv_drill_order_t          order,     /*!< the order to write the holes of each tool in */
+    gdouble*                     travel     /*!< if not NULL, set to the distance between holes, in inches */
+);
+
 //! Export an image to a new file in ISEL NCP drill format
 //! \return TRUE if successful, or FALSE if not
 gboolean gerbv_export_isel_drill_file_from_image(
@@ -302,6 +302,7 @@ interface_create_gui(int req_width, int req_height) {
     GtkWidget* statusbar_label_left;
     GtkWidget* statusUnitComboBox;
     GtkWidget* statusbar_label_right;
+    GtkWidget* statusbar_label_memory;
     GtkWidget *drawingarea, *hAdjustment, *vAdjustment, *hScrollbar, *vScrollbar;
 
     GtkAccelGroup* accel_group;
@@ -1282,6 +1283,10 @@ interface_create_gui(int req_width, int req_height) {
     gtk_label_set_ellipsize(GTK_LABEL(statusbar_label_right), PANGO_ELLIPSIZE_END);
     gtk_misc_set_alignment(GTK_MISC(statusbar_label_right), 0, 0.5);
 
+    statusbar_label_memory = gtk_label_new("");
+    gtk_box_pack_end(GTK_BOX(hbox5), statusbar_label_memory, FALSE, FALSE, 0);
+    gtk_widget_set_tooltip_text(statusbar_label_memory, _("Memory used by the loaded layers"));
+
     /*
      *  Connect signals to widgets
      */
@@ -1678,11 +1683,12 @@ interface_create_gui(int req_width, int req_height) {
 
     gtk_widget_show_all(mainWindow);
 
-    screen.win.messageTextView    = message_textview;
-    screen.win.statusMessageLeft  = statusbar_label_left;
-    screen.win.statusMessageRight = statusbar_label_right;
-    screen.win.layerTree          = tree;
-    screen.win.treeIsUpdating     = FALSE;
+    screen.win.messageTextView     = message_textview;
+    screen.win.statusMessageLeft   = statusbar_label_left;
+    screen.win.statusMessageRight  = statusbar_label_right;
+    screen.win.statusMessageMemory = statusbar_label_memory;
+    screen.win.layerTree           = tree;
+    screen.win.treeIsUpdating      = FALSE;
 
     /* Request label largest width: negative mils coords require largest space */
     utf8_snprintf(
@@ -56,6 +56,7 @@
 #include "interface.h"
 #include "render.h"
 #include "project.h"
+#include "batch.h"
 
 #if (DEBUG)
 #define dprintf                      \
@@ -71,6 +72,7 @@
 #define NUMBER_OF_DEFAULT_TRANSFORMATIONS 20
 
 static void gerbv_print_help(void);
+static void gerbv_print_memory_report(gerbv_project_t* project);
 
 static int
 getopt_configured(int argc, char* const argv[], const char* optstring, const struct option* longopts, int* longindex);
@@ -131,11 +133,14 @@ const struct option longopts[]  = {
     {          "origin", required_argument,         NULL, 'O'},
     {     "window_inch", required_argument,         NULL, 'W'},
     {       "antialias",       no_argument,         NULL, 'a'},
+    {         "compact",       no_argument,         NULL, 'C'},
     {      "background", required_argument,         NULL, 'b'},
     {            "dump",       no_argument,         NULL, 'd'},
     {      "foreground", required_argument,         NULL, 'f'},
     {          "rotate", required_argument,         NULL, 'r'},
+    {     "sort-drills", required_argument,         NULL, 'S'},
     {          "mirror", required_argument,         NULL, 'm'},
+    {          "memory",       no_argument,         NULL, 'M'},
     {            "help",       no_argument,         NULL, 'h'},
     {             "log", required_argument,         NULL, 'l'},
     {          "output", required_argument,         NULL, 'o'},
@@ -145,6 +150,8 @@ const struct option longopts[]  = {
     {           "units", required_argument,         NULL, 'u'},
     {          "window", required_argument,         NULL, 'w'},
     {          "export", required_argument,         NULL, 'x'},
+    {           "batch", required_argument,         NULL, 'j'},
+    {    "split-layers", required_argument,         NULL, 'L'},
     {        "geometry", required_argument, &longopt_val,   1},
  /* GDK/GDK debug flags to be "let through" */
     {      "gtk-module", required_argument, &longopt_val,   2},
@@ -161,7 +168,7 @@ const struct option longopts[]  = {
     {                 0,                 0,            0,   0},
 };
 #endif /* HAVE_GETOPT_LONG*/
-const char* opt_options = "VadhB:D:O:W:b:f:r:m:l:o:p:t:T:u:w:x:";
+const char* opt_options = "VadhCMB:D:L:O:S:W:b:f:j:r:m:l:o:p:t:T:u:w:x:";
 
 /**Global state variable to keep track of what's happening on the screen.
    Declared extern in main.h
@@ -188,7 +195,8 @@ care_for_x_in_cords(char* string) {
 void
 main_open_project_from_filename(gerbv_project_t* gerbvProject, gchar* filename) {
     project_list_t *  list, *plist;
-    gint              i, max_layer_num = -1;
+    gint              i, max_layer_num = -1, retv;
+    gboolean          deferred = FALSE;
     gerbv_fileinfo_t* file_info;
 
     dprintf("Opening project = %s\n", (gchar*)filename);
@@ -239,8 +247,12 @@ main_open_project_from_filename(gerbv_project_t* gerbvProject, gchar* filename)
                 fullName = g_strdup(plist->filename);
             }
 
-            if (gerbv_open_image(gerbvProject, fullName, fileIndex, FALSE, plist->attr_list, plist->n_attr, TRUE)
-                == -1) {
+            /* hidden layers are only pre-scanned, and fully loaded when
+             * they are first needed or the GUI is idle */
+            gerbvProject->lazy_open = !plist->visible;
+            retv = gerbv_open_image(gerbvProject, fullName, fileIndex, FALSE, plist->attr_list, plist->n_attr, TRUE);
+            gerbvProject->lazy_open = FALSE;
+            if (retv == -1) {
                 GERB_MESSAGE(_("could not read file: %s"), fullName);
                 plist = plist->next;
                 continue;
@@ -262,6 +274,7 @@ main_open_project_from_filename(gerbv_project_t* gerbvProject, gchar* filename)
             file_info->transform.mirrorAroundX = plist->mirror_x;
             file_info->transform.mirrorAroundY = plist->mirror_y;
             file_info->isVisible               = plist->visible;
+            deferred |= file_info->deferred;
 
             plist = plist->next;
         }
@@ -269,6 +282,10 @@ main_open_project_from_filename(gerbv_project_t* gerbvProject, gchar* filename)
 
     project_destroy_project_list(list);
 
+    /* a command line export exits before the main loop ever gets idle */
+    if (deferred)
+        g_idle_add_full(G_PRIORITY_LOW, render_load_deferred_layers_idle, NULL, NULL);
+
     /* Save project filename for later use */
     if (gerbvProject->project) {
         g_free(gerbvProject->project);
@@ -355,6 +372,7 @@ main_save_as_project_from_filename(gerbv_project_t* gerbvProject, gchar* filenam
 } /* gerbv_save_as_project_from_filename */
 
 GArray* log_array_tmp = NULL;
+G_LOCK_DEFINE_STATIC(log_array_tmp);
 
 /* Temporary log messages handler. It will store log messages before GUI
  * initialization. */
@@ -367,7 +385,10 @@ callbacks_temporary_handle_log_messages(
     item.domain  = g_strdup(log_domain);
     item.level   = log_level;
     item.message = g_strdup(message);
+    /* batch export jobs log from several threads */
+    G_LOCK(log_array_tmp);
     g_array_append_val(log_array_tmp, item);
+    G_UNLOCK(log_array_tmp);
 
     g_log_default_handler(log_domain, log_level, message, user_data);
 }
@@ -413,7 +434,7 @@ main(int argc, char* argv[]) {
 #endif
     char*    project_filename   = NULL;
     gboolean userSuppliedOrigin = FALSE, userSuppliedWindow = FALSE, userSuppliedAntiAlias = FALSE,
-             userSuppliedWindowInPixels = FALSE, userSuppliedDpi = FALSE;
+             userSuppliedWindowInPixels = FALSE, userSuppliedDpi = FALSE, printMemoryReport = FALSE;
     gint         layerctr = 0, transformCount = 0;
     gdouble      initial_rotation = 0.0;
     gdouble      input_divisor    = 1.0; /* 1.0 for inch */
@@ -421,25 +442,17 @@ main(int argc, char* argv[]) {
     gboolean     initial_mirror_x    = FALSE;
     gboolean     initial_mirror_y    = FALSE;
     const gchar* exportFilename      = NULL;
+    const gchar* batchFilename       = NULL;
+    const gchar* splitLayers         = NULL;
     gfloat       userSuppliedOriginX = 0.0, userSuppliedOriginY = 0.0, userSuppliedDpiX = 72.0, userSuppliedDpiY = 72.0,
            userSuppliedWidth = 0, userSuppliedHeight = 0, userSuppliedBorder = GERBV_DEFAULT_BORDER_COEFF;
 
-    gerbv_image_t* exportImage;
-
-    enum exp_type {
-        EXP_TYPE_NONE = -1,
-        EXP_TYPE_PNG,
-        EXP_TYPE_PDF,
-        EXP_TYPE_SVG,
-        EXP_TYPE_PS,
-        EXP_TYPE_RS274X,
-        EXP_TYPE_DRILL,
-        EXP_TYPE_IDRILL,
-    };
-    enum exp_type exportType              = EXP_TYPE_NONE;
-    const char*   export_type_names[]     = { "png", "pdf", "svg", "ps", "rs274x", "drill", "idrill", NULL };
-    const gchar*  export_def_file_names[] = { "output.png", "output.pdf", "output.svg", "output.ps",
-                                              "output.gbx", "output.cnc", "output.ncp", NULL };
+    batch_export_type_t exportType = BATCH_EXPORT_NONE;
+
+    const char*         drill_order_names[] = { "file", "hilbert", NULL };
+    gerbv_drill_order_t drillOrder          = GERBV_DRILL_ORDER_FILE;
+    gboolean            reportDrillTravel   = FALSE;
+    gboolean            compactRS274X       = FALSE;
 
     const gchar* settings_schema_env = "GSETTINGS_SCHEMA_DIR";
 #ifdef WIN32
@@ -638,6 +651,7 @@ main(int argc, char* argv[]) {
                 );
                 exit(0);
             case 'a': userSuppliedAntiAlias = TRUE; break;
+            case 'C': compactRS274X = TRUE; break;
             case 'b':  // Set background to this color
                 if (optarg == NULL) {
                     fprintf(
@@ -834,19 +848,41 @@ main(int argc, char* argv[]) {
                     exit(1);
                 }
 
-                for (i = 0; export_type_names[i] != NULL; i++) {
-                    if (strcmp(optarg, export_type_names[i]) == 0) {
-                        exportType = i;
+                exportType = batch_export_type_from_name(optarg);
+                if (exportType == BATCH_EXPORT_NONE) {
+                    fprintf(stderr, _("Unrecognized \"%s\" export type.\n"), optarg);
+                    exit(1);
+                }
+                break;
+            case 'S':
+                for (i = 0; drill_order_names[i] != NULL; i++) {
+                    if (strcmp(optarg, drill_order_names[i]) == 0)
                         break;
-                    }
                 }
 
-                if (exportType == EXP_TYPE_NONE) {
-                    fprintf(stderr, _("Unrecognized \"%s\" export type.\n"), optarg);
+                if (drill_order_names[i] == NULL) {
+                    fprintf(stderr, _("Unrecognized \"%s\" drill order.\n"), optarg);
                     exit(1);
                 }
+                drillOrder        = i;
+                reportDrillTravel = TRUE;
+                break;
+            case 'j':
+                if (optarg == NULL) {
+                    fprintf(stderr, _("You must give a job file.\n"));
+                    exit(1);
+                }
+                batchFilename = optarg;
+                break;
+            case 'L':
+                if (optarg == NULL) {
+                    fprintf(stderr, _("You must give the layers to export.\n"));
+                    exit(1);
+                }
+                splitLayers = optarg;
                 break;
             case 'd': screen.dump_parsed_image = 1; break;
+            case 'M': printMemoryReport = TRUE; break;
             case '?':
             case 'h':
                 gerbv_print_help();
@@ -859,6 +895,11 @@ main(int argc, char* argv[]) {
         }
     }
 
+    if (splitLayers != NULL && exportType == BATCH_EXPORT_NONE) {
+        fprintf(stderr, _("You must supply an export type to split the layers.\n"));
+        exit(1);
+    }
+
     /*
      * If no project_filename and only file ends in .gvp, use as project file. -erco 02/20/2020
      */
@@ -950,126 +991,45 @@ main(int argc, char* argv[]) {
         }
     }
 
-    if (exportType != EXP_TYPE_NONE) {
-        /* load the info struct with the default values */
-
-        if (!exportFilename)
-            exportFilename = export_def_file_names[exportType];
-
-        gerbv_render_size_t bb;
-        gerbv_render_get_boundingbox(mainProject, &bb);
-        // Set origin to the left-bottom corner if it is not specified
-        if (!userSuppliedOrigin) {
-            userSuppliedOriginX = bb.left;
-            userSuppliedOriginY = bb.top;
-        }
-
-        float width  = bb.right - userSuppliedOriginX + 0.001;   // Plus a little extra to prevent from
-        float height = bb.bottom - userSuppliedOriginY + 0.001;  // missing items due to round-off errors
-        // If the user did not specify a height and width, autoscale w&h till full size from origin.
-        if (!userSuppliedWindow) {
-            userSuppliedWidth  = width;
-            userSuppliedHeight = height;
+    if (printMemoryReport)
+        gerbv_print_memory_report(mainProject);
+
+    if (exportType != BATCH_EXPORT_NONE || batchFilename != NULL) {
+        batch_settings_t settings;
+        gboolean         ok;
+
+        settings.originX           = userSuppliedOriginX;
+        settings.originY           = userSuppliedOriginY;
+        settings.dpiX              = userSuppliedDpiX;
+        settings.dpiY              = userSuppliedDpiY;
+        settings.width             = userSuppliedWidth;
+        settings.height            = userSuppliedHeight;
+        settings.border            = userSuppliedBorder;
+        settings.userOrigin        = userSuppliedOrigin;
+        settings.userWindow        = userSuppliedWindow;
+        settings.windowInPixels    = userSuppliedWindowInPixels;
+        settings.userDpi           = userSuppliedDpi;
+        settings.antiAlias         = userSuppliedAntiAlias;
+        settings.drillOrder        = drillOrder;
+        settings.reportDrillTravel = reportDrillTravel;
+        settings.compactRS274X     = compactRS274X;
+        settings.transforms        = mainDefaultTransformations;
+        settings.nTransforms       = NUMBER_OF_DEFAULT_TRANSFORMATIONS;
+
+        if (batchFilename != NULL) {
+            ok = batch_run(mainProject, &settings, batchFilename);
         } else {
-            // If size was specified in pixels, and no resolution was specified, autoscale resolution till fit
-            if ((!userSuppliedDpi) && userSuppliedWindowInPixels) {
-                userSuppliedDpiX = MIN((userSuppliedWidth - 0.5) / width, (userSuppliedHeight - 0.5) / height);
-                userSuppliedDpiY = userSuppliedDpiX;
-                userSuppliedOriginX -= 0.5 / userSuppliedDpiX;
-                userSuppliedOriginY -= 0.5 / userSuppliedDpiY;
-            }
-        }
+            if (!exportFilename)
+                exportFilename = batch_default_filename(exportType);
 
-        // Add the border size (if there is one)
-        if (userSuppliedBorder != 0) {
-            // If supplied in inches, add a border around the image
-            if (!userSuppliedWindowInPixels) {
-                userSuppliedOriginX -= (userSuppliedWidth * userSuppliedBorder) / 2.0;
-                userSuppliedOriginY -= (userSuppliedHeight * userSuppliedBorder) / 2.0;
-                userSuppliedWidth += userSuppliedWidth * userSuppliedBorder;
-                userSuppliedHeight += userSuppliedHeight * userSuppliedBorder;
-            }
-            // If supplied in pixels, shrink image content for border_size
-            else {
-                userSuppliedOriginX -= ((userSuppliedWidth / userSuppliedDpiX) * userSuppliedBorder) / 2.0;
-                userSuppliedOriginY -= ((userSuppliedHeight / userSuppliedDpiX) * userSuppliedBorder) / 2.0;
-                userSuppliedDpiX -= (userSuppliedDpiX * userSuppliedBorder);
-                userSuppliedDpiY -= (userSuppliedDpiY * userSuppliedBorder);
-            }
-        }
-
-        if (!userSuppliedWindowInPixels) {
-            userSuppliedWidth *= userSuppliedDpiX;
-            userSuppliedHeight *= userSuppliedDpiY;
-        }
-
-        // Make sure there is something valid in it. It could become negative if
-        // the userSuppliedOrigin is further than the bb.right or bb.top.
-        if (userSuppliedWidth <= 0)
-            userSuppliedWidth = 1;
-        if (userSuppliedHeight <= 0)
-            userSuppliedHeight = 1;
-
-        gerbv_render_info_t renderInfo = { userSuppliedDpiX,
-                                           userSuppliedDpiY,
-                                           userSuppliedOriginX,
-                                           userSuppliedOriginY,
-                                           userSuppliedAntiAlias ? GERBV_RENDER_TYPE_CAIRO_HIGH_QUALITY
-                                                                 : GERBV_RENDER_TYPE_CAIRO_NORMAL,
-                                           userSuppliedWidth,
-                                           userSuppliedHeight };
-
-        switch (exportType) {
-            case EXP_TYPE_PNG: gerbv_export_png_file_from_project(mainProject, &renderInfo, exportFilename); break;
-            case EXP_TYPE_PDF: gerbv_export_pdf_file_from_project(mainProject, &renderInfo, exportFilename); break;
-            case EXP_TYPE_SVG: gerbv_export_svg_file_from_project(mainProject, &renderInfo, exportFilename); break;
-            case EXP_TYPE_PS:
-                gerbv_export_postscript_file_from_project(mainProject, &renderInfo, exportFilename);
-                break;
-            case EXP_TYPE_RS274X:
-            case EXP_TYPE_DRILL:
-            case EXP_TYPE_IDRILL:
-                if (!mainProject->file[0]->image) {
-                    fprintf(stderr, _("A valid file was not loaded.\n"));
-                    exit(1);
-                }
-
-                exportImage = gerbv_image_duplicate_image(mainProject->file[0]->image, &mainDefaultTransformations[0]);
-
-                /* If more than one file, merge them before exporting */
-                for (i = mainProject->last_loaded; i > 0; i--) {
-                    if (mainProject->file[i])
-                        gerbv_image_copy_image(
-                            mainProject->file[i]->image, &mainDefaultTransformations[i], exportImage
-                        );
-                }
-
-                switch (exportType) {
-                    case EXP_TYPE_RS274X:
-                        gerbv_export_rs274x_file_from_image(
-                            exportFilename, exportImage, &mainProject->file[0]->transform
-                        );
-                        break;
-                    case EXP_TYPE_DRILL:
-                        gerbv_export_drill_file_from_image(
-                            exportFilename, exportImage, &mainProject->file[0]->transform
-                        );
-                        break;
-                    case EXP_TYPE_IDRILL:
-                        gerbv_export_isel_drill_file_from_image(
-                            exportFilename, exportImage, &mainProject->file[0]->transform
-                        );
-                        break;
-                    default: break;
-                }
-
-                gerbv_destroy_image(exportImage);
-                break;
-            default: fprintf(stderr, _("A valid file was not loaded.\n")); exit(1);
+            if (splitLayers != NULL)
+                ok = batch_export_layers(mainProject, &settings, exportType, exportFilename, splitLayers);
+            else
+                ok = batch_export(mainProject, &settings, exportType, exportFilename);
         }
 
         /* exit now and don't start up gtk if this is a command line export */
-        exit(0);
+        exit(ok ? 0 : 1);
     }
     gtk_init(&argc, &argv);
     interface_create_gui(req_width, req_height);
@@ -1206,6 +1166,41 @@ gerbv_print_help(void) {
     printf(_("  -m<axis>                Set initial mirroring axis (X or Y).\n"));
 #endif
 
+#ifdef HAVE_GETOPT_LONG
+    printf(_("  -M, --memory            Print the memory used by each loaded layer.\n"));
+#else
+    printf(_("  -M                      Print the memory used by each loaded layer.\n"));
+#endif
+
+#ifdef HAVE_GETOPT_LONG
+    printf(
+        _("  -C, --compact           Write RS274X as compactly as possible: merge\n"
+          "                          tracks, write equal apertures once and panels\n"
+          "                          of copies with a step and repeat.\n")
+    );
+#else
+    printf(
+        _("  -C                      Write RS274X as compactly as possible: merge\n"
+          "                          tracks, write equal apertures once and panels\n"
+          "                          of copies with a step and repeat.\n")
+    );
+#endif
+
+#ifdef HAVE_GETOPT_LONG
+    printf(
+        _("  -S, --sort-drills=<file|hilbert>\n"
+          "                          Write the holes of each tool in file order, or\n"
+          "                          along a Hilbert curve to shorten the travel,\n"
+          "                          and print the travel when exporting drill.\n")
+    );
+#else
+    printf(
+        _("  -S<file|hilbert>        Write the holes of each tool in file order, or\n"
+          "                          along a Hilbert curve to shorten the travel,\n"
+          "                          and print the travel when exporting drill.\n")
+    );
+#endif
+
 #ifdef HAVE_GETOPT_LONG
     printf(_("  -h, --help              Print this help message.\n"));
 #else
@@ -1289,15 +1284,93 @@ gerbv_print_help(void) {
 
 #ifdef HAVE_GETOPT_LONG
     printf(
-        _("  -x, --export=<png|pdf|ps|svg|rs274x|drill|idrill>\n"
+        _("  -x, --export=<png|pdf|ps|svg|rs274x|drill|idrill|svg-native|pdf-native>\n"
           "                          Export a rendered picture to a file with\n"
-          "                          the specified format.\n")
+          "                          the specified format. svg-native and pdf-native\n"
+          "                          write SVG and PDF with gerbv's own writers,\n"
+          "                          defining every flashed aperture once.\n")
     );
 #else
     printf(
         _("  -x<png|pdf|ps|svg|      Export a rendered picture to a file with\n"
-          "     rs274x|drill|        the specified format.\n"
-          "     idrill>\n")
+          "     rs274x|drill|        the specified format. svg-native and pdf-native\n"
+          "     idrill|svg-native|   write SVG and PDF with gerbv's own writers,\n"
+          "     pdf-native>          defining every flashed aperture once.\n")
+    );
+#endif
+
+#ifdef HAVE_GETOPT_LONG
+    printf(
+        _("  -L, --split-layers=<all|N,M,...>\n"
+          "                          Export each of the given layers, numbered from 1,\n"
+          "                          on its own: to a page each with -x pdf or\n"
+          "                          pdf-native, else to files named after the\n"
+          "                          output file with \"-N\" added before the\n"
+          "                          extension.\n")
+    );
+#else
+    printf(
+        _("  -L<all|N,M,...>         Export each of the given layers, numbered from 1,\n"
+          "                          on its own: to a page each with -x pdf or\n"
+          "                          pdf-native, else to files named after the\n"
+          "                          output file with \"-N\" added before the\n"
+          "                          extension.\n")
+    );
+#endif
+
+#ifdef HAVE_GETOPT_LONG
+    printf(
+        _("  -j, --batch=<jobfile>   Run the exports listed in <jobfile> concurrently,\n"
+          "                          one \"<format> <filename> [options]\" per line,\n"
+          "                          and print the time each one took.\n")
+    );
+#else
+    printf(
+        _("  -j<jobfile>             Run the exports listed in <jobfile> concurrently,\n"
+          "                          one \"<format> <filename> [options]\" per line,\n"
+          "                          and print the time each one took.\n")
     );
 #endif
 }
+
+/* ------------------------------------------------------------------ */
+static void
+gerbv_print_memory_report(gerbv_project_t* project) {
+    gerbv_memory_usage_t total;
+    int                  i;
+
+    memset(&total, 0, sizeof(total));
+
+    printf(
+        _("Memory used by the loaded layers, in KiB:\n"
+          "%10s %10s %8s %8s %9s %10s %8s %8s %8s %8s %10s  %s\n"),
+        _("nets"), _("count"), _("arcs"), _("labels"), _("apertures"), _("macros"), _("layers"), _("stats"),
+        _("caches"), _("surfaces"), _("total"), _("file")
+    );
+
+    for (i = 0; i <= project->last_loaded; i++) {
+        gerbv_memory_usage_t usage;
+
+        if (project->file[i] == NULL)
+            continue;
+
+        memset(&usage, 0, sizeof(usage));
+        gerbv_fileinfo_add_memory_usage(project->file[i], &usage);
+        printf(
+            "%10lu %10u %8lu %8lu %9lu %10lu %8lu %8lu %8lu %8lu %10lu  %s%s\n", (gulong)(usage.nets / 1024),
+            usage.n_nets, (gulong)(usage.cirsegs / 1024), (gulong)(usage.labels / 1024),
+            (gulong)(usage.apertures / 1024), (gulong)((usage.simplified + usage.amacros) / 1024),
+            (gulong)(usage.layers / 1024), (gulong)(usage.stats / 1024), (gulong)(usage.caches / 1024),
+            (gulong)(usage.surfaces / 1024), (gulong)(usage.total / 1024), project->file[i]->name,
+            project->file[i]->loadFailed ? _(" (failed to load)")
+            : project->file[i]->deferred ? _(" (not parsed yet)")
+                                         : ""
+        );
+    }
+
+    gerbv_project_get_memory_usage(project, &total);
+    printf(
+        _("Total: %.1f MiB in %u nets and %u apertures\n"), total.total / (1024.0 * 1024.0), total.n_nets,
+        total.n_apertures
+    );
+}
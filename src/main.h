@@ -68,6 +68,9 @@ typedef enum {
 typedef struct {
     GtkWidget* drawing_area;
     GdkPixmap* pixmap;
+    GdkPixmap* exposePixmap; /* window sized, to put exposed areas together in */
+    GdkPixmap* colorStamp;   /* scratch pixmaps of the GDK renderer */
+    GdkPixmap* clipmask;
     GdkColor   zoom_outline_color;
     GdkColor   dist_measure_color;
     GdkColor   selection_color;
@@ -78,6 +81,7 @@ typedef struct {
         GtkWidget*         messageTextView;
         GtkWidget*         statusMessageLeft;
         GtkWidget*         statusMessageRight;
+        GtkWidget*         statusMessageMemory;
         GtkWidget*         statusUnitComboBox;
         GtkCheckMenuItem** menu_view_unit_group;
         GtkWidget*         layerTree;
@@ -34,10 +34,14 @@
 
 #include "gerber.h"
 #include "common.h"
-#include "csv.h"
 #include "pick-and-place.h"
 
-static gerbv_net_t* pnp_new_net(gerbv_net_t* net);
+/* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
+#define dprintf \
+    if (DEBUG)  \
+    printf
+
+static gerbv_net_t* pnp_new_net(gerbv_image_t* image, gerbv_net_t* net);
 static void         pnp_reset_bbox(gerbv_net_t* net);
 static void         pnp_init_net(
             gerbv_net_t* net, gerbv_image_t* image, const char* label, gerbv_aperture_state_t apert_state,
@@ -132,9 +136,17 @@ pick_and_place_get_float_unit(const char* str, const char* def_unit) {
           0,
     };
     const char* unit = unit_str;
+    char*       end;
+    int         len;
 
     /* float, optional space, optional unit mm,cm,in,mil */
-    sscanf(str, "%lf %40s", &x, unit_str);
+    x = g_ascii_strtod(str, &end);
+    if (end != str) {
+        while (isspace((unsigned char)*end))
+            end++;
+        for (len = 0; len < 40 && end[len] != '\0' && !isspace((unsigned char)end[len]); len++)
+            unit_str[len] = end[len];
+    }
 
     if (unit_str[0] == '\0')
         unit = def_unit;
@@ -201,11 +213,304 @@ pick_and_place_screen_for_delimiter(char* str, int n) {
     }
 } /* pick_and_place_screen_for_delimiter */
 
+/* A field of a row, pointing into the file */
+typedef struct {
+    const char* start;   /* First character of the field, without the quotes */
+    gsize       len;     /* Length of the field, including escaped quotes */
+    gboolean    escaped; /* TRUE if the field contains "" pairs that stand for one " */
+} pnp_field_t;
+
+/* Columns of the parsed data, in the order of the Protel/Altium export */
+typedef enum {
+    PNP_COLUMN_DESIGNATOR,
+    PNP_COLUMN_FOOTPRINT,
+    PNP_COLUMN_MID_X,
+    PNP_COLUMN_MID_Y,
+    PNP_COLUMN_REF_X,
+    PNP_COLUMN_REF_Y,
+    PNP_COLUMN_PAD_X,
+    PNP_COLUMN_PAD_Y,
+    PNP_COLUMN_LAYER,
+    PNP_COLUMN_ROTATION,
+    PNP_COLUMN_COMMENT,
+    PNP_COLUMN_COUNT
+} pnp_column_t;
+
+/* Most fields a row is split into */
+#define PNP_MAX_FIELDS 32
+
+/* Header names of the columns, lower case without spaces, '-', '_' and '.' */
+static const struct {
+    const char*  name;
+    pnp_column_t column;
+} pnp_column_names[] = {
+    {"designator", PNP_COLUMN_DESIGNATOR},
+    {    "refdes", PNP_COLUMN_DESIGNATOR},
+    {       "ref", PNP_COLUMN_DESIGNATOR},
+    { "reference", PNP_COLUMN_DESIGNATOR},
+    { "footprint",  PNP_COLUMN_FOOTPRINT},
+    {   "package",  PNP_COLUMN_FOOTPRINT},
+    {   "pattern",  PNP_COLUMN_FOOTPRINT},
+    {      "midx",      PNP_COLUMN_MID_X},
+    {   "centerx",      PNP_COLUMN_MID_X},
+    {      "posx",      PNP_COLUMN_MID_X},
+    {         "x",      PNP_COLUMN_MID_X},
+    {      "midy",      PNP_COLUMN_MID_Y},
+    {   "centery",      PNP_COLUMN_MID_Y},
+    {      "posy",      PNP_COLUMN_MID_Y},
+    {         "y",      PNP_COLUMN_MID_Y},
+    {      "refx",      PNP_COLUMN_REF_X},
+    {      "refy",      PNP_COLUMN_REF_Y},
+    {      "padx",      PNP_COLUMN_PAD_X},
+    {      "pady",      PNP_COLUMN_PAD_Y},
+    {     "layer",      PNP_COLUMN_LAYER},
+    {        "tb",      PNP_COLUMN_LAYER},
+    {      "side",      PNP_COLUMN_LAYER},
+    {  "rotation",   PNP_COLUMN_ROTATION},
+    {       "rot",   PNP_COLUMN_ROTATION},
+    {     "angle",   PNP_COLUMN_ROTATION},
+    {   "comment",    PNP_COLUMN_COMMENT},
+    {     "value",    PNP_COLUMN_COMMENT},
+    {       "val",    PNP_COLUMN_COMMENT},
+};
+
+/* Reads a file line by line, in place when it is in memory */
+typedef struct {
+    gerb_file_t* fd;
+    const char*  start; /* where reading started */
+    const char*  ptr;   /* the unread rest of the file, or NULL if it is streamed */
+    const char*  end;   /* the end of the file */
+    GString*     line;  /* the current line of a streamed file */
+} pnp_reader_t;
+
+static void
+pnp_reader_init(pnp_reader_t* reader, gerb_file_t* fd) {
+    goffset len;
+
+    reader->fd    = fd;
+    reader->start = reader->ptr = gerb_fbuffer(fd, &len);
+    reader->end                 = reader->ptr != NULL ? reader->ptr + len : NULL;
+    reader->line                = NULL;
+}
+
+/* Return the next line of the file in line and len, without its line end.
+ * Lines of streamed files are only valid until the next call. */
+static gboolean
+pnp_reader_next(pnp_reader_t* reader, const char** line, gsize* len) {
+    const char* eol;
+
+    if (reader->ptr == NULL) {
+        char buf[4096];
+
+        if (reader->line == NULL)
+            reader->line = g_string_new(NULL);
+        g_string_truncate(reader->line, 0);
+
+        /* gerb_fgets() stops at a '\n' or after sizeof(buf) - 1 characters */
+        do {
+            goffset before = reader->fd->ptr;
+
+            if (gerb_fgets(buf, sizeof(buf), reader->fd) == NULL)
+                break;
+            g_string_append_len(reader->line, buf, reader->fd->ptr - before);
+        } while (reader->line->str[reader->line->len - 1] != '\n');
+
+        if (reader->line->len == 0)
+            return FALSE;
+
+        *line = reader->line->str;
+        *len  = reader->line->len;
+        if (reader->line->str[*len - 1] == '\n')
+            (*len)--;
+    } else {
+        if (reader->ptr >= reader->end)
+            return FALSE;
+
+        *line = reader->ptr;
+        eol   = memchr(reader->ptr, '\n', reader->end - reader->ptr);
+        if (eol == NULL) {
+            *len        = reader->end - reader->ptr;
+            reader->ptr = reader->end;
+        } else {
+            *len        = eol - reader->ptr;
+            reader->ptr = eol + 1;
+        }
+    }
+
+    if (*len > 0 && (*line)[*len - 1] == '\r')
+        (*len)--;
+
+    return TRUE;
+}
+
+/* Count the lines left in a file that is in memory, or return 0 */
+static gsize
+pnp_reader_count_lines(const pnp_reader_t* reader) {
+    const char* p;
+    gsize       n = 0;
+
+    if (reader->ptr == NULL)
+        return 0;
+
+    for (p = reader->ptr; p < reader->end && (p = memchr(p, '\n', reader->end - p)) != NULL; p++)
+        n++;
+
+    return n;
+}
+
+static void
+pnp_reader_done(pnp_reader_t* reader) {
+    if (reader->ptr != NULL)
+        reader->fd->ptr += reader->ptr - reader->start;
+    if (reader->line != NULL)
+        g_string_free(reader->line, TRUE);
+}
+
+/* Split a line into at most maxFields comma separated fields, the same way
+ * csv_row_parse() does with CSV_QUOTES. Returns the number of fields, or -1
+ * if the line isn't a valid row. */
+static int
+pnp_split_row(const char* line, gsize len, pnp_field_t* fields, int maxFields) {
+    const char* p   = line;
+    const char* end = line + len;
+    int         n   = 0;
+
+    /* csv_row_parse() stops at the end of the string */
+    if ((end = memchr(line, '\0', len)) == NULL)
+        end = line + len;
+
+    while (n < maxFields) {
+        pnp_field_t* field = &fields[n];
+        const char*  q     = p;
+
+        /* leading white space belongs to the field, unless it is quoted */
+        while (q < end && *q != ',' && isspace((unsigned char)*q))
+            q++;
+
+        if (q < end && *q == '"') {
+            field->start   = ++q;
+            field->escaped = FALSE;
+            while (1) {
+                q = memchr(q, '"', end - q);
+                if (q == NULL)
+                    return -1; /* no end quote */
+                if (q + 1 < end && q[1] == '"') {
+                    field->escaped = TRUE;
+                    q += 2;
+                    continue;
+                }
+                break;
+            }
+            field->len = q - field->start;
+
+            /* only white space may follow the end quote */
+            for (q++; q < end && *q != ','; q++) {
+                if (!isspace((unsigned char)*q))
+                    return -1;
+            }
+        } else {
+            if (q >= end)
+                return -1; /* nothing after the last separator */
+
+            field->start   = p;
+            field->escaped = FALSE;
+            q              = memchr(q, ',', end - q);
+            if (q == NULL)
+                q = end;
+            if (memchr(p, '"', q - p) != NULL)
+                return -1; /* quote inside an unquoted field */
+            field->len = q - p;
+        }
+        n++;
+
+        if (q >= end)
+            break;
+        p = q + 1;
+    }
+
+    /* rows need at least four fields */
+    return n < 4 ? -1 : n;
+}
+
+/* Copy a field into dest, of size bytes, truncating it if needed */
+static void
+pnp_field_copy(const pnp_field_t* field, char* dest, gsize size) {
+    gsize i, j;
+
+    for (i = j = 0; i < field->len && j + 1 < size; i++) {
+        dest[j++] = field->start[i];
+        if (field->escaped && field->start[i] == '"')
+            i++;
+    }
+    dest[j] = '\0';
+}
+
+/* Like pick_and_place_get_float_unit(), for a field */
+static double
+pnp_field_get_float_unit(const pnp_field_t* field, const char* def_unit) {
+    char str[MAXL];
+
+    pnp_field_copy(field, str, sizeof(str) - 1);
+    return pick_and_place_get_float_unit(str, def_unit);
+}
+
+/* Map the columns named in the header to the parsed data. Returns FALSE if
+ * the header doesn't name all the columns needed to place a part. */
+static gboolean
+pnp_map_columns(const char* line, gsize len, int columns[PNP_COLUMN_COUNT], int* nFields, char* def_unit) {
+    pnp_field_t fields[PNP_MAX_FIELDS];
+    int         n, i, c;
+
+    for (c = 0; c < PNP_COLUMN_COUNT; c++)
+        columns[c] = -1;
+
+    n = pnp_split_row(line, len, fields, PNP_MAX_FIELDS);
+    for (i = 0; i < n; i++) {
+        char  name[MAXL], unit[MAXL] = "";
+        char* paren;
+        gsize j, k;
+
+        pnp_field_copy(&fields[i], name, sizeof(name));
+
+        /* "Mid X(mm)", "Center-X (mil)" */
+        if ((paren = strchr(name, '(')) != NULL) {
+            sscanf(paren + 1, "%[a-zA-Z]", unit);
+            *paren = '\0';
+        }
+
+        for (j = k = 0; name[j]; j++) {
+            if (!isspace((unsigned char)name[j]) && !strchr("-_.", name[j]))
+                name[k++] = g_ascii_tolower(name[j]);
+        }
+        name[k] = '\0';
+
+        for (c = 0; c < (int)G_N_ELEMENTS(pnp_column_names); c++) {
+            if (strcmp(name, pnp_column_names[c].name) == 0 && columns[pnp_column_names[c].column] < 0) {
+                columns[pnp_column_names[c].column] = i;
+                if (pnp_column_names[c].column == PNP_COLUMN_MID_X && unit[0] != '\0' && def_unit[0] == '\0')
+                    g_strlcpy(def_unit, unit, 41);
+                break;
+            }
+        }
+    }
+
+    if (columns[PNP_COLUMN_DESIGNATOR] < 0 || columns[PNP_COLUMN_MID_X] < 0 || columns[PNP_COLUMN_MID_Y] < 0
+        || columns[PNP_COLUMN_LAYER] < 0 || columns[PNP_COLUMN_ROTATION] < 0)
+        return FALSE;
+
+    *nFields = 0;
+    for (c = 0; c < PNP_COLUMN_COUNT; c++)
+        *nFields = MAX(*nFields, columns[c] + 1);
+
+    return TRUE;
+}
+
 /**Parses the PNP data.
    two lists are filled with the row data.\n One for the scrollable list in the search and select parts interface, the
    other one a mere two columned list, which drives the autocompletion when entering a search.\n It also tries to
    determine the shape of a part and sets  pnp_state->shape accordingly which will be used when drawing the selections
-   as an overlay on screen.
+   as an overlay on screen.\n The first line is read as a header, and if it names the columns, they are taken from
+   there. Otherwise the Protel/Altium and PCB column orders are recognized.
    @return the initial node of the pnp_state netlist
  */
 
@@ -213,19 +518,24 @@ GArray*
 pick_and_place_parse_file(gerb_file_t* fd) {
     PnpPartData pnpPartData;
     memset(&pnpPartData, 0, sizeof(PnpPartData));
-    int   lineCounter = 0, parsedLines = 0;
-    int   ret;
-    char* row[12];
-    char  buf[MAXL + 2], buf0[MAXL + 2];
-    char  def_unit[41] = {
-         0,
+    int         lineCounter = 0, parsedLines = 0;
+    int         ret;
+    pnp_field_t row[PNP_MAX_FIELDS];
+    char        def_unit[41] = {
+        0,
     };
     double          tmp_x, tmp_y;
     gerbv_transf_t* tr_rot            = gerb_transf_new();
-    GArray*         pnpParseDataArray = g_array_new(FALSE, FALSE, sizeof(PnpPartData));
+    GArray*         pnpParseDataArray = NULL;
     gboolean        foundValidDataRow = FALSE;
     /* Unit declaration for "PcbXY Version 1.0" files as exported by pcb */
-    const char* def_unit_prefix = "# X,Y in ";
+    const char*  def_unit_prefix = "# X,Y in ";
+    int          columns[PNP_COLUMN_COUNT];
+    int          nFields = 11;
+    gboolean     mapped  = FALSE;
+    const char*  line;
+    gsize        len;
+    pnp_reader_t reader;
 
     /*
      * many locales redefine "." as "," and so on, so sscanf has problems when
@@ -233,113 +543,154 @@ pick_and_place_parse_file(gerb_file_t* fd) {
      */
     setlocale(LC_NUMERIC, "C");
 
-    while (fgets(buf, MAXL, fd->fd) != NULL) {
-        int len      = strlen(buf) - 1;
+    /* size the array once for files that are in memory */
+    pnp_reader_init(&reader, fd);
+    pnpParseDataArray = g_array_sized_new(FALSE, FALSE, sizeof(PnpPartData), pnp_reader_count_lines(&reader) + 1);
+
+    while (pnp_reader_next(&reader, &line, &len)) {
         int i_length = 0, i_width = 0;
 
         lineCounter += 1; /*next line*/
         if (lineCounter < 2) {
-            /*
-             * TODO in principle column names could be read and interpreted
-             * but we skip the first line with names of columns for this time
-             */
+            mapped = pnp_map_columns(line, len, columns, &nFields, def_unit);
+            dprintf("%s(): %s header\n", __FUNCTION__, mapped ? "Using" : "Ignoring");
             continue;
         }
-        if (len >= 0 && buf[len] == '\n') {
-            buf[len--] = 0;
-        }
-        if (len >= 0 && buf[len] == '\r') {
-            buf[len--] = 0;
-        }
-        if (0 == strncmp(buf, def_unit_prefix, strlen(def_unit_prefix))) {
-            sscanf(&buf[strlen(def_unit_prefix)], "%40s.", def_unit);
+        if (len >= strlen(def_unit_prefix) && 0 == strncmp(line, def_unit_prefix, strlen(def_unit_prefix))) {
+            char  unit_line[MAXL];
+            gsize n = MIN(len - strlen(def_unit_prefix), MAXL - 1);
+
+            memcpy(unit_line, line + strlen(def_unit_prefix), n);
+            unit_line[n] = '\0';
+            sscanf(unit_line, "%40s.", def_unit);
         }
-        if (len <= 11) {  // lets check a minimum length of 11
+        if (len < 13) {  // rows are at least 13 characters long
             continue;
         }
 
-        if ((len > 0) && (buf[0] == '%')) {
+        if (line[0] == '%') {
             continue;
         }
 
         /* Abort if we see a G54 */
-        if ((len > 4) && (strncmp(buf, "G54 ", 4) == 0)) {
+        if (strncmp(line, "G54 ", 4) == 0) {
             g_array_free(pnpParseDataArray, TRUE);
-            return NULL;
+            pnpParseDataArray = NULL;
+            break;
         }
 
         /* abort if we see a G04 code */
-        if ((len > 4) && (strncmp(buf, "G04 ", 4) == 0)) {
+        if (strncmp(line, "G04 ", 4) == 0) {
             g_array_free(pnpParseDataArray, TRUE);
-            return NULL;
+            pnpParseDataArray = NULL;
+            break;
         }
 
         /* this accepts file both with and without quotes */
-        /* 	if (!pnp_state) { /\* we are in first line *\/ */
-        /* 	   if ((delimiter = pnp_screen_for_delimiter(buf, 8)) < 0) { */
-        /* 	   continue; */
-        /* 	   } */
-        /* 	} */
-
-        ret = csv_row_parse(buf, MAXL, buf0, MAXL, row, 11, ',', CSV_QUOTES);
+        ret = pnp_split_row(line, len, row, nFields);
 
         if (ret > 0) {
             foundValidDataRow = TRUE;
         } else {
             continue;
         }
-        /* 	printf("direct:%s, %s, %s, %s, %s, %s, %s, %s, %s, %s,  %s, ret %d\n", row[0], row[1], row[2],row[3],
-         * row[4], row[5], row[6], row[7], row[8], row[9], row[10], ret);        */
-        /* 	g_warning ("FFF %s %s\n",row[8],row[6]); */
-
-        if (row[0] && row[8]) {  // here could be some better check for the syntax
-            snprintf(pnpPartData.designator, sizeof(pnpPartData.designator) - 1, "%s", row[0]);
-            snprintf(pnpPartData.footprint, sizeof(pnpPartData.footprint) - 1, "%s", row[1]);
-            snprintf(pnpPartData.layer, sizeof(pnpPartData.layer) - 1, "%s", row[8]);
-            if (row[10] != NULL) {
-                if (!g_utf8_validate(row[10], -1, NULL)) {
-                    gchar* str = g_convert(row[10], strlen(row[10]), "UTF-8", "ISO-8859-1", NULL, NULL, NULL);
-                    // I have not decided yet whether it is better to use always
-                    // "ISO-8859-1" or current locale.
-                    // str = g_locale_to_utf8(row[10], -1, NULL, NULL, NULL);
-                    snprintf(pnpPartData.comment, sizeof(pnpPartData.comment) - 1, "%s", str);
-                    g_free(str);
-                } else {
-                    snprintf(pnpPartData.comment, sizeof(pnpPartData.comment) - 1, "%s", row[10]);
+
+        if (mapped) {
+            int c;
+
+            if (columns[PNP_COLUMN_ROTATION] >= ret || columns[PNP_COLUMN_LAYER] >= ret)
+                continue;
+
+            memset(&pnpPartData, 0, sizeof(PnpPartData));
+            for (c = 0; c < PNP_COLUMN_COUNT; c++) {
+                const pnp_field_t* field = columns[c] >= 0 && columns[c] < ret ? &row[columns[c]] : NULL;
+
+                if (field == NULL)
+                    continue;
+
+                switch (c) {
+                    case PNP_COLUMN_DESIGNATOR:
+                        pnp_field_copy(field, pnpPartData.designator, sizeof(pnpPartData.designator) - 1);
+                        break;
+                    case PNP_COLUMN_FOOTPRINT:
+                        pnp_field_copy(field, pnpPartData.footprint, sizeof(pnpPartData.footprint) - 1);
+                        break;
+                    case PNP_COLUMN_LAYER:
+                        pnp_field_copy(field, pnpPartData.layer, sizeof(pnpPartData.layer) - 1);
+                        break;
+                    case PNP_COLUMN_COMMENT:
+                        pnp_field_copy(field, pnpPartData.comment, sizeof(pnpPartData.comment) - 1);
+                        break;
+                    case PNP_COLUMN_MID_X: pnpPartData.mid_x = pnp_field_get_float_unit(field, def_unit); break;
+                    case PNP_COLUMN_MID_Y: pnpPartData.mid_y = pnp_field_get_float_unit(field, def_unit); break;
+                    case PNP_COLUMN_REF_X: pnpPartData.ref_x = pnp_field_get_float_unit(field, def_unit); break;
+                    case PNP_COLUMN_REF_Y: pnpPartData.ref_y = pnp_field_get_float_unit(field, def_unit); break;
+                    case PNP_COLUMN_PAD_X: pnpPartData.pad_x = pnp_field_get_float_unit(field, def_unit); break;
+                    case PNP_COLUMN_PAD_Y: pnpPartData.pad_y = pnp_field_get_float_unit(field, def_unit); break;
+                    case PNP_COLUMN_ROTATION:
+                        {
+                            char rotation[MAXL];
+
+                            pnp_field_copy(field, rotation, sizeof(rotation) - 1);
+                            /* CVE-2021-40403
+                             */
+                            if (1 != sscanf(rotation, "%lf", &pnpPartData.rotation)) {  // no units, always deg
+                                g_array_free(pnpParseDataArray, TRUE);
+                                pnpParseDataArray = NULL;
+                            }
+                        }
+                        break;
                 }
             }
-            /*
-              gchar* g_convert(const gchar *str, gssize len, const gchar *to_codeset, const gchar *from_codeset, gsize
-              *bytes_read, gsize *bytes_written, GError **error);
-            */
-            pnpPartData.mid_x = pick_and_place_get_float_unit(row[2], def_unit);
-            pnpPartData.mid_y = pick_and_place_get_float_unit(row[3], def_unit);
-            pnpPartData.ref_x = pick_and_place_get_float_unit(row[4], def_unit);
-            pnpPartData.ref_y = pick_and_place_get_float_unit(row[5], def_unit);
-            pnpPartData.pad_x = pick_and_place_get_float_unit(row[6], def_unit);
-            pnpPartData.pad_y = pick_and_place_get_float_unit(row[7], def_unit);
+            if (pnpParseDataArray == NULL)
+                break;
+
+            /* without pad positions, guess like for PCB files */
+            if (columns[PNP_COLUMN_PAD_X] < 0 || columns[PNP_COLUMN_PAD_X] >= ret)
+                pnpPartData.pad_x = pnpPartData.mid_x + 0.03;
+            if (columns[PNP_COLUMN_PAD_Y] < 0 || columns[PNP_COLUMN_PAD_Y] >= ret)
+                pnpPartData.pad_y = pnpPartData.mid_y + 0.03;
+        } else if (ret > 8) {  // here could be some better check for the syntax
+            pnp_field_copy(&row[0], pnpPartData.designator, sizeof(pnpPartData.designator) - 1);
+            pnp_field_copy(&row[1], pnpPartData.footprint, sizeof(pnpPartData.footprint) - 1);
+            pnp_field_copy(&row[8], pnpPartData.layer, sizeof(pnpPartData.layer) - 1);
+            if (ret > 10) {
+                pnp_field_copy(&row[10], pnpPartData.comment, sizeof(pnpPartData.comment) - 1);
+            }
+            pnpPartData.mid_x = pnp_field_get_float_unit(&row[2], def_unit);
+            pnpPartData.mid_y = pnp_field_get_float_unit(&row[3], def_unit);
+            pnpPartData.ref_x = pnp_field_get_float_unit(&row[4], def_unit);
+            pnpPartData.ref_y = pnp_field_get_float_unit(&row[5], def_unit);
+            pnpPartData.pad_x = pnp_field_get_float_unit(&row[6], def_unit);
+            pnpPartData.pad_y = pnp_field_get_float_unit(&row[7], def_unit);
             /* This line causes segfault if we accidently starts parsing
              * a gerber file. It is crap crap crap */
-            if (row[9]) {
-                const int rc = sscanf(row[9], "%lf", &pnpPartData.rotation);  // no units, always deg
+            if (ret > 9) {
+                char rotation[MAXL];
+
+                pnp_field_copy(&row[9], rotation, sizeof(rotation) - 1);
+                const int rc = sscanf(rotation, "%lf", &pnpPartData.rotation);  // no units, always deg
 
                 /* CVE-2021-40403
                  */
                 if (1 != rc) {
                     g_array_free(pnpParseDataArray, TRUE);
-                    return NULL;
+                    pnpParseDataArray = NULL;
+                    break;
                 }
             }
         }
         /* for now, default back to PCB program format
          * TODO: implement better checking for format
          */
-        else if (row[0] && row[1] && row[2] && row[3] && row[4] && row[5] && row[6]) {
-            snprintf(pnpPartData.designator, sizeof(pnpPartData.designator) - 1, "%s", row[0]);
-            snprintf(pnpPartData.footprint, sizeof(pnpPartData.footprint) - 1, "%s", row[1]);
-            snprintf(pnpPartData.layer, sizeof(pnpPartData.layer) - 1, "%s", row[6]);
-            pnpPartData.mid_x = pick_and_place_get_float_unit(row[3], def_unit);
-            pnpPartData.mid_y = pick_and_place_get_float_unit(row[4], def_unit);
+        else if (ret > 6) {
+            char rotation[MAXL];
+
+            pnp_field_copy(&row[0], pnpPartData.designator, sizeof(pnpPartData.designator) - 1);
+            pnp_field_copy(&row[1], pnpPartData.footprint, sizeof(pnpPartData.footprint) - 1);
+            pnp_field_copy(&row[6], pnpPartData.layer, sizeof(pnpPartData.layer) - 1);
+            pnpPartData.mid_x = pnp_field_get_float_unit(&row[3], def_unit);
+            pnpPartData.mid_y = pnp_field_get_float_unit(&row[4], def_unit);
             pnpPartData.pad_x = pnpPartData.mid_x + 0.03;
             pnpPartData.pad_y = pnpPartData.mid_y + 0.03;
 
@@ -352,15 +703,28 @@ pick_and_place_parse_file(gerb_file_t* fd) {
 
             /* CVE-2021-40403
              */
-            const int rc = sscanf(row[5], "%lf", &pnpPartData.rotation);  // no units, always deg
+            pnp_field_copy(&row[5], rotation, sizeof(rotation) - 1);
+            const int rc = sscanf(rotation, "%lf", &pnpPartData.rotation);  // no units, always deg
             if (1 != rc) {
                 g_array_free(pnpParseDataArray, TRUE);
-                return NULL;
+                pnpParseDataArray = NULL;
+                break;
             }
         } else {
             continue;
         }
 
+        if (!g_utf8_validate(pnpPartData.comment, -1, NULL)) {
+            gchar* str = g_convert(
+                pnpPartData.comment, strlen(pnpPartData.comment), "UTF-8", "ISO-8859-1", NULL, NULL, NULL
+            );
+            // I have not decided yet whether it is better to use always
+            // "ISO-8859-1" or current locale.
+            // str = g_locale_to_utf8(row[10], -1, NULL, NULL, NULL);
+            snprintf(pnpPartData.comment, sizeof(pnpPartData.comment) - 1, "%s", str);
+            g_free(str);
+        }
+
         /*
          * now, try and figure out the actual footprint shape to draw, or just
          * guess something reasonable
@@ -390,11 +754,10 @@ pick_and_place_parse_file(gerb_file_t* fd) {
         parsedLines += 1;
     }
     gerb_transf_free(tr_rot);
-    /* fd->ptr=0; */
-    /* rewind(fd->fd); */
+    pnp_reader_done(&reader);
 
     /* so a sanity check and see if this is a valid pnp file */
-    if ((((float)parsedLines / (float)lineCounter) < 0.3) || (!foundValidDataRow)) {
+    if (pnpParseDataArray != NULL && ((((float)parsedLines / (float)lineCounter) < 0.3) || (!foundValidDataRow))) {
         /* this doesn't look like a valid PNP file, so return error */
         g_array_free(pnpParseDataArray, TRUE);
         return NULL;
@@ -413,99 +776,94 @@ pick_and_place_parse_file(gerb_file_t* fd) {
  */
 gboolean
 pick_and_place_check_file_type(gerb_file_t* fd, gboolean* returnFoundBinary) {
-    char*    buf;
-    int      len = 0;
-    int      i;
-    char*    letter;
-    gboolean found_binary    = FALSE;
-    gboolean found_G54       = FALSE;
-    gboolean found_M0        = FALSE;
-    gboolean found_M2        = FALSE;
-    gboolean found_G2        = FALSE;
-    gboolean found_ADD       = FALSE;
-    gboolean found_comma     = FALSE;
-    gboolean found_R         = FALSE;
-    gboolean found_U         = FALSE;
-    gboolean found_C         = FALSE;
-    gboolean found_boardside = FALSE;
-
-    buf = malloc(MAXL);
-    if (buf == NULL)
-        GERB_FATAL_ERROR("malloc buf failed in %s()", __FUNCTION__);
-
-    while (fgets(buf, MAXL, fd->fd) != NULL) {
-        len = strlen(buf);
-
-        /* First look through the file for indications of its type */
-
-        /* check for non-binary file */
-        for (i = 0; i < len; i++) {
-            if (!isprint((int)buf[i]) && (buf[i] != '\r') && (buf[i] != '\n') && (buf[i] != '\t')) {
+    const char*  buf;
+    gsize        len = 0;
+    gsize        i;
+    gboolean     found_binary    = FALSE;
+    gboolean     found_G54       = FALSE;
+    gboolean     found_M0        = FALSE;
+    gboolean     found_M2        = FALSE;
+    gboolean     found_G2        = FALSE;
+    gboolean     found_ADD       = FALSE;
+    gboolean     found_comma     = FALSE;
+    gboolean     found_R         = FALSE;
+    gboolean     found_U         = FALSE;
+    gboolean     found_C         = FALSE;
+    gboolean     found_boardside = FALSE;
+    pnp_reader_t reader;
+
+    pnp_reader_init(&reader, fd);
+    while (pnp_reader_next(&reader, &buf, &len)) {
+        gboolean seen_R = FALSE, seen_C = FALSE, seen_U = FALSE;
+
+        /* First look through the file for indications of its type, in a
+         * single pass over the line up to the first NUL */
+        for (i = 0; i < len && buf[i] != '\0'; i++) {
+            const char* next = buf + i + 1;
+            gsize       left = len - i - 1;
+
+            /* check for non-binary file */
+            if (!isprint((int)buf[i]) && (buf[i] != '\r') && (buf[i] != '\t')) {
                 found_binary = TRUE;
             }
-        }
 
-        if (g_strstr_len(buf, len, "G54")) {
-            found_G54 = TRUE;
-        }
-        if (g_strstr_len(buf, len, "M00")) {
-            found_M0 = TRUE;
-        }
-        if (g_strstr_len(buf, len, "M02")) {
-            found_M2 = TRUE;
-        }
-        if (g_strstr_len(buf, len, "G02")) {
-            found_G2 = TRUE;
-        }
-        if (g_strstr_len(buf, len, "ADD")) {
-            found_ADD = TRUE;
-        }
-        if (g_strstr_len(buf, len, ",")) {
-            found_comma = TRUE;
-        }
-        /* Semicolon can be separator too */
-        if (g_strstr_len(buf, len, ";")) {
-            found_comma = TRUE;
-        }
-
-        /* Look for refdes -- This is dumb, but what else can we do? */
-        if ((letter = g_strstr_len(buf, len, "R")) != NULL) {
-            if (isdigit((int)letter[1])) { /* grab char after R */
-                found_R = TRUE;
-            }
-        }
-        if ((letter = g_strstr_len(buf, len, "C")) != NULL) {
-            if (isdigit((int)letter[1])) { /* grab char after C */
-                found_C = TRUE;
-            }
-        }
-        if ((letter = g_strstr_len(buf, len, "U")) != NULL) {
-            if (isdigit((int)letter[1])) { /* grab char after U */
-                found_U = TRUE;
+            switch (buf[i]) {
+                case 'G':
+                    if (left >= 2 && (strncmp(next, "54", 2) == 0))
+                        found_G54 = TRUE;
+                    if (left >= 2 && (strncmp(next, "02", 2) == 0))
+                        found_G2 = TRUE;
+                    break;
+                case 'M':
+                    if (left >= 2 && (strncmp(next, "00", 2) == 0))
+                        found_M0 = TRUE;
+                    if (left >= 2 && (strncmp(next, "02", 2) == 0))
+                        found_M2 = TRUE;
+                    break;
+                case 'A':
+                    if (left >= 2 && strncmp(next, "DD", 2) == 0)
+                        found_ADD = TRUE;
+                    if (left >= 3 && strncmp(next, "YER", 3) == 0)
+                        found_boardside = TRUE;
+                    break;
+                /* Semicolon can be separator too */
+                case ',':
+                case ';': found_comma = TRUE; break;
+                /* Look for refdes -- This is dumb, but what else can we do?
+                 * Only the first R, C and U of a line count. */
+                case 'R':
+                    if (!seen_R && left >= 1 && isdigit((int)*next))
+                        found_R = TRUE;
+                    seen_R = TRUE;
+                    break;
+                case 'C':
+                    if (!seen_C && left >= 1 && isdigit((int)*next))
+                        found_C = TRUE;
+                    seen_C = TRUE;
+                    break;
+                case 'U':
+                    if (!seen_U && left >= 1 && isdigit((int)*next))
+                        found_U = TRUE;
+                    seen_U = TRUE;
+                    break;
+                /* Look for board side indicator since this is required
+                 * by many vendors */
+                case 't':
+                case 'T':
+                    if (left >= 2
+                        && (strncmp(next, "op", 2) == 0 || (buf[i] == 'T' && strncmp(next, "OP", 2) == 0)))
+                        found_boardside = TRUE;
+                    break;
+                /* Also look for evidence of "Layer" in header.... */
+                case 'a':
+                    if (left >= 3 && strncmp(next, "yer", 3) == 0)
+                        found_boardside = TRUE;
+                    break;
             }
         }
-
-        /* Look for board side indicator since this is required
-         * by many vendors */
-        if (g_strstr_len(buf, len, "top")) {
-            found_boardside = TRUE;
-        }
-        if (g_strstr_len(buf, len, "Top")) {
-            found_boardside = TRUE;
-        }
-        if (g_strstr_len(buf, len, "TOP")) {
-            found_boardside = TRUE;
-        }
-        /* Also look for evidence of "Layer" in header.... */
-        if (g_strstr_len(buf, len, "ayer")) {
-            found_boardside = TRUE;
-        }
-        if (g_strstr_len(buf, len, "AYER")) {
-            found_boardside = TRUE;
-        }
     }
-    rewind(fd->fd);
-    free(buf);
+    pnp_reader_done(&reader);
+    gerb_frewind(fd);
 
     /* Now form logical expression determining if this is a pick-place file */
     *returnFoundBinary = found_binary;
@@ -598,7 +956,7 @@ pick_and_place_convert_pnp_data_to_image(GArray* parsedPickAndPlaceData, gint bo
         PnpPartData partData = g_array_index(parsedPickAndPlaceData, PnpPartData, i);
         float       radius, labelOffset;
 
-        curr_net        = pnp_new_net(curr_net);
+        curr_net        = pnp_new_net(image, curr_net);
         curr_net->layer = image->layers;
         curr_net->state = image->states;
 
@@ -625,7 +983,7 @@ pick_and_place_convert_pnp_data_to_image(GArray* parsedPickAndPlaceData, gint bo
         if ((boardSide == 1) && !((partData.layer[0] == 't') || (partData.layer[0] == 'T')))
             continue;
 
-        curr_net = pnp_new_net(curr_net);
+        curr_net = pnp_new_net(image, curr_net);
         pnp_init_net(curr_net, image, partData.designator, GERBV_APERTURE_STATE_OFF, GERBV_INTERPOLATION_LINEARx1);
 
         /* First net of PNP is just a label holder, so calculate the lower left
@@ -640,7 +998,7 @@ pick_and_place_convert_pnp_data_to_image(GArray* parsedPickAndPlaceData, gint bo
         if ((partData.shape == PART_SHAPE_RECTANGLE) || (partData.shape == PART_SHAPE_STD)) {
             // TODO: draw rectangle length x width taking into account rotation or pad x,y
 
-            curr_net = pnp_new_net(curr_net);
+            curr_net = pnp_new_net(image, curr_net);
             pnp_init_net(curr_net, image, partData.designator, GERBV_APERTURE_STATE_ON, GERBV_INTERPOLATION_LINEARx1);
 
             gerb_transf_apply(partData.length / 2, partData.width / 2, tr_rot, &curr_net->start_x, &curr_net->start_y);
@@ -648,13 +1006,13 @@ pick_and_place_convert_pnp_data_to_image(GArray* parsedPickAndPlaceData, gint bo
 
             /* TODO: write unifying function */
 
-            curr_net = pnp_new_net(curr_net);
+            curr_net = pnp_new_net(image, curr_net);
             pnp_init_net(curr_net, image, partData.designator, GERBV_APERTURE_STATE_ON, GERBV_INTERPOLATION_LINEARx1);
 
             gerb_transf_apply(-partData.length / 2, partData.width / 2, tr_rot, &curr_net->start_x, &curr_net->start_y);
             gerb_transf_apply(-partData.length / 2, -partData.width / 2, tr_rot, &curr_net->stop_x, &curr_net->stop_y);
 
-            curr_net = pnp_new_net(curr_net);
+            curr_net = pnp_new_net(image, curr_net);
             pnp_init_net(curr_net, image, partData.designator, GERBV_APERTURE_STATE_ON, GERBV_INTERPOLATION_LINEARx1);
 
             gerb_transf_apply(
@@ -662,13 +1020,13 @@ pick_and_place_convert_pnp_data_to_image(GArray* parsedPickAndPlaceData, gint bo
             );
             gerb_transf_apply(partData.length / 2, -partData.width / 2, tr_rot, &curr_net->stop_x, &curr_net->stop_y);
 
-            curr_net = pnp_new_net(curr_net);
+            curr_net = pnp_new_net(image, curr_net);
             pnp_init_net(curr_net, image, partData.designator, GERBV_APERTURE_STATE_ON, GERBV_INTERPOLATION_LINEARx1);
 
             gerb_transf_apply(partData.length / 2, -partData.width / 2, tr_rot, &curr_net->start_x, &curr_net->start_y);
             gerb_transf_apply(partData.length / 2, partData.width / 2, tr_rot, &curr_net->stop_x, &curr_net->stop_y);
 
-            curr_net = pnp_new_net(curr_net);
+            curr_net = pnp_new_net(image, curr_net);
             pnp_init_net(curr_net, image, partData.designator, GERBV_APERTURE_STATE_ON, GERBV_INTERPOLATION_LINEARx1);
 
             if (partData.shape == PART_SHAPE_RECTANGLE) {
@@ -686,7 +1044,7 @@ pick_and_place_convert_pnp_data_to_image(GArray* parsedPickAndPlaceData, gint bo
                     partData.length / 4, partData.width / 4, tr_rot, &curr_net->stop_x, &curr_net->stop_y
                 );
 
-                curr_net = pnp_new_net(curr_net);
+                curr_net = pnp_new_net(image, curr_net);
                 pnp_init_net(
                     curr_net, image, partData.designator, GERBV_APERTURE_STATE_ON, GERBV_INTERPOLATION_LINEARx1
                 );
@@ -713,7 +1071,7 @@ pick_and_place_convert_pnp_data_to_image(GArray* parsedPickAndPlaceData, gint bo
             curr_net->stop_x = tmp_x;
             curr_net->stop_y = tmp_y;
 
-            curr_net = pnp_new_net(curr_net);
+            curr_net = pnp_new_net(image, curr_net);
             pnp_init_net(
                 curr_net, image, partData.designator, GERBV_APERTURE_STATE_ON, GERBV_INTERPOLATION_CW_CIRCULAR
             );
@@ -723,7 +1081,7 @@ pick_and_place_convert_pnp_data_to_image(GArray* parsedPickAndPlaceData, gint bo
             curr_net->stop_x  = partData.pad_x;
             curr_net->stop_y  = partData.pad_y;
 
-            curr_net->cirseg         = g_new0(gerbv_cirseg_t, 1);
+            curr_net->cirseg         = gerbv_image_new_cirseg(image);
             curr_net->cirseg->angle1 = 0.0;
             curr_net->cirseg->angle2 = 360.0;
             curr_net->cirseg->cp_x   = partData.mid_x;
@@ -777,9 +1135,9 @@ pick_and_place_parse_file_to_images(gerb_file_t* fd, gerbv_image_t** topImage, g
 } /* pick_and_place_parse_file_to_images */
 
 static gerbv_net_t*
-pnp_new_net(gerbv_net_t* net) {
+pnp_new_net(gerbv_image_t* image, gerbv_net_t* net) {
     gerbv_net_t* n;
-    net->next = g_new0(gerbv_net_t, 1);
+    net->next = gerbv_image_new_net(image);
     n         = net->next;
     assert(n != NULL);
 
@@ -808,6 +1166,6 @@ pnp_init_net(
     net->state          = image->states;
 
     if (strlen(label) > 0) {
-        net->label = g_string_new(label);
+        net->label = gerbv_image_intern_label(image, label);
     }
 }
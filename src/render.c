@@ -62,6 +62,7 @@
 #include <cairo-xlib.h>
 #endif
 #include "draw.h"
+#include "composite.h"
 
 #define dprintf \
     if (DEBUG)  \
@@ -69,6 +70,77 @@
 
 gerbv_render_info_t screenRenderInfo;
 
+/* Image surfaces kept between frames, so a refresh doesn't have to
+   reallocate a full-window buffer for every layer */
+static GSList* surfacePool = NULL;
+
+/* Size of screen.bufferSurface, which is not an image surface */
+static gint bufferSurfaceWidth = 0, bufferSurfaceHeight = 0;
+
+/* ------------------------------------------------------ */
+/* Return an image surface of the display size from the pool, or allocate
+   one if none match. Pooled surfaces of another size are stale after a
+   resize and get freed on the way. */
+static cairo_surface_t*
+render_pool_get_surface(cairo_format_t format, gboolean clear) {
+    cairo_surface_t* surface = NULL;
+    GSList*          item    = surfacePool;
+
+    while (item) {
+        cairo_surface_t* pooled = (cairo_surface_t*)item->data;
+        GSList*          next   = item->next;
+
+        if (cairo_image_surface_get_width(pooled) != screenRenderInfo.displayWidth
+            || cairo_image_surface_get_height(pooled) != screenRenderInfo.displayHeight) {
+            surfacePool = g_slist_delete_link(surfacePool, item);
+            cairo_surface_destroy(pooled);
+        } else if (!surface && cairo_image_surface_get_format(pooled) == format) {
+            surfacePool = g_slist_delete_link(surfacePool, item);
+            surface     = pooled;
+        }
+        item = next;
+    }
+
+    if (!surface)
+        return cairo_image_surface_create(format, screenRenderInfo.displayWidth, screenRenderInfo.displayHeight);
+
+    if (clear) {
+        cairo_surface_flush(surface);
+        memset(
+            cairo_image_surface_get_data(surface), 0,
+            (gsize)cairo_image_surface_get_stride(surface) * cairo_image_surface_get_height(surface)
+        );
+        cairo_surface_mark_dirty(surface);
+    }
+
+    return surface;
+}
+
+/* ------------------------------------------------------ */
+/* Hand a surface back to the pool for the next frame */
+static void
+render_pool_put_surface(cairo_surface_t* surface) {
+    if (!surface)
+        return;
+
+    if (cairo_surface_get_type(surface) != CAIRO_SURFACE_TYPE_IMAGE
+        || cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS
+        || cairo_image_surface_get_width(surface) != screenRenderInfo.displayWidth
+        || cairo_image_surface_get_height(surface) != screenRenderInfo.displayHeight) {
+        cairo_surface_destroy(surface);
+        return;
+    }
+
+    surfacePool = g_slist_prepend(surfacePool, surface);
+}
+
+/* ------------------------------------------------------ */
+static void
+render_pool_free(void) {
+    g_slist_free_full(surfacePool, (GDestroyNotify)cairo_surface_destroy);
+    surfacePool = NULL;
+}
+
 /* ------------------------------------------------------ */
 void
 render_zoom_display(gint zoomType, gdouble scaleFactor, gdouble mouseX, gdouble mouseY) {
@@ -107,7 +179,10 @@ render_zoom_display(gint zoomType, gdouble scaleFactor, gdouble mouseX, gdouble
             screenRenderInfo.lowerLeftY +=
                 (oldHeight - (screenRenderInfo.displayHeight / screenRenderInfo.scaleFactorY)) / 2.0;
             break;
-        case ZOOM_FIT: /* Zoom Fit */ gerbv_render_zoom_to_fit_display(mainProject, &screenRenderInfo); break;
+        case ZOOM_FIT: /* Zoom Fit */
+            render_load_visible_deferred_layers();
+            gerbv_render_zoom_to_fit_display(mainProject, &screenRenderInfo);
+            break;
         case ZOOM_SET: /*explicit scale set by user */
             screenRenderInfo.scaleFactorX = MIN((gdouble)GERBV_SCALE_MAX, scaleFactor);
             screenRenderInfo.scaleFactorY = screenRenderInfo.scaleFactorX;
@@ -358,13 +433,9 @@ render_selection(void) {
     if (selection_length(&screen.selectionInfo) == 0)
         return;
 
-    if (screen.selectionRenderData)
-        cairo_surface_destroy((cairo_surface_t*)screen.selectionRenderData);
-
-    screen.selectionRenderData = (gpointer)cairo_surface_create_similar(
-        (cairo_surface_t*)screen.windowSurface, CAIRO_CONTENT_COLOR_ALPHA, screenRenderInfo.displayWidth,
-        screenRenderInfo.displayHeight
-    );
+    /* an image surface, so the compositor can read its pixels */
+    render_pool_put_surface((cairo_surface_t*)screen.selectionRenderData);
+    screen.selectionRenderData = (gpointer)render_pool_get_surface(CAIRO_FORMAT_ARGB32, TRUE);
 
     pixel_width = 1.0 / MAX(screenRenderInfo.scaleFactorX, screenRenderInfo.scaleFactorY);
 
@@ -395,6 +466,64 @@ render_selection(void) {
     }
 }
 
+/* ------------------------------------------------------ */
+/* Render a layer into its own surface, for render_recreate_composite_surface() */
+static void
+render_layer_surface(gint index) {
+    cairo_t* cr;
+
+    render_pool_put_surface((cairo_surface_t*)mainProject->file[index]->privateRenderData);
+    mainProject->file[index]->privateRenderData = (gpointer)render_pool_get_surface(CAIRO_FORMAT_ARGB32, TRUE);
+    cr = cairo_create(mainProject->file[index]->privateRenderData);
+    gerbv_render_layer_to_cairo_target(cr, mainProject->file[index], &screenRenderInfo);
+    cairo_destroy(cr);
+}
+
+/* ------------------------------------------------------ */
+/* Load a layer that was only pre-scanned when the project was opened */
+void
+render_load_deferred_layer(gint index) {
+    gerbv_fileinfo_t* file = mainProject->file[index];
+
+    if (file == NULL || !file->deferred || file->loadFailed)
+        return;
+
+    gerbv_load_deferred_layer(file);
+
+    /* in cairo mode all layers are kept rendered, so toggling one on only needs a composite */
+    if (screenRenderInfo.renderType > GERBV_RENDER_TYPE_GDK_XOR && screen.drawing_area != NULL)
+        render_layer_surface(index);
+}
+
+/* ------------------------------------------------------ */
+/* Load the visible layers that were only pre-scanned, before they are drawn
+   or measured. libgerbv renders whatever image a layer holds. */
+void
+render_load_visible_deferred_layers(void) {
+    gint i;
+
+    for (i = 0; i <= mainProject->last_loaded; i++) {
+        if (mainProject->file[i] && mainProject->file[i]->isVisible)
+            gerbv_load_deferred_layer(mainProject->file[i]);
+    }
+}
+
+/* ------------------------------------------------------ */
+/* Idle handler loading the pre-scanned layers one at a time */
+gboolean
+render_load_deferred_layers_idle(gpointer data) {
+    gint i;
+
+    for (i = 0; i <= mainProject->last_loaded; i++) {
+        if (mainProject->file[i] && mainProject->file[i]->deferred && !mainProject->file[i]->loadFailed) {
+            render_load_deferred_layer(i);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
 /* ------------------------------------------------------ */
 void
 render_refresh_rendered_image_on_screen(void) {
@@ -405,14 +534,24 @@ render_refresh_rendered_image_on_screen(void) {
     gdk_window_set_cursor(GDK_WINDOW(screen.drawing_area->window), cursor);
     gdk_cursor_destroy(cursor);
 
+    render_load_visible_deferred_layers();
+
     if (screenRenderInfo.renderType <= GERBV_RENDER_TYPE_GDK_XOR) {
+        gint width = 0, height = 0;
+
+        /* the whole pixmap gets painted over, so keep it unless the window was resized */
         if (screen.pixmap)
-            gdk_pixmap_unref(screen.pixmap);
-        screen.pixmap = gdk_pixmap_new(
-            screen.drawing_area->window, screenRenderInfo.displayWidth, screenRenderInfo.displayHeight, -1
-        );
-        gerbv_render_to_pixmap_using_gdk(
-            mainProject, screen.pixmap, &screenRenderInfo, &screen.selectionInfo, &screen.selection_color
+            gdk_drawable_get_size(screen.pixmap, &width, &height);
+        if (width != screenRenderInfo.displayWidth || height != screenRenderInfo.displayHeight) {
+            if (screen.pixmap)
+                gdk_pixmap_unref(screen.pixmap);
+            screen.pixmap = gdk_pixmap_new(
+                screen.drawing_area->window, screenRenderInfo.displayWidth, screenRenderInfo.displayHeight, -1
+            );
+        }
+        gerbv_render_to_pixmap_using_gdk_with_scratch(
+            mainProject, screen.pixmap, &screenRenderInfo, &screen.selectionInfo, &screen.selection_color,
+            &screen.colorStamp, &screen.clipmask
         );
         dprintf("<---- leaving redraw_pixmap.\n");
     } else {
@@ -423,18 +562,10 @@ render_refresh_rendered_image_on_screen(void) {
          * Higher layer numbers have higher priority in the Z-order.
          */
         for (i = mainProject->last_loaded; i >= 0; i--) {
-            if (mainProject->file[i]) {
-                cairo_t* cr;
-                if (mainProject->file[i]->privateRenderData)
-                    cairo_surface_destroy((cairo_surface_t*)mainProject->file[i]->privateRenderData);
-                mainProject->file[i]->privateRenderData = (gpointer)cairo_surface_create_similar(
-                    (cairo_surface_t*)screen.windowSurface, CAIRO_CONTENT_COLOR_ALPHA, screenRenderInfo.displayWidth,
-                    screenRenderInfo.displayHeight
-                );
-                cr = cairo_create(mainProject->file[i]->privateRenderData);
-                gerbv_render_layer_to_cairo_target(cr, mainProject->file[i], &screenRenderInfo);
+            /* hidden layers that were only pre-scanned get rendered once they are loaded */
+            if (mainProject->file[i] && (mainProject->file[i]->isVisible || !mainProject->file[i]->deferred)) {
                 dprintf("    .... calling render_image_to_cairo_target on layer %d...\n", i);
-                cairo_destroy(cr);
+                render_layer_surface(i);
             }
         }
 
@@ -463,17 +594,23 @@ render_remove_selected_objects_belonging_to_layer(gerbv_selection_info_t* sel_in
 /* ------------------------------------------------------ */
 gint
 render_create_cairo_buffer_surface() {
-    if (screen.bufferSurface) {
-        cairo_surface_destroy(screen.bufferSurface);
-        screen.bufferSurface = NULL;
-    }
     if (!screen.windowSurface)
         return 0;
 
+    /* its contents are always fully replaced, so only reallocate on resize */
+    if (screen.bufferSurface && bufferSurfaceWidth == screenRenderInfo.displayWidth
+        && bufferSurfaceHeight == screenRenderInfo.displayHeight)
+        return 1;
+
+    if (screen.bufferSurface)
+        cairo_surface_destroy(screen.bufferSurface);
+
     screen.bufferSurface = cairo_surface_create_similar(
         (cairo_surface_t*)screen.windowSurface, CAIRO_CONTENT_COLOR, screenRenderInfo.displayWidth,
         screenRenderInfo.displayHeight
     );
+    bufferSurfaceWidth  = screenRenderInfo.displayWidth;
+    bufferSurfaceHeight = screenRenderInfo.displayHeight;
     return 1;
 }
 
@@ -496,6 +633,8 @@ render_find_selected_objects_and_refresh_display(gint activeFileIndex, enum sele
 
     /* call draw_image... passing the FILL_SELECTION mode to just search for
        nets which match the selection, and fill the selection buffer with them */
+    render_load_deferred_layer(activeFileIndex);
+
     cairo_t* cr = cairo_create(screen.bufferSurface);
     gerbv_render_cairo_set_scale_and_translation(cr, &screenRenderInfo);
     draw_image_to_cairo_target(
@@ -542,42 +681,68 @@ render_fill_selection_buffer_from_mouse_drag(
     render_find_selected_objects_and_refresh_display(activeFileIndex, action);
 }
 
+/* ------------------------------------------------------ */
+/* A layer surface can only be handed to the compositor if it matches the
+   current display size, it is stale until the next full refresh otherwise */
+static gboolean
+render_is_layer_surface_usable(cairo_surface_t* surface) {
+    return surface != NULL && cairo_surface_get_type(surface) == CAIRO_SURFACE_TYPE_IMAGE
+        && cairo_image_surface_get_width(surface) == screenRenderInfo.displayWidth
+        && cairo_image_surface_get_height(surface) == screenRenderInfo.displayHeight;
+}
+
 /* ------------------------------------------------------ */
 void
 render_recreate_composite_surface() {
-    gint i;
+    gerbv_composite_layer_t* layers;
+    cairo_surface_t*         frame;
+    guint                    nLayers = 0;
+    gint                     i;
 
     if (!render_create_cairo_buffer_surface())
         return;
 
-    cairo_t* cr = cairo_create(screen.bufferSurface);
-    /* fill the background with the appropriate color */
-    cairo_set_source_rgba(
-        cr, (double)mainProject->background.red / G_MAXUINT16, (double)mainProject->background.green / G_MAXUINT16,
-        (double)mainProject->background.blue / G_MAXUINT16, 1
-    );
-    cairo_paint(cr);
+    layers = g_new0(gerbv_composite_layer_t, mainProject->last_loaded + 2);
 
     for (i = mainProject->last_loaded; i >= 0; i--) {
-        if (mainProject->file[i] && mainProject->file[i]->isVisible) {
-            cairo_set_source_surface(cr, (cairo_surface_t*)mainProject->file[i]->privateRenderData, 0, 0);
+        if (mainProject->file[i] && mainProject->file[i]->isVisible
+            && render_is_layer_surface_usable((cairo_surface_t*)mainProject->file[i]->privateRenderData)) {
             /* ignore alpha if we are in high-speed render mode */
-            if (((double)mainProject->file[i]->alpha < 65535)
-                && (screenRenderInfo.renderType != GERBV_RENDER_TYPE_GDK_XOR)) {
-                cairo_paint_with_alpha(cr, (double)mainProject->file[i]->alpha / G_MAXUINT16);
-            } else {
-                cairo_paint(cr);
-            }
+            gerbv_composite_layer_from_surface(
+                &layers[nLayers++], (cairo_surface_t*)mainProject->file[i]->privateRenderData,
+                (screenRenderInfo.renderType != GERBV_RENDER_TYPE_GDK_XOR) ? mainProject->file[i]->alpha : G_MAXUINT16
+            );
         }
     }
 
     /* render the selection layer at the end */
     if (selection_length(&screen.selectionInfo) != 0) {
         render_selection();
-        cairo_set_source_surface(cr, (cairo_surface_t*)screen.selectionRenderData, 0, 0);
-        cairo_paint_with_alpha(cr, 1.0);
+        if (render_is_layer_surface_usable((cairo_surface_t*)screen.selectionRenderData)) {
+            gerbv_composite_layer_from_surface(
+                &layers[nLayers++], (cairo_surface_t*)screen.selectionRenderData, G_MAXUINT16
+            );
+        }
     }
+
+    /* blend the background and all layers in a single pass, then upload
+       the finished frame to the buffer surface */
+    frame = render_pool_get_surface(CAIRO_FORMAT_RGB24, FALSE);
+    gerbv_composite_layers_to_surface(
+        frame,
+        gerbv_composite_pixel_from_color(
+            mainProject->background.red, mainProject->background.green, mainProject->background.blue
+        ),
+        layers, nLayers
+    );
+    g_free(layers);
+
+    cairo_t* cr = cairo_create(screen.bufferSurface);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface(cr, frame, 0, 0);
+    cairo_paint(cr);
     cairo_destroy(cr);
+    render_pool_put_surface(frame);
 }
 
 /* ------------------------------------------------------ */
@@ -605,6 +770,38 @@ render_free_screen_resources(void) {
         cairo_surface_destroy((cairo_surface_t*)screen.windowSurface);
     if (screen.pixmap)
         gdk_pixmap_unref(screen.pixmap);
+    if (screen.exposePixmap)
+        gdk_pixmap_unref(screen.exposePixmap);
+    if (screen.colorStamp)
+        gdk_pixmap_unref(screen.colorStamp);
+    if (screen.clipmask)
+        gdk_pixmap_unref(screen.clipmask);
+    render_pool_free();
+}
+
+/* ------------------------------------------------------------------ */
+static gsize
+render_image_surface_size(cairo_surface_t* surface) {
+    if (surface == NULL || cairo_surface_get_type(surface) != CAIRO_SURFACE_TYPE_IMAGE)
+        return 0;
+
+    return (gsize)cairo_image_surface_get_stride(surface) * cairo_image_surface_get_height(surface);
+}
+
+/* ------------------------------------------------------------------ */
+gsize
+render_get_memory_usage(void) {
+    gsize   size = render_image_surface_size((cairo_surface_t*)screen.selectionRenderData);
+    GSList* item;
+
+    /* the buffer lives wherever the window system keeps it, count it as RGB24 */
+    if (screen.bufferSurface)
+        size += (gsize)bufferSurfaceWidth * bufferSurfaceHeight * 4;
+
+    for (item = surfacePool; item != NULL; item = item->next)
+        size += render_image_surface_size((cairo_surface_t*)item->data);
+
+    return size;
 }
 
 /* ------------------------------------------------------------------ */
@@ -625,6 +822,7 @@ generate_gerber_analysis(void) {
     for (i = 0; i <= mainProject->last_loaded; i++) {
         if (mainProject->file[i] && mainProject->file[i]->isVisible
             && (mainProject->file[i]->image->layertype == GERBV_LAYERTYPE_RS274X)) {
+            render_load_deferred_layer(i);
             instats = mainProject->file[i]->image->gerbv_stats;
             gerbv_stats_add_layer(stats, instats, i + 1);
         }
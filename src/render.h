@@ -49,10 +49,18 @@ void render_draw_measure_distance(void);
 
 void render_refresh_rendered_image_on_screen(void);
 
+void     render_load_deferred_layer(gint index);
+void     render_load_visible_deferred_layers(void);
+gboolean render_load_deferred_layers_idle(gpointer data);
+
 void render_remove_selected_objects_belonging_to_layer(gerbv_selection_info_t* sel_info, gerbv_image_t* image);
 
 void render_free_screen_resources(void);
 
+/* Return the bytes held by the screen surfaces that don't belong to a layer:
+ * the selection, the frame buffer and the pooled surfaces */
+gsize render_get_memory_usage(void);
+
 enum selection_action {
     SELECTION_REPLACE = 0,
     SELECTION_ADD,
@@ -269,12 +269,17 @@ for t in $all_tests ; do
     outpng="${OUTDIR}/${t}.png"
     errdir="${ERRDIR}/${t}"
 
-    # test_name | layout file(s) | [optional arguments to gerbv] | [mismatch]
+    # test_name | layout file(s) | [optional arguments to gerbv] | [mismatch] | [reference] | [fuzz]
     tmp=`grep "^[ \t]*${t}[ \t]*|" $TESTLIST`
     name=`echo $tmp | $AWK 'BEGIN{FS="|"} {print $1}'`
     files=`echo $tmp | $AWK 'BEGIN{FS="|"} {print $2}'`
     args=`echo $tmp | $AWK 'BEGIN{FS="|"} {print $3}'`
+    args=`echo $args`	# strip whitespaces
     mismatch=`echo $tmp | $AWK 'BEGIN{FS="|"} {if($2 == "mismatch"){print "yes"}else{print "no"}}'`
+    reference=`echo $tmp | $AWK 'BEGIN{FS="|"} {print $5}'`
+    reference=`echo $reference`	# strip whitespaces
+    fuzz=`echo $tmp | $AWK 'BEGIN{FS="|"} {print $6}'`
+    fuzz=`echo $fuzz`	# strip whitespaces
 
     if test "X${name}" = "X" ; then
 	echo "ERROR:  Specified test ${t} does not appear to exist"
@@ -282,6 +287,16 @@ for t in $all_tests ; do
 	continue
     fi
 
+    # compare with the reference PNG of another test
+    if test "X${reference}" != "X" ; then
+	if test "X$regen" = "Xyes" ; then
+	    echo "Uses the reference file of ${reference}, not regenerated"
+	    tot=`expr $tot - 1`
+	    continue
+	fi
+	refpng="${REFDIR}/${reference}.png"
+    fi
+
     ######################################################################
     #
     # check to see if the files we need exist
@@ -335,11 +350,31 @@ for t in $all_tests ; do
 
     ######################################################################
     #
-    # export the layout to PNG
+    # export the layout to PNG, or to SVG or PDF and rasterize that
     #
 
-    echo "${GERBV} ${gerbv_flags} --output=${outpng} ${path_files}"
-    ${GERBV} ${gerbv_flags} --output=${outpng} ${path_files}
+    vector=""
+    case " ${gerbv_flags} " in
+	*" --export=svg "*|*" --export=svg-native "*) vector=svg ;;
+	*" --export=pdf "*|*" --export=pdf-native "*) vector=pdf ;;
+    esac
+
+    if test "X${vector}" = "X" ; then
+	echo "${GERBV} ${gerbv_flags} --output=${outpng} ${path_files}"
+	${GERBV} ${gerbv_flags} --output=${outpng} ${path_files}
+    else
+	outvec="${OUTDIR}/${t}.${vector}"
+	echo "${GERBV} ${gerbv_flags} --output=${outvec} ${path_files}"
+	${GERBV} ${gerbv_flags} --output=${outvec} ${path_files}
+
+	# a page of 640x480 pt is 640x480 pixels at 72 dpi.  Vector
+	# exports leave out a black background, so put it back.
+	if ! ${IM_CONVERT} -density 72 ${outvec} -background black -flatten ${outpng} ; then
+	    echo "SKIPPED: ${IM_CONVERT} can't rasterize ${outvec}"
+	    skip=`expr $skip + 1`
+	    continue
+	fi
+    fi
 
     ######################################################################
     #
@@ -347,9 +382,20 @@ for t in $all_tests ; do
     #
 
     if test "X$regen" != "Xyes" ; then
-	if test -f ${REFDIR}/${t}.png ; then
+	if test -f ${refpng} -a "X${fuzz}" != "X" ; then
+	    # compare the shapes only, since vector exports draw layers
+	    # opaque and anti-aliased
+	    refmask="${OUTDIR}/${t}-refmask.png"
+	    outmask="${OUTDIR}/${t}-mask.png"
+	    ${IM_CONVERT} ${refpng} -colorspace gray -threshold 20% ${refmask}
+	    ${IM_CONVERT} ${outpng} -colorspace gray -threshold 20% ${outmask}
+	    same=`${IM_COMPARE} -metric MAE $refmask $outmask  null: 2>&1 | \
+                ${AWK} -v fuzz=${fuzz} '{v=$2; gsub(/[()]/, "", v); if(v + 0 <= fuzz + 0){print "yes"} else {print "no"}}'`
+	elif test -f ${refpng} ; then
 	    same=`${IM_COMPARE} -metric MAE $refpng $outpng  null: 2>&1 | \
                 ${AWK} '{if($1 == 0){print "yes"} else {print "no"}}'`
+	fi
+	if test -f ${refpng} ; then
 	    if test "$same" = yes ; then
 		echo "PASS"
 		pass=`expr $pass + 1`
@@ -373,7 +419,7 @@ EOF
 		fail=`expr $fail + 1`
 	    fi
 	else
-	    echo "SKIPPED: No reference file ${REFDIR}/${t}.png"
+	    echo "SKIPPED: No reference file ${refpng}"
 	    skip=`expr $skip + 1`
 	fi
     else
@@ -0,0 +1,182 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ *
+ * test-composite.c -- this file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** \file test-composite.c
+    \brief Checks the fused compositor against cairo
+
+    The compositor blends four pixels at a time with SSE2 where the compiler
+    targets it, and is meant to give exactly what cairo_paint_with_alpha()
+    gives for each layer. This blends random layers of every width up to a
+    few SIMD blocks, on frames tall enough to be split across threads, both
+    all at once and one layer at a time, and compares every pixel with the
+    same layers painted by cairo.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "gerbv.h"
+#include "composite.h"
+
+#define TEST_MAX_WIDTH  37
+#define TEST_MAX_LAYERS 4
+
+/* enough rows to be split into several bands */
+#define TEST_TALL_ROWS 1029
+
+/* a random premultiplied ARGB32 pixel, fully transparent or opaque a good
+   part of the time since most layer pixels are */
+static guint32
+test_random_pixel(GRand* rand) {
+    guint32 a, r, g, b;
+
+    switch (g_rand_int_range(rand, 0, 4)) {
+        case 0: return 0;
+        case 1: a = 255; break;
+        default: a = g_rand_int_range(rand, 0, 256); break;
+    }
+    r = g_rand_int_range(rand, 0, a + 1);
+    g = g_rand_int_range(rand, 0, a + 1);
+    b = g_rand_int_range(rand, 0, a + 1);
+
+    return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static guint8
+test_random_alpha(GRand* rand) {
+    switch (g_rand_int_range(rand, 0, 4)) {
+        case 0: return 0;
+        case 1: return 255;
+        default: return g_rand_int_range(rand, 0, 256);
+    }
+}
+
+/* Paint the layers onto the background with cairo, one
+   cairo_paint_with_alpha() each, into a new ARGB32 surface */
+static cairo_surface_t*
+test_cairo_frame(
+    gint width, gint height, guint32 background, const gerbv_composite_layer_t* layers, guint nLayers
+) {
+    cairo_surface_t* frame = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+    cairo_t*         cr    = cairo_create(frame);
+    guint            l;
+
+    cairo_set_source_rgb(
+        cr, ((background >> 16) & 0xff) / 255.0, ((background >> 8) & 0xff) / 255.0, (background & 0xff) / 255.0
+    );
+    cairo_paint(cr);
+
+    for (l = 0; l < nLayers; l++) {
+        cairo_surface_t* layer = cairo_image_surface_create_for_data(
+            (unsigned char*)layers[l].data, CAIRO_FORMAT_ARGB32, width, height, layers[l].stride
+        );
+
+        cairo_set_source_surface(cr, layer, 0, 0);
+        cairo_paint_with_alpha(cr, layers[l].alpha / 255.0);
+        cairo_surface_destroy(layer);
+    }
+
+    cairo_destroy(cr);
+    cairo_surface_flush(frame);
+
+    return frame;
+}
+
+/* Blend one frame both ways and count the pixels that differ from cairo */
+static gint
+test_frame(GRand* rand, gint width, gint height, guint nLayers) {
+    gerbv_composite_layer_t layers[TEST_MAX_LAYERS];
+    guint32*                data[TEST_MAX_LAYERS];
+    guint32                 background = gerbv_composite_pixel_from_color(
+        g_rand_int_range(rand, 0, 65536), g_rand_int_range(rand, 0, 65536), g_rand_int_range(rand, 0, 65536)
+    );
+    gint             stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
+    guint32*         fused  = g_new(guint32, width * height);
+    guint32*         single = g_new(guint32, width * height);
+    cairo_surface_t* reference;
+    gint             errors = 0, x, y;
+    guint            l;
+
+    for (l = 0; l < nLayers; l++) {
+        data[l] = g_malloc((gsize)stride * height);
+        for (y = 0; y < height; y++) {
+            for (x = 0; x < width; x++)
+                data[l][y * stride / 4 + x] = test_random_pixel(rand);
+        }
+
+        layers[l].data   = (const guint8*)data[l];
+        layers[l].stride = stride;
+        layers[l].alpha  = test_random_alpha(rand);
+    }
+
+    gerbv_composite_layers((guint8*)fused, width * sizeof(guint32), width, height, background, layers, nLayers);
+
+    gerbv_composite_layers((guint8*)single, width * sizeof(guint32), width, height, background, NULL, 0);
+    for (l = 0; l < nLayers; l++)
+        gerbv_composite_layers_over((guint8*)single, width * sizeof(guint32), width, height, &layers[l], 1);
+
+    reference = test_cairo_frame(width, height, background, layers, nLayers);
+
+    for (y = 0; y < height; y++) {
+        const guint32* expected =
+            (const guint32*)(cairo_image_surface_get_data(reference) + y * cairo_image_surface_get_stride(reference));
+
+        for (x = 0; x < width; x++) {
+            if (fused[y * width + x] != expected[x] || single[y * width + x] != expected[x]) {
+                if (errors++ < 10) {
+                    fprintf(
+                        stderr, "%dx%d, %u layers, pixel %d,%d: cairo %08x, fused %08x, one at a time %08x\n", width,
+                        height, nLayers, x, y, expected[x], fused[y * width + x], single[y * width + x]
+                    );
+                }
+            }
+        }
+    }
+
+    cairo_surface_destroy(reference);
+    for (l = 0; l < nLayers; l++)
+        g_free(data[l]);
+    g_free(fused);
+    g_free(single);
+
+    return errors;
+}
+
+int
+main(int argc, char** argv) {
+    GRand* rand   = g_rand_new_with_seed(20261019);
+    gint   errors = 0, width;
+    guint  nLayers;
+
+    for (width = 1; width <= TEST_MAX_WIDTH; width++) {
+        for (nLayers = 0; nLayers <= TEST_MAX_LAYERS; nLayers++)
+            errors += test_frame(rand, width, 3, nLayers);
+    }
+
+    /* twice, so the second frame reuses the threads of the first */
+    errors += test_frame(rand, 203, TEST_TALL_ROWS, TEST_MAX_LAYERS);
+    errors += test_frame(rand, 203, TEST_TALL_ROWS, TEST_MAX_LAYERS);
+
+    g_rand_free(rand);
+
+    printf("%d pixels differ from cairo\n", errors);
+
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ *
+ * test-export-rs274x.c -- this file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** \file test-export-rs274x.c
+    \brief Checks which apertures the compact RS-274X export shares
+
+    Flashes three apertures of one macro, a ring, side by side. The first
+    and the third are the same ring; the second has the same two circles
+    but a smaller hole. The image is written with the compact exporter and
+    read back. The first and the third flash must now use one aperture, and
+    the second must keep its own ring with its own hole.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <stdio.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <glib/gstdio.h>
+
+#include "gerbv.h"
+
+/* how far a coordinate read back may be from the one written, in inches */
+#define TEST_TOLERANCE 1e-6
+
+#define TEST_GERBER                     \
+    "%FSLAX24Y24*%\n"                   \
+    "%MOIN*%\n"                         \
+    "%AMRING*1,1,$1,0,0*1,0,$2,0,0*%\n" \
+    "%ADD10RING,0.1X0.05*%\n"           \
+    "%ADD11RING,0.1X0.04*%\n"           \
+    "%ADD12RING,0.1X0.05*%\n"           \
+    "D10*\nX0Y0D03*\n"                  \
+    "D11*\nX10000Y0D03*\n"              \
+    "D12*\nX20000Y0D03*\n"              \
+    "M02*\n"
+
+static gint errors = 0;
+
+#define TEST_CHECK(cond)                                                      \
+    do {                                                                      \
+        if (!(cond)) {                                                        \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #cond); \
+            errors++;                                                         \
+        }                                                                     \
+    } while (0)
+
+/* Return the flash of image at x, y = 0, or NULL if there is none */
+static const gerbv_net_t*
+test_find_flash(const gerbv_image_t* image, gdouble x) {
+    const gerbv_net_t* net;
+
+    for (net = image->netlist; net != NULL; net = net->next) {
+        if (net->aperture_state == GERBV_APERTURE_STATE_FLASH && fabs(net->stop_x - x) < TEST_TOLERANCE
+            && fabs(net->stop_y) < TEST_TOLERANCE)
+            return net;
+    }
+
+    return NULL;
+}
+
+/* Return the diameter of the hole of the ring flashed by net, or -1 if it
+   isn't a ring */
+static gdouble
+test_hole_diameter(const gerbv_image_t* image, const gerbv_net_t* net) {
+    const gerbv_aperture_t*          aperture = image->aperture[net->aperture];
+    const gerbv_simplified_amacro_t* hole;
+
+    if (aperture == NULL || aperture->type != GERBV_APTYPE_MACRO || aperture->simplified == NULL)
+        return -1.0;
+
+    hole = aperture->simplified->next;
+    if (hole == NULL || hole->type != GERBV_APTYPE_MACRO_CIRCLE || hole->next != NULL)
+        return -1.0;
+
+    return hole->parameter[CIRCLE_DIAMETER];
+}
+
+int
+main(int argc, char** argv) {
+    GError*            error = NULL;
+    gchar *            input, *output;
+    gerbv_image_t *    image, *exported;
+    const gerbv_net_t *first, *second, *third;
+    int                fd;
+
+    fd = g_file_open_tmp("gerbv-apertures-XXXXXX.gbr", &input, &error);
+    if (fd < 0) {
+        printf("can't create a temporary file: %s\n", error->message);
+        g_error_free(error);
+        return 1;
+    }
+    close(fd);
+
+    fd = g_file_open_tmp("gerbv-apertures-compact-XXXXXX.gbr", &output, &error);
+    if (fd < 0) {
+        printf("can't create a temporary file: %s\n", error->message);
+        g_error_free(error);
+        g_unlink(input);
+        g_free(input);
+        return 1;
+    }
+    close(fd);
+
+    TEST_CHECK(g_file_set_contents(input, TEST_GERBER, -1, NULL));
+    image = gerbv_create_rs274x_image_from_filename(input);
+    TEST_CHECK(image != NULL);
+
+    if (image != NULL) {
+        TEST_CHECK(gerbv_export_rs274x_file_from_image_compact(output, image, NULL));
+        exported = gerbv_create_rs274x_image_from_filename(output);
+        TEST_CHECK(exported != NULL);
+
+        if (exported != NULL) {
+            first  = test_find_flash(exported, 0.0);
+            second = test_find_flash(exported, 1.0);
+            third  = test_find_flash(exported, 2.0);
+            TEST_CHECK(first != NULL && second != NULL && third != NULL);
+
+            if (first != NULL && second != NULL && third != NULL) {
+                /* the equal rings are one aperture, the other ring isn't */
+                TEST_CHECK(first->aperture == third->aperture);
+                TEST_CHECK(first->aperture != second->aperture);
+                TEST_CHECK(fabs(test_hole_diameter(exported, first) - 0.05) < TEST_TOLERANCE);
+                TEST_CHECK(fabs(test_hole_diameter(exported, second) - 0.04) < TEST_TOLERANCE);
+            }
+            gerbv_destroy_image(exported);
+        }
+        gerbv_destroy_image(image);
+    }
+
+    g_unlink(input);
+    g_unlink(output);
+    g_free(input);
+    g_free(output);
+
+    printf("compact RS-274X apertures: %d checks failed\n", errors);
+
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,320 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ *
+ * test-gerb-file.c -- this file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** \file test-gerb-file.c
+    \brief Checks reading files larger than 4 GB and compressed files
+
+    Creates a sparse file of a little over 4 GB with Gerber text at its start
+    and across the 4 GB mark, and reads it mapped and through the streaming
+    window. Offsets that are truncated to 32 bits anywhere in the file layer
+    read the wrong bytes or make the file look nearly empty. This part is
+    skipped where the file system can't hold such a file.
+
+    Then writes a few MB of Gerber text gzip and zstd compressed, more than
+    the decompression window holds, and reads it back with and without the
+    background decoder, sequentially, after jumping ahead and after going
+    back to the start.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <glib/gstdio.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "gerbv.h"
+#include "gerb_file.h"
+
+/* Lines of text in the compressed files, about 3 MB */
+#define TEST_COMPRESSED_LINES 150000
+
+#define TEST_HEAD "G04 start*\nX123Y456D01*\n"
+#define TEST_TAIL "X-7654321Y89D02*\nG04 past 4 GB*\nM02*\n"
+
+/* The tail starts a few bytes before 4 GB, so the Y coordinate straddles the mark */
+#define TEST_TAIL_OFFSET ((G_GINT64_CONSTANT(1) << 32) - 11)
+
+typedef enum {
+    TEST_GZIP,
+    TEST_ZSTD,
+} test_compression_t;
+
+static gint errors = 0;
+
+#define TEST_CHECK(mode, cond)                                                          \
+    do {                                                                                \
+        if (!(cond)) {                                                                  \
+            fprintf(stderr, "%s: %s:%d: %s failed\n", mode, __FILE__, __LINE__, #cond); \
+            errors++;                                                                   \
+        }                                                                               \
+    } while (0)
+
+static gboolean
+test_write_at(int fd, goffset offset, const char* text) {
+    size_t len = strlen(text);
+
+    if (lseek(fd, (off_t)offset, SEEK_SET) != (off_t)offset)
+        return FALSE;
+
+    return write(fd, text, len) == (ssize_t)len;
+}
+
+/* Read the text at the start and across the 4 GB mark of an open file */
+static void
+test_read(const char* mode, gerb_file_t* fd) {
+    goffset size = TEST_TAIL_OFFSET + (goffset)strlen(TEST_TAIL);
+    char*   str;
+    int     len, c, n;
+
+    if (fd == NULL) {
+        fprintf(stderr, "%s: can't open the file: %s\n", mode, strerror(errno));
+        errors++;
+        return;
+    }
+
+    TEST_CHECK(mode, fd->datalen == size);
+
+    /* the tail first, so the streaming window has to move back afterwards */
+    fd->ptr = TEST_TAIL_OFFSET;
+    TEST_CHECK(mode, gerb_fgetc(fd) == 'X');
+    TEST_CHECK(mode, gerb_fgetint(fd, &len) == -7654321 && len == 7);
+    TEST_CHECK(mode, gerb_fgetc(fd) == 'Y');
+    TEST_CHECK(mode, fd->ptr < (G_GINT64_CONSTANT(1) << 32));
+    TEST_CHECK(mode, gerb_fgetint(fd, &len) == 89 && len == 2);
+    TEST_CHECK(mode, fd->ptr > (G_GINT64_CONSTANT(1) << 32));
+
+    str = gerb_fgetstring(fd, '*');
+    TEST_CHECK(mode, str != NULL && strcmp(str, "D02") == 0);
+    g_free(str);
+
+    gerb_ungetc(fd);
+    TEST_CHECK(mode, gerb_fgetc(fd) == '2');
+    TEST_CHECK(mode, gerb_fgetc(fd) == '*');
+    TEST_CHECK(mode, gerb_fgetc(fd) == '\n');
+
+    str = gerb_fgetstring(fd, '*');
+    TEST_CHECK(mode, str != NULL && strcmp(str, "G04 past 4 GB") == 0);
+    g_free(str);
+
+    /* the rest of the file, then nothing */
+    for (n = 0; (c = gerb_fgetc(fd)) != EOF; n++)
+        ;
+    TEST_CHECK(mode, n == (int)strlen("*\nM02*\n"));
+    TEST_CHECK(mode, fd->ptr == size);
+
+    /* the hole between the texts reads as NUL bytes */
+    fd->ptr = G_GINT64_CONSTANT(3) << 30;
+    TEST_CHECK(mode, gerb_fgetc(fd) == 0);
+
+    gerb_frewind(fd);
+    str = gerb_fgetstring(fd, '*');
+    TEST_CHECK(mode, str != NULL && strcmp(str, "G04 start") == 0);
+    g_free(str);
+    TEST_CHECK(mode, gerb_fgetc(fd) == '*');
+    TEST_CHECK(mode, gerb_fgetc(fd) == '\n');
+    TEST_CHECK(mode, gerb_fgetc(fd) == 'X');
+    TEST_CHECK(mode, gerb_fgetint(fd, NULL) == 123);
+
+    gerb_fclose(fd);
+}
+
+static void
+test_large(void) {
+    GError* error = NULL;
+    gchar*  filename;
+    int     fd;
+
+    fd = g_file_open_tmp("gerbv-large-XXXXXX.gbr", &filename, &error);
+    if (fd < 0) {
+        printf("can't create a temporary file, skipping files larger than 4 GB: %s\n", error->message);
+        g_error_free(error);
+        return;
+    }
+
+    if (!test_write_at(fd, 0, TEST_HEAD) || !test_write_at(fd, TEST_TAIL_OFFSET, TEST_TAIL)) {
+        printf("can't create a file larger than 4 GB, skipping it: %s\n", strerror(errno));
+        close(fd);
+        g_unlink(filename);
+        g_free(filename);
+        return;
+    }
+    close(fd);
+
+    test_read("mapped", gerb_fopen(filename));
+    test_read("streaming", gerb_fopen_streaming(filename));
+
+    g_unlink(filename);
+    g_free(filename);
+}
+
+#if defined(HAVE_ZLIB) || defined(HAVE_ZSTD)
+/* Read a compressed copy of text in every way a parser might */
+static void
+test_read_compressed(const char* mode, gerb_file_t* fd, const GString* text) {
+    goffset i, middle;
+    char*   str;
+    int     c;
+
+    if (fd == NULL) {
+        fprintf(stderr, "%s: can't open the file: %s\n", mode, strerror(errno));
+        errors++;
+        return;
+    }
+
+    /* all of it, sliding the window through the file */
+    for (i = 0; (c = gerb_fgetc(fd)) != EOF; i++) {
+        if (i >= (goffset)text->len || c != text->str[i]) {
+            TEST_CHECK(mode, i < (goffset)text->len && c == text->str[i]);
+            break;
+        }
+    }
+    TEST_CHECK(mode, i == (goffset)text->len && fd->datalen == (goffset)text->len);
+
+    /* back to the start, which has left the window */
+    gerb_frewind(fd);
+    TEST_CHECK(mode, gerb_fgetc(fd) == 'X');
+    TEST_CHECK(mode, gerb_fgetint(fd, NULL) == 0);
+    TEST_CHECK(mode, gerb_fgetc(fd) == 'Y');
+    TEST_CHECK(mode, gerb_fgetint(fd, NULL) == -5);
+
+    /* ahead to the start of a line in the middle */
+    middle  = strchr(text->str + text->len / 2, '\n') + 1 - text->str;
+    fd->ptr = middle;
+    TEST_CHECK(mode, gerb_fgetc(fd) == 'X');
+    TEST_CHECK(mode, gerb_fgetint(fd, NULL) == atoi(text->str + middle + 1));
+    str = gerb_fgetstring(fd, '*');
+    TEST_CHECK(mode, str != NULL && strncmp(str, strchr(text->str + middle, 'Y'), strlen(str)) == 0);
+    g_free(str);
+
+    gerb_fclose(fd);
+}
+
+static gboolean
+test_write_compressed(int fd, test_compression_t type, const GString* text) {
+    gboolean ok = FALSE;
+
+    switch (type) {
+#ifdef HAVE_ZLIB
+        case TEST_GZIP:
+            {
+                gzFile gz = gzdopen(fd, "wb");
+
+                ok = gz != NULL && gzwrite(gz, text->str, text->len) == (int)text->len;
+                ok = gz != NULL && gzclose(gz) == Z_OK && ok;
+                return ok;
+            }
+#endif
+#ifdef HAVE_ZSTD
+        case TEST_ZSTD:
+            {
+                size_t bound = ZSTD_compressBound(text->len);
+                char*  data  = g_malloc(bound);
+                size_t len   = ZSTD_compress(data, bound, text->str, text->len, 3);
+
+                ok = !ZSTD_isError(len) && write(fd, data, len) == (ssize_t)len;
+                g_free(data);
+                break;
+            }
+#endif
+        default: break;
+    }
+    close(fd);
+
+    return ok;
+}
+
+static void
+test_compressed(test_compression_t type, const GString* text) {
+    const char* name  = type == TEST_GZIP ? "gzip" : "zstd";
+    GError*     error = NULL;
+    gchar*      filename;
+    gchar*      mode;
+    int         fd;
+
+    fd = g_file_open_tmp("gerbv-compressed-XXXXXX.gbr", &filename, &error);
+    if (fd < 0) {
+        printf("can't create a temporary file, skipping %s: %s\n", name, error->message);
+        g_error_free(error);
+        return;
+    }
+
+    if (test_write_compressed(fd, type, text)) {
+        mode = g_strdup_printf("%s", name);
+        test_read_compressed(mode, gerb_fopen(filename), text);
+        g_free(mode);
+
+        mode = g_strdup_printf("%s on a thread", name);
+        test_read_compressed(mode, gerb_fopen_with_flags(filename, GERB_FILE_BACKGROUND_DECODE), text);
+        g_free(mode);
+    } else {
+        fprintf(stderr, "%s: can't write %s\n", name, filename);
+        errors++;
+    }
+
+    g_unlink(filename);
+    g_free(filename);
+}
+#endif
+
+int
+main(int argc, char** argv) {
+    GRand*   rand = g_rand_new_with_seed(20261019);
+    GString* text = g_string_new(NULL);
+    gint     i;
+
+    test_large();
+
+    g_string_append(text, "X0Y-5D02*\n");
+    for (i = 0; i < TEST_COMPRESSED_LINES; i++) {
+        g_string_append_printf(
+            text, "X%dY%dD0%d*\n", g_rand_int_range(rand, -999999, 999999), g_rand_int_range(rand, -999999, 999999),
+            g_rand_int_range(rand, 1, 4)
+        );
+    }
+    g_string_append(text, "M02*\n");
+
+#ifdef HAVE_ZLIB
+    test_compressed(TEST_GZIP, text);
+#endif
+#ifdef HAVE_ZSTD
+    test_compressed(TEST_ZSTD, text);
+#endif
+
+    g_string_free(text, TRUE);
+    g_rand_free(rand);
+
+    printf("large and compressed files: %d checks failed\n", errors);
+
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ *
+ * test-gerber-lexer.c -- this file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** \file test-gerber-lexer.c
+    \brief Checks the parallel lexer against reading the file serially
+
+    Writes a Gerber file several lexer chunks long, with comments and
+    extended commands full of code letters, odd whitespace and numbers of
+    every length. It is then read the way parse_gerb() reads it, once
+    through the parallel lexer and once straight from the file, and every
+    code, number, length and string read must be the same.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <glib/gstdio.h>
+
+#include "gerbv.h"
+#include "gerb_file.h"
+#include "gerber_lexer.h"
+
+/* Worker threads to lex with, even where there is only one processor */
+#define TEST_LEXER_THREADS 4
+
+/* automake's exit status for a skipped test */
+#define TEST_SKIP 77
+
+/* Add random Gerber until text is a little over size bytes long */
+static void
+test_generate(GRand* rand, GString* text, gsize size) {
+    g_string_append(text, "G04 test-gerber-lexer*\n%FSLAX36Y36*%\n%MOMM*%\n%ADD10C,0.1*%\n");
+
+    while (text->len < size) {
+        switch (g_rand_int_range(rand, 0, 10)) {
+            case 0: g_string_append(text, "G04 comment with X1 Y-2 and D03 in it*\n"); break;
+            case 1:
+                g_string_append_printf(
+                    text, "%%ADD%dR,0.%dX0.%d*%%\n", g_rand_int_range(rand, 10, 999), g_rand_int_range(rand, 0, 99999),
+                    g_rand_int_range(rand, 0, 99999)
+                );
+                break;
+            case 2:
+                g_string_append_printf(
+                    text, "G01X%dY%dI%dJ%dD01*\r\n", g_rand_int_range(rand, -999999, 999999),
+                    g_rand_int_range(rand, -999999, 999999), g_rand_int_range(rand, -999, 999),
+                    g_rand_int_range(rand, -999, 999)
+                );
+                break;
+            case 3: g_string_append_printf(text, "D%d*\n", g_rand_int_range(rand, 10, 999)); break;
+            case 4:
+                /* leading zeros make numbers longer than the usual lookahead */
+                g_string_append_printf(
+                    text, "X0000000000000000000000000000000000000000000000000000000000000000000%d*\n",
+                    g_rand_int_range(rand, 0, 9999)
+                );
+                break;
+            case 5: g_string_append_printf(text, "Y-%d D02 *\n\n", g_rand_int_range(rand, 0, 999999)); break;
+            default:
+                g_string_append_printf(
+                    text, "X%dY%dD0%d*\n", g_rand_int_range(rand, -999999, 999999),
+                    g_rand_int_range(rand, -999999, 999999), g_rand_int_range(rand, 1, 4)
+                );
+                break;
+        }
+    }
+    g_string_append(text, "M02*\n");
+}
+
+/* Read fd like parse_gerb() does, and write down everything that was read */
+static void
+test_parse(gerber_lexer_t* lex, gerb_file_t* fd, GString* out) {
+    char* str;
+    int   c, value, len;
+
+    while ((c = gerber_lexer_getc(lex, fd)) != EOF) {
+        switch (c) {
+            case 'G':
+            case 'D':
+            case 'M':
+            case 'X':
+            case 'Y':
+            case 'I':
+            case 'J':
+                value = gerber_lexer_getint(lex, fd, &len);
+                g_string_append_printf(out, "%c%d/%d ", c, value, len);
+
+                /* comments are read from the file, past the letters in them */
+                if (c == 'G' && value == 4) {
+                    str = gerb_fgetstring(fd, '*');
+                    g_string_append_printf(out, "[%s] ", str);
+                    g_free(str);
+                }
+                break;
+            case '%':
+                str = gerb_fgetstring(fd, '%');
+                g_string_append_printf(out, "%%%s%% ", str);
+                g_free(str);
+                gerb_fgetc(fd);
+                break;
+            case '*': g_string_append(out, "*\n"); break;
+            default: break;
+        }
+    }
+}
+
+int
+main(int argc, char** argv) {
+    GRand*          rand     = g_rand_new_with_seed(20261019);
+    GString*        text     = g_string_new(NULL);
+    GString*        serial   = g_string_new(NULL);
+    GString*        parallel = g_string_new(NULL);
+    GError*         error    = NULL;
+    gerber_lexer_t* lex;
+    gerb_file_t*    fd;
+    gchar*          filename;
+    int             tmp, rc = 0;
+
+    test_generate(rand, text, GERBER_LEXER_MIN_SIZE + 5 * GERBER_LEXER_CHUNK_SIZE / 2);
+
+    tmp = g_file_open_tmp("gerbv-lexer-XXXXXX.gbr", &filename, &error);
+    if (tmp < 0) {
+        printf("can't create a temporary file: %s\n", error->message);
+        g_error_free(error);
+        return TEST_SKIP;
+    }
+    close(tmp);
+
+    if (!g_file_set_contents(filename, text->str, text->len, &error)) {
+        printf("can't write %s: %s\n", filename, error->message);
+        g_error_free(error);
+        g_unlink(filename);
+        return TEST_SKIP;
+    }
+
+    fd = gerb_fopen(filename);
+    test_parse(NULL, fd, serial);
+    gerb_fclose(fd);
+
+    gerber_lexer_set_threads(TEST_LEXER_THREADS);
+    fd  = gerb_fopen(filename);
+    lex = gerber_lexer_new(fd);
+    if (lex == NULL) {
+        printf("the parallel lexer isn't built on this system\n");
+        rc = TEST_SKIP;
+    } else {
+        printf(
+            "lexing %d chunks on %d threads\n", (gint)((text->len + GERBER_LEXER_CHUNK_SIZE - 1) / GERBER_LEXER_CHUNK_SIZE),
+            TEST_LEXER_THREADS
+        );
+        test_parse(lex, fd, parallel);
+        gerber_lexer_free(lex);
+
+        if (!g_string_equal(serial, parallel)) {
+            gsize i;
+
+            for (i = 0; i < serial->len && i < parallel->len && serial->str[i] == parallel->str[i]; i++)
+                ;
+            fprintf(stderr, "parallel lexer differs after %" G_GSIZE_FORMAT " bytes of output:\n", i);
+            fprintf(stderr, "serial:   %.60s\nparallel: %.60s\n", serial->str + i, parallel->str + i);
+            rc = 1;
+        }
+    }
+    gerb_fclose(fd);
+
+    printf(
+        "%" G_GSIZE_FORMAT " bytes of input, %" G_GSIZE_FORMAT " bytes read back serially\n", text->len, serial->len
+    );
+
+    g_unlink(filename);
+    g_free(filename);
+    g_string_free(text, TRUE);
+    g_string_free(serial, TRUE);
+    g_string_free(parallel, TRUE);
+    g_rand_free(rand);
+
+    return rc;
+}
@@ -0,0 +1,172 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ *
+ * test-image-merge.c -- this file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** \file test-image-merge.c
+    \brief Times panelizing 1, 10, 100 and 1000 copies of a board
+
+    Merges copies of a board side by side into one image, the way main.c
+    merges several files for RS-274X and drill export, and prints how long
+    each panel took. Every copy must add the same nets as the board, moved
+    over by its place in the panel; that is what the test passes or fails on.
+    Merging should stay linear in the number of copies, so a note is printed
+    when the time per copy grows more than twice from one panel to the next,
+    ten times larger one. Timings depend too much on the machine to fail on.
+
+    Run it with a Gerber or drill file to time panels of that board instead.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "gerbv.h"
+
+/* automake's exit status for a skipped test */
+#define TEST_SKIP 77
+
+/* the most the time per copy should grow from one panel to the next, ten times larger one */
+#define TEST_MAX_GROWTH 2.0
+
+/* how far a copied coordinate may be from where it should be, in inches */
+#define TEST_TOLERANCE 1e-9
+
+static guint
+test_count_nets(const gerbv_image_t* image) {
+    const gerbv_net_t* net;
+    guint              n = 0;
+
+    for (net = image->netlist; net != NULL; net = net->next)
+        n++;
+
+    return n;
+}
+
+/* Return the number of nets of the panel that aren't where the copies of the
+   board's nets should be, copy i being moved right by i times width */
+static guint
+test_count_misplaced_nets(const gerbv_image_t* board, const gerbv_image_t* panel, guint copies, gdouble width) {
+    const gerbv_net_t *boardNet, *panelNet = panel->netlist;
+    guint              misplaced = 0, i;
+
+    for (i = 0; i < copies; i++) {
+        for (boardNet = board->netlist; boardNet != NULL && panelNet != NULL;
+             boardNet = boardNet->next, panelNet = panelNet->next) {
+            if (panelNet->interpolation != boardNet->interpolation
+                || fabs(panelNet->start_x - boardNet->start_x - i * width) > TEST_TOLERANCE
+                || fabs(panelNet->stop_x - boardNet->stop_x - i * width) > TEST_TOLERANCE
+                || fabs(panelNet->start_y - boardNet->start_y) > TEST_TOLERANCE
+                || fabs(panelNet->stop_y - boardNet->stop_y) > TEST_TOLERANCE)
+                misplaced++;
+        }
+    }
+
+    return misplaced;
+}
+
+/* Merge copies of board into one panel, and return the CPU time it took in
+   seconds, or a negative time if the panel is wrong */
+static gdouble
+test_panelize(gerbv_image_t* board, guint copies) {
+    gerbv_user_transformation_t trans = { 0.0, 0.0, 1.0, 1.0, 0.0, FALSE, FALSE, FALSE };
+    gerbv_memory_usage_t        usage = { 0 };
+    gerbv_image_t*              panel;
+    gdouble                     width = board->info->max_x - board->info->min_x + 0.1;
+    guint                       boardNets, panelNets, misplaced, i;
+    clock_t                     start;
+    gdouble                     seconds;
+
+    start = clock();
+    panel = gerbv_image_duplicate_image(board, NULL);
+    for (i = 1; i < copies; i++) {
+        trans.translateX = i * width;
+        gerbv_image_copy_image(board, &trans, panel);
+    }
+    seconds = (gdouble)(clock() - start) / CLOCKS_PER_SEC;
+
+    boardNets = test_count_nets(board);
+    panelNets = test_count_nets(panel);
+    misplaced = test_count_misplaced_nets(board, panel, copies, width);
+    gerbv_image_add_memory_usage(panel, &usage);
+    printf(
+        "%4u copies: %8.3f s, %6.2f us per copy, %7u nets, %7" G_GSIZE_FORMAT " kB\n", copies, seconds,
+        1e6 * seconds / copies, panelNets, usage.total / 1024
+    );
+
+    gerbv_destroy_image(panel);
+
+    if (panelNets != copies * boardNets) {
+        fprintf(stderr, "%u copies of %u nets gave %u nets\n", copies, boardNets, panelNets);
+        return -1.0;
+    }
+    if (misplaced > 0) {
+        fprintf(stderr, "%u of the %u nets of %u copies are misplaced\n", misplaced, panelNets, copies);
+        return -1.0;
+    }
+
+    return seconds;
+}
+
+int
+main(int argc, char** argv) {
+    static const guint copies[] = { 1, 10, 100, 1000 };
+    const gchar*       srcdir   = g_getenv("srcdir");
+    gerbv_project_t*   project  = gerbv_create_project();
+    gchar*             filename;
+    gdouble            seconds, perCopy, lastPerCopy = 0.0;
+    guint              i;
+    int                rc = 0;
+
+    if (argc > 1)
+        filename = g_strdup(argv[1]);
+    else
+        filename = g_build_filename(srcdir ? srcdir : ".", "inputs", "test-merge-b.gbx", NULL);
+
+    gerbv_open_layer_from_filename(project, filename);
+    if (project->last_loaded < 0 || project->file[0]->image == NULL) {
+        printf("can't read %s\n", filename);
+        g_free(filename);
+        gerbv_destroy_project(project);
+        return TEST_SKIP;
+    }
+    printf("panelizing %s\n", filename);
+
+    for (i = 0; i < G_N_ELEMENTS(copies); i++) {
+        seconds = test_panelize(project->file[0]->image, copies[i]);
+        if (seconds < 0) {
+            rc = 1;
+            continue;
+        }
+
+        /* panels too fast to time reliably aren't compared */
+        perCopy = seconds / copies[i];
+        if (lastPerCopy > 0 && seconds > 0.1 && perCopy > TEST_MAX_GROWTH * lastPerCopy) {
+            printf(
+                "note: merging %u copies took %.1f times longer per copy than %u copies\n", copies[i],
+                perCopy / lastPerCopy, copies[i - 1]
+            );
+        }
+        lastPerCopy = perCopy;
+    }
+
+    g_free(filename);
+    gerbv_destroy_project(project);
+
+    return rc;
+}